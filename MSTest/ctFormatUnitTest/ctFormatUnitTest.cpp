@@ -0,0 +1,165 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#include <sdkddkver.h>
+#include "CppUnitTest.h"
+
+#include <chrono>
+#include <string>
+
+#include <Windows.h>
+#include <wil/stl.h>
+#include <wil/resource.h>
+
+#include <ctFormat.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace ctsUnitTest
+{
+TEST_CLASS(ctFormatUnitTest)
+{
+private:
+    static constexpr uint32_t c_benchmarkMessages = 1'000'000;
+
+    static void LogMessagesPerSecond(const wchar_t* name, uint32_t messages, std::chrono::steady_clock::duration elapsed)
+    {
+        const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        const auto messagesPerSecond = microseconds > 0 ? static_cast<long long>(messages) * 1'000'000LL / microseconds : 0LL;
+        Logger::WriteMessage((std::wstring(name) + L" : " + std::to_wstring(messagesPerSecond) + L" messages/sec\n").c_str());
+    }
+
+public:
+    TEST_METHOD(FormatsConnectionCsvLine)
+    {
+        const auto formatted = ctl::ctFormatUtf8(
+            "{:.3f},{},{},{},{},{}\r\n",
+            1.5f,
+            "10.0.0.1:4444",
+            "10.0.0.2:5555",
+            1024LL,
+            ctl::ctWideArg{L"Succeeded"},
+            "{6C1D2F63-2A6B-4B4E-8C5D-1E2F3A4B5C6D}");
+        Assert::AreEqual(
+            std::string("1.500,10.0.0.1:4444,10.0.0.2:5555,1024,Succeeded,{6C1D2F63-2A6B-4B4E-8C5D-1E2F3A4B5C6D}\r\n"),
+            std::string(formatted));
+    }
+
+    TEST_METHOD(AppendContinuesThePriorFormat)
+    {
+        ctl::ctFormatUtf8("[{}]", 1);
+        const auto formatted = ctl::ctFormatUtf8Append(" [{}]", 2);
+        Assert::AreEqual(std::string("[1] [2]"), std::string(formatted));
+
+        // the next format starts over
+        Assert::AreEqual(std::string("3"), std::string(ctl::ctFormatUtf8("{}", 3)));
+    }
+
+    TEST_METHOD(ReusesTheThreadBuffer)
+    {
+        ctl::ctFormatUtf8("{:>200}", "x");
+        const auto* const initialBuffer = ctl::ctThreadFormatBuffer().data();
+        for (auto index = 0; index < 1'000; ++index)
+        {
+            ctl::ctFormatUtf8("{},{},{}", index, index * 2, "short");
+        }
+        Assert::IsTrue(initialBuffer == ctl::ctThreadFormatBuffer().data());
+    }
+
+    TEST_METHOD(ConvertsWideArgumentsToUtf8)
+    {
+        // 2-byte, 3-byte, and surrogate pair (4-byte) encodings
+        const auto formatted = ctl::ctFormatUtf8("{}", ctl::ctWideArg{L"\u00E9\u4E2D\U0001F600"});
+        Assert::AreEqual(std::string("\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80"), std::string(formatted));
+
+        Assert::AreEqual(std::string("[]"), std::string(ctl::ctFormatUtf8("[{}]", ctl::ctWideArg{static_cast<const wchar_t*>(nullptr)})));
+    }
+
+    TEST_METHOD(ConvertsLongWideArgumentsAcrossChunks)
+    {
+        // surrogate pairs placed to straddle every chunk boundary
+        std::wstring longString;
+        std::string expected;
+        for (auto index = 0; index < 200; ++index)
+        {
+            longString.append(L"a\U0001F600");
+            expected.append("a\xF0\x9F\x98\x80");
+        }
+        Assert::AreEqual(expected, std::string(ctl::ctFormatUtf8("{}", ctl::ctWideArg{longString})));
+    }
+
+    TEST_METHOD(RoundTripsUtf16)
+    {
+        const std::wstring original{L"10054: An existing connection was forcibly closed \u00E9\U0001F600"};
+        std::string utf8;
+        ctl::ctAppendUtf8(original, utf8);
+        std::wstring roundTrip{L">"};
+        ctl::ctAppendUtf16(utf8, roundTrip);
+        Assert::AreEqual(L">" + original, roundTrip);
+    }
+
+    //
+    // Not a pass/fail test: logs the messages/sec of each to compare
+    // - formats the same TCP connection result text ctsTraffic writes to the connection log
+    //
+    TEST_METHOD(BenchmarkConnectionResultFormatting)
+    {
+        const std::wstring errorString{L"10054: An existing connection was forcibly closed by the remote host."};
+        size_t totalLength = 0;
+
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < c_benchmarkMessages; ++index)
+            {
+                const auto formatted = wil::str_printf<std::wstring>(
+                    L"[%.3f] TCP connection failed with the error %ws : [%ws - %ws] [%hs] : SendBytes[%lld]  SendBps[%lld]  RecvBytes[%lld]  RecvBps[%lld]  Time[%lld ms]\r\n",
+                    1.5f,
+                    errorString.c_str(),
+                    L"192.168.1.100:50000",
+                    L"192.168.1.1:4444",
+                    "{6C1D2F63-2A6B-4B4E-8C5D-1E2F3A4B5C6D}",
+                    static_cast<long long>(index),
+                    1234567LL,
+                    static_cast<long long>(index),
+                    7654321LL,
+                    1000LL);
+                totalLength += formatted.size();
+            }
+            LogMessagesPerSecond(L"wil::str_printf (UTF16, allocating)", c_benchmarkMessages, std::chrono::steady_clock::now() - start);
+        }
+
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < c_benchmarkMessages; ++index)
+            {
+                const auto formatted = ctl::ctFormatUtf8(
+                    "[{:.3f}] TCP connection failed with the error {} : [{} - {}] [{}] : SendBytes[{}]  SendBps[{}]  RecvBytes[{}]  RecvBps[{}]  Time[{} ms]\r\n",
+                    1.5f,
+                    ctl::ctWideArg{errorString},
+                    "192.168.1.100:50000",
+                    "192.168.1.1:4444",
+                    "{6C1D2F63-2A6B-4B4E-8C5D-1E2F3A4B5C6D}",
+                    static_cast<long long>(index),
+                    1234567LL,
+                    static_cast<long long>(index),
+                    7654321LL,
+                    1000LL);
+                totalLength += formatted.size();
+            }
+            LogMessagesPerSecond(L"ctFormatUtf8 (UTF8, thread buffer)", c_benchmarkMessages, std::chrono::steady_clock::now() - start);
+        }
+
+        Assert::IsTrue(totalLength > 0);
+    }
+};
+}
@@ -0,0 +1,215 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#include <sdkddkver.h>
+#include "CppUnitTest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <Windows.h>
+#include <wil/resource.h>
+
+#include <ctMath.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace ctsUnitTest
+{
+TEST_CLASS(ctMathUnitTest)
+{
+private:
+    static std::vector<double> MakeSamples(uint32_t count)
+    {
+        // a long-tailed distribution, similar to throughput and latency counters
+        std::mt19937 generator{20221019};
+        std::lognormal_distribution<double> distribution{5.0, 1.5};
+
+        std::vector<double> samples;
+        samples.reserve(count);
+        for (uint32_t sample = 0; sample < count; ++sample)
+        {
+            samples.push_back(std::floor(distribution(generator)));
+        }
+        return samples;
+    }
+
+    static void AssertWithinRelative(double expected, double actual, double tolerance)
+    {
+        const auto allowed = std::abs(expected) * tolerance + 1.0e-9;
+        Assert::IsTrue(std::abs(expected - actual) <= allowed);
+    }
+
+public:
+    TEST_METHOD(RunningStatisticsEmpty)
+    {
+        const ctl::ctRunningStatistics statistics;
+        Assert::AreEqual(0ULL, statistics.GetCount());
+        Assert::AreEqual(0.0, statistics.GetMean());
+        Assert::AreEqual(0.0, statistics.GetVariance());
+        Assert::AreEqual(0.0, statistics.GetMin());
+        Assert::AreEqual(0.0, statistics.GetMax());
+    }
+
+    TEST_METHOD(RunningStatisticsMatchesSampledStandardDeviation)
+    {
+        const auto samples = MakeSamples(10'000);
+
+        ctl::ctRunningStatistics statistics;
+        for (const auto& sample : samples)
+        {
+            statistics.Add(sample);
+        }
+
+        const auto [mean, stdDev] = ctl::ctSampledStandardDeviation(samples.begin(), samples.end());
+        Assert::AreEqual(10'000ULL, statistics.GetCount());
+        AssertWithinRelative(mean, statistics.GetMean(), 1.0e-9);
+        AssertWithinRelative(stdDev, statistics.GetStandardDeviation(), 1.0e-9);
+        Assert::AreEqual(*std::ranges::min_element(samples), statistics.GetMin());
+        Assert::AreEqual(*std::ranges::max_element(samples), statistics.GetMax());
+    }
+
+    TEST_METHOD(RunningStatisticsMergeMatchesSingleStream)
+    {
+        const auto samples = MakeSamples(10'000);
+
+        ctl::ctRunningStatistics all;
+        ctl::ctRunningStatistics first;
+        ctl::ctRunningStatistics second;
+        for (size_t index = 0; index < samples.size(); ++index)
+        {
+            all.Add(samples[index]);
+            (index < 3'000 ? first : second).Add(samples[index]);
+        }
+
+        ctl::ctRunningStatistics empty;
+        empty.Merge(first);
+        empty.Merge(second);
+
+        Assert::AreEqual(all.GetCount(), empty.GetCount());
+        AssertWithinRelative(all.GetMean(), empty.GetMean(), 1.0e-9);
+        AssertWithinRelative(all.GetVariance(), empty.GetVariance(), 1.0e-9);
+        Assert::AreEqual(all.GetMin(), empty.GetMin());
+        Assert::AreEqual(all.GetMax(), empty.GetMax());
+    }
+
+    TEST_METHOD(QuantileSketchEmpty)
+    {
+        const ctl::ctQuantileSketch sketch;
+        Assert::AreEqual(0ULL, sketch.GetCount());
+        Assert::AreEqual(0.0, sketch.GetQuantile(0.5));
+    }
+
+    TEST_METHOD(QuantileSketchCountsZeros)
+    {
+        ctl::ctQuantileSketch sketch;
+        for (auto count = 0; count < 60; ++count)
+        {
+            sketch.Add(0.0);
+        }
+        for (auto count = 0; count < 40; ++count)
+        {
+            sketch.Add(100.0);
+        }
+
+        Assert::AreEqual(100ULL, sketch.GetCount());
+        Assert::AreEqual(0.0, sketch.GetQuantile(0.5));
+        AssertWithinRelative(100.0, sketch.GetQuantile(0.75), ctl::ctQuantileSketch::c_relativeAccuracy);
+    }
+
+    TEST_METHOD(QuantileSketchWithinRelativeAccuracy)
+    {
+        auto samples = MakeSamples(100'000);
+
+        ctl::ctQuantileSketch sketch;
+        for (const auto& sample : samples)
+        {
+            sketch.Add(sample);
+        }
+        std::ranges::sort(samples);
+
+        for (const auto quantile : {0.0, 0.01, 0.25, 0.5, 0.75, 0.99, 1.0})
+        {
+            const auto rank = static_cast<size_t>(quantile * static_cast<double>(samples.size() - 1));
+            const auto expected = samples[rank];
+            if (expected == 0.0)
+            {
+                Assert::AreEqual(0.0, sketch.GetQuantile(quantile));
+            }
+            else
+            {
+                AssertWithinRelative(expected, sketch.GetQuantile(quantile), ctl::ctQuantileSketch::c_relativeAccuracy);
+            }
+        }
+    }
+
+    TEST_METHOD(QuantileSketchMergeMatchesSingleStream)
+    {
+        const auto samples = MakeSamples(10'000);
+
+        ctl::ctQuantileSketch all;
+        ctl::ctQuantileSketch first;
+        ctl::ctQuantileSketch second;
+        for (size_t index = 0; index < samples.size(); ++index)
+        {
+            all.Add(samples[index]);
+            (index % 2 ? first : second).Add(samples[index]);
+        }
+        first.Merge(second);
+
+        Assert::AreEqual(all.GetCount(), first.GetCount());
+        for (const auto quantile : {0.0, 0.25, 0.5, 0.75, 1.0})
+        {
+            Assert::AreEqual(all.GetQuantile(quantile), first.GetQuantile(quantile));
+        }
+    }
+
+    TEST_METHOD(QuantileSketchCollapsesOnlyTheLowestValues)
+    {
+        // values spanning 1e-30 to 1e29 cannot fit in c_maxBuckets
+        // - the highest values must remain accurate
+        ctl::ctQuantileSketch sketch;
+        for (auto exponent = -30; exponent < 30; ++exponent)
+        {
+            sketch.Add(std::pow(10.0, exponent));
+        }
+
+        Assert::AreEqual(60ULL, sketch.GetCount());
+        AssertWithinRelative(1.0e29, sketch.GetQuantile(1.0), ctl::ctQuantileSketch::c_relativeAccuracy);
+        AssertWithinRelative(1.0e28, sketch.GetQuantile(58.0 / 59.0), ctl::ctQuantileSketch::c_relativeAccuracy);
+        // the collapsed values are all reported at the lowest value still tracked
+        Assert::IsTrue(sketch.GetQuantile(0.0) > 1.0e-30);
+        Assert::IsTrue(sketch.GetQuantile(0.0) <= sketch.GetQuantile(0.5));
+    }
+
+    TEST_METHOD(SampleSummaryMatchesInterquartileRange)
+    {
+        auto samples = MakeSamples(10'001);
+
+        ctl::ctSampleSummary summary;
+        for (const auto& sample : samples)
+        {
+            summary.Add(sample);
+        }
+        std::ranges::sort(samples);
+
+        const auto [lowerQuartile, median, upperQuartile] = ctl::ctInterquartileRange(samples.begin(), samples.end());
+        Assert::AreEqual(10'001ULL, summary.GetStatistics().GetCount());
+        AssertWithinRelative(lowerQuartile, summary.GetQuantiles().GetQuantile(0.25), ctl::ctQuantileSketch::c_relativeAccuracy * 2);
+        AssertWithinRelative(median, summary.GetQuantiles().GetQuantile(0.5), ctl::ctQuantileSketch::c_relativeAccuracy * 2);
+        AssertWithinRelative(upperQuartile, summary.GetQuantiles().GetQuantile(0.75), ctl::ctQuantileSketch::c_relativeAccuracy * 2);
+    }
+};
+}
@@ -0,0 +1,287 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#include <sdkddkver.h>
+#include "CppUnitTest.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Windows.h>
+#include <wil/resource.h>
+
+#include <ctThreadpoolQueue.hpp>
+#include <ctWorkStealingPool.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace ctsUnitTest
+{
+TEST_CLASS(ctWorkStealingPoolUnitTest)
+{
+private:
+    static constexpr uint32_t c_benchmarkItems = 1'000'000;
+
+    static void WaitForCount(const std::atomic<uint32_t>& counter, uint32_t expected)
+    {
+        const auto start = GetTickCount64();
+        while (counter.load() < expected)
+        {
+            Assert::IsTrue(GetTickCount64() - start < 30'000, L"Timed out waiting for work to run");
+            Sleep(1);
+        }
+    }
+
+    struct Win32TpContext
+    {
+        std::atomic<uint32_t> m_count{0};
+        PTP_WORK m_work = nullptr;
+    };
+
+    static void CALLBACK Win32TpCallback(PTP_CALLBACK_INSTANCE, void* context, PTP_WORK) noexcept
+    {
+        static_cast<Win32TpContext*>(context)->m_count.fetch_add(1);
+    }
+
+    static void LogItemsPerSecond(const wchar_t* name, uint32_t items, std::chrono::steady_clock::duration elapsed)
+    {
+        const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        const auto itemsPerSecond = microseconds > 0 ? static_cast<long long>(items) * 1'000'000LL / microseconds : 0LL;
+        Logger::WriteMessage((std::wstring(name) + L" : " + std::to_wstring(itemsPerSecond) + L" items/sec\n").c_str());
+    }
+
+public:
+    TEST_METHOD(RunsExternallySubmittedWork)
+    {
+        std::atomic<uint32_t> count{0};
+        ctl::ctWorkStealingPool pool{4};
+        Assert::AreEqual(4u, pool.thread_count());
+        Assert::IsFalse(pool.is_worker_thread());
+
+        for (auto index = 0; index < 10'000; ++index)
+        {
+            pool.submit([&count] { count.fetch_add(1); });
+        }
+        WaitForCount(count, 10'000);
+    }
+
+    TEST_METHOD(RunsWorkSubmittedFromWorkers)
+    {
+        // each item fans out on its own worker's deque, which idle workers must steal from
+        std::atomic<uint32_t> count{0};
+        std::atomic<bool> ranOnWorker{true};
+        ctl::ctWorkStealingPool pool{4};
+
+        for (auto outer = 0; outer < 100; ++outer)
+        {
+            pool.submit([&] {
+                ranOnWorker = ranOnWorker && pool.is_worker_thread();
+                // more than a deque holds, so some overflow to the injection queue
+                for (auto inner = 0; inner < 5'000; ++inner)
+                {
+                    pool.submit([&count] { count.fetch_add(1); });
+                }
+                count.fetch_add(1);
+            });
+        }
+        WaitForCount(count, 100 * 5'001);
+        Assert::IsTrue(ranOnWorker.load());
+    }
+
+    TEST_METHOD(ContinuesAfterThrowingWork)
+    {
+        std::atomic<uint32_t> count{0};
+        ctl::ctWorkStealingPool pool{1};
+        pool.submit([] { THROW_WIN32(ERROR_INVALID_DATA); });
+        pool.submit([&count] { count.fetch_add(1); });
+        WaitForCount(count, 1);
+    }
+
+    TEST_METHOD(DestroyingDiscardsPendingWork)
+    {
+        auto sharedCount = std::make_shared<uint32_t>(0);
+        {
+            ctl::ctWorkStealingPool pool{1};
+            wil::slim_event_manual_reset release;
+            pool.submit([&release] { release.wait(); });
+            for (auto index = 0; index < 100; ++index)
+            {
+                pool.submit([sharedCount] { ++*sharedCount; });
+            }
+            release.SetEvent();
+        }
+        // all functors not run were destroyed, releasing their references
+        Assert::AreEqual(1L, sharedCount.use_count());
+    }
+
+    TEST_METHOD(QueueOnPoolRunsInOrder)
+    {
+        ctl::ctWorkStealingPool pool{4};
+        std::vector<uint32_t> order;
+        {
+            ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Growable> queue{&pool};
+            for (uint32_t index = 0; index < 1'000; ++index)
+            {
+                // never runs concurrently, so the vector needs no lock
+                queue.submit([&order, index] { order.push_back(index); });
+            }
+            Assert::AreEqual(S_OK, queue.submit_and_wait([] { return S_OK; }));
+        }
+
+        Assert::AreEqual(size_t{1'000}, order.size());
+        for (uint32_t index = 0; index < 1'000; ++index)
+        {
+            Assert::AreEqual(index, order[index]);
+        }
+    }
+
+    TEST_METHOD(QueueOnPoolRunningInQueue)
+    {
+        ctl::ctWorkStealingPool pool{2};
+        ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Growable> queue{&pool};
+        Assert::IsFalse(queue.IsRunningInQueue());
+        Assert::AreEqual(S_OK, queue.submit_and_wait([&queue] { return queue.IsRunningInQueue() ? S_OK : E_FAIL; }));
+    }
+
+    TEST_METHOD(QueueWithoutPoolUsesThreadpool)
+    {
+        // as constructed by ctsSocketBroker when -Options:workstealing is not set
+        ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Growable> queue{nullptr};
+        Assert::AreEqual(S_OK, queue.submit_and_wait([&queue] { return queue.IsRunningInQueue() ? S_OK : E_FAIL; }));
+    }
+
+    TEST_METHOD(FlatQueueOnPoolKeepsLatest)
+    {
+        ctl::ctWorkStealingPool pool{2};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> lastValue{0};
+        {
+            ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Flat> queue{&pool};
+            wil::slim_event_manual_reset release;
+            queue.submit([&release] { release.wait(); });
+            // only the last of these is still queued once the blocking item completes
+            for (uint32_t index = 1; index <= 100; ++index)
+            {
+                queue.submit([&, index] {
+                    count.fetch_add(1);
+                    lastValue = index;
+                });
+            }
+            release.SetEvent();
+            WaitForCount(count, 1);
+        }
+        Assert::AreEqual(1u, count.load());
+        Assert::AreEqual(100u, lastValue.load());
+    }
+
+    TEST_METHOD(QueueOnPoolCancelReleasesWaiters)
+    {
+        ctl::ctWorkStealingPool pool{2};
+        ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Growable> queue{&pool};
+        wil::slim_event_manual_reset release;
+        queue.submit([&release] { release.wait(); });
+        const auto result = queue.submit_with_results<HRESULT>([] { return S_OK; });
+        Assert::IsNotNull(result.get());
+
+        release.SetEvent();
+        queue.cancel();
+        // either ran before the cancel or was aborted by it
+        const auto error = result->wait(0);
+        Assert::IsTrue(error == ERROR_SUCCESS || error == ERROR_CANCELLED);
+    }
+
+    //
+    // Not a pass/fail test: logs the items/sec of each to compare
+    //
+    TEST_METHOD(BenchmarkSubmitThroughput)
+    {
+        // Win32 threadpool: one TP_WORK submitted for each item
+        {
+            Win32TpContext context;
+            context.m_work = CreateThreadpoolWork(Win32TpCallback, &context, nullptr);
+            Assert::IsNotNull(context.m_work);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < c_benchmarkItems; ++index)
+            {
+                SubmitThreadpoolWork(context.m_work);
+            }
+            WaitForThreadpoolWorkCallbacks(context.m_work, FALSE);
+            LogItemsPerSecond(L"Win32 threadpool (external submit)", c_benchmarkItems, std::chrono::steady_clock::now() - start);
+            Assert::AreEqual(c_benchmarkItems, context.m_count.load());
+            CloseThreadpoolWork(context.m_work);
+        }
+
+        // work-stealing pool: submitted from outside the pool
+        {
+            std::atomic<uint32_t> count{0};
+            ctl::ctWorkStealingPool pool;
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < c_benchmarkItems; ++index)
+            {
+                pool.submit([&count] { count.fetch_add(1); });
+            }
+            WaitForCount(count, c_benchmarkItems);
+            LogItemsPerSecond(L"ctWorkStealingPool (external submit)", c_benchmarkItems, std::chrono::steady_clock::now() - start);
+        }
+
+        // work-stealing pool: fanned out from the workers, the pattern of IO completions queuing more work
+        {
+            std::atomic<uint32_t> count{0};
+            ctl::ctWorkStealingPool pool;
+            const auto fanOut = pool.thread_count() * 4;
+            const auto itemsPerTask = c_benchmarkItems / fanOut;
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t task = 0; task < fanOut; ++task)
+            {
+                pool.submit([&] {
+                    for (uint32_t index = 0; index < itemsPerTask; ++index)
+                    {
+                        pool.submit([&count] { count.fetch_add(1); });
+                    }
+                });
+            }
+            WaitForCount(count, fanOut * itemsPerTask);
+            LogItemsPerSecond(L"ctWorkStealingPool (worker submit)", fanOut * itemsPerTask, std::chrono::steady_clock::now() - start);
+        }
+
+        // serialized queues: the existing single-threaded threadpool vs. running on the pool
+        {
+            std::atomic<uint32_t> count{0};
+            ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Growable> queue;
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < c_benchmarkItems / 10; ++index)
+            {
+                queue.submit([&count] { count.fetch_add(1); });
+            }
+            WaitForCount(count, c_benchmarkItems / 10);
+            LogItemsPerSecond(L"ctThreadpoolQueue (Win32 threadpool)", c_benchmarkItems / 10, std::chrono::steady_clock::now() - start);
+        }
+        {
+            std::atomic<uint32_t> count{0};
+            ctl::ctWorkStealingPool pool;
+            ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Growable> queue{&pool};
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < c_benchmarkItems / 10; ++index)
+            {
+                queue.submit([&count] { count.fetch_add(1); });
+            }
+            WaitForCount(count, c_benchmarkItems / 10);
+            LogItemsPerSecond(L"ctThreadpoolQueue (ctWorkStealingPool)", c_benchmarkItems / 10, std::chrono::steady_clock::now() - start);
+        }
+    }
+};
+}
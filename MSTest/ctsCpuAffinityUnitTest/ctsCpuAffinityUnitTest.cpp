@@ -0,0 +1,265 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#include <sdkddkver.h>
+#include "CppUnitTest.h"
+
+// cpp headers
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+// wil headers
+#include <wil/stl.h>
+#include <wil/resource.h>
+// project headers
+#include "ctsCpuAffinity.h"
+#include "ctsConfig.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// everything written through ctsConfig::PrintSummary
+static std::wstring g_summary; // NOLINT(clang-diagnostic-exit-time-destructors)
+static long g_errorCount = 0;
+
+///
+/// Fakes
+///
+namespace ctsTraffic::ctsConfig
+{
+ctsConfigSettings* g_configSettings;
+
+void PrintErrorIfFailed(_In_ PCSTR text, uint32_t why) noexcept
+{
+    if (why != 0)
+    {
+        ++g_errorCount;
+        Logger::WriteMessage(
+            wil::str_printf<std::wstring>(L"ctsConfig::PrintErrorIfFailed(%hs, %u)\n", text, why).c_str());
+    }
+}
+
+void __cdecl PrintSummary(_In_ _Printf_format_string_ PCWSTR text, ...) noexcept
+{
+    va_list args;
+    va_start(args, text);
+    std::wstring outputString;
+    wil::details::str_vprintf_nothrow<std::wstring>(outputString, text, args);
+    va_end(args);
+
+    Logger::WriteMessage(outputString.c_str());
+    try
+    {
+        g_summary += outputString;
+    }
+    catch (...)
+    {
+    }
+}
+
+bool ShutdownCalled() noexcept
+{
+    return false;
+}
+
+uint32_t ConsoleVerbosity() noexcept
+{
+    return 0;
+}
+}
+
+///
+/// End of Fakes
+///
+
+using namespace ctsTraffic;
+
+namespace ctsUnitTest
+{
+TEST_CLASS(ctsCpuAffinityUnitTest)
+{
+private:
+    // the per-processor threadpools are created once for the process
+    static void StartOnce()
+    {
+        static bool s_started = false;
+        if (!s_started)
+        {
+            ctsConfig::g_configSettings->CpuAffinity = ctsConfig::CpuAffinityType::RoundRobin;
+            ctsCpuAffinity::Start();
+            s_started = true;
+        }
+        ctsConfig::g_configSettings->CpuAffinity = ctsConfig::CpuAffinityType::RoundRobin;
+    }
+
+    // ctsCpuAffinity indexes processors group by group, in the order of their processor numbers
+    static std::vector<PROCESSOR_NUMBER> ActiveProcessors()
+    {
+        std::vector<PROCESSOR_NUMBER> processors;
+        const auto groupCount = GetActiveProcessorGroupCount();
+        for (WORD group = 0; group < groupCount; ++group)
+        {
+            const auto processorCount = GetActiveProcessorCount(group);
+            for (DWORD number = 0; number < processorCount; ++number)
+            {
+                PROCESSOR_NUMBER processor{};
+                processor.Group = group;
+                processor.Number = static_cast<BYTE>(number);
+                processors.push_back(processor);
+            }
+        }
+        return processors;
+    }
+
+    struct CallbackContext
+    {
+        wil::unique_event m_completed{wil::EventOptions::ManualReset};
+        PROCESSOR_NUMBER m_processor{};
+    };
+
+    static VOID CALLBACK RecordProcessorCallback(PTP_CALLBACK_INSTANCE, PVOID context) noexcept
+    {
+        auto* const callbackContext = static_cast<CallbackContext*>(context);
+        GetCurrentProcessorNumberEx(&callbackContext->m_processor);
+        callbackContext->m_completed.SetEvent();
+    }
+
+public:
+    TEST_CLASS_INITIALIZE(Setup)
+    {
+        WSADATA wsadata;
+        const int wsError = WSAStartup(WINSOCK_VERSION, &wsadata);
+        Assert::AreEqual(0, wsError);
+
+        ctsConfig::g_configSettings = new ctsConfig::ctsConfigSettings;
+    }
+
+    TEST_CLASS_CLEANUP(Cleanup)
+    {
+        // the threadpools are never closed: the settings must stay alive with them
+        WSACleanup();
+    }
+
+    TEST_METHOD(NoCpuAffinityUsesTheDefaultEnvironment)
+    {
+        ctsConfig::g_configSettings->CpuAffinity = ctsConfig::CpuAffinityType::None;
+        ctsCpuAffinity::Start();
+
+        // a processor without its own threadpool uses the shared environment
+        Assert::IsTrue(ctsConfig::g_configSettings->pTpEnvironment == ctsCpuAffinity::GetEnvironment(UINT32_MAX));
+
+        uint32_t processor = 0;
+        ctsCpuAffinity::SteerConnection(INVALID_SOCKET, processor, true);
+        Assert::AreEqual(0u, processor);
+    }
+
+    TEST_METHOD(AssignsProcessorsRoundRobin)
+    {
+        StartOnce();
+
+        const auto processorCount = static_cast<uint32_t>(ActiveProcessors().size());
+        std::set<uint32_t> assigned;
+        auto prior = ctsCpuAffinity::AssignProcessor();
+        assigned.insert(prior);
+        for (uint32_t count = 1; count < processorCount; ++count)
+        {
+            const auto processor = ctsCpuAffinity::AssignProcessor();
+            Assert::IsTrue(processor < processorCount);
+            Assert::AreEqual((prior + 1) % processorCount, processor);
+            assigned.insert(processor);
+            prior = processor;
+        }
+
+        // every processor is assigned once before any is assigned again
+        Assert::AreEqual(static_cast<size_t>(processorCount), assigned.size());
+    }
+
+    TEST_METHOD(CallbacksRunOnTheirProcessor)
+    {
+        StartOnce();
+        Assert::AreEqual(0L, g_errorCount);
+
+        const auto processors = ActiveProcessors();
+        std::set<PTP_CALLBACK_ENVIRON> environments;
+        for (uint32_t index = 0; index < processors.size(); ++index)
+        {
+            const auto environment = ctsCpuAffinity::GetEnvironment(index);
+            Assert::IsTrue(environment != ctsConfig::g_configSettings->pTpEnvironment);
+            environments.insert(environment);
+
+            CallbackContext context;
+            Assert::IsTrue(!!TrySubmitThreadpoolCallback(RecordProcessorCallback, &context, environment));
+            Assert::IsTrue(context.m_completed.wait(10000));
+
+            Assert::AreEqual(static_cast<uint32_t>(processors[index].Group), static_cast<uint32_t>(context.m_processor.Group));
+            Assert::AreEqual(static_cast<uint32_t>(processors[index].Number), static_cast<uint32_t>(context.m_processor.Number));
+        }
+
+        // each processor has its own threadpool
+        Assert::AreEqual(processors.size(), environments.size());
+    }
+
+    TEST_METHOD(RssSteeringKeepsProcessorWhenUnavailable)
+    {
+        StartOnce();
+        ctsConfig::g_configSettings->CpuAffinity = ctsConfig::CpuAffinityType::Rss;
+        auto restoreAffinity = wil::scope_exit([&]() noexcept {
+            ctsConfig::g_configSettings->CpuAffinity = ctsConfig::CpuAffinityType::RoundRobin;
+        });
+
+        // an unconnected socket has no RSS processor
+        const wil::unique_socket socket{WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr, 0, WSA_FLAG_OVERLAPPED)};
+        Assert::IsTrue(socket.is_valid());
+
+        uint32_t processor = 0;
+        ctsCpuAffinity::SteerConnection(socket.get(), processor, true);
+        Assert::AreEqual(0u, processor);
+
+        g_summary.clear();
+        ctsCpuAffinity::PrintSummary(1000);
+        Assert::IsTrue(g_summary.find(L"RSS Placement") != std::wstring::npos);
+        Assert::IsTrue(g_summary.find(L"Steered [0]") != std::wstring::npos);
+        // counted as unavailable (at least once, as the counters are for the process)
+        Assert::IsTrue(g_summary.find(L"Unavailable [0]") == std::wstring::npos);
+    }
+
+    TEST_METHOD(SummaryReportsEachProcessor)
+    {
+        StartOnce();
+
+        const auto processors = ActiveProcessors();
+        const auto lastProcessor = static_cast<uint32_t>(processors.size() - 1);
+        ctsCpuAffinity::RecordResult(lastProcessor, 2000);
+        // results for processors without a threadpool are ignored
+        ctsCpuAffinity::RecordResult(UINT32_MAX, 1000);
+
+        g_summary.clear();
+        ctsCpuAffinity::PrintSummary(1000);
+
+        for (const auto& processor : processors)
+        {
+            const auto line = wil::str_printf<std::wstring>(L"Processor %u:%u :", processor.Group, processor.Number);
+            Assert::IsTrue(g_summary.find(line) != std::wstring::npos);
+        }
+        const auto lastLine = wil::str_printf<std::wstring>(
+            L"Processor %u:%u :", processors[lastProcessor].Group, processors[lastProcessor].Number);
+        const auto lastBytes = g_summary.find(L"Bytes [2000] Bytes/sec [2000]", g_summary.find(lastLine));
+        Assert::IsTrue(lastBytes != std::wstring::npos);
+        // only the -CpuAffinity:rss summary reports placement
+        Assert::IsTrue(g_summary.find(L"RSS Placement") == std::wstring::npos);
+    }
+};
+}
@@ -22,6 +22,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include "ctsIOTask.hpp"
 #include "ctsConfig.h"
 #include "ctsIOPattern.h"
+#include "ctsTrace.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace std;
@@ -120,6 +121,10 @@ void PrintJitterUpdate(const JitterFrameEntry&, const JitterFrameEntry&) noexcep
 {
 }
 
+void RecordMediaStreamQuality(const ctsMediaStreamQuality&) noexcept
+{
+}
+
 void PrintErrorInfo(_In_ _Printf_format_string_ PCWSTR, ...) noexcept
 {
 }
@@ -128,6 +133,14 @@ void PrintTcpDetails(const ctl::ctSockaddr&, const ctl::ctSockaddr&, SOCKET, con
 {
 }
 
+void PrintRoundTripResults(const ctl::ctSockaddr&, const ctl::ctSockaddr&, PCSTR, const ctsRoundTripHistogram&, uint32_t, uint32_t) noexcept
+{
+}
+
+void PrintThroughputTimeline(const ctl::ctSockaddr&, const ctl::ctSockaddr&, PCSTR, const ctsThroughputTimeline&) noexcept
+{
+}
+
 bool IsListening() noexcept
 {
     return g_IsListening;
@@ -179,6 +192,31 @@ uint32_t ConsoleVerbosity() noexcept
 }
 }
 
+namespace ctsTraffic::ctsMetricsExporter
+{
+bool IsEnabled() noexcept
+{
+    return false;
+}
+
+void RecordIo(bool, uint32_t, int64_t) noexcept
+{
+}
+}
+
+namespace ctsTraffic::ctsTrace
+{
+// never registered: the tracepoints are no-ops
+TRACELOGGING_DEFINE_PROVIDER(
+    g_traceLoggingProvider,
+    "ctsTraffic",
+    (0xc21cae82, 0xe297, 0x59c9, 0x62, 0x24, 0xfc, 0x82, 0x1b, 0x28, 0xbc, 0x71));
+
+void RecordEvent(ctsTraceEventType, uint64_t, uint32_t, uint16_t) noexcept
+{
+}
+}
+
 ///
 /// End of Fakes
 ///
@@ -972,5 +1010,115 @@ public:
 
         Assert::AreEqual(ctsIoStatus::CompletedIo, test_pattern->CompleteIo(test_task, 0, 0));
     }
+    TEST_METHOD(PingPongServer_RoundTrips)
+    {
+        constexpr uint32_t messageSize = 16;
+        ctsConfig::g_configSettings->IoPattern = ctsConfig::IoPatternType::PingPong;
+        ctsConfig::g_configSettings->Protocol = ctsConfig::ProtocolType::TCP;
+        ctsConfig::g_configSettings->TcpShutdown = ctsConfig::TcpShutdownType::ServerSideShutdown;
+        ctsConfig::g_configSettings->UseSharedBuffer = false;
+        ctsConfig::g_configSettings->ShouldVerifyBuffers = false;
+        ctsConfig::g_configSettings->PrePostRecvs = 1;
+        ctsConfig::g_configSettings->PrePostSends = 1;
+        ctsConfig::g_configSettings->PingPongBytes = messageSize;
+        g_tcpBytesPerSecond = 0LL;
+        g_MaxBufferSize = g_TestRecvBufferLength;
+        g_BufferSize = g_TestRecvBufferLength;
+        g_transferSize = messageSize * 2 * 3;
+        g_IsListening = true;
+
+        const std::shared_ptr test_pattern(ctsIoPattern::MakeIoPattern());
+
+        ctsTask test_task = test_pattern->InitiateIo();
+        Assert::AreEqual(ctsStatistics::ConnectionIdLength, test_task.m_bufferLength);
+        Assert::AreEqual(ctsTaskAction::Send, test_task.m_ioAction);
+        Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, ctsStatistics::ConnectionIdLength, 0));
+
+        for (uint32_t round_trip = 0; round_trip < 3; ++round_trip)
+        {
+            // the server receives first, then replies
+            test_task = test_pattern->InitiateIo();
+            Assert::AreEqual(messageSize, test_task.m_bufferLength);
+            Assert::AreEqual(ctsTaskAction::Recv, test_task.m_ioAction);
+            Logger::WriteMessage(wil::str_printf<std::wstring>(L"%u: %ws", round_trip, ToString<ctsTask>(test_task).c_str()).c_str());
+
+            // only one IO is ever in flight
+            ctsTask empty_task = test_pattern->InitiateIo();
+            Assert::AreEqual(ctsTaskAction::None, empty_task.m_ioAction);
+            Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, messageSize, 0));
+
+            test_task = test_pattern->InitiateIo();
+            Assert::AreEqual(messageSize, test_task.m_bufferLength);
+            Assert::AreEqual(ctsTaskAction::Send, test_task.m_ioAction);
+
+            empty_task = test_pattern->InitiateIo();
+            Assert::AreEqual(ctsTaskAction::None, empty_task.m_ioAction);
+            Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, messageSize, 0));
+        }
+
+        // send server completion
+        test_task = test_pattern->InitiateIo();
+        Assert::AreEqual(ctsTaskAction::Send, test_task.m_ioAction);
+        Assert::AreEqual(g_TestBufferLength, test_task.m_bufferLength);
+
+        char completion[5] = {0x00, 0x00, 0x00, 0x00, 0x00};
+        memcpy_s(completion, 4, test_task.m_buffer + test_task.m_bufferOffset, 4);
+        Assert::IsTrue(g_doneString == completion);
+        Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, 4, 0));
+
+        test_task = test_pattern->InitiateIo();
+        Assert::AreEqual(ctsTaskAction::Recv, test_task.m_ioAction);
+        Assert::AreEqual(ctsIoStatus::CompletedIo, test_pattern->CompleteIo(test_task, 0, 0));
+    }
+
+    TEST_METHOD(PingPongServer_PartialRoundTripIsRoundedUp)
+    {
+        constexpr uint32_t messageSize = 16;
+        ctsConfig::g_configSettings->IoPattern = ctsConfig::IoPatternType::PingPong;
+        ctsConfig::g_configSettings->Protocol = ctsConfig::ProtocolType::TCP;
+        ctsConfig::g_configSettings->TcpShutdown = ctsConfig::TcpShutdownType::ServerSideShutdown;
+        ctsConfig::g_configSettings->UseSharedBuffer = false;
+        ctsConfig::g_configSettings->ShouldVerifyBuffers = false;
+        ctsConfig::g_configSettings->PrePostRecvs = 1;
+        ctsConfig::g_configSettings->PrePostSends = 1;
+        ctsConfig::g_configSettings->PingPongBytes = messageSize;
+        g_tcpBytesPerSecond = 0LL;
+        g_MaxBufferSize = g_TestRecvBufferLength;
+        g_BufferSize = g_TestRecvBufferLength;
+        // one byte into the second round trip: the server still receives and replies with full messages
+        g_transferSize = messageSize * 2 + 1;
+        g_IsListening = true;
+
+        const std::shared_ptr test_pattern(ctsIoPattern::MakeIoPattern());
+
+        ctsTask test_task = test_pattern->InitiateIo();
+        Assert::AreEqual(ctsStatistics::ConnectionIdLength, test_task.m_bufferLength);
+        Assert::AreEqual(ctsTaskAction::Send, test_task.m_ioAction);
+        Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, ctsStatistics::ConnectionIdLength, 0));
+
+        for (uint32_t round_trip = 0; round_trip < 2; ++round_trip)
+        {
+            test_task = test_pattern->InitiateIo();
+            Assert::AreEqual(messageSize, test_task.m_bufferLength);
+            Assert::AreEqual(ctsTaskAction::Recv, test_task.m_ioAction);
+            Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, messageSize, 0));
+
+            test_task = test_pattern->InitiateIo();
+            Assert::AreEqual(messageSize, test_task.m_bufferLength);
+            Assert::AreEqual(ctsTaskAction::Send, test_task.m_ioAction);
+            Logger::WriteMessage(wil::str_printf<std::wstring>(L"%u: %ws", round_trip, ToString<ctsTask>(test_task).c_str()).c_str());
+            Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, messageSize, 0));
+        }
+
+        // send server completion
+        test_task = test_pattern->InitiateIo();
+        Assert::AreEqual(ctsTaskAction::Send, test_task.m_ioAction);
+        Assert::AreEqual(g_TestBufferLength, test_task.m_bufferLength);
+        Assert::AreEqual(ctsIoStatus::ContinueIo, test_pattern->CompleteIo(test_task, 4, 0));
+
+        test_task = test_pattern->InitiateIo();
+        Assert::AreEqual(ctsTaskAction::Recv, test_task.m_ioAction);
+        Assert::AreEqual(ctsIoStatus::CompletedIo, test_pattern->CompleteIo(test_task, 0, 0));
+    }
 };
 }
@@ -243,7 +243,7 @@ ctsSocket::~ctsSocket() noexcept
 {
 }
 
-void ctsSocket::SetSocket(SOCKET _s) noexcept
+void ctsSocket::SetSocket(SOCKET _s, std::shared_ptr<ctl::ctThreadIocp>) noexcept
 {
     m_socket.reset(_s);
 }
@@ -26,6 +26,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include "ctsSocketBroker.h"
 #include "ctsSocketState.h"
 #include "ctsConfig.h"
+#include "ctsTrace.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -79,6 +80,19 @@ uint32_t ConsoleVerbosity() noexcept
 }
 }
 
+namespace ctsTraffic::ctsTrace
+{
+// never registered: the tracepoints are no-ops
+TRACELOGGING_DEFINE_PROVIDER(
+    g_traceLoggingProvider,
+    "ctsTraffic",
+    (0xc21cae82, 0xe297, 0x59c9, 0x62, 0x24, 0xfc, 0x82, 0x1b, 0x28, 0xbc, 0x71));
+
+void RecordEvent(ctsTraceEventType, uint64_t, uint32_t, uint16_t) noexcept
+{
+}
+}
+
 ///
 /// End of Fakes
 ///
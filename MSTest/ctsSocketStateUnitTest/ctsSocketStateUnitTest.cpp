@@ -22,6 +22,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include "ctsSocketState.h"
 #include "ctsSocketBroker.h"
 #include "ctsWinsockLayer.h"
+#include "ctsTrace.h"
 
 namespace Microsoft::VisualStudio::CppUnitTestFramework
 {
@@ -65,10 +66,67 @@ wsIOResult ctsSetLingertoResetSocket(SOCKET) noexcept
     return wsIOResult();
 }
 
+namespace ctsSocketPool
+{
+    bool Recycle(ctsPooledSocket&) noexcept
+    {
+        return false;
+    }
+}
+
+namespace ctsCpuAffinity
+{
+    uint32_t AssignProcessor() noexcept
+    {
+        return 0;
+    }
+
+    PTP_CALLBACK_ENVIRON GetEnvironment(uint32_t) noexcept
+    {
+        return nullptr;
+    }
+
+    void SteerConnection(SOCKET, uint32_t&, bool) noexcept
+    {
+    }
+
+    void RecordResult(uint32_t, int64_t) noexcept
+    {
+    }
+}
+
+namespace ctsTargetSelector
+{
+    void RecordConnectLatency(ctsTargetLease&, int64_t) noexcept
+    {
+    }
+
+    void RecordResult(ctsTargetLease&, uint32_t, int64_t) noexcept
+    {
+    }
+}
+
+namespace ctsTrace
+{
+    // never registered: the tracepoints are no-ops
+    TRACELOGGING_DEFINE_PROVIDER(
+        g_traceLoggingProvider,
+        "ctsTraffic",
+        (0xc21cae82, 0xe297, 0x59c9, 0x62, 0x24, 0xfc, 0x82, 0x1b, 0x28, 0xbc, 0x71));
+
+    void RecordEvent(ctsTraceEventType, uint64_t, uint32_t, uint16_t) noexcept
+    {
+    }
+}
+
 namespace ctsConfig
 {
     ctsConfigSettings* g_configSettings;
 
+    void RecordConnectLatency(int64_t) noexcept
+    {
+    }
+
     void PrintDebug(PCWSTR text, ...) noexcept
     {
         va_list args;
@@ -14,12 +14,15 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <sdkddkver.h>
 #include "CppUnitTest.h"
 
+#include <chrono>
+
 #include <ctString.hpp>
 
 #include "ctsSocket.h"
 #include "ctsSocketState.h"
 #include "ctsIOPattern.h"
 #include "ctsWinsockLayer.h"
+#include "ctsTrace.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace std;
@@ -68,10 +71,67 @@ wsIOResult ctsSetLingertoResetSocket(SOCKET) noexcept
     return wsIOResult();
 }
 
+namespace ctsSocketPool
+{
+    bool Recycle(ctsPooledSocket&) noexcept
+    {
+        return false;
+    }
+}
+
+namespace ctsCpuAffinity
+{
+    uint32_t AssignProcessor() noexcept
+    {
+        return 0;
+    }
+
+    PTP_CALLBACK_ENVIRON GetEnvironment(uint32_t) noexcept
+    {
+        return nullptr;
+    }
+
+    void SteerConnection(SOCKET, uint32_t&, bool) noexcept
+    {
+    }
+
+    void RecordResult(uint32_t, int64_t) noexcept
+    {
+    }
+}
+
+namespace ctsTargetSelector
+{
+    void RecordConnectLatency(ctsTargetLease&, int64_t) noexcept
+    {
+    }
+
+    void RecordResult(ctsTargetLease&, uint32_t, int64_t) noexcept
+    {
+    }
+}
+
+namespace ctsTrace
+{
+    // never registered: the tracepoints are no-ops
+    TRACELOGGING_DEFINE_PROVIDER(
+        g_traceLoggingProvider,
+        "ctsTraffic",
+        (0xc21cae82, 0xe297, 0x59c9, 0x62, 0x24, 0xfc, 0x82, 0x1b, 0x28, 0xbc, 0x71));
+
+    void RecordEvent(ctsTraceEventType, uint64_t, uint32_t, uint16_t) noexcept
+    {
+    }
+}
+
 namespace ctsConfig
 {
     ctsConfigSettings* g_configSettings;
 
+    void RecordConnectLatency(int64_t) noexcept
+    {
+    }
+
     void PrintDebug(PCWSTR _text, ...) noexcept
     {
         va_list args;
@@ -315,6 +375,127 @@ public:
         // todo: not sure how to validate going below 0 invokes fail-fast
     }
 
+    TEST_METHOD(HandleResolvesAfterSetIoPattern)
+    {
+        shared_ptr<ctsSocketState> default_socket_state_object;
+        const auto test(make_shared<ctsSocket>(default_socket_state_object));
+
+        // not registered until IO can be started
+        Assert::AreEqual(0U, test->GetHandle().m_generation);
+        Assert::IsNull(ctsSocket::FromHandle(test->GetHandle()));
+
+        test->SetIoPattern();
+        const auto handle = test->GetHandle();
+        Assert::AreNotEqual(0U, handle.m_generation);
+        Assert::IsTrue(test.get() == ctsSocket::FromHandle(handle));
+
+        // registering again must not change the handle
+        test->SetIoPattern();
+        Assert::AreEqual(handle.m_index, test->GetHandle().m_index);
+        Assert::AreEqual(handle.m_generation, test->GetHandle().m_generation);
+    }
+
+    TEST_METHOD(HandleIsStaleAfterShutdown)
+    {
+        shared_ptr<ctsSocketState> default_socket_state_object;
+        auto test(make_shared<ctsSocket>(default_socket_state_object));
+
+        test->SetIoPattern();
+        const auto handle = test->GetHandle();
+        Assert::IsNotNull(ctsSocket::FromHandle(handle));
+
+        // the dtor calls Shutdown
+        test.reset();
+        Assert::IsNull(ctsSocket::FromHandle(handle));
+    }
+
+    TEST_METHOD(HandleSlotReuseBumpsGeneration)
+    {
+        shared_ptr<ctsSocketState> default_socket_state_object;
+        auto first(make_shared<ctsSocket>(default_socket_state_object));
+        first->SetIoPattern();
+        const auto firstHandle = first->GetHandle();
+        first.reset();
+
+        // the released slot is reused by the next ctsSocket
+        const auto second(make_shared<ctsSocket>(default_socket_state_object));
+        second->SetIoPattern();
+        const auto secondHandle = second->GetHandle();
+        Assert::AreEqual(firstHandle.m_index, secondHandle.m_index);
+        Assert::AreNotEqual(firstHandle.m_generation, secondHandle.m_generation);
+
+        // the old handle must not resolve to the new ctsSocket
+        Assert::IsNull(ctsSocket::FromHandle(firstHandle));
+        Assert::IsTrue(second.get() == ctsSocket::FromHandle(secondHandle));
+    }
+
+    //
+    // Times the work done per IO completion to find the ctsSocket and its pattern
+    // - through a std::weak_ptr<ctsSocket> in the completion context, as before ctsSocketHandle
+    // - through ctsSocketHandle, which resolves the socket without touching its reference count
+    //
+    TEST_METHOD(HandleLookupBenchmark)
+    {
+        shared_ptr<ctsSocketState> default_socket_state_object;
+        const auto test(make_shared<ctsSocket>(default_socket_state_object));
+        test->SetIoPattern();
+
+        constexpr uint32_t iterations = 10'000'000;
+        const weak_ptr<ctsSocket> weakSocket(test);
+        const auto handle = test->GetHandle();
+
+        uint32_t resolved = 0;
+        const auto weakStart = chrono::steady_clock::now();
+        for (uint32_t count = 0; count < iterations; ++count)
+        {
+            const auto copiedContext(weakSocket);
+            const auto sharedSocket(copiedContext.lock());
+            const auto lockedSocket = sharedSocket->AcquireSocketLock();
+            // stands in for the weak_ptr<ctsIoPattern> the SocketReference used to construct and lock
+            // - the fake MakeIoPattern does not create a pattern, so use the same control block
+            const weak_ptr<ctsSocket> patternReference(sharedSocket);
+            const auto sharedPattern(patternReference.lock());
+            resolved += sharedPattern ? 1 : 0;
+        }
+        const auto weakElapsed = chrono::steady_clock::now() - weakStart;
+
+        const auto handleStart = chrono::steady_clock::now();
+        for (uint32_t count = 0; count < iterations; ++count)
+        {
+            const auto copiedContext(handle);
+            auto* const pSocket = ctsSocket::FromHandle(copiedContext);
+            const auto lockedSocket = pSocket->AcquireSocketLock();
+            const auto& lockedPattern = lockedSocket.GetPattern();
+            resolved += lockedPattern ? 0 : 1;
+        }
+        const auto handleElapsed = chrono::steady_clock::now() - handleStart;
+
+        Assert::AreEqual(iterations * 2, resolved);
+
+        // the weak_ptr lookup takes references on the socket, the handle lookup never does
+        {
+            const auto useCount = test.use_count();
+            const auto copiedContext(weakSocket);
+            const auto sharedSocket(copiedContext.lock());
+            Assert::AreEqual(useCount + 1, test.use_count());
+            const weak_ptr<ctsSocket> patternReference(sharedSocket);
+            const auto sharedPattern(patternReference.lock());
+            Assert::AreEqual(useCount + 2, test.use_count());
+        }
+        {
+            const auto useCount = test.use_count();
+            auto* const pSocket = ctsSocket::FromHandle(handle);
+            const auto lockedSocket = pSocket->AcquireSocketLock();
+            Assert::AreEqual(useCount, test.use_count());
+        }
+
+        Logger::WriteMessage(wil::str_printf<std::wstring>(
+            L"%u completions: weak_ptr %lld ns/IO, ctsSocketHandle %lld ns/IO\n",
+            iterations,
+            chrono::duration_cast<chrono::nanoseconds>(weakElapsed).count() / iterations,
+            chrono::duration_cast<chrono::nanoseconds>(handleElapsed).count() / iterations).c_str());
+    }
+
 private:
     [[nodiscard]] SOCKET create_socket() const
     {
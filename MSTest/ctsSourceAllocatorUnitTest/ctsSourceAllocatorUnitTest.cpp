@@ -0,0 +1,208 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#include <sdkddkver.h>
+#include "CppUnitTest.h"
+
+// cpp headers
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+// wil headers
+#include <wil/stl.h>
+#include <wil/resource.h>
+// ctl headers
+#include <ctSockaddr.hpp>
+// project headers
+#include "ctsSourceAllocator.h"
+#include "ctsConfig.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+///
+/// Fakes
+///
+namespace ctsTraffic::ctsConfig
+{
+ctsConfigSettings* g_configSettings;
+
+unsigned long PrintThrownException() noexcept
+{
+    Logger::WriteMessage(L"ctsConfig::PrintThrownException\n");
+    return 0;
+}
+
+bool ShutdownCalled() noexcept
+{
+    return false;
+}
+
+uint32_t ConsoleVerbosity() noexcept
+{
+    return 0;
+}
+}
+
+///
+/// End of Fakes
+///
+
+using namespace ctsTraffic;
+
+namespace ctsUnitTest
+{
+// two IPv4 bind addresses, each with the local ports c_portLow to c_portHigh to every target
+// - the allocator is initialized once from these for the process: each test uses its own targets
+TEST_CLASS(ctsSourceAllocatorUnitTest)
+{
+private:
+    static constexpr uint16_t c_portLow = 40100;
+    static constexpr uint16_t c_portHigh = 40102;
+    static constexpr uint32_t c_portCount = c_portHigh - c_portLow + 1;
+
+    static ctl::ctSockaddr MakeAddress(PCWSTR address, uint16_t port)
+    {
+        ctl::ctSockaddr returnAddr;
+        Assert::IsTrue(returnAddr.setAddress(address));
+        returnAddr.setPort(port);
+        return returnAddr;
+    }
+
+    static ctl::ctSockaddr Select(size_t targetIndex, std::shared_ptr<ctsSourceLease>& lease)
+    {
+        ctl::ctSockaddr localAddr;
+        Assert::AreEqual(static_cast<uint32_t>(NO_ERROR), ctsSourceAllocator::Select(targetIndex, localAddr, lease));
+        Assert::IsTrue(!!lease);
+        return localAddr;
+    }
+
+public:
+    TEST_CLASS_INITIALIZE(Setup)
+    {
+        WSADATA wsadata;
+        const int wsError = WSAStartup(WINSOCK_VERSION, &wsadata);
+        Assert::AreEqual(0, wsError);
+
+        ctsConfig::g_configSettings = new ctsConfig::ctsConfigSettings;
+        ctsConfig::g_configSettings->Protocol = ctsConfig::ProtocolType::TCP;
+        ctsConfig::g_configSettings->LocalPortLow = c_portLow;
+        ctsConfig::g_configSettings->LocalPortHigh = c_portHigh;
+        ctsConfig::g_configSettings->BindAddresses = {MakeAddress(L"127.0.0.1", 0), MakeAddress(L"127.0.0.2", 0)};
+        for (uint16_t target = 0; target < 6; ++target)
+        {
+            ctsConfig::g_configSettings->TargetAddresses.push_back(MakeAddress(L"127.0.0.1", static_cast<uint16_t>(7001 + target)));
+        }
+    }
+
+    TEST_CLASS_CLEANUP(Cleanup)
+    {
+        delete ctsConfig::g_configSettings;
+        WSACleanup();
+    }
+
+    TEST_METHOD(PortsAreReusedInReleaseOrderAndWrapAround)
+    {
+        Assert::IsTrue(ctsSourceAllocator::IsEnabled());
+
+        // one connection at a time: the first bind address always has the fewest connections
+        // - each released port goes to the back of the ring, so every port is used in turn
+        for (uint32_t count = 0; count < c_portCount * 2 + 1; ++count)
+        {
+            std::shared_ptr<ctsSourceLease> lease;
+            const auto localAddr = Select(0, lease);
+            Assert::IsTrue(MakeAddress(L"127.0.0.1", static_cast<uint16_t>(c_portLow + count % c_portCount)) == localAddr);
+        }
+    }
+
+    TEST_METHOD(ExhaustedPairsRefuseAnotherLease)
+    {
+        // connections alternate between the bind addresses, and no (bind address, port) is leased twice to a target
+        std::vector<std::shared_ptr<ctsSourceLease>> leases(c_portCount * 2);
+        std::set<ctl::ctSockaddr> leasedAddresses;
+        for (uint32_t count = 0; count < leases.size(); ++count)
+        {
+            const auto localAddr = Select(1, leases[count]);
+            Assert::IsTrue(MakeAddress(count % 2 == 0 ? L"127.0.0.1" : L"127.0.0.2", static_cast<uint16_t>(c_portLow + count / 2)) == localAddr);
+            leasedAddresses.insert(localAddr);
+        }
+        Assert::AreEqual(leases.size(), leasedAddresses.size());
+
+        // every pair to this target has all its ports leased
+        ctl::ctSockaddr localAddr;
+        std::shared_ptr<ctsSourceLease> refusedLease;
+        Assert::AreEqual(static_cast<uint32_t>(WSAEADDRINUSE), ctsSourceAllocator::Select(1, localAddr, refusedLease));
+        Assert::IsFalse(!!refusedLease);
+
+        // other targets are unaffected
+        std::shared_ptr<ctsSourceLease> otherTargetLease;
+        Assert::IsTrue(MakeAddress(L"127.0.0.1", c_portLow) == Select(2, otherTargetLease));
+    }
+
+    TEST_METHOD(ReleasedPortIsReused)
+    {
+        std::vector<std::shared_ptr<ctsSourceLease>> leases(c_portCount * 2);
+        std::vector<ctl::ctSockaddr> leasedAddresses;
+        for (auto& lease : leases)
+        {
+            leasedAddresses.push_back(Select(3, lease));
+        }
+
+        // the only free port is the one released, on the pair it was released to
+        constexpr size_t releaseOrder[]{3, 0, 4};
+        for (const auto released : releaseOrder)
+        {
+            leases[released].reset();
+            Assert::IsTrue(leasedAddresses[released] == Select(3, leases[released]));
+
+            ctl::ctSockaddr localAddr;
+            std::shared_ptr<ctsSourceLease> refusedLease;
+            Assert::AreEqual(static_cast<uint32_t>(WSAEADDRINUSE), ctsSourceAllocator::Select(3, localAddr, refusedLease));
+        }
+    }
+
+    TEST_METHOD(TargetsShareLocalPortsWithReuseAddr)
+    {
+        Assert::IsTrue(ctsSourceAllocator::SharesLocalPorts());
+
+        // the same local address is leased to both targets at once
+        std::shared_ptr<ctsSourceLease> firstLease;
+        const auto firstAddr = Select(4, firstLease);
+        std::shared_ptr<ctsSourceLease> secondLease;
+        const auto secondAddr = Select(5, secondLease);
+        Assert::IsTrue(firstAddr == secondAddr);
+
+        // so each socket is set to SO_REUSEADDR before it's bound
+        std::vector<wil::unique_socket> sockets;
+        for (const auto& localAddr : {firstAddr, secondAddr})
+        {
+            wil::unique_socket socket{WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr, 0, WSA_FLAG_OVERLAPPED)};
+            Assert::IsTrue(socket.is_valid());
+            Assert::AreEqual(static_cast<uint32_t>(NO_ERROR), ctsSourceAllocator::SetPreBindOptions(socket.get()));
+
+            DWORD optval{};
+            int optlen{sizeof optval};
+            Assert::AreEqual(0, getsockopt(socket.get(), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&optval), &optlen));
+            Assert::AreEqual(1UL, optval);
+
+            Assert::AreEqual(0, bind(socket.get(), localAddr.sockaddr(), localAddr.length()));
+            sockets.emplace_back(std::move(socket));
+        }
+    }
+};
+}
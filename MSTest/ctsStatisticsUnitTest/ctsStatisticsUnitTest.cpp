@@ -122,5 +122,334 @@ public:
         ctsUdpStatistics udp_stats;
         ctsConnectionStatistics conn_stats;
     }
+
+    TEST_METHOD(RoundTripHistogramEmpty)
+    {
+        const ctsRoundTripHistogram histogram;
+        Assert::AreEqual(0ULL, histogram.GetCount());
+        Assert::AreEqual(0ULL, histogram.GetMean());
+        Assert::AreEqual(0ULL, histogram.GetPercentile(50.0));
+    }
+
+    TEST_METHOD(RoundTripHistogramSmallValuesAreExact)
+    {
+        ctsRoundTripHistogram histogram;
+        for (uint64_t value = 0; value < ctsRoundTripHistogram::c_subBucketCount; ++value)
+        {
+            Assert::AreEqual(static_cast<uint32_t>(value), ctsRoundTripHistogram::BucketIndex(value));
+            histogram.AddSample(value);
+        }
+
+        Assert::AreEqual(8ULL, histogram.GetCount());
+        Assert::AreEqual(0ULL, histogram.GetMin());
+        Assert::AreEqual(7ULL, histogram.GetMax());
+        Assert::AreEqual(3ULL, histogram.GetPercentile(50.0));
+        Assert::AreEqual(7ULL, histogram.GetPercentile(100.0));
+    }
+
+    TEST_METHOD(RoundTripHistogramBucketBounds)
+    {
+        // every value must fall within the bounds of the bucket it maps to
+        for (const uint64_t value : {8ULL, 9ULL, 15ULL, 16ULL, 17ULL, 1000ULL, 123456789ULL, 0xffffffffffffffffULL})
+        {
+            const auto index = ctsRoundTripHistogram::BucketIndex(value);
+            Assert::IsTrue(index < ctsRoundTripHistogram::c_bucketCount);
+            Assert::IsTrue(value <= ctsRoundTripHistogram::BucketUpperBound(index));
+            Assert::IsTrue(index == 0 || value > ctsRoundTripHistogram::BucketUpperBound(index - 1));
+        }
+    }
+
+    TEST_METHOD(RoundTripHistogramPercentiles)
+    {
+        ctsRoundTripHistogram histogram;
+        for (uint64_t value = 1; value <= 1000; ++value)
+        {
+            histogram.AddSample(value);
+        }
+
+        Assert::AreEqual(1000ULL, histogram.GetCount());
+        Assert::AreEqual(1ULL, histogram.GetMin());
+        Assert::AreEqual(1000ULL, histogram.GetMax());
+        Assert::AreEqual(500ULL, histogram.GetMean());
+
+        // log-linear buckets bound the error to 1/8 of the value
+        const auto p50 = histogram.GetPercentile(50.0);
+        Assert::IsTrue(p50 >= 500 && p50 <= 500 + 500 / 8);
+        const auto p99 = histogram.GetPercentile(99.0);
+        Assert::IsTrue(p99 >= 990 && p99 <= 1000);
+        Assert::AreEqual(1000ULL, histogram.GetPercentile(100.0));
+    }
+
+    TEST_METHOD(RoundTripHistogramCopyBuckets)
+    {
+        ctsRoundTripHistogram histogram;
+        histogram.AddSample(3);
+        histogram.AddSample(3);
+        histogram.AddSample(1000);
+        Assert::AreEqual(1006ULL, histogram.GetSum());
+
+        uint64_t buckets[ctsRoundTripHistogram::c_bucketCount]{};
+        histogram.CopyBuckets(buckets);
+        Assert::AreEqual(2ULL, buckets[3]);
+        Assert::AreEqual(1ULL, buckets[ctsRoundTripHistogram::BucketIndex(1000)]);
+
+        uint64_t total = 0;
+        for (const auto bucket : buckets)
+        {
+            total += bucket;
+        }
+        Assert::AreEqual(histogram.GetCount(), total);
+    }
+
+    TEST_METHOD(RoundTripHistogramMerge)
+    {
+        ctsRoundTripHistogram first;
+        first.AddSample(10);
+        first.AddSample(20);
+        ctsRoundTripHistogram second;
+        second.AddSample(5);
+        second.AddSample(1000);
+
+        first.Merge(second);
+        first.Merge(ctsRoundTripHistogram{});
+        Assert::AreEqual(4ULL, first.GetCount());
+        Assert::AreEqual(5ULL, first.GetMin());
+        Assert::AreEqual(1000ULL, first.GetMax());
+        Assert::AreEqual(1035ULL, first.GetSum());
+
+        ctsRoundTripHistogram empty;
+        empty.Merge(second);
+        Assert::AreEqual(5ULL, empty.GetMin());
+        Assert::AreEqual(2ULL, empty.GetCount());
+    }
+
+    TEST_METHOD(MediaStreamQualityRfc3550Jitter)
+    {
+        ctsMediaStreamQuality quality;
+        // a constant transit time (a fixed clock offset of 1,000,000us plus 500us in flight) has no jitter
+        for (int64_t sequence = 1; sequence <= 10; ++sequence)
+        {
+            const auto senderUsec = static_cast<double>(sequence) * 10'000.0;
+            quality.RecordArrival(sequence, senderUsec, senderUsec + 1'000'500.0);
+        }
+        Assert::AreEqual(0.0, quality.GetJitterUsec());
+        Assert::AreEqual(0ULL, quality.GetDelayVariation().GetMax());
+
+        // one datagram delayed 1600us: J = 1600/16 = 100, then decays by 15/16 as the transit returns to normal
+        quality.RecordArrival(11, 110'000.0, 110'000.0 + 1'002'100.0);
+        Assert::AreEqual(100.0, quality.GetJitterUsec(), 0.001);
+        quality.RecordArrival(12, 120'000.0, 120'000.0 + 1'000'500.0);
+        Assert::AreEqual(100.0 + (1600.0 - 100.0) / 16.0, quality.GetJitterUsec(), 0.001);
+
+        Assert::AreEqual(1600ULL, quality.GetDelayVariation().GetMax());
+        Assert::AreEqual(12ULL, quality.GetDelayVariation().GetCount());
+        Assert::AreEqual(0ULL, quality.GetDelayVariation().GetPercentile(50.0));
+    }
+
+    TEST_METHOD(MediaStreamQualityDelayVariationFromStreamMinimum)
+    {
+        ctsMediaStreamQuality quality;
+        // three datagrams in 1000us, then one in 900us: the first three are 100us above the stream's minimum
+        quality.RecordArrival(1, 10'000.0, 11'000.0);
+        quality.RecordArrival(2, 20'000.0, 21'000.0);
+        quality.RecordArrival(3, 30'000.0, 31'000.0);
+        quality.RecordArrival(4, 40'000.0, 40'900.0);
+
+        Assert::AreEqual(4ULL, quality.GetDelayVariation().GetCount());
+        Assert::AreEqual(0ULL, quality.GetDelayVariation().GetMin());
+        Assert::AreEqual(100ULL, quality.GetDelayVariation().GetMax());
+        Assert::AreEqual(100ULL, quality.GetDelayVariation().GetPercentile(50.0));
+
+        // ending the stream keeps the same values
+        quality.EndStream();
+        Assert::AreEqual(4ULL, quality.GetDelayVariation().GetCount());
+        Assert::AreEqual(100ULL, quality.GetDelayVariation().GetPercentile(50.0));
+
+        ctsMediaStreamQuality total;
+        total.Merge(quality);
+        Assert::AreEqual(100ULL, total.GetDelayVariation().GetMax());
+        Assert::AreEqual(100ULL, total.GetDelayVariation().GetPercentile(50.0));
+    }
+
+    TEST_METHOD(MediaStreamQualityReorderingAndLateFrames)
+    {
+        ctsMediaStreamQuality quality;
+        quality.RecordArrival(1, 0.0, 100.0);
+        // two datagrams of the same frame are not reordered
+        quality.RecordArrival(2, 0.0, 100.0);
+        quality.RecordArrival(2, 0.0, 100.0);
+        quality.RecordArrival(5, 0.0, 100.0);
+        quality.RecordArrival(3, 0.0, 100.0);
+        quality.RecordArrival(4, 0.0, 100.0);
+        quality.RecordArrival(1, 0.0, 100.0);
+        quality.RecordLateFrame();
+
+        Assert::AreEqual(3ULL, quality.GetReorderedFrames());
+        Assert::AreEqual(4ULL, quality.GetMaxReorderDepth());
+        Assert::AreEqual(1ULL, quality.GetLateFrames());
+    }
+
+    TEST_METHOD(MediaStreamQualityLossRuns)
+    {
+        Assert::AreEqual(0U, ctsMediaStreamQuality::LossRunBucketIndex(1));
+        Assert::AreEqual(1U, ctsMediaStreamQuality::LossRunBucketIndex(2));
+        Assert::AreEqual(1U, ctsMediaStreamQuality::LossRunBucketIndex(3));
+        Assert::AreEqual(2U, ctsMediaStreamQuality::LossRunBucketIndex(4));
+        Assert::AreEqual(7U, ctsMediaStreamQuality::LossRunBucketIndex(128));
+        Assert::AreEqual(7U, ctsMediaStreamQuality::LossRunBucketIndex(100'000));
+
+        ctsMediaStreamQuality quality;
+        // runs of 1, 3, and 5 (left open at the end of the stream)
+        for (const auto dropped : {false, true, false, true, true, true, false, false, true, true, true, true, true})
+        {
+            quality.RecordRenderedFrame(dropped);
+        }
+        Assert::AreEqual(2ULL, quality.GetLossRunCount());
+
+        quality.EndStream();
+        quality.EndStream();
+        Assert::AreEqual(3ULL, quality.GetLossRunCount());
+        Assert::AreEqual(5ULL, quality.GetLongestLossRun());
+        Assert::AreEqual(1ULL, quality.GetLossRuns(0));
+        Assert::AreEqual(1ULL, quality.GetLossRuns(1));
+        Assert::AreEqual(1ULL, quality.GetLossRuns(2));
+    }
+
+    TEST_METHOD(MediaStreamQualityMergesEndedStreams)
+    {
+        ctsMediaStreamQuality first;
+        first.RecordArrival(1, 0.0, 100.0);
+        first.RecordArrival(2, 0.0, 1'700.0);
+        first.RecordRenderedFrame(true);
+        first.EndStream();
+
+        ctsMediaStreamQuality second;
+        second.RecordArrival(1, 0.0, 100.0);
+        second.RecordArrival(2, 0.0, 420.0);
+        second.RecordLateFrame();
+        second.RecordRenderedFrame(true);
+        second.RecordRenderedFrame(true);
+        second.EndStream();
+
+        ctsMediaStreamQuality total;
+        total.Merge(first);
+        total.Merge(second);
+        Assert::AreEqual(4ULL, total.GetArrivals());
+        Assert::AreEqual(2ULL, total.GetJitterStreamCount());
+        Assert::AreEqual((100.0 + 20.0) / 2.0, total.GetMeanStreamJitterUsec(), 0.001);
+        Assert::AreEqual(100.0, total.GetMaxStreamJitterUsec(), 0.001);
+        Assert::AreEqual(1600ULL, total.GetDelayVariation().GetMax());
+        Assert::AreEqual(1ULL, total.GetLateFrames());
+        Assert::AreEqual(2ULL, total.GetLossRunCount());
+        Assert::AreEqual(2ULL, total.GetLongestLossRun());
+    }
+
+    TEST_METHOD(ThroughputTimelineSteadyProgress)
+    {
+        ctsThroughputTimeline timeline;
+        Assert::AreEqual(0U, timeline.GetIntervalCount());
+
+        timeline.Start(1000, 100);
+        timeline.RecordProgress(1050, 10, 1000);
+        timeline.RecordProgress(1090, 5, 1000);
+        timeline.RecordProgress(1150, 20, 1000);
+        timeline.RecordProgress(1250, 30, 1000);
+
+        Assert::AreEqual(0ULL, timeline.GetStallCount());
+        Assert::AreEqual(3U, timeline.GetIntervalCount());
+        Assert::AreEqual(30ULL, timeline.GetIntervalBytes(0));
+        Assert::AreEqual(20ULL, timeline.GetIntervalBytes(1));
+        Assert::AreEqual(15ULL, timeline.GetIntervalBytes(2));
+        Assert::AreEqual(0ULL, timeline.GetIntervalBytes(3));
+    }
+
+    TEST_METHOD(ThroughputTimelineDetectsStall)
+    {
+        ctsThroughputTimeline timeline;
+        timeline.Start(1000, 100);
+        timeline.RecordProgress(1050, 10, 1000);
+        // IO remained outstanding from 1050 to 1400 : intervals 1 through 3 had no progress
+        timeline.RecordProgress(1400, 20, 1000);
+        timeline.RecordProgress(1450, 20, 1000);
+        // a later, shorter stall
+        timeline.RecordProgress(1720, 5, 1000);
+
+        Assert::AreEqual(2ULL, timeline.GetStallCount());
+        Assert::AreEqual(350LL + 270LL, timeline.GetStallTimeMs());
+        Assert::AreEqual(350LL, timeline.GetLongestStallMs());
+
+        // the intervals skipped are reported as zero bytes
+        Assert::AreEqual(5ULL, timeline.GetIntervalBytes(0));
+        Assert::AreEqual(0ULL, timeline.GetIntervalBytes(1));
+        Assert::AreEqual(0ULL, timeline.GetIntervalBytes(2));
+        Assert::AreEqual(40ULL, timeline.GetIntervalBytes(3));
+        Assert::AreEqual(0ULL, timeline.GetIntervalBytes(4));
+        Assert::AreEqual(10ULL, timeline.GetIntervalBytes(7));
+    }
+
+    TEST_METHOD(ThroughputTimelineIgnoresIdleWithoutOutstandingIo)
+    {
+        ctsThroughputTimeline timeline;
+        timeline.Start(1000, 100);
+        timeline.RecordProgress(1050, 10, 1000);
+        // no IO was requested until 1380 (e.g. delayed by a rate limit)
+        timeline.RecordProgress(1420, 10, 1380);
+        // less than one whole interval without progress is not a stall
+        timeline.RecordProgress(1595, 10, 1420);
+
+        Assert::AreEqual(0ULL, timeline.GetStallCount());
+        Assert::AreEqual(0LL, timeline.GetStallTimeMs());
+    }
+
+    TEST_METHOD(ThroughputTimelineCountsStallAtClose)
+    {
+        ctsThroughputTimeline timeline;
+        timeline.Start(1000, 100);
+        timeline.RecordProgress(1050, 10, 1000);
+        // the connection closed at 1400 with the IO requested at 1050 never completing
+        timeline.RecordClose(1400, 1050);
+
+        Assert::AreEqual(1ULL, timeline.GetStallCount());
+        Assert::AreEqual(350LL, timeline.GetStallTimeMs());
+        Assert::AreEqual(350LL, timeline.GetLongestStallMs());
+        // the timeline still ends at the last interval with progress
+        Assert::AreEqual(1U, timeline.GetIntervalCount());
+        Assert::AreEqual(10ULL, timeline.GetIntervalBytes(0));
+
+        // the same wait is not counted twice
+        timeline.RecordClose(1400, 1050);
+        Assert::AreEqual(1ULL, timeline.GetStallCount());
+
+        // less than one whole interval outstanding at close is not a stall
+        ctsThroughputTimeline shortWait;
+        shortWait.Start(1000, 100);
+        shortWait.RecordProgress(1050, 10, 1000);
+        shortWait.RecordClose(1190, 1050);
+        Assert::AreEqual(0ULL, shortWait.GetStallCount());
+    }
+
+    TEST_METHOD(ThroughputTimelineWrapsTheRing)
+    {
+        ctsThroughputTimeline timeline;
+        timeline.Start(0, 100);
+        for (int64_t interval = 0; interval < 100; ++interval)
+        {
+            timeline.RecordProgress(interval * 100, static_cast<uint64_t>(interval), interval * 100);
+        }
+
+        Assert::AreEqual(ctsThroughputTimeline::c_intervalCount, timeline.GetIntervalCount());
+        Assert::AreEqual(99ULL, timeline.GetIntervalBytes(0));
+        Assert::AreEqual(36ULL, timeline.GetIntervalBytes(ctsThroughputTimeline::c_intervalCount - 1));
+        Assert::AreEqual(0ULL, timeline.GetIntervalBytes(ctsThroughputTimeline::c_intervalCount));
+
+        // a gap longer than the ring clears every slot
+        timeline.RecordProgress(20'000, 7, 19'950);
+        Assert::AreEqual(7ULL, timeline.GetIntervalBytes(0));
+        for (uint32_t age = 1; age < ctsThroughputTimeline::c_intervalCount; ++age)
+        {
+            Assert::AreEqual(0ULL, timeline.GetIntervalBytes(age));
+        }
+        Assert::AreEqual(0ULL, timeline.GetStallCount());
+    }
 };
 }
@@ -0,0 +1,230 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#include <sdkddkver.h>
+#include "CppUnitTest.h"
+
+// cpp headers
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+// wil headers
+#include <wil/stl.h>
+#include <wil/resource.h>
+// project headers
+#include "ctsTargetSelector.h"
+#include "ctsConfig.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// everything written through ctsConfig::PrintSummary
+static std::wstring g_summary; // NOLINT(clang-diagnostic-exit-time-destructors)
+
+///
+/// Fakes
+///
+namespace ctsTraffic::ctsConfig
+{
+ctsConfigSettings* g_configSettings;
+
+unsigned long PrintThrownException() noexcept
+{
+    Logger::WriteMessage(L"ctsConfig::PrintThrownException\n");
+    return 0;
+}
+
+void __cdecl PrintSummary(_In_ _Printf_format_string_ PCWSTR text, ...) noexcept
+{
+    va_list args;
+    va_start(args, text);
+    std::wstring outputString;
+    wil::details::str_vprintf_nothrow<std::wstring>(outputString, text, args);
+    va_end(args);
+
+    Logger::WriteMessage(outputString.c_str());
+    try
+    {
+        g_summary += outputString;
+    }
+    catch (...)
+    {
+    }
+}
+}
+
+///
+/// End of Fakes
+///
+
+using namespace ctsTraffic;
+
+namespace ctsUnitTest
+{
+// targets 0 and 1 are IPv4, target 2 is IPv6
+// - the selector is initialized once from these for the process: every test releases its leases
+TEST_CLASS(ctsTargetSelectorUnitTest)
+{
+private:
+    static size_t Select(ADDRESS_FAMILY family, std::shared_ptr<ctsTargetLease>& lease)
+    {
+        const auto index = ctsTargetSelector::Select(family, lease);
+        Assert::IsTrue(index < ctsConfig::g_configSettings->TargetAddresses.size());
+        Assert::IsTrue(!!lease);
+        return index;
+    }
+
+public:
+    TEST_CLASS_INITIALIZE(Setup)
+    {
+        WSADATA wsadata;
+        const int wsError = WSAStartup(WINSOCK_VERSION, &wsadata);
+        Assert::AreEqual(0, wsError);
+
+        ctsConfig::g_configSettings = new ctsConfig::ctsConfigSettings;
+
+        ctl::ctSockaddr firstTarget(AF_INET, ctl::ctSockaddr::AddressType::Loopback);
+        firstTarget.setPort(4444);
+        ctl::ctSockaddr secondTarget(AF_INET, ctl::ctSockaddr::AddressType::Loopback);
+        secondTarget.setPort(5555);
+        ctl::ctSockaddr thirdTarget(AF_INET6, ctl::ctSockaddr::AddressType::Loopback);
+        thirdTarget.setPort(4444);
+        ctsConfig::g_configSettings->TargetAddresses = {firstTarget, secondTarget, thirdTarget};
+        ctsConfig::g_configSettings->TargetWeights = {3, 1, 1};
+    }
+
+    TEST_CLASS_CLEANUP(Cleanup)
+    {
+        delete ctsConfig::g_configSettings;
+        WSACleanup();
+    }
+
+    TEST_METHOD(RoundRobinSelectsEachTargetInTurn)
+    {
+        ctsConfig::g_configSettings->TargetPolicy = ctsConfig::TargetPolicyType::RoundRobin;
+
+        std::shared_ptr<ctsTargetLease> lease;
+        auto prior = Select(AF_UNSPEC, lease);
+        for (auto count = 0; count < 6; ++count)
+        {
+            lease.reset();
+            const auto selected = Select(AF_UNSPEC, lease);
+            Assert::AreEqual((prior + 1) % 3, selected);
+            prior = selected;
+        }
+
+        // only the targets of the family are eligible
+        lease.reset();
+        prior = Select(AF_INET, lease);
+        Assert::IsTrue(prior < 2);
+        for (auto count = 0; count < 4; ++count)
+        {
+            lease.reset();
+            const auto selected = Select(AF_INET, lease);
+            Assert::AreEqual(1 - prior, selected);
+            prior = selected;
+        }
+
+        lease.reset();
+        Assert::AreEqual(size_t{2}, Select(AF_INET6, lease));
+    }
+
+    TEST_METHOD(LeastActiveSelectsTheTargetWithFewestConnections)
+    {
+        ctsConfig::g_configSettings->TargetPolicy = ctsConfig::TargetPolicyType::LeastActive;
+
+        // with no connections open, each new connection goes to a target without one
+        std::vector<std::shared_ptr<ctsTargetLease>> leases(3);
+        std::vector<size_t> selected;
+        for (auto& lease : leases)
+        {
+            selected.push_back(Select(AF_UNSPEC, lease));
+        }
+        Assert::AreEqual(size_t{3}, std::set<size_t>(selected.begin(), selected.end()).size());
+
+        // closing a connection makes its target the least active
+        for (size_t released = 0; released < leases.size(); ++released)
+        {
+            leases[released].reset();
+            Assert::AreEqual(selected[released], Select(AF_UNSPEC, leases[released]));
+        }
+        leases.clear();
+    }
+
+    TEST_METHOD(WeightedSelectsInProportionToWeights)
+    {
+        ctsConfig::g_configSettings->TargetPolicy = ctsConfig::TargetPolicyType::Weighted;
+
+        // weights {3, 1, 1}: the heavier target is spread between the lighter ones, the same every cycle
+        const std::vector<size_t> expected{0, 1, 0, 2, 0};
+        for (auto cycle = 0; cycle < 2; ++cycle)
+        {
+            for (const auto expectedIndex : expected)
+            {
+                std::shared_ptr<ctsTargetLease> lease;
+                Assert::AreEqual(expectedIndex, Select(AF_UNSPEC, lease));
+            }
+        }
+    }
+
+    TEST_METHOD(LowestLatencySelectsTheFasterTarget)
+    {
+        ctsConfig::g_configSettings->TargetPolicy = ctsConfig::TargetPolicyType::LowestLatency;
+
+        // the two IPv4 targets are always the two compared
+        // - a target without a latency sample is selected first so it gets one
+        std::shared_ptr<ctsTargetLease> lease;
+        const auto firstSampled = Select(AF_INET, lease);
+        Assert::IsTrue(firstSampled < 2);
+        ctsTargetSelector::RecordConnectLatency(*lease, 0 == firstSampled ? 100 : 500);
+        lease.reset();
+
+        const auto secondSampled = Select(AF_INET, lease);
+        Assert::AreEqual(1 - firstSampled, secondSampled);
+        ctsTargetSelector::RecordConnectLatency(*lease, 0 == secondSampled ? 100 : 500);
+        lease.reset();
+
+        // target 0 connects in 100us, target 1 in 500us
+        for (auto count = 0; count < 20; ++count)
+        {
+            Assert::AreEqual(size_t{0}, Select(AF_INET, lease));
+            lease.reset();
+        }
+    }
+
+    TEST_METHOD(SummaryReportsEachTarget)
+    {
+        ctsConfig::g_configSettings->TargetPolicy = ctsConfig::TargetPolicyType::RoundRobin;
+
+        std::shared_ptr<ctsTargetLease> lease;
+        const auto index = Select(AF_UNSPEC, lease);
+        ctsTargetSelector::RecordResult(*lease, 0, 1000);
+        lease.reset();
+
+        g_summary.clear();
+        ctsTargetSelector::PrintSummary();
+        for (const auto& target : ctsConfig::g_configSettings->TargetAddresses)
+        {
+            Assert::IsTrue(g_summary.find(target.writeCompleteAddress()) != std::wstring::npos);
+        }
+        // Bytes/sec is over the time each target had a connection open
+        const auto targetLine = g_summary.find(ctsConfig::g_configSettings->TargetAddresses[index].writeCompleteAddress());
+        Assert::IsTrue(g_summary.find(L"Active [", targetLine) != std::wstring::npos);
+        Assert::IsTrue(g_summary.find(L"Bytes [", targetLine) != std::wstring::npos);
+    }
+};
+}
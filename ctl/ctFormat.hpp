@@ -0,0 +1,138 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+#include <algorithm>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <Windows.h>
+
+namespace ctl
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// UTF-8 formatting into reusable per-thread buffers
+///
+/// ctFormatUtf8 formats with std::format_to into a thread_local std::string which is cleared (not freed) on each call
+/// - once the buffer has grown to the longest message formatted on that thread, formatting no longer allocates
+/// - the returned string_view is only valid until the next ctFormatUtf8 call on the same thread
+///
+/// Wide strings (e.g. from FormatMessage or Winsock) are passed as ctWideArg, and are converted to UTF-8
+/// as they are written into the output, without an intermediate string
+///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct ctWideArg
+{
+    std::wstring_view m_value;
+
+    explicit ctWideArg(const wchar_t* value) noexcept :
+        m_value(value ? value : L"")
+    {
+    }
+
+    explicit ctWideArg(std::wstring_view value) noexcept :
+        m_value(value)
+    {
+    }
+};
+
+// appends the UTF-8 encoding of wideString to utf8String
+// - can throw std::bad_alloc if utf8String must grow
+inline void ctAppendUtf8(std::wstring_view wideString, std::string& utf8String)
+{
+    if (wideString.empty())
+    {
+        return;
+    }
+
+    const auto required = WideCharToMultiByte(CP_UTF8, 0, wideString.data(), static_cast<int>(wideString.size()), nullptr, 0, nullptr, nullptr);
+    const auto originalLength = utf8String.size();
+    utf8String.resize(originalLength + required);
+    WideCharToMultiByte(CP_UTF8, 0, wideString.data(), static_cast<int>(wideString.size()), utf8String.data() + originalLength, required, nullptr, nullptr);
+}
+
+// appends the UTF-16 decoding of utf8String to wideString
+// - can throw std::bad_alloc if wideString must grow
+inline void ctAppendUtf16(std::string_view utf8String, std::wstring& wideString)
+{
+    if (utf8String.empty())
+    {
+        return;
+    }
+
+    const auto required = MultiByteToWideChar(CP_UTF8, 0, utf8String.data(), static_cast<int>(utf8String.size()), nullptr, 0);
+    const auto originalLength = wideString.size();
+    wideString.resize(originalLength + required);
+    MultiByteToWideChar(CP_UTF8, 0, utf8String.data(), static_cast<int>(utf8String.size()), wideString.data() + originalLength, required);
+}
+
+inline std::string& ctThreadFormatBuffer() noexcept
+{
+    thread_local std::string t_buffer;
+    return t_buffer;
+}
+
+// can throw std::bad_alloc if the thread's buffer must grow, or std::format_error
+template <typename... Args>
+std::string_view ctFormatUtf8(std::format_string<Args...> format, Args&&... args)
+{
+    auto& buffer = ctThreadFormatBuffer();
+    buffer.clear();
+    std::format_to(std::back_inserter(buffer), format, std::forward<Args>(args)...);
+    return buffer;
+}
+
+// appends to the thread's buffer after what was formatted by the prior ctFormatUtf8 call
+template <typename... Args>
+std::string_view ctFormatUtf8Append(std::format_string<Args...> format, Args&&... args)
+{
+    auto& buffer = ctThreadFormatBuffer();
+    std::format_to(std::back_inserter(buffer), format, std::forward<Args>(args)...);
+    return buffer;
+}
+} // namespace
+
+template <>
+struct std::formatter<ctl::ctWideArg, char>
+{
+    constexpr auto parse(std::format_parse_context& context)
+    {
+        return context.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const ctl::ctWideArg& argument, FormatContext& context) const
+    {
+        // convert through a stack buffer, in chunks which never split a surrogate pair
+        constexpr size_t chunkLength = 64;
+        char utf8Chunk[chunkLength * 3]{};
+
+        auto output = context.out();
+        auto remaining = argument.m_value;
+        while (!remaining.empty())
+        {
+            auto length = (std::min)(remaining.size(), chunkLength);
+            if (length < remaining.size() && IS_HIGH_SURROGATE(remaining[length - 1]))
+            {
+                --length;
+            }
+
+            const auto converted = WideCharToMultiByte(CP_UTF8, 0, remaining.data(), static_cast<int>(length), utf8Chunk, static_cast<int>(sizeof utf8Chunk), nullptr, nullptr);
+            output = std::copy_n(utf8Chunk, converted, output);
+            remaining.remove_prefix(length);
+        }
+        return output;
+    }
+};
@@ -13,6 +13,9 @@ See the Apache Version 2.0 License for specific language governing permissions a
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <tuple>
 #include <numeric>
 #include <cmath>
@@ -175,4 +178,278 @@ std::tuple<double, double, double> ctInterquartileRange(const BidirectionalItera
         median,
         higherQuartile);
 }
+
+///
+/// ctRunningStatistics
+///
+/// Streaming count / mean / sampled variance / min / max in constant memory
+/// - uses Welford's update for each added value, which avoids the cancellation error
+///   of the naive sum / sum-of-squares approach over very long runs
+/// - two instances can be merged (Chan et al.) to combine summaries across instances or intervals
+///
+/// Produces the same results as ctSampledStandardDeviation without retaining the samples
+///
+class ctRunningStatistics
+{
+public:
+    void Add(double value) noexcept
+    {
+        ++m_count;
+        const auto delta = value - m_mean;
+        m_mean += delta / static_cast<double>(m_count);
+        m_m2 += delta * (value - m_mean);
+
+        if (1 == m_count)
+        {
+            m_min = value;
+            m_max = value;
+        }
+        else
+        {
+            m_min = (std::min)(m_min, value);
+            m_max = (std::max)(m_max, value);
+        }
+    }
+
+    void Merge(const ctRunningStatistics& rhs) noexcept
+    {
+        if (0 == rhs.m_count)
+        {
+            return;
+        }
+        if (0 == m_count)
+        {
+            *this = rhs;
+            return;
+        }
+
+        const auto lhsCount = static_cast<double>(m_count);
+        const auto rhsCount = static_cast<double>(rhs.m_count);
+        const auto totalCount = lhsCount + rhsCount;
+        const auto delta = rhs.m_mean - m_mean;
+
+        m_mean += delta * rhsCount / totalCount;
+        m_m2 += rhs.m_m2 + delta * delta * lhsCount * rhsCount / totalCount;
+        m_count += rhs.m_count;
+        m_min = (std::min)(m_min, rhs.m_min);
+        m_max = (std::max)(m_max, rhs.m_max);
+    }
+
+    [[nodiscard]] uint64_t GetCount() const noexcept
+    {
+        return m_count;
+    }
+
+    [[nodiscard]] double GetMean() const noexcept
+    {
+        return m_mean;
+    }
+
+    // the sampled (n - 1) variance, matching ctSampledStandardDeviation
+    [[nodiscard]] double GetVariance() const noexcept
+    {
+        return m_count > 1 ? m_m2 / (static_cast<double>(m_count) - 1.0) : 0.0;
+    }
+
+    [[nodiscard]] double GetStandardDeviation() const noexcept
+    {
+        return std::sqrt(GetVariance());
+    }
+
+    [[nodiscard]] double GetMin() const noexcept
+    {
+        return m_min;
+    }
+
+    [[nodiscard]] double GetMax() const noexcept
+    {
+        return m_max;
+    }
+
+private:
+    uint64_t m_count = 0;
+    double m_mean = 0.0;
+    double m_m2 = 0.0;
+    double m_min = 0.0;
+    double m_max = 0.0;
+};
+
+///
+/// ctQuantileSketch
+///
+/// Approximate quantiles of non-negative values in constant memory
+/// - values are counted in logarithmically sized buckets (as DDSketch does), so any returned
+///   quantile is within c_relativeAccuracy of the value actually at that rank
+/// - at most c_maxBuckets buckets are kept: with 1% accuracy that covers values spanning
+///   roughly 8 orders of magnitude; beyond that the lowest buckets are collapsed together,
+///   which only loses accuracy for the very smallest values
+/// - zero (and negative) values are counted separately
+/// - two sketches can be merged without any loss beyond the bucket accuracy
+///
+class ctQuantileSketch
+{
+public:
+    static constexpr double c_relativeAccuracy = 0.01;
+    static constexpr int32_t c_maxBuckets = 1024;
+
+    void Add(double value) noexcept
+    {
+        if (value <= 0.0 || std::isnan(value))
+        {
+            ++m_zeroCount;
+            return;
+        }
+        AddToBucket(IndexOf(value), 1);
+    }
+
+    void Merge(const ctQuantileSketch& rhs) noexcept
+    {
+        m_zeroCount += rhs.m_zeroCount;
+        if (0 == rhs.m_bucketedCount)
+        {
+            return;
+        }
+        for (auto index = rhs.m_minIndex; index <= rhs.m_maxIndex; ++index)
+        {
+            const auto count = rhs.m_buckets[index - rhs.m_offset];
+            if (count > 0)
+            {
+                AddToBucket(index, count);
+            }
+        }
+    }
+
+    [[nodiscard]] uint64_t GetCount() const noexcept
+    {
+        return m_zeroCount + m_bucketedCount;
+    }
+
+    // quantile is expressed from 0.0 to 1.0 (e.g. 0.5 is the median)
+    [[nodiscard]] double GetQuantile(double quantile) const noexcept
+    {
+        const auto count = GetCount();
+        if (0 == count)
+        {
+            return 0.0;
+        }
+
+        quantile = (std::max)(0.0, (std::min)(1.0, quantile));
+        const auto rank = static_cast<uint64_t>(quantile * static_cast<double>(count - 1));
+        if (rank < m_zeroCount)
+        {
+            return 0.0;
+        }
+
+        auto seen = m_zeroCount;
+        for (auto index = m_minIndex; index <= m_maxIndex; ++index)
+        {
+            seen += m_buckets[index - m_offset];
+            if (seen > rank)
+            {
+                return ValueOf(index);
+            }
+        }
+        return ValueOf(m_maxIndex);
+    }
+
+private:
+    [[nodiscard]] static double Gamma() noexcept
+    {
+        return (1.0 + c_relativeAccuracy) / (1.0 - c_relativeAccuracy);
+    }
+
+    // bucket 'i' holds values in (gamma^(i-1), gamma^i]
+    [[nodiscard]] static int32_t IndexOf(double value) noexcept
+    {
+        return static_cast<int32_t>(std::ceil(std::log(value) / std::log(Gamma())));
+    }
+
+    // the value returned for a bucket is within c_relativeAccuracy of both of its bounds
+    [[nodiscard]] static double ValueOf(int32_t index) noexcept
+    {
+        return 2.0 * std::pow(Gamma(), index) / (Gamma() + 1.0);
+    }
+
+    void AddToBucket(int32_t index, uint64_t count) noexcept
+    {
+        if (0 == m_bucketedCount)
+        {
+            // center the window on the first value so it can grow in either direction
+            m_offset = index - c_maxBuckets / 2;
+            m_minIndex = index;
+            m_maxIndex = index;
+        }
+        else if (index < m_offset)
+        {
+            // slide the window down as far as the current highest value allows
+            MoveWindow((std::max)(index, m_maxIndex - c_maxBuckets + 1));
+        }
+        else if (index >= m_offset + c_maxBuckets)
+        {
+            MoveWindow(index - c_maxBuckets + 1);
+        }
+
+        // anything still below the window is collapsed into the lowest bucket
+        const auto bucketIndex = (std::max)(index, m_offset);
+        m_buckets[bucketIndex - m_offset] += count;
+        m_minIndex = (std::min)(m_minIndex, bucketIndex);
+        m_maxIndex = (std::max)(m_maxIndex, bucketIndex);
+        m_bucketedCount += count;
+    }
+
+    void MoveWindow(int32_t newOffset) noexcept
+    {
+        std::array<uint64_t, c_maxBuckets> moved{};
+        for (auto index = m_minIndex; index <= m_maxIndex; ++index)
+        {
+            moved[(std::max)(index, newOffset) - newOffset] += m_buckets[index - m_offset];
+        }
+        m_buckets = moved;
+        m_offset = newOffset;
+        m_minIndex = (std::max)(m_minIndex, newOffset);
+    }
+
+    std::array<uint64_t, c_maxBuckets> m_buckets{};
+    uint64_t m_zeroCount = 0;
+    uint64_t m_bucketedCount = 0;
+    int32_t m_offset = 0;
+    int32_t m_minIndex = 0;
+    int32_t m_maxIndex = 0;
+};
+
+///
+/// ctSampleSummary
+///
+/// The bounded-memory equivalent of retaining every sample to later compute
+/// min / max / mean / standard deviation / quartiles
+///
+class ctSampleSummary
+{
+public:
+    void Add(double value) noexcept
+    {
+        m_statistics.Add(value);
+        m_quantiles.Add(value);
+    }
+
+    void Merge(const ctSampleSummary& rhs) noexcept
+    {
+        m_statistics.Merge(rhs.m_statistics);
+        m_quantiles.Merge(rhs.m_quantiles);
+    }
+
+    [[nodiscard]] const ctRunningStatistics& GetStatistics() const noexcept
+    {
+        return m_statistics;
+    }
+
+    [[nodiscard]] const ctQuantileSketch& GetQuantiles() const noexcept
+    {
+        return m_quantiles;
+    }
+
+private:
+    ctRunningStatistics m_statistics;
+    ctQuantileSketch m_quantiles;
+};
 }
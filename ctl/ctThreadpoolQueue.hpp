@@ -18,6 +18,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <variant>
 #include <Windows.h>
 #include <wil/resource.h>
+#include "ctWorkStealingPool.hpp"
 
 namespace ctl
 {
@@ -177,10 +178,24 @@ public:
         m_tpHandle = m_tpEnvironment.create_tp(WorkCallback, this);
     }
 
+    // runs the queue on the threads of a ctWorkStealingPool instead of its own single-threaded threadpool
+    // - work items still run one at a time, in the order queued
+    // - the pool must outlive this ctThreadpoolQueue
+    // - a nullptr pool creates the single-threaded threadpool as the default constructor does
+    explicit ctThreadpoolQueue(ctWorkStealingPool* pool) :
+        m_tpEnvironment(pool ? TpEnvironment{} : TpEnvironment{0, 1}),
+        m_pool(pool)
+    {
+        if (!m_pool)
+        {
+            m_tpHandle = m_tpEnvironment.create_tp(WorkCallback, this);
+        }
+    }
+
     template <typename TReturn, typename FunctorType>
     std::shared_ptr<ctThreadpoolQueueWaitableResult<TReturn>> submit_with_results(FunctorType&& functor) noexcept try
     {
-        FAIL_FAST_IF(m_tpHandle.get() == nullptr);
+        FAIL_FAST_IF(m_tpHandle.get() == nullptr && m_pool == nullptr);
 
         std::shared_ptr<ctThreadpoolQueueWaitableResult<TReturn>> returnResult{std::make_shared<ctThreadpoolQueueWaitableResult<TReturn>>(std::forward<FunctorType>(functor))};
         auto shouldSubmit = false;
@@ -194,7 +209,7 @@ public:
 
         if (shouldSubmit)
         {
-            SubmitThreadpoolWork(m_tpHandle.get());
+            ScheduleWork();
         }
         return returnResult;
     }
@@ -204,10 +219,11 @@ public:
         return nullptr;
     }
 
+    // returns false if the functor could not be queued
     template <typename FunctorType>
-    void submit(FunctorType&& functor) noexcept try
+    bool submit(FunctorType&& functor) noexcept try
     {
-        FAIL_FAST_IF(m_tpHandle.get() == nullptr);
+        FAIL_FAST_IF(m_tpHandle.get() == nullptr && m_pool == nullptr);
 
         auto shouldSubmit = false;
 
@@ -220,10 +236,15 @@ public:
 
         if (shouldSubmit)
         {
-            SubmitThreadpoolWork(m_tpHandle.get());
+            ScheduleWork();
         }
+        return true;
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION();
+        return false;
     }
-    CATCH_LOG()
 
     // functors must return type HRESULT
     template <typename FunctorType>
@@ -252,9 +273,14 @@ public:
     CATCH_RETURN()
 
     // cancels anything queued to the TP - this ctThreadpoolQueue instance can no longer be used
+    // - must not be called from a work item of this queue: it waits for the running work item to return
     void cancel() noexcept try
     {
-        if (m_tpHandle)
+        FAIL_FAST_IF_MSG(
+            m_pool && IsRunningInQueue(),
+            "ctThreadpoolQueue::cancel cannot be called from a work item running in the same queue (this == %p)", this);
+
+        if (m_tpHandle || m_pool)
         {
             // immediately release anyone waiting for these workitems not yet run
             {
@@ -270,9 +296,18 @@ public:
                 }
 
                 m_workItems.clear();
+                m_canceled = true;
             }
         }
 
+        if (m_pool)
+        {
+            // the callback already running in the pool sees the queue empty and won't schedule another
+            m_poolIdle.wait();
+            // and acquiring the lock guarantees that callback has released it
+            const auto queueLock = m_lock.lock();
+        }
+
         // force the m_tpHandle to wait and close the TP
         m_tpHandle.reset();
         m_tpEnvironment.reset();
@@ -304,6 +339,12 @@ private:
         using unique_tp_env = wil::unique_struct<TP_CALLBACK_ENVIRON, decltype(&DestroyThreadpoolEnvironment), DestroyThreadpoolEnvironment>;
         unique_tp_env m_tpEnvironment;
 
+        // no threadpool is created when the queue runs on a ctWorkStealingPool
+        TpEnvironment() noexcept
+        {
+            InitializeThreadpoolEnvironment(&m_tpEnvironment);
+        }
+
         TpEnvironment(DWORD countMinThread, DWORD countMaxThread)
         {
             InitializeThreadpoolEnvironment(&m_tpEnvironment);
@@ -344,6 +385,13 @@ private:
     std::deque<FunctionVariantT> m_workItems;
     mutable LONG64 m_threadpoolThreadId{0}; // useful for callers to assert they are running within the queue
 
+    // when running on a ctWorkStealingPool, at most one callback is scheduled in the pool at a time
+    // - it runs one work item then schedules itself again while work remains, keeping the queue serialized
+    ctWorkStealingPool* m_pool = nullptr;
+    bool m_poolCallbackScheduled = false;
+    bool m_canceled = false;
+    wil::slim_event_manual_reset m_poolIdle{true};
+
     bool ShouldSubmitThreadpoolWork() noexcept
     {
         if constexpr (GrowthPolicy == ctThreadpoolGrowthPolicy::Flat)
@@ -352,15 +400,118 @@ private:
             // else we already called SubmitThreadpoolWork for existing the item in the queue (that we're about to erase)
             const auto returnValue = m_workItems.empty();
             m_workItems.clear();
+            if (m_pool)
+            {
+                return ShouldSchedulePoolCallback();
+            }
             return returnValue;
         }
 
         if constexpr (GrowthPolicy == ctThreadpoolGrowthPolicy::Growable)
         {
+            if (m_pool)
+            {
+                return ShouldSchedulePoolCallback();
+            }
             return true;
         }
     }
 
+    // must be called holding m_lock
+    bool ShouldSchedulePoolCallback() noexcept
+    {
+        if (m_poolCallbackScheduled)
+        {
+            return false;
+        }
+        m_poolCallbackScheduled = true;
+        m_poolIdle.ResetEvent();
+        return true;
+    }
+
+    // must be called holding m_lock
+    void SetPoolIdle() noexcept
+    {
+        m_poolCallbackScheduled = false;
+        m_poolIdle.SetEvent();
+    }
+
+    void ScheduleWork() noexcept
+    {
+        if (!m_pool)
+        {
+            SubmitThreadpoolWork(m_tpHandle.get());
+            return;
+        }
+
+        try
+        {
+            m_pool->submit([this] { PoolCallback(); });
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            // the queued work is scheduled again with the next submit
+            const auto queueLock = m_lock.lock();
+            SetPoolIdle();
+        }
+    }
+
+    static void RunWorkItem(const FunctionVariantT& work)
+    {
+        if (work.index() == 0)
+        {
+            const auto& workItem = std::get<SimpleFunctionT>(work);
+            workItem();
+        }
+        else
+        {
+            const auto& waitableWorkItem = std::get<WaitableFunctionT>(work);
+            waitableWorkItem->run();
+        }
+    }
+
+    void PoolCallback() noexcept try
+    {
+        FunctionVariantT work;
+        {
+            const auto queueLock = m_lock.lock();
+            if (m_workItems.empty() || m_canceled)
+            {
+                SetPoolIdle();
+                return;
+            }
+
+            std::swap(work, m_workItems.front());
+            m_workItems.pop_front();
+
+            InterlockedExchange64(&m_threadpoolThreadId, GetThreadId(GetCurrentThread()));
+        }
+
+        {
+            // run the tasks outside the ctThreadpoolQueue lock
+            const auto resetThreadIdOnExit = wil::scope_exit([this] { InterlockedExchange64(&m_threadpoolThreadId, 0ll); });
+            RunWorkItem(work);
+        }
+
+        {
+            const auto queueLock = m_lock.lock();
+            if (m_workItems.empty() || m_canceled)
+            {
+                SetPoolIdle();
+                return;
+            }
+        }
+        // yield the pool thread between work items rather than draining the whole queue in one callback
+        ScheduleWork();
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION();
+        const auto queueLock = m_lock.lock();
+        SetPoolIdle();
+    }
+
     static void CALLBACK WorkCallback(PTP_CALLBACK_INSTANCE, void* context, PTP_WORK) noexcept try
     {
         auto* pThis = static_cast<ctThreadpoolQueue*>(context);
@@ -383,16 +534,7 @@ private:
 
         // run the tasks outside the ctThreadpoolQueue lock
         const auto resetThreadIdOnExit = wil::scope_exit([pThis] { InterlockedExchange64(&pThis->m_threadpoolThreadId, 0ll); });
-        if (work.index() == 0)
-        {
-            const auto& workItem = std::get<SimpleFunctionT>(work);
-            workItem();
-        }
-        else
-        {
-            const auto& waitableWorkItem = std::get<WaitableFunctionT>(work);
-            waitableWorkItem->run();
-        }
+        RunWorkItem(work);
     }
     CATCH_LOG()
 };
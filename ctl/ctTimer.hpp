@@ -63,5 +63,23 @@ namespace ctl {namespace ctTimer { namespace Details
             return qpc.QuadPart * 1000LL / Details::g_qpf.QuadPart;
         }
 #endif
+
+#ifdef CTSTRAFFIC_UNIT_TESTS
+        inline int64_t snap_qpc_as_usec() noexcept
+        {
+            return 0;
+        }
+#else
+        inline int64_t snap_qpc_as_usec() noexcept
+        {
+            InitOnceExecuteOnce(&Details::g_qpfInitOnce, Details::QpfInitOnceCallback, nullptr, nullptr);
+            LARGE_INTEGER qpc;
+            QueryPerformanceCounter(&qpc);
+            // splitting the whole seconds from the remainder to avoid overflowing when scaling by 1000000
+            const auto seconds = qpc.QuadPart / Details::g_qpf.QuadPart;
+            const auto remainder = qpc.QuadPart % Details::g_qpf.QuadPart;
+            return seconds * 1000000LL + remainder * 1000000LL / Details::g_qpf.QuadPart;
+        }
+#endif
     } // namespace ctTimer
 } // namespace ctl
@@ -31,6 +31,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <wil/resource.h>
 #include <wil/win32_helpers.h>
 // ctl headers
+#include <ctMath.hpp>
 #include <ctString.hpp>
 #include <ctWmiInitialize.hpp>
 
@@ -59,6 +60,8 @@ See the Apache Version 2.0 License for specific language governing permissions a
 /// - add_filter(): allows the caller to only capture instances which match the parameter/value combination for that object
 /// - reference_range() : takes an Instance Name by which to return values
 /// -- returns begin/end iterators to reference the data
+/// - reference_summary() : takes an Instance Name by which to return the bounded-memory summary
+/// -- only populated for counters created with ctWmiPerformanceCollectionType::Summary
 ///
 /// ctWmiPerformanceCounter populates data by invoking a pure virtual function (update_counter_data) every one second.
 /// - update_counter_data takes a boolean parameter: true will invoke the virtual function to update the data, false will clear the data.
@@ -85,7 +88,9 @@ enum class ctWmiPerformanceCollectionType
 {
     Detailed,
     MeanOnly,
-    FirstLast
+    FirstLast,
+    // retains only a ctSampleSummary (constant memory) instead of every data point
+    Summary
 };
 
 inline bool operator ==(const wil::unique_variant& rhs, const wil::unique_variant& lhs) noexcept
@@ -480,10 +485,16 @@ namespace details
         const std::wstring m_counterName;
         std::vector<T> m_counterData;
         uint64_t m_counterSum = 0;
+        ctSampleSummary m_counterSummary;
+        // the most recent data point, regardless of the collection type
+        T m_latestData{};
+        bool m_hasLatestData = false;
 
         void add_data(const T& instanceData)
         {
             const auto lock = m_guardData.lock();
+            m_latestData = instanceData;
+            m_hasLatestData = true;
             switch (m_collectionType)
             {
                 case ctWmiPerformanceCollectionType::Detailed:
@@ -537,6 +548,10 @@ namespace details
                     }
                     break;
 
+                case ctWmiPerformanceCollectionType::Summary:
+                    m_counterSummary.Add(static_cast<double>(instanceData));
+                    break;
+
                 default:
                     FAIL_FAST_MSG(
                         "Unknown ctWmiPerformanceCollectionType (%d)", m_collectionType);
@@ -650,11 +665,33 @@ namespace details
             return access_end() - access_begin();
         }
 
+        ctSampleSummary summary() const noexcept
+        {
+            const auto lock = m_guardData.lock();
+            return m_counterSummary;
+        }
+
+        // returns false if no data has been added since created or cleared
+        bool latest(_Out_ T* value) const noexcept
+        {
+            const auto lock = m_guardData.lock();
+            *value = m_latestData;
+            return m_hasLatestData;
+        }
+
+        const std::wstring& instance_name() const noexcept
+        {
+            return m_instanceName;
+        }
+
         void clear() noexcept
         {
             const auto lock = m_guardData.lock();
             m_counterData.clear();
             m_counterSum = 0;
+            m_counterSummary = ctSampleSummary{};
+            m_latestData = T{};
+            m_hasLatestData = false;
         }
 
         // non-copyable
@@ -888,6 +925,69 @@ public:
         return std::pair<iterator, iterator>(instanceReference->begin(), instanceReference->end());
     }
 
+    ///
+    /// returns a copy of the summary of all data points for ctWmiPerformanceCollectionType::Summary counters
+    /// - static classes will have a null instance name
+    /// - returns an empty summary if nothing matches that instance name
+    ///
+    ctSampleSummary reference_summary(_In_opt_ PCWSTR instanceName = nullptr)
+    {
+        FAIL_FAST_IF_MSG(
+            !m_dataStopped,
+            "ctWmiPerformanceCounter: must call stop_all_counters on the ctWmiPerformance class containing this counter");
+
+        const auto lock = m_guardCounterData.lock();
+        const auto foundInstance = std::ranges::find_if(
+            m_counterData,
+            [&](const auto& instance) {
+                return instance->match(instanceName);
+            });
+        if (std::end(m_counterData) == foundInstance)
+        {
+            return {};
+        }
+        return (*foundInstance)->summary();
+    }
+
+    ///
+    /// invokes fn(instanceName, value) with the most recent data point of each instance
+    /// - unlike the above, can be called while the counters are running
+    ///   e.g. from a callback added with ctWmiPerformance::add_update_callback
+    ///
+    template <typename Fn>
+    void for_each_latest(Fn&& fn) const
+    {
+        const auto lock = m_guardCounterData.lock();
+        for (const auto& instance : m_counterData)
+        {
+            T value{};
+            if (instance->latest(&value))
+            {
+                fn(instance->instance_name(), value);
+            }
+        }
+    }
+
+    ///
+    /// returns false if nothing matches that instance name, or that instance has no data yet
+    /// - can be called while the counters are running
+    ///
+    bool reference_latest(_In_opt_ PCWSTR instanceName, _Out_ T* value) const
+    {
+        *value = T{};
+        const auto lock = m_guardCounterData.lock();
+        const auto foundInstance = std::ranges::find_if(
+            m_counterData,
+            [&](const auto& instance) {
+                return instance->match(instanceName);
+            });
+        if (std::end(m_counterData) == foundInstance)
+        {
+            return false;
+        }
+        return (*foundInstance)->latest(value);
+    }
+
 private:
     //
     // private stucture to track the 'filter' which instances to track
@@ -1186,6 +1286,25 @@ public:
         revertCallback.release();
     }
 
+    ///
+    /// callback is invoked after every Refresh, after the Update of every counter added before it
+    /// - e.g. to combine the same sample of two counters
+    /// - must be added before start_all_counters
+    ///
+    void add_update_callback(std::function<void()> callback)
+    {
+        m_callbacks.emplace_back([callback = std::move(callback)](const details::CallbackAction action) noexcept {
+            if (details::CallbackAction::Update == action)
+            {
+                try
+                {
+                    callback();
+                }
+                CATCH_LOG()
+            }
+        });
+    }
+
     void start_all_counters(uint32_t interval)
     {
         if (!m_timer)
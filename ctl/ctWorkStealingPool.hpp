@@ -0,0 +1,322 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <wil/result.h>
+
+namespace ctl
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// ctWorkStealingPool
+///
+/// A fixed set of worker threads, each owning a Chase-Lev work-stealing deque
+/// - work submitted from a worker thread is pushed on that worker's own deque, and popped LIFO while it's cache-hot
+/// - work submitted from any other thread is added to a shared injection queue
+/// - idle workers take from the injection queue, then steal FIFO from the other workers' deques
+///
+/// Idle workers park with std::atomic::wait on an epoch counter (WaitOnAddress on Windows, futex on Linux)
+/// - submitting bumps the epoch and only wakes a worker if any are parked
+///
+/// Work is not guaranteed to run in the order submitted, and runs concurrently across workers
+/// - ctThreadpoolQueue layers its serialized queue semantics on top when given a ctWorkStealingPool
+///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class ctWorkStealingPool
+{
+public:
+    using WorkT = std::function<void()>;
+
+    // a threadCount of zero creates a worker for each hardware thread
+    explicit ctWorkStealingPool(uint32_t threadCount = 0)
+    {
+        if (0 == threadCount)
+        {
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        m_workers.reserve(threadCount);
+        for (uint32_t index = 0; index < threadCount; ++index)
+        {
+            m_workers.emplace_back(std::make_unique<Worker>());
+        }
+        for (uint32_t index = 0; index < threadCount; ++index)
+        {
+            m_workers[index]->m_thread = std::thread([this, index] { WorkerLoop(index); });
+        }
+    }
+
+    ~ctWorkStealingPool() noexcept
+    {
+        m_shuttingDown.store(true);
+        m_epoch.fetch_add(1);
+        m_epoch.notify_all();
+        for (const auto& worker : m_workers)
+        {
+            if (worker->m_thread.joinable())
+            {
+                worker->m_thread.join();
+            }
+        }
+
+        // work never run is deleted without being invoked
+        for (const auto& worker : m_workers)
+        {
+            while (const auto* work = worker->m_deque.pop())
+            {
+                delete work;
+            }
+        }
+        for (const auto* work : m_injectionQueue)
+        {
+            delete work;
+        }
+    }
+
+    // throws std::bad_alloc
+    void submit(WorkT&& work)
+    {
+        auto newWork = std::make_unique<WorkT>(std::move(work));
+
+        if (t_currentPool == this && t_currentWorker->m_deque.push(newWork.get()))
+        {
+            newWork.release();
+        }
+        else
+        {
+            const std::lock_guard lock{m_injectionLock};
+            m_injectionQueue.push_back(newWork.get());
+            newWork.release();
+        }
+
+        // the epoch must change after the work is visible so a worker about to park sees one or the other
+        m_epoch.fetch_add(1);
+        if (m_parkedCount.load() > 0)
+        {
+            m_epoch.notify_one();
+        }
+    }
+
+    [[nodiscard]] uint32_t thread_count() const noexcept
+    {
+        return static_cast<uint32_t>(m_workers.size());
+    }
+
+    // true if called from one of this pool's worker threads
+    [[nodiscard]] bool is_worker_thread() const noexcept
+    {
+        return t_currentPool == this;
+    }
+
+    ctWorkStealingPool(const ctWorkStealingPool&) = delete;
+    ctWorkStealingPool& operator=(const ctWorkStealingPool&) = delete;
+    ctWorkStealingPool(ctWorkStealingPool&&) = delete;
+    ctWorkStealingPool& operator=(ctWorkStealingPool&&) = delete;
+
+private:
+    //
+    // Chase-Lev deque over a fixed-size ring (Le, Pop, Cohen, Zappa Nardelli - PPoPP 2013)
+    // - push and pop are only called by the owning worker, steal by any thread
+    // - push fails when full: the caller then uses the injection queue instead of growing the ring
+    //
+    class ChaseLevDeque
+    {
+    public:
+        static constexpr int64_t c_capacity = 4096;
+
+        bool push(WorkT* work) noexcept
+        {
+            const auto bottom = m_bottom.load(std::memory_order_relaxed);
+            const auto top = m_top.load(std::memory_order_acquire);
+            if (bottom - top >= c_capacity)
+            {
+                return false;
+            }
+            m_ring[bottom & (c_capacity - 1)].store(work, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        WorkT* pop() noexcept
+        {
+            const auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = m_top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                // empty
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            auto* work = m_ring[bottom & (c_capacity - 1)].load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // the last item: race any thieves for it
+                if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    work = nullptr;
+                }
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return work;
+        }
+
+        WorkT* steal() noexcept
+        {
+            auto top = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto bottom = m_bottom.load(std::memory_order_acquire);
+            if (top >= bottom)
+            {
+                return nullptr;
+            }
+
+            auto* work = m_ring[top & (c_capacity - 1)].load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                // lost the race to the owner or another thief
+                return nullptr;
+            }
+            return work;
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+        }
+
+    private:
+        // top and bottom are written by different threads - keeping them on separate cache lines
+        alignas(64) std::atomic<int64_t> m_top{0};
+        alignas(64) std::atomic<int64_t> m_bottom{0};
+        alignas(64) std::atomic<WorkT*> m_ring[c_capacity]{};
+    };
+
+    struct Worker
+    {
+        ChaseLevDeque m_deque;
+        std::thread m_thread;
+    };
+
+    static inline thread_local ctWorkStealingPool* t_currentPool = nullptr;
+    static inline thread_local Worker* t_currentWorker = nullptr;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    std::mutex m_injectionLock;
+    std::deque<WorkT*> m_injectionQueue;
+
+    std::atomic<uint64_t> m_epoch{0};
+    std::atomic<uint32_t> m_parkedCount{0};
+    std::atomic<bool> m_shuttingDown{false};
+
+    WorkT* TakeInjected() noexcept
+    {
+        const std::lock_guard lock{m_injectionLock};
+        if (m_injectionQueue.empty())
+        {
+            return nullptr;
+        }
+        auto* work = m_injectionQueue.front();
+        m_injectionQueue.pop_front();
+        return work;
+    }
+
+    WorkT* FindWork(uint32_t index) noexcept
+    {
+        if (auto* work = m_workers[index]->m_deque.pop())
+        {
+            return work;
+        }
+        if (auto* work = TakeInjected())
+        {
+            return work;
+        }
+        // steal starting from the next worker so thieves spread across victims
+        const auto workerCount = static_cast<uint32_t>(m_workers.size());
+        for (uint32_t offset = 1; offset < workerCount; ++offset)
+        {
+            if (auto* work = m_workers[(index + offset) % workerCount]->m_deque.steal())
+            {
+                return work;
+            }
+        }
+        return nullptr;
+    }
+
+    bool HasVisibleWork() noexcept
+    {
+        {
+            const std::lock_guard lock{m_injectionLock};
+            if (!m_injectionQueue.empty())
+            {
+                return true;
+            }
+        }
+        for (const auto& worker : m_workers)
+        {
+            if (!worker->m_deque.empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(uint32_t index) noexcept
+    {
+        t_currentPool = this;
+        t_currentWorker = m_workers[index].get();
+
+        while (!m_shuttingDown.load())
+        {
+            if (auto* work = FindWork(index))
+            {
+                const std::unique_ptr<WorkT> runningWork{work};
+                try
+                {
+                    (*runningWork)();
+                }
+                CATCH_LOG()
+                continue;
+            }
+
+            // park: the epoch is read before checking for work a final time
+            // - any submit after that check changes the epoch, so the wait returns immediately
+            m_parkedCount.fetch_add(1);
+            const auto epoch = m_epoch.load();
+            if (!HasVisibleWork() && !m_shuttingDown.load())
+            {
+                m_epoch.wait(epoch);
+            }
+            m_parkedCount.fetch_sub(1);
+        }
+
+        t_currentPool = nullptr;
+        t_currentWorker = nullptr;
+    }
+};
+} // namespace
@@ -0,0 +1,446 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// ctsLogConverter converts a binary connection log (-ConnectionFilename:<file>.ctsbin)
+// to the csv layout ctsTraffic writes with -ConnectionFilename:<file>.csv
+//
+// ctsLogConverter also converts an IO event trace (-TraceFilename:<file>)
+// to the Chrome / Perfetto trace event json format (open with ui.perfetto.dev or chrome://tracing)
+
+// cpp headers
+#include <cstdio>
+#include <algorithm>
+#include <cwchar>
+#include <format>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+// wil headers
+#include <wil/stl.h>
+#include <wil/resource.h>
+// ctl headers
+#include <ctFormat.hpp>
+#include <ctSockaddr.hpp>
+#include <ctString.hpp>
+// project headers
+#include "ctsBinaryConnectionLog.hpp"
+#include "ctsTrace.h"
+
+using namespace std;
+using namespace ctl;
+using namespace ctsTraffic;
+
+namespace
+{
+constexpr size_t c_writeThreshold = 1024 * 1024;
+
+void WriteBuffer(HANDLE file, string& buffer)
+{
+    DWORD bytesWritten{};
+    THROW_LAST_ERROR_IF(!WriteFile(
+        file,
+        buffer.c_str(),
+        static_cast<DWORD>(buffer.size()),
+        &bytesWritten,
+        nullptr));
+    buffer.clear();
+}
+
+wstring BuildResultString(const ctsBinaryConnectionRecord& record)
+{
+    switch (record.m_resultType)
+    {
+        case ctsBinaryResultType::Success:
+            return L"Succeeded";
+
+        case ctsBinaryResultType::ProtocolError:
+            return {record.m_protocolError, wcsnlen_s(record.m_protocolError, ARRAYSIZE(record.m_protocolError))};
+
+        case ctsBinaryResultType::NetworkError:
+            [[fallthrough]];
+        default:
+        {
+            auto errorString = wil::str_printf<std::wstring>(
+                L"%lu: %ws",
+                record.m_error,
+                ctString::format_message(record.m_error).c_str());
+            // remove any commas from the formatted string - since that will mess up csv files
+            ctString::replace_all(errorString, L",", L" ");
+            return errorString;
+        }
+    }
+}
+
+void AppendCsvRecord(const ctsBinaryConnectionRecord& record, string& buffer)
+{
+    CHAR localAddress[ctSockaddr::FixedStringLength]{};
+    ctSockaddr(&record.m_localAddress).writeCompleteAddress(localAddress);
+    CHAR remoteAddress[ctSockaddr::FixedStringLength]{};
+    ctSockaddr(&record.m_remoteAddress).writeCompleteAddress(remoteAddress);
+
+    char connectionId[ARRAYSIZE(record.m_connectionId) + 1]{};
+    memcpy_s(connectionId, sizeof connectionId, record.m_connectionId, sizeof record.m_connectionId);
+
+    const auto resultString = BuildResultString(record);
+    if (ctsBinaryRecordType::UdpResult == record.m_recordType)
+    {
+        format_to(
+            back_inserter(buffer),
+            "{:.3f},{},{},{},{},{},{},{},{},{}\r\n",
+            record.m_timeSlice,
+            localAddress,
+            remoteAddress,
+            record.m_counters[0],
+            record.m_counters[1],
+            record.m_counters[2],
+            record.m_counters[3],
+            record.m_counters[4],
+            ctWideArg{resultString},
+            connectionId);
+    }
+    else
+    {
+        // failures before a connection was made are written in the TCP layout, as ctsTraffic does
+        format_to(
+            back_inserter(buffer),
+            "{:.3f},{},{},{},{},{},{},{},{},{}\r\n",
+            record.m_timeSlice,
+            localAddress,
+            remoteAddress,
+            record.m_counters[0],
+            record.m_counters[1],
+            record.m_counters[2],
+            record.m_counters[3],
+            record.m_elapsedMs,
+            ctWideArg{resultString},
+            connectionId);
+    }
+}
+
+// the names match ctsTaskAction and ctsSocketState::InternalState
+constexpr const char* c_taskActionNames[]{"None", "Send", "Recv", "GracefulShutdown", "HardShutdown", "Abort", "FatalAbort"};
+constexpr const char* c_socketStateNames[]{"Creating", "Created", "Connecting", "Connected", "InitiatingIo", "InitiatedIo", "Closing", "Closed"};
+constexpr uint16_t c_closedState = 7;
+
+const char* TaskActionName(uint16_t action) noexcept
+{
+    return action < ARRAYSIZE(c_taskActionNames) ? c_taskActionNames[action] : "Unknown";
+}
+
+const char* SocketStateName(uint16_t state) noexcept
+{
+    return state < ARRAYSIZE(c_socketStateNames) ? c_socketStateNames[state] : "Unknown";
+}
+
+struct ctsTraceRecord
+{
+    ctsTrace::ctsTraceEvent m_event;
+    uint32_t m_threadId;
+};
+
+void AppendTraceEvent(const ctsTraceRecord& record, double timestampUs, unordered_map<uint64_t, const char*>& connectionStates, string& buffer)
+{
+    using ctsTrace::ctsTraceEventType;
+
+    const auto& event = record.m_event;
+    if (event.m_type == ctsTraceEventType::SocketState)
+    {
+        // each state is an async slice on the connection's track, ending when the next state begins
+        const auto* const stateName = SocketStateName(event.m_detail);
+        const auto foundState = connectionStates.find(event.m_connection);
+        if (foundState != connectionStates.end())
+        {
+            format_to(
+                back_inserter(buffer),
+                ",\r\n{{\"name\":\"{}\",\"cat\":\"connection\",\"ph\":\"e\",\"ts\":{:.3f},\"pid\":1,\"tid\":{},\"id\":\"0x{:x}\"}}",
+                foundState->second,
+                timestampUs,
+                record.m_threadId,
+                event.m_connection);
+        }
+
+        if (event.m_detail == c_closedState)
+        {
+            if (foundState != connectionStates.end())
+            {
+                connectionStates.erase(foundState);
+            }
+            return;
+        }
+
+        connectionStates[event.m_connection] = stateName;
+        format_to(
+            back_inserter(buffer),
+            ",\r\n{{\"name\":\"{}\",\"cat\":\"connection\",\"ph\":\"b\",\"ts\":{:.3f},\"pid\":1,\"tid\":{},\"id\":\"0x{:x}\"}}",
+            stateName,
+            timestampUs,
+            record.m_threadId,
+            event.m_connection);
+        return;
+    }
+
+    string name;
+    switch (event.m_type)
+    {
+        case ctsTraceEventType::IoInitiated:
+            name = format("{} initiated", TaskActionName(event.m_detail));
+            break;
+        case ctsTraceEventType::IoCompleted:
+            name = format("{} completed", TaskActionName(event.m_detail));
+            break;
+        case ctsTraceEventType::IoFailed:
+            name = format("{} failed", TaskActionName(event.m_detail));
+            break;
+        case ctsTraceEventType::TimerArmed:
+            name = format("{} timer armed", TaskActionName(event.m_detail));
+            break;
+        case ctsTraceEventType::TimerFired:
+            name = format("{} timer fired", TaskActionName(event.m_detail));
+            break;
+        case ctsTraceEventType::BrokerRefresh:
+            name = "Broker refresh";
+            break;
+        case ctsTraceEventType::MediaFrameSent:
+            name = "Media frame sent";
+            break;
+        case ctsTraceEventType::MediaFrameReceived:
+            name = "Media frame received";
+            break;
+        default:
+            name = format("Unknown event {}", static_cast<uint16_t>(event.m_type));
+            break;
+    }
+
+    format_to(
+        back_inserter(buffer),
+        ",\r\n{{\"name\":\"{}\",\"cat\":\"io\",\"ph\":\"i\",\"s\":\"t\",\"ts\":{:.3f},\"pid\":1,\"tid\":{},\"args\":{{\"connection\":\"0x{:x}\",\"value\":{}}}}}",
+        name,
+        timestampUs,
+        record.m_threadId,
+        event.m_connection,
+        event.m_value);
+}
+
+// returns 0 or the Win32 error to return from wmain
+int ConvertTrace(const BYTE* view, size_t fileSize, PCWSTR inputFilename, PCWSTR outputFilename)
+{
+    const auto* header = reinterpret_cast<const ctsTrace::ctsTraceFileHeader*>(view);
+    if (fileSize < sizeof(ctsTrace::ctsTraceFileHeader) ||
+        header->m_version != ctsTrace::ctsTraceFileHeader::c_currentVersion ||
+        header->m_headerSize != sizeof(ctsTrace::ctsTraceFileHeader) ||
+        header->m_chunkHeaderSize != sizeof(ctsTrace::ctsTraceChunkHeader) ||
+        header->m_eventSize != sizeof(ctsTrace::ctsTraceEvent) ||
+        header->m_qpcFrequency == 0)
+    {
+        wprintf(L"%ws is not a ctsTraffic IO trace of a supported version\n", inputFilename);
+        return ERROR_INVALID_DATA;
+    }
+
+    // chunks from each thread are written in the order they were drained, not in time order
+    vector<ctsTraceRecord> records;
+    unordered_map<uint32_t, uint64_t> droppedEvents;
+    const ctsTrace::ctsTraceChunkHeader* lastChunk = nullptr;
+    size_t offset = header->m_headerSize;
+    while (offset + sizeof(ctsTrace::ctsTraceChunkHeader) <= fileSize)
+    {
+        const auto* chunk = reinterpret_cast<const ctsTrace::ctsTraceChunkHeader*>(view + offset);
+        const auto chunkEnd = offset + sizeof(ctsTrace::ctsTraceChunkHeader) + static_cast<size_t>(chunk->m_eventCount) * sizeof(ctsTrace::ctsTraceEvent);
+        if (chunkEnd > fileSize)
+        {
+            // a partially written chunk at the end (if ctsTraffic was still running) is ignored
+            break;
+        }
+
+        const auto* events = reinterpret_cast<const ctsTrace::ctsTraceEvent*>(view + offset + sizeof(ctsTrace::ctsTraceChunkHeader));
+        for (uint32_t index = 0; index < chunk->m_eventCount; ++index)
+        {
+            records.push_back({events[index], chunk->m_threadId});
+        }
+        // the count is cumulative for the thread
+        droppedEvents[chunk->m_threadId] = chunk->m_droppedEvents;
+        lastChunk = chunk;
+        offset = chunkEnd;
+    }
+    ranges::stable_sort(records, [](const ctsTraceRecord& lhs, const ctsTraceRecord& rhs) {
+        return lhs.m_event.m_timestamp < rhs.m_event.m_timestamp;
+    });
+
+    // the event timestamps tick at a fixed rate relative to QPC:
+    // derive it from the QPC / timestamp pairs taken when tracing started and when the last chunk was written
+    auto timestampsPerQpc = 1.0;
+    if (lastChunk && lastChunk->m_qpc > header->m_qpcStart && lastChunk->m_timestamp > header->m_timestampStart)
+    {
+        timestampsPerQpc =
+            static_cast<double>(lastChunk->m_timestamp - header->m_timestampStart) /
+            static_cast<double>(lastChunk->m_qpc - header->m_qpcStart);
+    }
+    const auto usPerTimestamp = 1000000.0 / (static_cast<double>(header->m_qpcFrequency) * timestampsPerQpc);
+
+    const wil::unique_hfile outputFile{CreateFileW(
+        outputFilename,
+        GENERIC_WRITE,
+        FILE_SHARE_READ,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr)};
+    THROW_LAST_ERROR_IF_MSG(!outputFile.is_valid(), "CreateFile(%ws)", outputFilename);
+
+    string buffer;
+    buffer.reserve(c_writeThreshold + 1024);
+    buffer.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\r\n");
+    buffer.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ctsTraffic\"}}");
+
+    unordered_map<uint64_t, const char*> connectionStates;
+    for (const auto& record : records)
+    {
+        const auto timestampUs = static_cast<double>(record.m_event.m_timestamp - header->m_timestampStart) * usPerTimestamp;
+        AppendTraceEvent(record, timestampUs, connectionStates, buffer);
+        if (buffer.size() >= c_writeThreshold)
+        {
+            WriteBuffer(outputFile.get(), buffer);
+        }
+    }
+    buffer.append("\r\n]}\r\n");
+    WriteBuffer(outputFile.get(), buffer);
+
+    uint64_t totalDropped = 0;
+    for (const auto& [threadId, dropped] : droppedEvents)
+    {
+        totalDropped += dropped;
+    }
+    wprintf(L"Converted %zu trace events to %ws\n", records.size(), outputFilename);
+    if (totalDropped > 0)
+    {
+        wprintf(L"  %llu events were dropped while tracing (the trace buffers filled faster than they were written)\n", totalDropped);
+    }
+    return 0;
+}
+}
+
+int __cdecl wmain(_In_ int argc, _In_reads_z_(argc) const wchar_t** argv)
+{
+    if (argc != 3)
+    {
+        wprintf(
+            L"ctsLogConverter.exe <input .ctsbin file> <output .csv file>\n"
+            L"  converts a binary connection log written by ctsTraffic -ConnectionFilename:<file>.ctsbin\n"
+            L"  to the csv layout written by -ConnectionFilename:<file>.csv\n"
+            L"\n"
+            L"ctsLogConverter.exe <input trace file> <output .json file>\n"
+            L"  converts an IO trace written by ctsTraffic -TraceFilename:<file>\n"
+            L"  to the Chrome / Perfetto trace event format\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    try
+    {
+        const wil::unique_hfile inputFile{CreateFileW(
+            argv[1],
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE, // ctsTraffic might still be writing to it
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr)};
+        THROW_LAST_ERROR_IF_MSG(!inputFile.is_valid(), "CreateFile(%ws)", argv[1]);
+
+        LARGE_INTEGER fileSize{};
+        THROW_IF_WIN32_BOOL_FALSE(GetFileSizeEx(inputFile.get(), &fileSize));
+        if (fileSize.QuadPart < static_cast<LONGLONG>(sizeof(ctsBinaryConnectionLogHeader)))
+        {
+            wprintf(L"%ws is not a ctsTraffic binary connection log (too small)\n", argv[1]);
+            return ERROR_INVALID_DATA;
+        }
+
+        const wil::unique_handle mapping{CreateFileMappingW(inputFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr)};
+        THROW_LAST_ERROR_IF_NULL(mapping.get());
+        const wil::unique_mapview_ptr<BYTE> view{static_cast<BYTE*>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0))};
+        THROW_LAST_ERROR_IF_NULL(view.get());
+
+        if (*reinterpret_cast<const uint32_t*>(view.get()) == ctsTrace::ctsTraceFileHeader::c_signature)
+        {
+            return ConvertTrace(view.get(), static_cast<size_t>(fileSize.QuadPart), argv[1], argv[2]);
+        }
+
+        const auto* header = reinterpret_cast<const ctsBinaryConnectionLogHeader*>(view.get());
+        if (header->m_signature != ctsBinaryConnectionLogHeader::c_signature ||
+            header->m_version != ctsBinaryConnectionLogHeader::c_currentVersion ||
+            header->m_headerSize != sizeof(ctsBinaryConnectionLogHeader) ||
+            header->m_recordSize != sizeof(ctsBinaryConnectionRecord))
+        {
+            wprintf(L"%ws is not a ctsTraffic binary connection log of a supported version\n", argv[1]);
+            return ERROR_INVALID_DATA;
+        }
+
+        // a partially written record at the end (if ctsTraffic was still running) is ignored
+        const auto recordCount = static_cast<size_t>(fileSize.QuadPart - header->m_headerSize) / header->m_recordSize;
+        const auto* records = reinterpret_cast<const ctsBinaryConnectionRecord*>(view.get() + header->m_headerSize);
+
+        const wil::unique_hfile outputFile{CreateFileW(
+            argv[2],
+            GENERIC_WRITE,
+            FILE_SHARE_READ,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr)};
+        THROW_LAST_ERROR_IF_MSG(!outputFile.is_valid(), "CreateFile(%ws)", argv[2]);
+
+        // the same UTF8 text and header ctsTraffic writes for csv connection files
+        string buffer;
+        buffer.reserve(c_writeThreshold + 1024);
+        buffer.append("\xEF\xBB\xBF");
+
+        auto isUdp = false;
+        for (size_t index = 0; index < recordCount; ++index)
+        {
+            if (records[index].m_recordType != ctsBinaryRecordType::ConnectionFailed)
+            {
+                isUdp = records[index].m_recordType == ctsBinaryRecordType::UdpResult;
+                break;
+            }
+        }
+        buffer.append(
+            isUdp ?
+            "TimeSlice,LocalAddress,RemoteAddress,Bits/Sec,Completed,Dropped,Repeated,Errors,Result,ConnectionId\r\n" :
+            "TimeSlice,LocalAddress,RemoteAddress,SendBytes,SendBps,RecvBytes,RecvBps,TimeMs,Result,ConnectionId\r\n");
+
+        for (size_t index = 0; index < recordCount; ++index)
+        {
+            AppendCsvRecord(records[index], buffer);
+            if (buffer.size() >= c_writeThreshold)
+            {
+                WriteBuffer(outputFile.get(), buffer);
+            }
+        }
+        WriteBuffer(outputFile.get(), buffer);
+
+        wprintf(L"Converted %zu connection records to %ws\n", recordCount, argv[2]);
+        return 0;
+    }
+    catch (const wil::ResultException& e)
+    {
+        wprintf(L"ctsLogConverter failed: %hs\n", e.what());
+        return e.GetErrorCode();
+    }
+    catch (const std::bad_alloc&)
+    {
+        wprintf(L"ctsLogConverter failed: Out of Memory\n");
+        return ERROR_OUTOFMEMORY;
+    }
+}
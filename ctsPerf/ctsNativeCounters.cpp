@@ -0,0 +1,560 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsNativeCounters.h"
+// cpp headers
+#include <cmath>
+#include <exception>
+#include <string>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <Psapi.h>
+#include <TlHelp32.h>
+// wil headers
+#include <wil/stl.h>
+#include <wil/resource.h>
+#include <wil/win32_helpers.h>
+// ctl headers
+#include <ctString.hpp>
+
+namespace ctsPerf
+{
+    // indexed as c_addressFamilies
+    constexpr PCWSTR c_ipClassNames[2]{L"TCPIP - IPv4", L"TCPIP - IPv6"};
+    constexpr PCWSTR c_tcpClassNames[2]{L"TCPIP - TCPv4", L"TCPIP - TCPv6"};
+    constexpr PCWSTR c_udpClassNames[2]{L"TCPIP - UDPv4", L"TCPIP - UDPv6"};
+
+    static double ToPercent(LONGLONG part, LONGLONG whole) noexcept
+    {
+        return whole > 0 ? static_cast<double>(part) * 100.0 / static_cast<double>(whole) : 0.0;
+    }
+
+    ctsNativeCounters::ctsNativeCounters(bool meanOnly, bool trackNetworking, const std::wstring& trackInterfaceDescription) :
+        m_meanOnly(meanOnly),
+        m_trackNetworking(trackNetworking)
+    {
+        LARGE_INTEGER frequency{};
+        QueryPerformanceFrequency(&frequency);
+        m_qpcFrequency = frequency.QuadPart;
+
+        // SystemProcessorPerformanceInformation returns the processors in the calling thread's processor group
+        SYSTEM_INFO systemInfo{};
+        GetSystemInfo(&systemInfo);
+        m_processorInformation.resize(systemInfo.dwNumberOfProcessors);
+        m_processorCounters.resize(systemInfo.dwNumberOfProcessors + 1);
+
+        if (!m_trackNetworking)
+        {
+            return;
+        }
+
+        PMIB_IF_TABLE2 interfaceTable{};
+        THROW_IF_WIN32_ERROR(GetIfTable2(&interfaceTable));
+        const auto freeTable = wil::scope_exit([&]() noexcept { FreeMibTable(interfaceTable); });
+
+        for (ULONG index = 0; index < interfaceTable->NumEntries; ++index)
+        {
+            const auto& row = interfaceTable->Table[index];
+            // by default only track the physical adapters, not the filter or pseudo-interfaces layered over them
+            const auto trackInterface = trackInterfaceDescription.empty() ?
+                row.InterfaceAndOperStatusFlags.HardwareInterface && !row.InterfaceAndOperStatusFlags.FilterInterface :
+                ctl::ctString::iordinal_equals(trackInterfaceDescription, row.Description);
+            if (trackInterface)
+            {
+                m_interfaces.emplace_back(row);
+            }
+        }
+        if (m_interfaces.empty())
+        {
+            throw std::exception("Unable to find an adapter to report on - GetIfTable2 returned no matching interfaces");
+        }
+        m_interfaceCounters.resize(m_interfaces.size());
+    }
+
+    ctsNativeCounters::~ctsNativeCounters() noexcept
+    {
+        Stop();
+    }
+
+    void ctsNativeCounters::TrackProcess(DWORD processId)
+    {
+        m_process.reset(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, processId));
+        THROW_LAST_ERROR_IF_MSG(!m_process, "OpenProcess (-pid:%u)", processId);
+    }
+
+    void ctsNativeCounters::TrackProcess(const std::wstring& processName)
+    {
+        const wil::unique_handle snapshot(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0));
+        THROW_LAST_ERROR_IF_MSG(!snapshot || snapshot.get() == INVALID_HANDLE_VALUE, "CreateToolhelp32Snapshot");
+
+        // the process name was given without its .exe extension
+        const auto imageName = processName + L".exe";
+        PROCESSENTRY32W processEntry{};
+        processEntry.dwSize = sizeof processEntry;
+        for (auto found = Process32FirstW(snapshot.get(), &processEntry); found; found = Process32NextW(snapshot.get(), &processEntry))
+        {
+            if (ctl::ctString::iordinal_equals(imageName, processEntry.szExeFile))
+            {
+                TrackProcess(processEntry.th32ProcessID);
+                return;
+            }
+        }
+
+        throw std::exception("Unable to find the process to report on - no running process has that name");
+    }
+
+    void ctsNativeCounters::Start(DWORD intervalMs)
+    {
+        m_stopEvent.create(wil::EventOptions::ManualReset);
+
+        // intervals shorter than the system clock tick (typically 15.6ms) need a high resolution timer
+        m_timer.reset(CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS));
+        if (!m_timer)
+        {
+            // high resolution timers are not supported before Windows 10 1803
+            m_timer.reset(CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS));
+            THROW_LAST_ERROR_IF_MSG(!m_timer, "CreateWaitableTimerEx");
+        }
+
+        // the first sample is the baseline for the rates calculated at the end of the first interval
+        TakeSample();
+
+        // a negative due time is relative, in 100ns units
+        LARGE_INTEGER dueTime{};
+        dueTime.QuadPart = -static_cast<LONGLONG>(intervalMs) * 10000LL;
+        THROW_IF_WIN32_BOOL_FALSE(SetWaitableTimer(m_timer.get(), &dueTime, static_cast<LONG>(intervalMs), nullptr, nullptr, FALSE));
+
+        m_samplingThread.reset(CreateThread(nullptr, 0, SamplingThread, this, 0, nullptr));
+        THROW_LAST_ERROR_IF_MSG(!m_samplingThread, "CreateThread");
+        // keep the samples on time when every processor is busy with the test being measured
+        SetThreadPriority(m_samplingThread.get(), THREAD_PRIORITY_HIGHEST);
+    }
+
+    void ctsNativeCounters::Stop() noexcept
+    {
+        if (!m_samplingThread)
+        {
+            return;
+        }
+
+        m_stopEvent.SetEvent();
+        WaitForSingleObject(m_samplingThread.get(), INFINITE);
+        m_samplingThread.reset();
+        CancelWaitableTimer(m_timer.get());
+    }
+
+    DWORD WINAPI ctsNativeCounters::SamplingThread(LPVOID context) noexcept
+    {
+        auto* const counters = static_cast<ctsNativeCounters*>(context);
+        const HANDLE waitHandles[2]{counters->m_stopEvent.get(), counters->m_timer.get()};
+        while (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+        {
+            counters->TakeSample();
+        }
+        return 0;
+    }
+
+    void ctsNativeCounters::AddRate(ctsRateCounter& counter, ULONGLONG value, LONGLONG qpc) const noexcept
+    {
+        if (counter.m_priorQpc != 0 && qpc > counter.m_priorQpc)
+        {
+            const auto elapsedSeconds = static_cast<double>(qpc - counter.m_priorQpc) / static_cast<double>(m_qpcFrequency);
+            counter.m_summary.Add(static_cast<double>(value - counter.m_priorValue) / elapsedSeconds);
+        }
+        counter.m_priorValue = value;
+        counter.m_priorQpc = qpc;
+    }
+
+    void ctsNativeCounters::AddDifference(ctsDifferenceCounter& counter, ULONGLONG value) noexcept
+    {
+        if (0 == counter.m_count)
+        {
+            counter.m_first = value;
+        }
+        counter.m_last = value;
+        ++counter.m_count;
+    }
+
+    void ctsNativeCounters::AddProcessorTimes(ctsProcessorCounters& counters, const ctsProcessorTimes& times) noexcept
+    {
+        if (counters.m_hasPriorTimes)
+        {
+            const auto idle = times.m_idle - counters.m_priorTimes.m_idle;
+            const auto kernel = times.m_kernel - counters.m_priorTimes.m_kernel;
+            const auto user = times.m_user - counters.m_priorTimes.m_user;
+            const auto dpc = times.m_dpc - counters.m_priorTimes.m_dpc;
+            const auto total = kernel + user;
+            // processor times are only updated on each clock tick: intervals shorter than a tick can see no change
+            if (total > 0)
+            {
+                counters.m_processorTime.Add(ToPercent(total - idle, total));
+                counters.m_dpcTime.Add(ToPercent(dpc, total));
+                counters.m_privilegedTime.Add(ToPercent(kernel - idle, total));
+                counters.m_userTime.Add(ToPercent(user, total));
+            }
+        }
+        counters.m_priorTimes = times;
+        counters.m_hasPriorTimes = true;
+    }
+
+    void ctsNativeCounters::TakeSample() noexcept
+    {
+        LARGE_INTEGER qpc{};
+        QueryPerformanceCounter(&qpc);
+
+        SampleProcessors();
+        SampleMemory();
+        if (m_trackNetworking)
+        {
+            SampleNetworkAdapters(qpc.QuadPart);
+            SampleIP();
+            SampleTCP();
+            SampleUDP(qpc.QuadPart);
+        }
+        if (m_process)
+        {
+            SampleProcess(qpc.QuadPart);
+        }
+    }
+
+    void ctsNativeCounters::SampleProcessors() noexcept
+    {
+        ULONG returnedLength{};
+        if (!NT_SUCCESS(NtQuerySystemInformation(
+            SystemProcessorPerformanceInformation,
+            m_processorInformation.data(),
+            static_cast<ULONG>(m_processorInformation.size() * sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION)),
+            &returnedLength)))
+        {
+            return;
+        }
+
+        ctsProcessorTimes totalTimes;
+        const auto processorCount = returnedLength / sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION);
+        for (size_t processor = 0; processor < processorCount; ++processor)
+        {
+            const auto& information = m_processorInformation[processor];
+            ctsProcessorTimes times;
+            times.m_idle = information.IdleTime.QuadPart;
+            times.m_kernel = information.KernelTime.QuadPart;
+            times.m_user = information.UserTime.QuadPart;
+            // winternl.h names the DPC time Reserved1[0] (followed by the interrupt time)
+            times.m_dpc = information.Reserved1[0].QuadPart;
+            AddProcessorTimes(m_processorCounters[processor], times);
+
+            totalTimes.m_idle += times.m_idle;
+            totalTimes.m_kernel += times.m_kernel;
+            totalTimes.m_user += times.m_user;
+            totalTimes.m_dpc += times.m_dpc;
+        }
+        AddProcessorTimes(*m_processorCounters.rbegin(), totalTimes);
+    }
+
+    void ctsNativeCounters::SampleMemory() noexcept
+    {
+        PERFORMANCE_INFORMATION performanceInformation{};
+        if (GetPerformanceInfo(&performanceInformation, sizeof performanceInformation))
+        {
+            m_pagedPoolBytes.Add(static_cast<double>(performanceInformation.KernelPaged * performanceInformation.PageSize));
+            m_nonPagedPoolBytes.Add(static_cast<double>(performanceInformation.KernelNonpaged * performanceInformation.PageSize));
+        }
+    }
+
+    void ctsNativeCounters::SampleNetworkAdapters(LONGLONG qpc) noexcept
+    {
+        for (size_t index = 0; index < m_interfaces.size(); ++index)
+        {
+            // the row already holds the InterfaceLuid identifying the interface to refresh
+            auto& row = m_interfaces[index];
+            if (GetIfEntry2(&row) != NO_ERROR)
+            {
+                continue;
+            }
+
+            auto& counters = m_interfaceCounters[index];
+            AddRate(counters.m_bytesTotalPerSecond, row.InOctets + row.OutOctets, qpc);
+            AddRate(counters.m_packetsPerSecond, row.InUcastPkts + row.InNUcastPkts + row.OutUcastPkts + row.OutNUcastPkts, qpc);
+            AddDifference(counters.m_packetsOutboundDiscarded, row.OutDiscards);
+            AddDifference(counters.m_packetsOutboundErrors, row.OutErrors);
+            AddDifference(counters.m_packetsReceivedDiscarded, row.InDiscards);
+            AddDifference(counters.m_packetsReceivedErrors, row.InErrors);
+            AddDifference(counters.m_packetsReceivedUnknown, row.InUnknownProtos);
+        }
+    }
+
+    void ctsNativeCounters::SampleIP() noexcept
+    {
+        for (size_t family = 0; family < 2; ++family)
+        {
+            MIB_IPSTATS ipStats{};
+            if (GetIpStatisticsEx(&ipStats, c_addressFamilies[family]) != NO_ERROR)
+            {
+                continue;
+            }
+
+            auto& counters = m_ipCounters[family];
+            AddDifference(counters.m_outboundDiscarded, ipStats.dwOutDiscards);
+            AddDifference(counters.m_outboundNoRoute, ipStats.dwOutNoRoutes);
+            AddDifference(counters.m_receivedAddressErrors, ipStats.dwInAddrErrors);
+            AddDifference(counters.m_receivedDiscarded, ipStats.dwInDiscards);
+            AddDifference(counters.m_receivedHeaderErrors, ipStats.dwInHdrErrors);
+            AddDifference(counters.m_receivedUnknownProtocol, ipStats.dwInUnknownProtos);
+            AddDifference(counters.m_fragmentReassemblyFailures, ipStats.dwReasmFails);
+            AddDifference(counters.m_fragmentationFailures, ipStats.dwFragFails);
+        }
+    }
+
+    void ctsNativeCounters::SampleTCP() noexcept
+    {
+        for (size_t family = 0; family < 2; ++family)
+        {
+            MIB_TCPSTATS tcpStats{};
+            if (GetTcpStatisticsEx(&tcpStats, c_addressFamilies[family]) != NO_ERROR)
+            {
+                continue;
+            }
+
+            auto& counters = m_tcpCounters[family];
+            counters.m_connectionsEstablished.Add(static_cast<double>(tcpStats.dwCurrEstab));
+            AddDifference(counters.m_connectionFailures, tcpStats.dwAttemptFails);
+            AddDifference(counters.m_connectionsReset, tcpStats.dwEstabResets);
+        }
+    }
+
+    void ctsNativeCounters::SampleUDP(LONGLONG qpc) noexcept
+    {
+        for (size_t family = 0; family < 2; ++family)
+        {
+            MIB_UDPSTATS2 udpStats{};
+            if (GetUdpStatisticsEx2(&udpStats, c_addressFamilies[family]) != NO_ERROR)
+            {
+                continue;
+            }
+
+            auto& counters = m_udpCounters[family];
+            AddRate(counters.m_noPortPerSecond, udpStats.dwNoPorts, qpc);
+            AddRate(counters.m_datagramsPerSecond, udpStats.dw64InDatagrams + udpStats.dw64OutDatagrams, qpc);
+            AddDifference(counters.m_receivedErrors, udpStats.dwInErrors);
+        }
+    }
+
+    void ctsNativeCounters::SampleProcess(LONGLONG qpc) noexcept
+    {
+        FILETIME creationTime{};
+        FILETIME exitTime{};
+        FILETIME kernelTime{};
+        FILETIME userTime{};
+        if (GetProcessTimes(m_process.get(), &creationTime, &exitTime, &kernelTime, &userTime))
+        {
+            const auto kernel = wil::filetime::to_int64(kernelTime);
+            const auto user = wil::filetime::to_int64(userTime);
+            auto& counters = m_processCounters;
+            if (counters.m_priorQpc != 0 && qpc > counters.m_priorQpc)
+            {
+                // as the WMI counters, a percentage of a single processor (can exceed 100 across multiple processors)
+                const auto elapsed = static_cast<LONGLONG>(
+                    static_cast<double>(qpc - counters.m_priorQpc) * static_cast<double>(wil::filetime_duration::one_second) / static_cast<double>(m_qpcFrequency));
+                const auto kernelDelta = static_cast<LONGLONG>(kernel - counters.m_priorKernelTime);
+                const auto userDelta = static_cast<LONGLONG>(user - counters.m_priorUserTime);
+                counters.m_privilegedTime.Add(ToPercent(kernelDelta, elapsed));
+                counters.m_userTime.Add(ToPercent(userDelta, elapsed));
+                counters.m_processorTime.Add(ToPercent(kernelDelta + userDelta, elapsed));
+            }
+            counters.m_priorKernelTime = kernel;
+            counters.m_priorUserTime = user;
+            counters.m_priorQpc = qpc;
+        }
+
+        PROCESS_MEMORY_COUNTERS_EX memoryCounters{};
+        if (GetProcessMemoryInfo(m_process.get(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&memoryCounters), sizeof memoryCounters))
+        {
+            m_processCounters.m_privateBytes.Add(static_cast<double>(memoryCounters.PrivateUsage));
+            m_processCounters.m_workingSet.Add(static_cast<double>(memoryCounters.WorkingSetSize));
+        }
+    }
+
+    void ctsNativeCounters::WriteSummary(ctsWriteDetails& writer, _In_ PCWSTR className, _In_ PCWSTR counterName, const ctl::ctSampleSummary& summary) const
+    {
+        if (m_meanOnly)
+        {
+            // the same [count, min, max, mean] as ctWmiPerformanceCollectionType::MeanOnly
+            const auto& statistics = summary.GetStatistics();
+            if (0 == statistics.GetCount())
+            {
+                return;
+            }
+            const std::vector<ULONGLONG> meanData{
+                statistics.GetCount(),
+                static_cast<ULONGLONG>(std::llround(statistics.GetMin())),
+                static_cast<ULONGLONG>(std::llround(statistics.GetMax())),
+                static_cast<ULONGLONG>(std::llround(statistics.GetMean()))};
+            writer.WriteMean(className, counterName, meanData);
+        }
+        else
+        {
+            writer.WriteDetails(className, counterName, summary);
+        }
+    }
+
+    void ctsNativeCounters::WriteDifference(ctsWriteDetails& writer, _In_ PCWSTR className, _In_ PCWSTR counterName, const ctsDifferenceCounter& counter)
+    {
+        if (0 == counter.m_count)
+        {
+            return;
+        }
+        // the same [count, first, last] as ctWmiPerformanceCollectionType::FirstLast
+        const std::vector<ULONGLONG> differenceData{counter.m_count, counter.m_first, counter.m_last};
+        writer.WriteDifference(className, counterName, differenceData);
+    }
+
+    void ctsNativeCounters::WriteProcessorCounters(ctsWriteDetails& writer) const
+    {
+        for (size_t processor = 0; processor < m_processorCounters.size(); ++processor)
+        {
+            const auto& counters = m_processorCounters[processor];
+            if (!counters.m_hasPriorTimes)
+            {
+                // processors beyond those returned for this processor group
+                continue;
+            }
+
+            writer.WriteRow(
+                processor + 1 == m_processorCounters.size() ?
+                std::wstring(L"Processor _Total") :
+                wil::str_printf<std::wstring>(L"Processor %zu", processor));
+
+            WriteSummary(writer, L"Processor", L"Raw CPU Usage", counters.m_processorTime);
+            WriteSummary(writer, L"Processor", L"Percent DPC Time", counters.m_dpcTime);
+            WriteSummary(writer, L"Processor", L"Percent Privileged Time", counters.m_privilegedTime);
+            WriteSummary(writer, L"Processor", L"Percent User Time", counters.m_userTime);
+        }
+
+        writer.WriteEmptyRow();
+    }
+
+    void ctsNativeCounters::WriteMemoryCounters(ctsWriteDetails& writer) const
+    {
+        WriteSummary(writer, L"Memory", L"PoolPagedBytes", m_pagedPoolBytes);
+        WriteSummary(writer, L"Memory", L"PoolNonpagedBytes", m_nonPagedPoolBytes);
+    }
+
+    void ctsNativeCounters::WriteNetworkAdapterCounters(ctsWriteDetails& writer) const
+    {
+        writer.WriteRow(L"NetworkAdapter");
+        for (size_t index = 0; index < m_interfaces.size(); ++index)
+        {
+            const auto* const name = m_interfaces[index].Description;
+            const auto& counters = m_interfaceCounters[index];
+
+            WriteSummary(
+                writer,
+                L"NetworkAdapter",
+                wil::str_printf<std::wstring>(L"PacketsPersec for interface %ws", name).c_str(),
+                counters.m_packetsPerSecond.m_summary);
+            WriteSummary(
+                writer,
+                L"NetworkAdapter",
+                wil::str_printf<std::wstring>(L"BytesTotalPersec for interface %ws", name).c_str(),
+                counters.m_bytesTotalPerSecond.m_summary);
+            WriteDifference(
+                writer,
+                L"NetworkAdapter",
+                wil::str_printf<std::wstring>(L"PacketsOutboundDiscarded for interface %ws", name).c_str(),
+                counters.m_packetsOutboundDiscarded);
+            WriteDifference(
+                writer,
+                L"NetworkAdapter",
+                wil::str_printf<std::wstring>(L"PacketsOutboundErrors for interface %ws", name).c_str(),
+                counters.m_packetsOutboundErrors);
+            WriteDifference(
+                writer,
+                L"NetworkAdapter",
+                wil::str_printf<std::wstring>(L"PacketsReceivedDiscarded for interface %ws", name).c_str(),
+                counters.m_packetsReceivedDiscarded);
+            WriteDifference(
+                writer,
+                L"NetworkAdapter",
+                wil::str_printf<std::wstring>(L"PacketsReceivedErrors for interface %ws", name).c_str(),
+                counters.m_packetsReceivedErrors);
+            WriteDifference(
+                writer,
+                L"NetworkAdapter",
+                wil::str_printf<std::wstring>(L"PacketsReceivedUnknown for interface %ws", name).c_str(),
+                counters.m_packetsReceivedUnknown);
+
+            writer.WriteEmptyRow();
+        }
+    }
+
+    void ctsNativeCounters::WriteIPCounters(ctsWriteDetails& writer) const
+    {
+        writer.WriteRow(L"TCPIP - IPv4");
+        for (size_t family = 0; family < 2; ++family)
+        {
+            const auto& counters = m_ipCounters[family];
+            WriteDifference(writer, c_ipClassNames[family], L"DatagramsOutboundDiscarded", counters.m_outboundDiscarded);
+            WriteDifference(writer, c_ipClassNames[family], L"DatagramsOutboundNoRoute", counters.m_outboundNoRoute);
+            WriteDifference(writer, c_ipClassNames[family], L"DatagramsReceivedAddressErrors", counters.m_receivedAddressErrors);
+            WriteDifference(writer, c_ipClassNames[family], L"DatagramsReceivedDiscarded", counters.m_receivedDiscarded);
+            WriteDifference(writer, c_ipClassNames[family], L"DatagramsReceivedHeaderErrors", counters.m_receivedHeaderErrors);
+            WriteDifference(writer, c_ipClassNames[family], L"DatagramsReceivedUnknownProtocol", counters.m_receivedUnknownProtocol);
+            WriteDifference(writer, c_ipClassNames[family], L"FragmentReassemblyFailures", counters.m_fragmentReassemblyFailures);
+            WriteDifference(writer, c_ipClassNames[family], L"FragmentationFailures", counters.m_fragmentationFailures);
+        }
+
+        writer.WriteEmptyRow();
+    }
+
+    void ctsNativeCounters::WriteTCPCounters(ctsWriteDetails& writer) const
+    {
+        writer.WriteRow(L"TCPIP - TCPv4");
+        for (size_t family = 0; family < 2; ++family)
+        {
+            WriteSummary(writer, c_tcpClassNames[family], L"ConnectionsEstablished", m_tcpCounters[family].m_connectionsEstablished);
+        }
+        for (size_t family = 0; family < 2; ++family)
+        {
+            WriteDifference(writer, c_tcpClassNames[family], L"ConnectionFailures", m_tcpCounters[family].m_connectionFailures);
+        }
+        for (size_t family = 0; family < 2; ++family)
+        {
+            WriteDifference(writer, c_tcpClassNames[family], L"ConnectionsReset", m_tcpCounters[family].m_connectionsReset);
+        }
+
+        writer.WriteEmptyRow();
+    }
+
+    void ctsNativeCounters::WriteUDPCounters(ctsWriteDetails& writer) const
+    {
+        for (size_t family = 0; family < 2; ++family)
+        {
+            const auto& counters = m_udpCounters[family];
+            writer.WriteRow(c_udpClassNames[family]);
+            WriteSummary(writer, c_udpClassNames[family], L"DatagramsNoPortPersec", counters.m_noPortPerSecond.m_summary);
+            WriteSummary(writer, c_udpClassNames[family], L"DatagramsPersec", counters.m_datagramsPerSecond.m_summary);
+            WriteDifference(writer, c_udpClassNames[family], L"DatagramsReceivedErrors", counters.m_receivedErrors);
+            writer.WriteEmptyRow();
+        }
+    }
+
+    void ctsNativeCounters::WritePerProcessCounters(_In_ PCWSTR className, ctsWriteDetails& writer) const
+    {
+        WriteSummary(writer, className, L"PercentPrivilegedTime", m_processCounters.m_privilegedTime);
+        WriteSummary(writer, className, L"PercentProcessorTime", m_processCounters.m_processorTime);
+        WriteSummary(writer, className, L"PercentUserTime", m_processCounters.m_userTime);
+        WriteSummary(writer, className, L"PrivateBytes", m_processCounters.m_privateBytes);
+        WriteSummary(writer, className, L"WorkingSet", m_processCounters.m_workingSet);
+    }
+}
@@ -0,0 +1,216 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <string>
+#include <vector>
+// os headers
+#include <Windows.h>
+// Winsock2 is needed for IPHelper headers
+// ReSharper disable once CppUnusedIncludeDirective
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+#include <iphlpapi.h>
+#include <winternl.h>
+// wil headers
+#include <wil/resource.h>
+// project headers
+#include "ctMath.hpp"
+#include "ctsWriteDetails.h"
+
+
+namespace ctsPerf
+{
+    ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    ///
+    /// ctsNativeCounters
+    ///
+    /// Collects the processor, memory, network adapter, IP, TCP, UDP, and per-process counters
+    /// directly from the APIs the WMI performance classes are built on, without WMI
+    /// - every buffer is allocated in the constructor: a sample only reads into them and updates
+    ///   bounded-memory summaries, so it can run at a 10ms interval next to a loaded test
+    /// - rates and percentages are calculated from the change since the prior sample
+    /// - rows are written with the same class and counter names, and the same columns, as the WMI counters
+    ///
+    /// Counters which have no source outside of WMI are not collected:
+    ///   PercentofMaximumFrequency, DPCsQueuedPersec, OffloadedConnections, TCPActiveRSCConnections,
+    ///   the Winsock rejected connections and dropped datagrams, and the process VirtualBytes
+    ///
+    ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    class ctsNativeCounters
+    {
+    public:
+        ctsNativeCounters(bool meanOnly, bool trackNetworking, const std::wstring& trackInterfaceDescription);
+        ~ctsNativeCounters() noexcept;
+
+        ctsNativeCounters(const ctsNativeCounters&) = delete;
+        ctsNativeCounters& operator=(const ctsNativeCounters&) = delete;
+        ctsNativeCounters(ctsNativeCounters&&) = delete;
+        ctsNativeCounters& operator=(ctsNativeCounters&&) = delete;
+
+        // must be called before Start()
+        // - by name, the first process found with that image name is tracked
+        void TrackProcess(DWORD processId);
+        void TrackProcess(const std::wstring& processName);
+
+        void Start(DWORD intervalMs);
+        void Stop() noexcept;
+
+        // must only be called after Stop()
+        void WriteProcessorCounters(ctsWriteDetails& writer) const;
+        void WriteMemoryCounters(ctsWriteDetails& writer) const;
+        void WriteNetworkAdapterCounters(ctsWriteDetails& writer) const;
+        void WriteIPCounters(ctsWriteDetails& writer) const;
+        void WriteTCPCounters(ctsWriteDetails& writer) const;
+        void WriteUDPCounters(ctsWriteDetails& writer) const;
+        void WritePerProcessCounters(_In_ PCWSTR className, ctsWriteDetails& writer) const;
+
+    private:
+        // a counter reported as its change per second between samples
+        struct ctsRateCounter
+        {
+            ctl::ctSampleSummary m_summary;
+            ULONGLONG m_priorValue = 0;
+            // zero until the first value is added
+            LONGLONG m_priorQpc = 0;
+        };
+
+        // a counter reported as the change from the first to the last sample (ctWmiPerformanceCollectionType::FirstLast)
+        struct ctsDifferenceCounter
+        {
+            ULONGLONG m_count = 0;
+            ULONGLONG m_first = 0;
+            ULONGLONG m_last = 0;
+        };
+
+        // 100ns units, as reported for each processor
+        struct ctsProcessorTimes
+        {
+            LONGLONG m_idle = 0;
+            // includes the idle and DPC time
+            LONGLONG m_kernel = 0;
+            LONGLONG m_user = 0;
+            LONGLONG m_dpc = 0;
+        };
+
+        struct ctsProcessorCounters
+        {
+            ctl::ctSampleSummary m_processorTime;
+            ctl::ctSampleSummary m_dpcTime;
+            ctl::ctSampleSummary m_privilegedTime;
+            ctl::ctSampleSummary m_userTime;
+            ctsProcessorTimes m_priorTimes;
+            bool m_hasPriorTimes = false;
+        };
+
+        struct ctsInterfaceCounters
+        {
+            ctsRateCounter m_bytesTotalPerSecond;
+            ctsRateCounter m_packetsPerSecond;
+            ctsDifferenceCounter m_packetsOutboundDiscarded;
+            ctsDifferenceCounter m_packetsOutboundErrors;
+            ctsDifferenceCounter m_packetsReceivedDiscarded;
+            ctsDifferenceCounter m_packetsReceivedErrors;
+            ctsDifferenceCounter m_packetsReceivedUnknown;
+        };
+
+        struct ctsIpCounters
+        {
+            ctsDifferenceCounter m_outboundDiscarded;
+            ctsDifferenceCounter m_outboundNoRoute;
+            ctsDifferenceCounter m_receivedAddressErrors;
+            ctsDifferenceCounter m_receivedDiscarded;
+            ctsDifferenceCounter m_receivedHeaderErrors;
+            ctsDifferenceCounter m_receivedUnknownProtocol;
+            ctsDifferenceCounter m_fragmentReassemblyFailures;
+            ctsDifferenceCounter m_fragmentationFailures;
+        };
+
+        struct ctsTcpCounters
+        {
+            ctl::ctSampleSummary m_connectionsEstablished;
+            ctsDifferenceCounter m_connectionFailures;
+            ctsDifferenceCounter m_connectionsReset;
+        };
+
+        struct ctsUdpCounters
+        {
+            ctsRateCounter m_noPortPerSecond;
+            ctsRateCounter m_datagramsPerSecond;
+            ctsDifferenceCounter m_receivedErrors;
+        };
+
+        struct ctsProcessCounters
+        {
+            ctl::ctSampleSummary m_privilegedTime;
+            ctl::ctSampleSummary m_processorTime;
+            ctl::ctSampleSummary m_userTime;
+            ctl::ctSampleSummary m_privateBytes;
+            ctl::ctSampleSummary m_workingSet;
+            ULONGLONG m_priorKernelTime = 0;
+            ULONGLONG m_priorUserTime = 0;
+            // zero until the first sample
+            LONGLONG m_priorQpc = 0;
+        };
+
+        // index 0 is IPv4, index 1 is IPv6
+        static constexpr ADDRESS_FAMILY c_addressFamilies[2]{AF_INET, AF_INET6};
+
+        static DWORD WINAPI SamplingThread(LPVOID context) noexcept;
+
+        void AddRate(ctsRateCounter& counter, ULONGLONG value, LONGLONG qpc) const noexcept;
+        static void AddDifference(ctsDifferenceCounter& counter, ULONGLONG value) noexcept;
+        static void AddProcessorTimes(ctsProcessorCounters& counters, const ctsProcessorTimes& times) noexcept;
+
+        void TakeSample() noexcept;
+        void SampleProcessors() noexcept;
+        void SampleMemory() noexcept;
+        void SampleNetworkAdapters(LONGLONG qpc) noexcept;
+        void SampleIP() noexcept;
+        void SampleTCP() noexcept;
+        void SampleUDP(LONGLONG qpc) noexcept;
+        void SampleProcess(LONGLONG qpc) noexcept;
+
+        void WriteSummary(ctsWriteDetails& writer, _In_ PCWSTR className, _In_ PCWSTR counterName, const ctl::ctSampleSummary& summary) const;
+        static void WriteDifference(ctsWriteDetails& writer, _In_ PCWSTR className, _In_ PCWSTR counterName, const ctsDifferenceCounter& counter);
+
+        const bool m_meanOnly;
+        const bool m_trackNetworking;
+        LONGLONG m_qpcFrequency = 0;
+
+        // all buffers are only accessed by the sampling thread between Start() and Stop()
+        std::vector<SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION> m_processorInformation;
+        // the last entry is the _Total of all processors
+        std::vector<ctsProcessorCounters> m_processorCounters;
+
+        ctl::ctSampleSummary m_pagedPoolBytes;
+        ctl::ctSampleSummary m_nonPagedPoolBytes;
+
+        // each row is refreshed in place by GetIfEntry2
+        std::vector<MIB_IF_ROW2> m_interfaces;
+        std::vector<ctsInterfaceCounters> m_interfaceCounters;
+
+        ctsIpCounters m_ipCounters[2]{};
+        ctsTcpCounters m_tcpCounters[2]{};
+        ctsUdpCounters m_udpCounters[2]{};
+
+        wil::unique_handle m_process;
+        ctsProcessCounters m_processCounters;
+
+        wil::unique_event m_stopEvent;
+        wil::unique_handle m_timer;
+        wil::unique_handle m_samplingThread;
+    };
+}
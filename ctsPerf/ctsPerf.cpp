@@ -14,6 +14,8 @@ See the Apache Version 2.0 License for specific language governing permissions a
 // cpp headers
 #include <cstdio>
 #include <cwchar>
+#include <algorithm>
+#include <map>
 #include <vector>
 #include <string>
 #include <memory>
@@ -30,6 +32,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 // project headers
 #include "ctsWriteDetails.h"
 #include "ctsEstats.h"
+#include "ctsNativeCounters.h"
 
 using namespace std;
 using namespace ctl;
@@ -50,6 +53,10 @@ constexpr PCWSTR c_usageStatement =
     L" -Networking [will enable performance and reliability related Network counters]\n"
     L" -Estats [will enable ESTATS tracking for all TCP connections]\n"
     L" -MeanOnly  [will save memory by not storing every data point, only a sum and mean\n"
+    L" -Native [will read the counters directly from the OS instead of through WMI\n"
+    L"          - sampling is lightweight enough for intervals as short as 10 milliseconds\n"
+    L"          - counters only available through WMI are not collected]\n"
+    L" -Interval:#### [the milliseconds between samples]  [default is 1000 milliseconds]\n"
     L"\n"
     L" [optionally the specific interface description can be specified\n"
     L"  by default *all* interface counters are collected]\n"
@@ -74,6 +81,9 @@ constexpr PCWSTR c_usageStatement =
     L"\n"
     L"> ctsPerf.exe -pid:2048\n"
     L"  -- will capture processor and memory + process counters for process id 2048 for 60 seconds"
+    L"\n"
+    L"> ctsPerf.exe -Networking -Native -Interval:10\n"
+    L"  -- will capture processor, memory, and networking counters every 10 milliseconds without WMI"
     L"\n";
 
 // 0 is a possible process ID
@@ -118,6 +128,22 @@ void ProcessIPCounters(ctsPerf::ctsWriteDetails& writer);
 void ProcessTCPCounters(ctsPerf::ctsWriteDetails& writer);
 void ProcessUDPCounters(ctsPerf::ctsWriteDetails& writer);
 void ProcessPerProcessCounters(const wstring& trackProcess, DWORD processId, ctsPerf::ctsWriteDetails& writer);
+wstring PerProcessClassName(const wstring& trackProcess, DWORD processId);
+
+void CollectWmiCounters(
+    bool trackNetworking,
+    const wstring& trackInterfaceDescription,
+    const wstring& trackProcess,
+    DWORD processId,
+    DWORD sampleIntervalMs,
+    DWORD timeToRunMs);
+void CollectNativeCounters(
+    bool trackNetworking,
+    const wstring& trackInterfaceDescription,
+    const wstring& trackProcess,
+    DWORD processId,
+    DWORD sampleIntervalMs,
+    DWORD timeToRunMs);
 
 PCWSTR g_fileName = L"ctsPerf.csv";
 PCWSTR g_networkingFilename = L"ctsNetworking.csv";
@@ -152,11 +178,13 @@ int __cdecl wmain(_In_ int argc, _In_reads_z_(argc) const wchar_t** argv)
 
     auto trackNetworking = false;
     auto trackEstats = false;
+    auto useNative = false;
 
     wstring trackInterfaceDescription;
     wstring trackProcess;
     auto processId = c_uninitializedProcessId;
     DWORD timeToRunMs = 60000; // default to 60 seconds
+    DWORD sampleIntervalMs = 1000; // default to 1 second
 
     for (DWORD argCount = argc; argCount > 1; --argCount)
     {
@@ -224,6 +252,26 @@ int __cdecl wmain(_In_ int argc, _In_reads_z_(argc) const wchar_t** argv)
         {
             g_meanOnly = true;
         }
+        else if (ctString::istarts_with(argv[argCount - 1], L"-Native"))
+        {
+            useNative = true;
+        }
+        else if (ctString::istarts_with(argv[argCount - 1], L"-Interval:"))
+        {
+            wstring intervalString(argv[argCount - 1]);
+
+            // strip off the "-Interval:" preface to the string
+            const auto endOfToken = ranges::find(intervalString, L':');
+            intervalString.erase(intervalString.begin(), endOfToken + 1);
+
+            sampleIntervalMs = wcstoul(intervalString.c_str(), nullptr, 10);
+            if (sampleIntervalMs == 0 || sampleIntervalMs == ULONG_MAX)
+            {
+                wprintf(L"Incorrect option: %ws\n", argv[argCount - 1]);
+                wprintf(c_usageStatement);
+                return 1;
+            }
+        }
         else
         {
             const auto timeToRun = wcstoul(argv[argCount - 1], nullptr, 10);
@@ -243,8 +291,6 @@ int __cdecl wmain(_In_ int argc, _In_reads_z_(argc) const wchar_t** argv)
         }
     }
 
-    const auto trackPerProcess = !trackProcess.empty() || processId != c_uninitializedProcessId;
-
     if (timeToRunMs <= 5000)
     {
         wprintf(L"ERROR: Must run over 5 seconds to have enough samples for analysis\n");
@@ -268,99 +314,180 @@ int __cdecl wmain(_In_ int argc, _In_reads_z_(argc) const wchar_t** argv)
             }
         }
 
-        wprintf(L"Instantiating WMI Performance objects (this can take a few seconds)\n");
-        const auto coInit = wil::CoInitializeEx();
-        const ctWmiService wmi(L"root\\cimv2");
-        g_wmi = &wmi;
-
-        auto deleteAllCounters = wil::scope_exit([&]() noexcept { DeleteAllCounters(); });
-
-        ctsPerf::ctsWriteDetails cpuwriter(g_fileName);
-        cpuwriter.CreateFile(g_meanOnly);
-
-        ctsPerf::ctsWriteDetails networkWriter(g_networkingFilename);
-        if (trackNetworking)
+        if (useNative)
         {
-            networkWriter.CreateFile(g_meanOnly);
+            CollectNativeCounters(trackNetworking, trackInterfaceDescription, trackProcess, processId, sampleIntervalMs, timeToRunMs);
         }
-
-        ctsPerf::ctsWriteDetails processWriter(g_processFilename);
-        if (trackPerProcess)
+        else
         {
-            processWriter.CreateFile(g_meanOnly);
+            CollectWmiCounters(trackNetworking, trackInterfaceDescription, trackProcess, processId, sampleIntervalMs, timeToRunMs);
         }
+    }
+    catch (const wil::ResultException& e)
+    {
+        wprintf(L"ctsPerf exception: %hs\n", e.what());
+        return 1;
+    }
+    catch (const exception& e)
+    {
+        wprintf(L"ctsPerf exception: %hs\n", e.what());
+        return 1;
+    }
 
-        wprintf(L".");
+    CloseHandle(g_break);
 
-        // create a perf counter objects to maintain these counters
-        std::vector<ctWmiPerformance> performanceVector;
+    return 0;
+}
 
-        performanceVector.emplace_back(InstantiateProcessorCounters());
-        performanceVector.emplace_back(InstantiateMemoryCounters());
+void CollectWmiCounters(
+    bool trackNetworking,
+    const wstring& trackInterfaceDescription,
+    const wstring& trackProcess,
+    DWORD processId,
+    DWORD sampleIntervalMs,
+    DWORD timeToRunMs)
+{
+    const auto trackPerProcess = !trackProcess.empty() || processId != c_uninitializedProcessId;
 
-        if (trackNetworking)
-        {
-            performanceVector.emplace_back(InstantiateNetworkAdapterCounters(trackInterfaceDescription));
-            performanceVector.emplace_back(InstantiateNetworkInterfaceCounters(trackInterfaceDescription));
-            performanceVector.emplace_back(InstantiateIPCounters());
-            performanceVector.emplace_back(InstantiateTCPCounters());
-            performanceVector.emplace_back(InstantiateUDPCounters());
-        }
+    wprintf(L"Instantiating WMI Performance objects (this can take a few seconds)\n");
+    const auto coInit = wil::CoInitializeEx();
+    const ctWmiService wmi(L"root\\cimv2");
+    g_wmi = &wmi;
 
-        if (!trackProcess.empty())
-        {
-            performanceVector.emplace_back(InstantiatePerProcessByNameCounters(trackProcess));
-        }
-        else if (processId != c_uninitializedProcessId)
-        {
-            performanceVector.emplace_back(InstantiatePerProcessByPIDCounters(processId));
-        }
+    auto deleteAllCounters = wil::scope_exit([&]() noexcept { DeleteAllCounters(); });
 
-        wprintf(L"\nStarting counters : will run for %lu seconds\n (hit ctrl-c to exit early) ...\n\n", timeToRunMs / 1000UL);
-        for (auto& perfObject : performanceVector)
-        {
-            perfObject.start_all_counters(1000);
-        }
+    ctsPerf::ctsWriteDetails cpuwriter(g_fileName);
+    cpuwriter.CreateFile(g_meanOnly);
 
-        WaitForSingleObject(g_break, timeToRunMs);
+    ctsPerf::ctsWriteDetails networkWriter(g_networkingFilename);
+    if (trackNetworking)
+    {
+        networkWriter.CreateFile(g_meanOnly);
+    }
 
-        wprintf(L"Stopping counters ....\n\n");
-        for (auto& perfObject : performanceVector)
-        {
-            perfObject.stop_all_counters();
-        }
+    ctsPerf::ctsWriteDetails processWriter(g_processFilename);
+    if (trackPerProcess)
+    {
+        processWriter.CreateFile(g_meanOnly);
+    }
 
-        ProcessProcessorCounters(cpuwriter);
-        ProcessMemoryCounters(cpuwriter);
+    wprintf(L".");
 
-        if (trackNetworking)
-        {
-            ProcessNetworkAdapterCounters(networkWriter);
-            ProcessNetworkInterfaceCounters(networkWriter);
-            ProcessIPCounters(networkWriter);
-            ProcessTCPCounters(networkWriter);
-            ProcessUDPCounters(networkWriter);
-        }
+    // create a perf counter objects to maintain these counters
+    std::vector<ctWmiPerformance> performanceVector;
 
-        if (trackPerProcess)
-        {
-            ProcessPerProcessCounters(trackProcess, processId, processWriter);
-        }
+    performanceVector.emplace_back(InstantiateProcessorCounters());
+    performanceVector.emplace_back(InstantiateMemoryCounters());
+
+    if (trackNetworking)
+    {
+        performanceVector.emplace_back(InstantiateNetworkAdapterCounters(trackInterfaceDescription));
+        performanceVector.emplace_back(InstantiateNetworkInterfaceCounters(trackInterfaceDescription));
+        performanceVector.emplace_back(InstantiateIPCounters());
+        performanceVector.emplace_back(InstantiateTCPCounters());
+        performanceVector.emplace_back(InstantiateUDPCounters());
     }
-    catch (const wil::ResultException& e)
+
+    if (!trackProcess.empty())
     {
-        wprintf(L"ctsPerf exception: %hs\n", e.what());
-        return 1;
+        performanceVector.emplace_back(InstantiatePerProcessByNameCounters(trackProcess));
     }
-    catch (const exception& e)
+    else if (processId != c_uninitializedProcessId)
     {
-        wprintf(L"ctsPerf exception: %hs\n", e.what());
-        return 1;
+        performanceVector.emplace_back(InstantiatePerProcessByPIDCounters(processId));
     }
 
-    CloseHandle(g_break);
+    wprintf(L"\nStarting counters : will run for %lu seconds\n (hit ctrl-c to exit early) ...\n\n", timeToRunMs / 1000UL);
+    for (auto& perfObject : performanceVector)
+    {
+        perfObject.start_all_counters(sampleIntervalMs);
+    }
 
-    return 0;
+    WaitForSingleObject(g_break, timeToRunMs);
+
+    wprintf(L"Stopping counters ....\n\n");
+    for (auto& perfObject : performanceVector)
+    {
+        perfObject.stop_all_counters();
+    }
+
+    ProcessProcessorCounters(cpuwriter);
+    ProcessMemoryCounters(cpuwriter);
+
+    if (trackNetworking)
+    {
+        ProcessNetworkAdapterCounters(networkWriter);
+        ProcessNetworkInterfaceCounters(networkWriter);
+        ProcessIPCounters(networkWriter);
+        ProcessTCPCounters(networkWriter);
+        ProcessUDPCounters(networkWriter);
+    }
+
+    if (trackPerProcess)
+    {
+        ProcessPerProcessCounters(trackProcess, processId, processWriter);
+    }
+}
+
+void CollectNativeCounters(
+    bool trackNetworking,
+    const wstring& trackInterfaceDescription,
+    const wstring& trackProcess,
+    DWORD processId,
+    DWORD sampleIntervalMs,
+    DWORD timeToRunMs)
+{
+    const auto trackPerProcess = !trackProcess.empty() || processId != c_uninitializedProcessId;
+
+    ctsPerf::ctsWriteDetails cpuwriter(g_fileName);
+    cpuwriter.CreateFile(g_meanOnly);
+
+    ctsPerf::ctsWriteDetails networkWriter(g_networkingFilename);
+    if (trackNetworking)
+    {
+        networkWriter.CreateFile(g_meanOnly);
+    }
+
+    ctsPerf::ctsWriteDetails processWriter(g_processFilename);
+    if (trackPerProcess)
+    {
+        processWriter.CreateFile(g_meanOnly);
+    }
+
+    // the counters keep a fixed-size summary of each counter: too large for the stack
+    const auto counters = std::make_unique<ctsPerf::ctsNativeCounters>(g_meanOnly, trackNetworking, trackInterfaceDescription);
+    if (!trackProcess.empty())
+    {
+        counters->TrackProcess(trackProcess);
+    }
+    else if (processId != c_uninitializedProcessId)
+    {
+        counters->TrackProcess(processId);
+    }
+
+    wprintf(L"Starting counters : will run for %lu seconds, sampling every %lu milliseconds\n (hit ctrl-c to exit early) ...\n\n", timeToRunMs / 1000UL, sampleIntervalMs);
+    counters->Start(sampleIntervalMs);
+
+    WaitForSingleObject(g_break, timeToRunMs);
+
+    wprintf(L"Stopping counters ....\n\n");
+    counters->Stop();
+
+    counters->WriteProcessorCounters(cpuwriter);
+    counters->WriteMemoryCounters(cpuwriter);
+
+    if (trackNetworking)
+    {
+        counters->WriteNetworkAdapterCounters(networkWriter);
+        counters->WriteIPCounters(networkWriter);
+        counters->WriteTCPCounters(networkWriter);
+        counters->WriteUDPCounters(networkWriter);
+    }
+
+    if (trackPerProcess)
+    {
+        counters->WritePerProcessCounters(PerProcessClassName(trackProcess, processId).c_str(), processWriter);
+    }
 }
 
 
@@ -373,6 +500,9 @@ shared_ptr<ctWmiPerformanceCounter<ULONGLONG>> g_processorPercentDpcTime;
 shared_ptr<ctWmiPerformanceCounter<ULONG>> g_processorDpcsQueuedPerSecond;
 shared_ptr<ctWmiPerformanceCounter<ULONGLONG>> g_processorPercentPrivilegedTime;
 shared_ptr<ctWmiPerformanceCounter<ULONGLONG>> g_processorPercentUserTime;
+// PercentProcessorTime * PercentofMaximumFrequency, summarized per sample for each processor
+// - only updated from the timer callback while the counters are running
+map<wstring, ctSampleSummary> g_processorNormalizedTime; // NOLINT(clang-diagnostic-exit-time-destructors)
 
 ctWmiPerformance InstantiateProcessorCounters()
 {
@@ -383,7 +513,7 @@ ctWmiPerformance InstantiateProcessorCounters()
         *g_wmi,
         ctWmiEnumClassName::Processor,
         L"PercentProcessorTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_processorTime);
     wprintf(L".");
 
@@ -391,7 +521,7 @@ ctWmiPerformance InstantiateProcessorCounters()
         *g_wmi,
         ctWmiEnumClassName::Processor,
         L"PercentofMaximumFrequency",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_processorPercentOfMax);
     wprintf(L".");
 
@@ -399,7 +529,7 @@ ctWmiPerformance InstantiateProcessorCounters()
         *g_wmi,
         ctWmiEnumClassName::Processor,
         L"PercentDPCTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_processorPercentDpcTime);
     wprintf(L".");
 
@@ -407,7 +537,7 @@ ctWmiPerformance InstantiateProcessorCounters()
         *g_wmi,
         ctWmiEnumClassName::Processor,
         L"DPCsQueuedPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_processorDpcsQueuedPerSecond);
     wprintf(L".");
 
@@ -415,7 +545,7 @@ ctWmiPerformance InstantiateProcessorCounters()
         *g_wmi,
         ctWmiEnumClassName::Processor,
         L"PercentPrivilegedTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_processorPercentPrivilegedTime);
     wprintf(L".");
 
@@ -423,10 +553,24 @@ ctWmiPerformance InstantiateProcessorCounters()
         *g_wmi,
         ctWmiEnumClassName::Processor,
         L"PercentUserTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_processorPercentUserTime);
     wprintf(L".");
 
+    if (!g_meanOnly)
+    {
+        // added after both counters, so each sample pairs the values from the same Refresh
+        performanceCounter.add_update_callback([] {
+            g_processorTime->for_each_latest([](const wstring& name, ULONGLONG processorTime) {
+                ULONG percentOfMax{};
+                if (g_processorPercentOfMax->reference_latest(name.c_str(), &percentOfMax))
+                {
+                    g_processorNormalizedTime[name].Add(static_cast<double>(processorTime) * percentOfMax / 100.0);
+                }
+            });
+        });
+    }
+
     return performanceCounter;
 }
 
@@ -438,6 +582,7 @@ void DeleteProcessorCounters() noexcept
     g_processorDpcsQueuedPerSecond.reset();
     g_processorPercentPrivilegedTime.reset();
     g_processorPercentUserTime.reset();
+    g_processorNormalizedTime.clear();
 }
 
 void ProcessProcessorCounters(ctsPerf::ctsWriteDetails& writer)
@@ -463,19 +608,19 @@ void ProcessProcessorCounters(ctsPerf::ctsWriteDetails& writer)
                 L"Processor %ws",
                 ctString::replace_all_copy(name, L",", L" - ").c_str()));
 
-        const auto processor_range = g_processorTime->reference_range(name.c_str());
-        vector processorTimeVector(processor_range.first, processor_range.second);
+        if (g_meanOnly)
+        {
+            const auto processor_range = g_processorTime->reference_range(name.c_str());
+            vector processorTimeVector(processor_range.first, processor_range.second);
 
-        const auto percent_range = g_processorPercentOfMax->reference_range(name.c_str());
-        vector processorPercentVector(percent_range.first, percent_range.second);
+            const auto percent_range = g_processorPercentOfMax->reference_range(name.c_str());
+            vector processorPercentVector(percent_range.first, percent_range.second);
 
-        const auto percent_dpc_time_range = g_processorPercentDpcTime->reference_range(name.c_str());
-        const auto dpcs_queued_per_second_range = g_processorDpcsQueuedPerSecond->reference_range(name.c_str());
-        const auto processor_percent_privileged_time_range = g_processorPercentPrivilegedTime->reference_range(name.c_str());
-        const auto processor_percent_user_time_range = g_processorPercentUserTime->reference_range(name.c_str());
+            const auto percent_dpc_time_range = g_processorPercentDpcTime->reference_range(name.c_str());
+            const auto dpcs_queued_per_second_range = g_processorDpcsQueuedPerSecond->reference_range(name.c_str());
+            const auto processor_percent_privileged_time_range = g_processorPercentPrivilegedTime->reference_range(name.c_str());
+            const auto processor_percent_user_time_range = g_processorPercentUserTime->reference_range(name.c_str());
 
-        if (g_meanOnly)
-        {
             auto normalizedProcessorTimeVector(processorTimeVector);
 
             // convert to a percentage
@@ -519,52 +664,44 @@ void ProcessProcessorCounters(ctsPerf::ctsWriteDetails& writer)
         }
         else
         {
-            vector<ULONG> normalizedProcessorTime;
             // produce the raw % as well as the 'normalized' % based off of the PercentofMaximumFrequency
-            auto percentageIterator(processorPercentVector.begin());
-            for (const auto& processorData : processorTimeVector)
-            {
-                // convert to a percentage
-                auto calculatedProcessorTime = static_cast<double>(processorData) / 100.0;
-                calculatedProcessorTime *= *percentageIterator / 100.0;
-
-                normalizedProcessorTime.push_back(static_cast<ULONG>(calculatedProcessorTime * 100UL));
-                ++percentageIterator;
-            }
-
             writer.WriteDetails(
                 L"Processor",
                 L"Raw CPU Usage",
-                processorTimeVector);
+                g_processorTime->reference_summary(name.c_str()));
+
+            const auto normalizedTime = ranges::find_if(
+                g_processorNormalizedTime,
+                [&](const auto& processor) {
+                    return ctString::iordinal_equals(processor.first, name);
+                });
+            if (normalizedTime != g_processorNormalizedTime.end())
+            {
+                writer.WriteDetails(
+                    L"Processor",
+                    L"Normalized CPU Usage (Raw * PercentofMaximumFrequency)",
+                    normalizedTime->second);
+            }
 
-            writer.WriteDetails(
-                L"Processor",
-                L"Normalized CPU Usage (Raw * PercentofMaximumFrequency)",
-                normalizedProcessorTime);
-
-            ullData.assign(percent_dpc_time_range.first, percent_dpc_time_range.second);
             writer.WriteDetails(
                 L"Processor",
                 L"Percent DPC Time",
-                ullData);
+                g_processorPercentDpcTime->reference_summary(name.c_str()));
 
-            ulData.assign(dpcs_queued_per_second_range.first, dpcs_queued_per_second_range.second);
             writer.WriteDetails(
                 L"Processor",
                 L"DPCs Queued Per Second",
-                ulData);
+                g_processorDpcsQueuedPerSecond->reference_summary(name.c_str()));
 
-            ullData.assign(processor_percent_privileged_time_range.first, processor_percent_privileged_time_range.second);
             writer.WriteDetails(
                 L"Processor",
                 L"Percent Privileged Time",
-                ullData);
+                g_processorPercentPrivilegedTime->reference_summary(name.c_str()));
 
-            ullData.assign(processor_percent_user_time_range.first, processor_percent_user_time_range.second);
             writer.WriteDetails(
                 L"Processor",
                 L"Percent User Time",
-                ullData);
+                g_processorPercentUserTime->reference_summary(name.c_str()));
         }
     }
 
@@ -584,7 +721,7 @@ ctWmiPerformance InstantiateMemoryCounters()
         *g_wmi,
         ctWmiEnumClassName::Memory,
         L"PoolPagedBytes",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_pagedPoolBytes);
     wprintf(L".");
 
@@ -592,7 +729,7 @@ ctWmiPerformance InstantiateMemoryCounters()
         *g_wmi,
         ctWmiEnumClassName::Memory,
         L"PoolNonpagedBytes",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_nonPagedPoolBytes);
     wprintf(L".");
 
@@ -627,17 +764,15 @@ void ProcessMemoryCounters(ctsPerf::ctsWriteDetails& writer)
     }
     else
     {
-        ullData.assign(paged_pool_range.first, paged_pool_range.second);
         writer.WriteDetails(
             L"Memory",
             L"PoolPagedBytes",
-            ullData);
+            g_pagedPoolBytes->reference_summary());
 
-        ullData.assign(non_paged_pool_range.first, non_paged_pool_range.second);
         writer.WriteDetails(
             L"Memory",
             L"PoolNonpagedBytes",
-            ullData);
+            g_nonPagedPoolBytes->reference_summary());
     }
 }
 
@@ -661,7 +796,7 @@ ctWmiPerformance InstantiateNetworkAdapterCounters(const std::wstring& trackInte
         *g_wmi,
         ctWmiEnumClassName::NetworkAdapter,
         L"BytesTotalPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     if (!trackInterfaceDescription.empty())
     {
         g_networkAdapterTotalBytes->add_filter(L"Name", trackInterfaceDescription.c_str());
@@ -733,7 +868,7 @@ ctWmiPerformance InstantiateNetworkAdapterCounters(const std::wstring& trackInte
         *g_wmi,
         ctWmiEnumClassName::NetworkAdapter,
         L"PacketsPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     if (!trackInterfaceDescription.empty())
     {
         g_networkAdapterPacketsPerSecond->add_filter(L"Name", trackInterfaceDescription.c_str());
@@ -806,7 +941,7 @@ void ProcessNetworkAdapterCounters(ctsPerf::ctsWriteDetails& writer)
                 wil::str_printf<std::wstring>(
                     L"PacketsPersec for interface %ws",
                     name.c_str()).c_str(),
-                ullData);
+                g_networkAdapterPacketsPerSecond->reference_summary(name.c_str()));
         }
         networkRange = g_networkAdapterTotalBytes->reference_range(name.c_str());
         ullData.assign(networkRange.first, networkRange.second);
@@ -826,7 +961,7 @@ void ProcessNetworkAdapterCounters(ctsPerf::ctsWriteDetails& writer)
                 wil::str_printf<std::wstring>(
                     L"BytesTotalPersec for interface %ws",
                     name.c_str()).c_str(),
-                ullData);
+                g_networkAdapterTotalBytes->reference_summary(name.c_str()));
         }
 
         networkRange = g_networkAdapterOffloadedConnections->reference_range(name.c_str());
@@ -905,7 +1040,7 @@ ctWmiPerformance InstantiateNetworkInterfaceCounters(const std::wstring& trackIn
         *g_wmi,
         ctWmiEnumClassName::NetworkInterface,
         L"BytesTotalPerSec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     if (!trackInterfaceDescription.empty())
     {
         g_networkInterfaceTotalBytes->add_filter(L"Name", trackInterfaceDescription.c_str());
@@ -1024,7 +1159,7 @@ void ProcessNetworkInterfaceCounters(ctsPerf::ctsWriteDetails& writer)
                 wil::str_printf<std::wstring>(
                     L"BytesTotalPerSec for interface %ws",
                     name.c_str()).c_str(),
-                ullData);
+                g_networkInterfaceTotalBytes->reference_summary(name.c_str()));
         }
         auto networkRange = g_networkInterfacePacketsOutboundDiscarded->reference_range(name.c_str());
         ullData.assign(networkRange.first, networkRange.second);
@@ -1397,7 +1532,7 @@ ctWmiPerformance InstantiateTCPCounters()
         *g_wmi,
         ctWmiEnumClassName::TcpipTcpv4,
         L"ConnectionsEstablished",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_tcpipTcpv4ConnectionsEstablished);
     wprintf(L".");
 
@@ -1405,7 +1540,7 @@ ctWmiPerformance InstantiateTCPCounters()
         *g_wmi,
         ctWmiEnumClassName::TcpipTcpv6,
         L"ConnectionsEstablished",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_tcpipTcpv6ConnectionsEstablished);
     wprintf(L".");
 
@@ -1453,7 +1588,7 @@ ctWmiPerformance InstantiateTCPCounters()
         *g_wmi,
         ctWmiEnumClassName::WinsockBsp,
         L"RejectedConnectionsPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_winsockBspRejectedConnectionsPerSec);
     wprintf(L".");
 
@@ -1491,7 +1626,7 @@ void ProcessTCPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"TCPIP - TCPv4",
             L"ConnectionsEstablished",
-            ulData);
+            g_tcpipTcpv4ConnectionsEstablished->reference_summary());
     }
 
     networkRange = g_tcpipTcpv6ConnectionsEstablished->reference_range();
@@ -1508,7 +1643,7 @@ void ProcessTCPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"TCPIP - TCPv6",
             L"ConnectionsEstablished",
-            ulData);
+            g_tcpipTcpv6ConnectionsEstablished->reference_summary());
     }
 
     networkRange = g_tcpipTcpv4ConnectionFailures->reference_range();
@@ -1560,7 +1695,7 @@ void ProcessTCPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"Winsock",
             L"RejectedConnectionsPersec",
-            ulData);
+            g_winsockBspRejectedConnectionsPerSec->reference_summary());
     }
 
     writer.WriteEmptyRow();
@@ -1588,7 +1723,7 @@ ctWmiPerformance InstantiateUDPCounters()
         *g_wmi,
         ctWmiEnumClassName::TcpipUdpv4,
         L"DatagramsNoPortPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_tcpipUdpv4NoportPerSec);
     wprintf(L".");
 
@@ -1604,7 +1739,7 @@ ctWmiPerformance InstantiateUDPCounters()
         *g_wmi,
         ctWmiEnumClassName::TcpipUdpv4,
         L"DatagramsPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_tcpipUdpv4DatagramsPerSec);
     wprintf(L".");
 
@@ -1612,7 +1747,7 @@ ctWmiPerformance InstantiateUDPCounters()
         *g_wmi,
         ctWmiEnumClassName::TcpipUdpv6,
         L"DatagramsNoPortPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_tcpipUdpv6NoportPerSec);
     wprintf(L".");
 
@@ -1628,7 +1763,7 @@ ctWmiPerformance InstantiateUDPCounters()
         *g_wmi,
         ctWmiEnumClassName::TcpipUdpv6,
         L"DatagramsPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_tcpipUdpv6DatagramsPerSec);
     wprintf(L".");
 
@@ -1644,7 +1779,7 @@ ctWmiPerformance InstantiateUDPCounters()
         *g_wmi,
         ctWmiEnumClassName::WinsockBsp,
         L"DroppedDatagramsPersec",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     performanceCounter.add_counter(g_winsockBspDroppedDatagramsPerSecond);
     wprintf(L".");
 
@@ -1683,7 +1818,7 @@ void ProcessUDPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"TCPIP - UDPv4",
             L"DatagramsNoPortPersec",
-            ulData);
+            g_tcpipUdpv4NoportPerSec->reference_summary());
     }
 
     udpRange = g_tcpipUdpv4DatagramsPerSec->reference_range();
@@ -1700,7 +1835,7 @@ void ProcessUDPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"TCPIP - UDPv4",
             L"DatagramsPersec",
-            ulData);
+            g_tcpipUdpv4DatagramsPerSec->reference_summary());
     }
 
     udpRange = g_tcpipUdpv4ReceivedErrors->reference_range();
@@ -1727,7 +1862,7 @@ void ProcessUDPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"TCPIP - UDPv6",
             L"DatagramsNoPortPersec",
-            ulData);
+            g_tcpipUdpv6NoportPerSec->reference_summary());
     }
 
     udpRange = g_tcpipUdpv6DatagramsPerSec->reference_range();
@@ -1744,7 +1879,7 @@ void ProcessUDPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"TCPIP - UDPv6",
             L"DatagramsPersec",
-            ulData);
+            g_tcpipUdpv6DatagramsPerSec->reference_summary());
     }
 
     udpRange = g_tcpipUdpv6ReceivedErrors->reference_range();
@@ -1778,7 +1913,7 @@ void ProcessUDPCounters(ctsPerf::ctsWriteDetails& writer)
         writer.WriteDetails(
             L"Winsock",
             L"DroppedDatagramsPersec",
-            ulData);
+            g_winsockBspDroppedDatagramsPerSecond->reference_summary());
     }
 
     writer.WriteEmptyRow();
@@ -1801,7 +1936,7 @@ ctWmiPerformance InstantiatePerProcessByNameCounters(const std::wstring& trackPr
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PercentPrivilegedTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessPrivilegedTime->add_filter(L"Name", trackProcess.c_str());
     performanceCounter.add_counter(g_perProcessPrivilegedTime);
     wprintf(L".");
@@ -1810,7 +1945,7 @@ ctWmiPerformance InstantiatePerProcessByNameCounters(const std::wstring& trackPr
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PercentProcessorTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessProcessorTime->add_filter(L"Name", trackProcess.c_str());
     performanceCounter.add_counter(g_perProcessProcessorTime);
     wprintf(L".");
@@ -1819,7 +1954,7 @@ ctWmiPerformance InstantiatePerProcessByNameCounters(const std::wstring& trackPr
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PercentUserTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessUserTime->add_filter(L"Name", trackProcess.c_str());
     performanceCounter.add_counter(g_perProcessUserTime);
     wprintf(L".");
@@ -1828,7 +1963,7 @@ ctWmiPerformance InstantiatePerProcessByNameCounters(const std::wstring& trackPr
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PrivateBytes",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessPrivateBytes->add_filter(L"Name", trackProcess.c_str());
     performanceCounter.add_counter(g_perProcessPrivateBytes);
     wprintf(L".");
@@ -1837,7 +1972,7 @@ ctWmiPerformance InstantiatePerProcessByNameCounters(const std::wstring& trackPr
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"VirtualBytes",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessVirtualBytes->add_filter(L"Name", trackProcess.c_str());
     performanceCounter.add_counter(g_perProcessVirtualBytes);
     wprintf(L".");
@@ -1846,7 +1981,7 @@ ctWmiPerformance InstantiatePerProcessByNameCounters(const std::wstring& trackPr
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"WorkingSet",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessWorkingSet->add_filter(L"Name", trackProcess.c_str());
     performanceCounter.add_counter(g_perProcessWorkingSet);
     wprintf(L".");
@@ -1863,7 +1998,7 @@ ctWmiPerformance InstantiatePerProcessByPIDCounters(const DWORD processId)
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PercentPrivilegedTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessPrivilegedTime->add_filter(L"IDProcess", processId);
     performanceCounter.add_counter(g_perProcessPrivilegedTime);
     wprintf(L".");
@@ -1872,7 +2007,7 @@ ctWmiPerformance InstantiatePerProcessByPIDCounters(const DWORD processId)
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PercentProcessorTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessProcessorTime->add_filter(L"IDProcess", processId);
     performanceCounter.add_counter(g_perProcessProcessorTime);
     wprintf(L".");
@@ -1881,7 +2016,7 @@ ctWmiPerformance InstantiatePerProcessByPIDCounters(const DWORD processId)
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PercentUserTime",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessUserTime->add_filter(L"IDProcess", processId);
     performanceCounter.add_counter(g_perProcessUserTime);
     wprintf(L".");
@@ -1890,7 +2025,7 @@ ctWmiPerformance InstantiatePerProcessByPIDCounters(const DWORD processId)
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"PrivateBytes",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessPrivateBytes->add_filter(L"IDProcess", processId);
     performanceCounter.add_counter(g_perProcessPrivateBytes);
     wprintf(L".");
@@ -1899,7 +2034,7 @@ ctWmiPerformance InstantiatePerProcessByPIDCounters(const DWORD processId)
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"VirtualBytes",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessVirtualBytes->add_filter(L"IDProcess", processId);
     performanceCounter.add_counter(g_perProcessVirtualBytes);
     wprintf(L".");
@@ -1908,7 +2043,7 @@ ctWmiPerformance InstantiatePerProcessByPIDCounters(const DWORD processId)
         *g_wmi,
         ctWmiEnumClassName::Process,
         L"WorkingSet",
-        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Detailed);
+        g_meanOnly ? ctWmiPerformanceCollectionType::MeanOnly : ctWmiPerformanceCollectionType::Summary);
     g_perProcessWorkingSet->add_filter(L"IDProcess", processId);
     performanceCounter.add_counter(g_perProcessWorkingSet);
     wprintf(L".");
@@ -1926,21 +2061,22 @@ void DeletePerProcessCounters() noexcept
     g_perProcessWorkingSet.reset();
 }
 
-void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processId, ctsPerf::ctsWriteDetails& writer)
+wstring PerProcessClassName(const wstring& trackProcess, const DWORD processId)
 {
-    vector<ULONGLONG> ullData;
-
-    wstring counterClassname;
     if (!trackProcess.empty())
     {
         wstring fullname(trackProcess);
         fullname += L".exe";
-        counterClassname = wil::str_printf<std::wstring>(L"Process (%ws)", fullname.c_str());
-    }
-    else
-    {
-        counterClassname = wil::str_printf<std::wstring>(L"Process (pid %u)", processId);
+        return wil::str_printf<std::wstring>(L"Process (%ws)", fullname.c_str());
     }
+    return wil::str_printf<std::wstring>(L"Process (pid %u)", processId);
+}
+
+void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processId, ctsPerf::ctsWriteDetails& writer)
+{
+    vector<ULONGLONG> ullData;
+
+    const auto counterClassname = PerProcessClassName(trackProcess, processId);
 
     auto perProcessRange = g_perProcessPrivilegedTime->reference_range();
     ullData.assign(perProcessRange.first, perProcessRange.second);
@@ -1956,7 +2092,7 @@ void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processI
         writer.WriteDetails(
             counterClassname.c_str(),
             L"PercentPrivilegedTime",
-            ullData);
+            g_perProcessPrivilegedTime->reference_summary());
     }
 
     perProcessRange = g_perProcessProcessorTime->reference_range();
@@ -1973,7 +2109,7 @@ void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processI
         writer.WriteDetails(
             counterClassname.c_str(),
             L"PercentProcessorTime",
-            ullData);
+            g_perProcessProcessorTime->reference_summary());
     }
 
     perProcessRange = g_perProcessUserTime->reference_range();
@@ -1990,7 +2126,7 @@ void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processI
         writer.WriteDetails(
             counterClassname.c_str(),
             L"PercentUserTime",
-            ullData);
+            g_perProcessUserTime->reference_summary());
     }
 
     perProcessRange = g_perProcessPrivateBytes->reference_range();
@@ -2007,7 +2143,7 @@ void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processI
         writer.WriteDetails(
             counterClassname.c_str(),
             L"PrivateBytes",
-            ullData);
+            g_perProcessPrivateBytes->reference_summary());
     }
 
     perProcessRange = g_perProcessVirtualBytes->reference_range();
@@ -2024,7 +2160,7 @@ void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processI
         writer.WriteDetails(
             counterClassname.c_str(),
             L"VirtualBytes",
-            ullData);
+            g_perProcessVirtualBytes->reference_summary());
     }
 
     perProcessRange = g_perProcessWorkingSet->reference_range();
@@ -2041,6 +2177,6 @@ void ProcessPerProcessCounters(const wstring& trackProcess, const DWORD processI
         writer.WriteDetails(
             counterClassname.c_str(),
             L"WorkingSet",
-            ullData);
+            g_perProcessWorkingSet->reference_summary());
     }
 }
@@ -17,6 +17,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <string>
 #include <vector>
 #include <tuple>
+#include <cmath>
 // os headers
 #include <Windows.h>
 // wil headers
@@ -119,6 +120,32 @@ namespace ctsPerf { namespace Details
             return formattedData;
         }
 
+        // produces the same columns as above from a bounded-memory summary
+        // - the quartiles are approximations within ctQuantileSketch::c_relativeAccuracy
+        static std::wstring PrintDetails(const ctl::ctSampleSummary& summary)
+        {
+            const auto& statistics = summary.GetStatistics();
+            if (0 == statistics.GetCount())
+            {
+                return std::wstring();
+            }
+
+            const auto mean = statistics.GetMean();
+            const auto stdDev = statistics.GetStandardDeviation();
+            const auto& quantiles = summary.GetQuantiles();
+
+            auto formattedData = Details::Write(static_cast<DWORD>(statistics.GetCount())); // SampleCount
+            formattedData += Details::Write(
+                static_cast<ULONGLONG>(std::llround(statistics.GetMin())),
+                static_cast<ULONGLONG>(std::llround(statistics.GetMax()))); // Min,Max
+            formattedData += Details::Write(mean - stdDev, mean, mean + stdDev); // -1Std,Mean,+1Std
+            formattedData += Details::Write(
+                quantiles.GetQuantile(0.25),
+                quantiles.GetQuantile(0.50),
+                quantiles.GetQuantile(0.75)); // -1IQR,Median,+1IQR
+            return formattedData;
+        }
+
         explicit ctsWriteDetails(_In_ PCWSTR file_name) :
             m_fileName(file_name)
         {
@@ -159,6 +186,23 @@ namespace ctsPerf { namespace Details
             EndRow();
         }
 
+        void WriteDetails(_In_ PCWSTR className, _In_ PCWSTR counterName, const ctl::ctSampleSummary& summary)
+        {
+            if (0 == summary.GetStatistics().GetCount())
+            {
+                return;
+            }
+
+            StartRow(className, counterName);
+
+            const std::wstring formattedData(PrintDetails(summary));
+            const auto length = static_cast<DWORD>(formattedData.length() * sizeof(wchar_t));
+            DWORD written{};
+            THROW_LAST_ERROR_IF(!::WriteFile(m_fileHandle.get(), formattedData.c_str(), length, &written, nullptr));
+
+            EndRow();
+        }
+
         template <typename T>
         void WriteDifference(_In_ PCWSTR className, _In_ PCWSTR counterName, const std::vector<T>& data)
         {
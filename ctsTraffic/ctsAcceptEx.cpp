@@ -16,6 +16,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <utility>
 #include <vector>
 #include <queue>
+#include <algorithm>
 // os headers
 #include <Windows.h>
 #include <WinSock2.h>
@@ -24,11 +25,14 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <wil/stl.h>
 #include <wil/resource.h>
 // ctl headers
+#include <ctMemoryGuard.hpp>
 #include <ctSocketExtensions.hpp>
 #include <ctThreadIocp.hpp>
 #include <ctSockaddr.hpp>
+#include <ctTimer.hpp>
 // project headers
 #include "ctsSocket.h"
+#include "ctsSocketPool.h"
 
 using ctsTraffic::ctsConfig::g_configSettings;
 
@@ -40,33 +44,44 @@ namespace ctsTraffic
 // - must return one accepted socket only after operator() is invoked
 //
 // General Algorithm
-// - initiate an AcceptEx on every address at startup (after posting a listen)
-// - a common "accept handler" routine is invoked directly from both:
-// --- operator()
-// --- the IOCP callback function
+// - initiate AcceptEx calls on every address at startup (after posting a listen)
+// --- -AcceptDepth AcceptEx calls are kept outstanding per address for each processor
 //
-// The 'accept handler' manages the interation between returning connections and posting more AcceptEx calls:
+// Accepted connections and requests for them are matched in per-processor shards, each with its own lock
+// - both the IOCP callback and operator() use the shard of the processor they are running on
 //
-// - if operator() is called and a connection is ready,
-// --- set_socket() and complete() are invoked
-// --- a new AcceptEx call is posted on that listening socket
+// - if the callback is called and a request is pended on its shard,
+// --- set_socket() and complete() are invoked for that request
+// - else the new connection is queued on its shard
 //
-// - if operator() is called and no connection is ready,
-// --- a counter is incremented to reflect a request arrived
+// - if operator() is called and a connection is queued on its shard,
+// --- set_socket() and complete() are invoked with that connection
+// - else the request is pended on its shard
 //
-// - if the callback is called and the counter reflects a request for a new socket is pending,
-// --- set_socket() and complete() are invoked
-// --- decrement the counter tracking requests
-// --- a new AcceptEx call is posted on that listening socket
-// - if the callback is called and the counter reflects no request arrived yet,
-// --- the new connection is added to a queue and AcceptEx is not reposted
+// - either side then looks at the other shards for a match to what it just queued or pended
+// --- as both queue or pend before looking, a connection and a request can't both miss each other
+// --- the total counts of queued connections and pended requests skip the look when there's nothing to find
+//
+// The number of outstanding AcceptEx calls adapts to the rate connections arrive
+// - if every AcceptEx completed within a window of c_depthWindowMilliseconds,
+// --- connections were left waiting in the listen backlog, so the depth is doubled
+// - if far fewer connections arrived in a window than the depth,
+// --- the depth is reduced by a quarter by not reposting AcceptEx calls as they complete
 //
 namespace details
 {
     //
-    // constant defining how many acceptex requests we want maintained per listener
+    // without -AcceptDepth, about this many AcceptEx requests are maintained per listener in total
+    // - with at least c_minimumAcceptDepth per processor
     //
     constexpr uint32_t c_pendedAcceptRequests = 100;
+    constexpr uint32_t c_minimumAcceptDepth = 4;
+
+    //
+    // the depth adapts between a quarter and 16 times the initial depth, evaluated over this window
+    //
+    constexpr uint32_t c_maximumAcceptDepthFactor = 16;
+    constexpr int64_t c_depthWindowMilliseconds = 100;
 
     //
     // necessary forward declarations of internal classes
@@ -84,6 +99,8 @@ namespace details
     struct ctsAcceptedConnection
     {
         wil::unique_socket m_acceptSocket;
+        // set only if m_acceptSocket was recycled from ctsSocketPool
+        std::shared_ptr<ctl::ctThreadIocp> m_acceptIocp;
         ctl::ctSockaddr m_localAddr;
         ctl::ctSockaddr m_remoteAddr;
         DWORD m_lastError = 0;
@@ -145,7 +162,21 @@ namespace details
         wil::unique_socket m_listenSocket;
         ctl::ctSockaddr m_sockaddr;
         std::unique_ptr<ctl::ctThreadIocp> m_iocp;
+        // AcceptEx requests currently posted on this listener
+        _Interlocked_ long m_outstandingAccepts = 0;
+
+        // guards the adaptive depth and the containers of accept objects
+        wil::critical_section m_depthLock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
         std::vector<std::shared_ptr<ctsAcceptSocketInfo>> m_acceptSockets;
+        // accept objects not reposted while the depth is reduced
+        // - has capacity reserved for m_maximumAccepts, so adding one cannot fail
+        std::vector<ctsAcceptSocketInfo*> m_idleAcceptSockets;
+        long m_targetAccepts = 0;
+        long m_minimumAccepts = 0;
+        long m_maximumAccepts = 0;
+        int64_t m_windowStartMilliseconds = 0;
+        long m_windowArrivals = 0;
+        bool m_windowDrained = false;
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -169,6 +200,12 @@ namespace details
         // attempts to post a new AcceptEx - internally tracks if succeeds or fails
         void InitatiateAcceptEx();
 
+        // returns the parent listening object, or null once it has been destroyed
+        [[nodiscard]] std::shared_ptr<ctsListenSocketInfo> GetListener() const noexcept
+        {
+            return m_listeningSocketInfo.lock();
+        }
+
         // returns a ctsAcceptedConnection struct describing the result of an AcceptEx call
         // - must be called only after the previous AcceptEx call has completed its OVERLAPPED call
         ctsAcceptedConnection GetAcceptedSocket() noexcept;
@@ -185,6 +222,8 @@ namespace details
         // the lock to guard access to the SOCKET
         wil::critical_section m_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
         wil::unique_socket m_acceptSocket;
+        // the IOCP TP a recycled m_acceptSocket remains associated with
+        std::shared_ptr<ctl::ctThreadIocp> m_acceptIocp;
         // the raw (non-owning) OVERLAPPED* for the AcceptEx request
         OVERLAPPED* m_pOverlapped = nullptr;
         // a weak reference back to the parent listening object
@@ -194,17 +233,28 @@ namespace details
     };
 
     //
-    // Impl object to carry around the real member data of ctsAcceptEx
-    // - the shared_ptr to the Impl allows an instance of ctsAcceptEx to be copyable
+    // the accepted connections and requests for them on one processor
     //
-    struct ctsAcceptExImpl
+    struct ctsAcceptShard
     {
         // must guard access to internal containers
         wil::critical_section m_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
-        std::vector<std::shared_ptr<ctsListenSocketInfo>> m_listeners;
         std::queue<std::weak_ptr<ctsSocket>> m_pendedAcceptRequests;
         std::queue<ctsAcceptedConnection> m_acceptedConnections;
         bool m_shuttingDown = false;
+    };
+
+    //
+    // Impl object to carry around the real member data of ctsAcceptEx
+    //
+    struct ctsAcceptExImpl
+    {
+        std::vector<std::shared_ptr<ctsListenSocketInfo>> m_listeners;
+        // created before any AcceptEx is posted, and not modified after
+        std::vector<std::unique_ptr<ctsAcceptShard>> m_shards;
+        // the totals across all shards
+        _Interlocked_ long m_pendedRequestCount = 0;
+        _Interlocked_ long m_queuedConnectionCount = 0;
 
         //
         // ctsAcceptExImpl constructor
@@ -216,6 +266,20 @@ namespace details
 
         void Start()
         {
+            const auto shardCount = std::max<uint32_t>(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS), 1u);
+            m_shards.reserve(shardCount);
+            for (auto shardCounter = 0u; shardCounter < shardCount; ++shardCounter)
+            {
+                m_shards.emplace_back(std::make_unique<ctsAcceptShard>());
+            }
+
+            const auto acceptDepth = g_configSettings->AcceptDepth != 0 ?
+                                     g_configSettings->AcceptDepth :
+                                     std::max(c_pendedAcceptRequests / shardCount, c_minimumAcceptDepth);
+
+            // capture the baseline of the system TCP attempt failures reported in status before accepting connections
+            (void)ctsConfig::GetTcpAttemptFailCount();
+
             // swap in the listen vector only if fully created
             // - if anything fails, this temp vector will go out of scope and safely be destroyed
             std::vector<std::shared_ptr<ctsListenSocketInfo>> tempListeners;
@@ -228,13 +292,25 @@ namespace details
                     // Make the structures for the listener and its accept sockets
                     auto listenSocketInfo(std::make_shared<ctsListenSocketInfo>(addr));
                     PRINT_DEBUG_INFO(L"\t\tListening to %ws\n", addr.writeCompleteAddress().c_str());
+
+                    const auto initialAccepts = static_cast<long>(acceptDepth * shardCount);
+                    listenSocketInfo->m_targetAccepts = initialAccepts;
+                    listenSocketInfo->m_minimumAccepts = std::max(initialAccepts / 4, static_cast<long>(shardCount));
+                    listenSocketInfo->m_maximumAccepts = initialAccepts * static_cast<long>(c_maximumAcceptDepthFactor);
+                    listenSocketInfo->m_acceptSockets.reserve(listenSocketInfo->m_maximumAccepts);
+                    listenSocketInfo->m_idleAcceptSockets.reserve(listenSocketInfo->m_maximumAccepts);
+                    listenSocketInfo->m_windowStartMilliseconds = ctl::ctTimer::snap_qpc_as_msec();
                     //
-                    // Add PendedAcceptRequests pended acceptex objects per listener
+                    // Add acceptDepth pended acceptex objects per listener for each shard
                     //
-                    for (auto acceptCounter = 0ul; acceptCounter < c_pendedAcceptRequests; ++acceptCounter)
+                    for (auto acceptCounter = 0l; acceptCounter < initialAccepts; ++acceptCounter)
                     {
                         auto acceptSocketInfo = std::make_shared<ctsAcceptSocketInfo>(listenSocketInfo);
-                        listenSocketInfo->m_acceptSockets.push_back(acceptSocketInfo);
+                        {
+                            // completions of the AcceptEx already posted can be adding accept objects
+                            const auto lock = listenSocketInfo->m_depthLock.lock();
+                            listenSocketInfo->m_acceptSockets.push_back(acceptSocketInfo);
+                        }
                         // post AcceptEx on this socket
                         acceptSocketInfo->InitatiateAcceptEx();
                     }
@@ -260,26 +336,27 @@ namespace details
         ~ctsAcceptExImpl() noexcept
         {
             // remove anything pended under lock since the IOCP callbacks still might be invoked
+            for (const auto& shard : m_shards)
             {
-                const auto lock = m_lock.lock();
-                m_shuttingDown = true;
+                const auto lock = shard->m_lock.lock();
+                shard->m_shuttingDown = true;
 
                 // close out all caller requests for new accepted sockets
-                while (!m_pendedAcceptRequests.empty())
+                while (!shard->m_pendedAcceptRequests.empty())
                 {
-                    auto weakSocket = m_pendedAcceptRequests.front();
+                    auto weakSocket = shard->m_pendedAcceptRequests.front();
 
                     if (const auto sharedSocket = weakSocket.lock())
                     {
                         sharedSocket->CompleteState(WSAECONNABORTED);
                     }
 
-                    m_pendedAcceptRequests.pop();
+                    shard->m_pendedAcceptRequests.pop();
                 }
 
-                while (!m_acceptedConnections.empty())
+                while (!shard->m_acceptedConnections.empty())
                 {
-                    m_acceptedConnections.pop();
+                    shard->m_acceptedConnections.pop();
                 }
             }
 
@@ -316,24 +393,38 @@ namespace details
             return;
         }
 
-        wil::unique_socket newAcceptedSocket(
-            ctsConfig::CreateSocket(
-                listeningSocketObject->m_sockaddr.family(),
-                SOCK_STREAM,
-                IPPROTO_TCP,
-                g_configSettings->SocketFlags));
-
-        // since not inheriting from the listening socket, must explicity set options on the accept socket
-        // - passing the listening address since that will be the local address of this accepted socket
-        auto error = ctsConfig::SetPreBindOptions(newAcceptedSocket.get(), listeningSocketObject->m_sockaddr);
-        if (error != 0)
+        wil::unique_socket newAcceptedSocket;
+        std::shared_ptr<ctl::ctThreadIocp> newAcceptedIocp;
+        if (g_configSettings->Options & ctsConfig::OptionType::ReuseSockets)
         {
-            THROW_WIN32_MSG(error, "SetPreBindOptions (ctsAcceptEx)");
+            // a recycled socket already has its options set from when it was first accepted
+            auto pooledSocket = ctsSocketPool::Acquire(listeningSocketObject->m_sockaddr.family());
+            newAcceptedSocket = std::move(pooledSocket.m_socket);
+            newAcceptedIocp = std::move(pooledSocket.m_tpIocp);
         }
-        error = ctsConfig::SetPreConnectOptions(newAcceptedSocket.get());
-        if (error != 0)
+
+        int32_t error = 0;
+        if (!newAcceptedSocket)
         {
-            THROW_WIN32_MSG(error, "SetPreConnectOptions (ctsAcceptEx)");
+            newAcceptedSocket.reset(
+                ctsConfig::CreateSocket(
+                    listeningSocketObject->m_sockaddr.family(),
+                    SOCK_STREAM,
+                    IPPROTO_TCP,
+                    g_configSettings->SocketFlags));
+
+            // since not inheriting from the listening socket, must explicity set options on the accept socket
+            // - passing the listening address since that will be the local address of this accepted socket
+            error = ctsConfig::SetPreBindOptions(newAcceptedSocket.get(), listeningSocketObject->m_sockaddr);
+            if (error != 0)
+            {
+                THROW_WIN32_MSG(error, "SetPreBindOptions (ctsAcceptEx)");
+            }
+            error = ctsConfig::SetPreConnectOptions(newAcceptedSocket.get());
+            if (error != 0)
+            {
+                THROW_WIN32_MSG(error, "SetPreConnectOptions (ctsAcceptEx)");
+            }
         }
 
         m_pOverlapped = listeningSocketObject->m_iocp->new_request(
@@ -341,6 +432,7 @@ namespace details
 
         ::ZeroMemory(m_outputBuffer, c_singleOutputBufferSize * 2);
         DWORD bytesReceived{};
+        ctl::ctMemoryGuardIncrement(&listeningSocketObject->m_outstandingAccepts);
         if (!ctl::ctAcceptEx(
             listeningSocketObject->m_listenSocket.get(),
             newAcceptedSocket.get(),
@@ -355,6 +447,7 @@ namespace details
                 // a real failure - must abort the IO
                 listeningSocketObject->m_iocp->cancel_request(m_pOverlapped);
                 m_pOverlapped = nullptr;
+                ctl::ctMemoryGuardDecrement(&listeningSocketObject->m_outstandingAccepts);
                 ctsConfig::PrintErrorIfFailed("AcceptEx", error);
                 return;
             }
@@ -370,6 +463,7 @@ namespace details
 
         // no failures - store the socket
         m_acceptSocket = std::move(newAcceptedSocket);
+        m_acceptIocp = std::move(newAcceptedIocp);
     }
 
     ctsAcceptedConnection ctsAcceptSocketInfo::GetAcceptedSocket() noexcept
@@ -381,6 +475,7 @@ namespace details
         {
             returnDetails.m_lastError = WSAECONNABORTED;
             m_acceptSocket.reset();
+            m_acceptIocp.reset();
             // return empty/failed details object
             return returnDetails;
         }
@@ -404,6 +499,7 @@ namespace details
                 returnDetails.m_lastError = WSAGetLastError();
                 ctsConfig::PrintErrorIfFailed("AcceptEx", returnDetails.m_lastError);
                 m_acceptSocket.reset();
+                m_acceptIocp.reset();
                 // return empty/failed details object
                 return returnDetails;
             }
@@ -439,6 +535,7 @@ namespace details
 
         // transfer ownership of the SOCKET to the caller
         returnDetails.m_acceptSocket = std::move(m_acceptSocket);
+        returnDetails.m_acceptIocp = std::move(m_acceptIocp);
         returnDetails.m_lastError = 0;
         returnDetails.m_localAddr.setSockaddr(localAddr);
         returnDetails.m_remoteAddr.setSockaddr(remoteAddr);
@@ -461,70 +558,335 @@ namespace details
         return FALSE;
     }
 
-    static void ctsAcceptExIoCompletionCallback(OVERLAPPED*, _In_ ctsAcceptSocketInfo* acceptInfo) noexcept try
+    static size_t CurrentShard() noexcept
     {
-        ctsAcceptedConnection acceptedSocket = acceptInfo->GetAcceptedSocket();
+        // processors in groups beyond the first share the shards of the first group
+        return GetCurrentProcessorNumber() % g_acceptExImpl.m_shards.size();
+    }
 
-        const auto lock = g_acceptExImpl.m_lock.lock();
-        if (g_acceptExImpl.m_shuttingDown)
+    static void CompleteAcceptRequest(const std::weak_ptr<ctsSocket>& weakSocket, ctsAcceptedConnection& acceptedConnection) noexcept
+    {
+        const auto sharedSocket = weakSocket.lock();
+        if (!sharedSocket)
         {
+            // socket was closed from beneath us
+            ctsConfig::PrintErrorIfFailed("AcceptEx", WSAECONNABORTED);
             return;
         }
 
-        if (!g_acceptExImpl.m_pendedAcceptRequests.empty())
+        ctsConfig::PrintErrorIfFailed("AcceptEx", acceptedConnection.m_lastError);
+        if (acceptedConnection.m_lastError != 0)
         {
-            //
-            // we have unfulfilled requests for more connections
-            // return a previously accepted socket
-            //
-            const auto weakSocket = g_acceptExImpl.m_pendedAcceptRequests.front();
-            g_acceptExImpl.m_pendedAcceptRequests.pop();
+            sharedSocket->CompleteState(acceptedConnection.m_lastError);
+            return;
+        }
 
+        // set the local addr
+        ctl::ctSockaddr localAddr;
+        auto localAddrLen = localAddr.length();
+        if (0 == getsockname(acceptedConnection.m_acceptSocket.get(), localAddr.sockaddr(), &localAddrLen))
+        {
+            sharedSocket->SetLocalSockaddr(localAddr);
+        }
+
+        // transfering ownership to the ctsSocket
+        sharedSocket->SetSocket(acceptedConnection.m_acceptSocket.release(), std::move(acceptedConnection.m_acceptIocp));
+        sharedSocket->SetRemoteSockaddr(acceptedConnection.m_remoteAddr);
+        sharedSocket->CompleteState(0);
+
+        ctsConfig::PrintNewConnection(localAddr, acceptedConnection.m_remoteAddr);
+    }
+
+    static bool DeliverAcceptedConnection(size_t shardIndex, ctsAcceptedConnection&& acceptedConnection) noexcept;
+
+    //
+    // fulfills the request with a connection queued on its shard, else pends it there
+    // - then takes a connection queued on another shard, if there is one
+    //
+    static void PendAcceptRequest(size_t shardIndex, const std::weak_ptr<ctsSocket>& weakSocket) noexcept
+    {
+        auto& shard = *g_acceptExImpl.m_shards[shardIndex];
+        ctsAcceptedConnection acceptedConnection;
+        auto matched = false;
+        DWORD error = 0;
+        {
+            const auto lock = shard.m_lock.lock();
+            if (shard.m_shuttingDown)
+            {
+                error = WSAECONNABORTED;
+            }
+            else if (!shard.m_acceptedConnections.empty())
+            {
+                acceptedConnection = std::move(shard.m_acceptedConnections.front());
+                shard.m_acceptedConnections.pop();
+                ctl::ctMemoryGuardDecrement(&g_acceptExImpl.m_queuedConnectionCount);
+                matched = true;
+            }
+            else
+            {
+                // no accepted connections yet -- save the weak_ptr, *not* the shared_ptr
+                try
+                {
+                    shard.m_pendedAcceptRequests.push(weakSocket);
+                    ctl::ctMemoryGuardIncrement(&g_acceptExImpl.m_pendedRequestCount);
+                }
+                catch (...)
+                {
+                    // fail the caller if can't save this request
+                    error = WSAENOBUFS;
+                }
+            }
+        }
+
+        if (error != 0)
+        {
+            ctsConfig::PrintErrorIfFailed("AcceptEx", error);
             if (const auto sharedSocket = weakSocket.lock())
             {
-                ctsConfig::PrintErrorIfFailed("AcceptEx", acceptedSocket.m_lastError);
+                sharedSocket->CompleteState(error);
+            }
+            return;
+        }
+        if (matched)
+        {
+            CompleteAcceptRequest(weakSocket, acceptedConnection);
+            return;
+        }
 
-                if (0 == acceptedSocket.m_lastError)
+        if (0 == ctl::ctMemoryGuardRead(&g_acceptExImpl.m_queuedConnectionCount))
+        {
+            return;
+        }
+        const auto shardCount = g_acceptExImpl.m_shards.size();
+        for (size_t offset = 1; offset < shardCount; ++offset)
+        {
+            const auto otherIndex = (shardIndex + offset) % shardCount;
+            auto& otherShard = *g_acceptExImpl.m_shards[otherIndex];
+            {
+                const auto lock = otherShard.m_lock.lock();
+                if (otherShard.m_shuttingDown || otherShard.m_acceptedConnections.empty())
                 {
-                    // set the local addr
-                    ctl::ctSockaddr localAddr;
-                    int localAddrLen = localAddr.length();
-                    if (0 == getsockname(acceptedSocket.m_acceptSocket.get(), localAddr.sockaddr(), &localAddrLen))
-                    {
-                        sharedSocket->SetLocalSockaddr(localAddr);
-                    }
+                    continue;
+                }
+                acceptedConnection = std::move(otherShard.m_acceptedConnections.front());
+                otherShard.m_acceptedConnections.pop();
+                ctl::ctMemoryGuardDecrement(&g_acceptExImpl.m_queuedConnectionCount);
+            }
+
+            // take back a request pended on this shard for that connection
+            std::weak_ptr<ctsSocket> pendedRequest;
+            auto reclaimed = false;
+            {
+                const auto lock = shard.m_lock.lock();
+                if (!shard.m_pendedAcceptRequests.empty())
+                {
+                    pendedRequest = std::move(shard.m_pendedAcceptRequests.front());
+                    shard.m_pendedAcceptRequests.pop();
+                    ctl::ctMemoryGuardDecrement(&g_acceptExImpl.m_pendedRequestCount);
+                    reclaimed = true;
+                }
+            }
+
+            if (reclaimed)
+            {
+                CompleteAcceptRequest(pendedRequest, acceptedConnection);
+            }
+            else
+            {
+                // the request was already fulfilled from another shard - queue the connection again
+                DeliverAcceptedConnection(otherIndex, std::move(acceptedConnection));
+            }
+            return;
+        }
+    }
+
+    //
+    // fulfills a request pended on its shard with the connection, else queues it there
+    // - then fulfills a request pended on another shard, if there is one
+    // - returns false once shutting down
+    //
+    static bool DeliverAcceptedConnection(size_t shardIndex, ctsAcceptedConnection&& acceptedConnection) noexcept
+    {
+        auto& shard = *g_acceptExImpl.m_shards[shardIndex];
+        std::weak_ptr<ctsSocket> pendedRequest;
+        auto matched = false;
+        {
+            const auto lock = shard.m_lock.lock();
+            if (shard.m_shuttingDown)
+            {
+                return false;
+            }
 
-                    // socket ownership was successfully transfered
-                    sharedSocket->SetSocket(acceptedSocket.m_acceptSocket.release());
-                    sharedSocket->SetRemoteSockaddr(acceptedSocket.m_remoteAddr);
-                    sharedSocket->CompleteState(0);
+            if (!shard.m_pendedAcceptRequests.empty())
+            {
+                //
+                // we have unfulfilled requests for more connections
+                // return a previously accepted socket
+                //
+                pendedRequest = std::move(shard.m_pendedAcceptRequests.front());
+                shard.m_pendedAcceptRequests.pop();
+                ctl::ctMemoryGuardDecrement(&g_acceptExImpl.m_pendedRequestCount);
+                matched = true;
+            }
+            else
+            {
+                //
+                // else, we have no requests for another connection,
+                // - queue this one for when a request comes in
+                //
+                try
+                {
+                    shard.m_acceptedConnections.push(std::move(acceptedConnection));
+                    ctl::ctMemoryGuardIncrement(&g_acceptExImpl.m_queuedConnectionCount);
+                }
+                catch (...)
+                {
+                    // the connection is closed as it can't be saved
+                    ctsConfig::PrintThrownException();
+                    return true;
+                }
+            }
+        }
 
-                    ctsConfig::PrintNewConnection(localAddr, acceptedSocket.m_remoteAddr);
+        if (matched)
+        {
+            CompleteAcceptRequest(pendedRequest, acceptedConnection);
+            return true;
+        }
+
+        if (0 == ctl::ctMemoryGuardRead(&g_acceptExImpl.m_pendedRequestCount))
+        {
+            return true;
+        }
+        const auto shardCount = g_acceptExImpl.m_shards.size();
+        for (size_t offset = 1; offset < shardCount; ++offset)
+        {
+            const auto otherIndex = (shardIndex + offset) % shardCount;
+            auto& otherShard = *g_acceptExImpl.m_shards[otherIndex];
+            {
+                const auto lock = otherShard.m_lock.lock();
+                if (otherShard.m_shuttingDown || otherShard.m_pendedAcceptRequests.empty())
+                {
+                    continue;
                 }
-                else
+                pendedRequest = std::move(otherShard.m_pendedAcceptRequests.front());
+                otherShard.m_pendedAcceptRequests.pop();
+                ctl::ctMemoryGuardDecrement(&g_acceptExImpl.m_pendedRequestCount);
+            }
+
+            // take back a connection queued on this shard for that request
+            ctsAcceptedConnection queuedConnection;
+            auto reclaimed = false;
+            {
+                const auto lock = shard.m_lock.lock();
+                if (!shard.m_acceptedConnections.empty())
                 {
-                    sharedSocket->CompleteState(acceptedSocket.m_lastError);
+                    queuedConnection = std::move(shard.m_acceptedConnections.front());
+                    shard.m_acceptedConnections.pop();
+                    ctl::ctMemoryGuardDecrement(&g_acceptExImpl.m_queuedConnectionCount);
+                    reclaimed = true;
                 }
             }
+
+            if (reclaimed)
+            {
+                CompleteAcceptRequest(pendedRequest, queuedConnection);
+            }
             else
             {
-                // socket was closed from beneath us
-                ctsConfig::PrintErrorIfFailed("AcceptEx", WSAECONNABORTED);
+                // the connection was already taken from another shard - pend the request again
+                PendAcceptRequest(otherIndex, pendedRequest);
             }
+            break;
         }
-        else
+        return true;
+    }
+
+    //
+    // adapts the depth of the listener to the arrival of the connection just accepted
+    // - returns the number of AcceptEx requests to post to reach that depth
+    //
+    static long UpdateAcceptDepth(ctsListenSocketInfo& listener, long outstandingAccepts) noexcept
+    {
+        if (outstandingAccepts <= 0)
         {
-            //
-            // else, we have no requests for another connection,
-            // - queue this one for when a request comes in
-            //
-            g_acceptExImpl.m_acceptedConnections.push(std::move(acceptedSocket));
+            // every AcceptEx has completed: new connections must wait in the listen backlog until one is posted
+            ctsConfig::g_configSettings->ConnectionStatusDetails.m_acceptQueueEmptyCount.Increment();
+        }
+
+        const auto currentTime = ctl::ctTimer::snap_qpc_as_msec();
+        const auto lock = listener.m_depthLock.lock();
+        ++listener.m_windowArrivals;
+        if (outstandingAccepts <= 0)
+        {
+            listener.m_windowDrained = true;
+        }
+
+        if (currentTime - listener.m_windowStartMilliseconds >= c_depthWindowMilliseconds)
+        {
+            if (listener.m_windowDrained)
+            {
+                listener.m_targetAccepts = std::min(listener.m_targetAccepts * 2, listener.m_maximumAccepts);
+                PRINT_DEBUG_INFO(L"\t\tctsAcceptEx : growing the AcceptEx depth to %ld\n", listener.m_targetAccepts);
+            }
+            else if (listener.m_windowArrivals < listener.m_targetAccepts / 4)
+            {
+                listener.m_targetAccepts = std::max(listener.m_targetAccepts - listener.m_targetAccepts / 4, listener.m_minimumAccepts);
+            }
+            listener.m_windowStartMilliseconds = currentTime;
+            listener.m_windowArrivals = 0;
+            listener.m_windowDrained = false;
+        }
+
+        return listener.m_targetAccepts - outstandingAccepts;
+    }
+
+    static void ctsAcceptExIoCompletionCallback(OVERLAPPED*, _In_ ctsAcceptSocketInfo* acceptInfo) noexcept try
+    {
+        const auto listener = acceptInfo->GetListener();
+        const auto outstandingAccepts = listener ? ctl::ctMemoryGuardDecrement(&listener->m_outstandingAccepts) : 0;
+
+        if (!DeliverAcceptedConnection(CurrentShard(), acceptInfo->GetAcceptedSocket()) || !listener)
+        {
+            return;
+        }
+
+        auto acceptsToPost = UpdateAcceptDepth(*listener, outstandingAccepts);
+        if (acceptsToPost <= 0)
+        {
+            // the depth was reduced - this accept object stays idle until the depth grows
+            const auto lock = listener->m_depthLock.lock();
+            listener->m_idleAcceptSockets.push_back(acceptInfo);
+            return;
         }
 
-        //
-        // always attempt another AcceptEx
-        //
         acceptInfo->InitatiateAcceptEx();
+        --acceptsToPost;
+
+        // the depth was increased - post AcceptEx on idle accept objects first, then on new ones
+        while (acceptsToPost > 0)
+        {
+            ctsAcceptSocketInfo* nextAcceptInfo = nullptr;
+            {
+                const auto lock = listener->m_depthLock.lock();
+                if (!listener->m_idleAcceptSockets.empty())
+                {
+                    nextAcceptInfo = listener->m_idleAcceptSockets.back();
+                    listener->m_idleAcceptSockets.pop_back();
+                }
+                else if (listener->m_acceptSockets.size() < static_cast<size_t>(listener->m_maximumAccepts))
+                {
+                    listener->m_acceptSockets.emplace_back(std::make_shared<ctsAcceptSocketInfo>(listener));
+                    nextAcceptInfo = listener->m_acceptSockets.back().get();
+                }
+            }
+            if (!nextAcceptInfo)
+            {
+                break;
+            }
+            nextAcceptInfo->InitatiateAcceptEx();
+            --acceptsToPost;
+        }
     }
     catch (...)
     {
@@ -535,7 +897,7 @@ namespace details
 //
 //
 // An accepted socket is being requested
-// - if have one queued, return that
+// - if one is queued, return that
 // - else store the weak_ptr<ctsSocket> to be fulfilled later
 //
 //
@@ -551,67 +913,11 @@ void ctsAcceptEx(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
         return;
     }
 
-    auto sharedSocket(weakSocket.lock());
-    if (!sharedSocket)
+    if (weakSocket.expired())
     {
         return;
     }
 
-    details::ctsAcceptedConnection acceptedConnection;
-
-    // scoped to the auto-release CS object
-    {
-        const auto lock = details::g_acceptExImpl.m_lock.lock();
-        // guard access to internal queues
-        if (details::g_acceptExImpl.m_acceptedConnections.empty())
-        {
-            // no accepted connections yet -- save the weak_ptr, *not* the shared_ptr
-            try { details::g_acceptExImpl.m_pendedAcceptRequests.push(weakSocket); }
-            catch (...)
-            {
-                // fail the caller if can't save this request
-                error = WSAENOBUFS;
-            }
-        }
-        else
-        {
-            // pull the next connection off the queue
-            acceptedConnection = std::move(details::g_acceptExImpl.m_acceptedConnections.front());
-            details::g_acceptExImpl.m_acceptedConnections.pop();
-            error = acceptedConnection.m_lastError;
-        }
-    }
-
-    //
-    // complete this socket state if something failed
-    //
-    ctsConfig::PrintErrorIfFailed("AcceptEx", error);
-    if (error != 0)
-    {
-        sharedSocket->CompleteState(error);
-        return;
-    }
-
-    //
-    // if did not defer the accept request and we have a new accepted socket,
-    // complete this socket state
-    //
-    if (acceptedConnection.m_acceptSocket.get() != INVALID_SOCKET)
-    {
-        // set the local addr
-        ctl::ctSockaddr localAddr;
-        auto localAddrLen = localAddr.length();
-        if (0 == getsockname(acceptedConnection.m_acceptSocket.get(), localAddr.sockaddr(), &localAddrLen))
-        {
-            sharedSocket->SetLocalSockaddr(localAddr);
-        }
-
-        // transfering ownership to the ctsSocket
-        sharedSocket->SetSocket(acceptedConnection.m_acceptSocket.release());
-        sharedSocket->SetRemoteSockaddr(acceptedConnection.m_remoteAddr);
-        sharedSocket->CompleteState(0);
-
-        ctsConfig::PrintNewConnection(localAddr, acceptedConnection.m_remoteAddr);
-    }
+    details::PendAcceptRequest(details::CurrentShard(), weakSocket);
 }
 } // namespace
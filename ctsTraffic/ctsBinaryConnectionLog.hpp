@@ -0,0 +1,177 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <cstdint>
+#include <memory>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+#include <ws2ipdef.h>
+// wil headers
+#include <wil/resource.h>
+
+// The binary connection log is written instead of text when -ConnectionFilename ends with .ctsbin
+// - a ctsBinaryConnectionLogHeader followed by one fixed-size ctsBinaryConnectionRecord per connection
+// - the file can be memory-mapped and indexed directly as an array of records after the header
+// - ctsLogConverter writes the same CSV layout as a .csv connection file from it
+//
+// Fields are in host byte order (little-endian) except the addresses, which are SOCKADDR_INET as returned by Winsock
+
+namespace ctsTraffic
+{
+enum class ctsBinaryRecordType : uint32_t
+{
+    TcpResult = 1,
+    UdpResult = 2,
+    // failed during socket creation, bind, or connect
+    ConnectionFailed = 3
+};
+
+enum class ctsBinaryResultType : uint32_t
+{
+    Success = 0,
+    NetworkError = 1,
+    ProtocolError = 2
+};
+
+struct ctsBinaryConnectionLogHeader
+{
+    static constexpr uint32_t c_signature = 0x42535443; // "CTSB"
+    static constexpr uint16_t c_currentVersion = 1;
+
+    uint32_t m_signature = c_signature;
+    uint16_t m_version = c_currentVersion;
+    uint16_t m_headerSize = sizeof(ctsBinaryConnectionLogHeader);
+    uint32_t m_recordSize = 0;
+    uint32_t m_reserved = 0;
+    // the QPC frequency and value when the log was created, to place the records on a timeline
+    int64_t m_qpcFrequency = 0;
+    int64_t m_qpcStart = 0;
+    uint8_t m_padding[32]{};
+};
+static_assert(sizeof(ctsBinaryConnectionLogHeader) == 64);
+
+struct ctsBinaryConnectionRecord
+{
+    ctsBinaryRecordType m_recordType = ctsBinaryRecordType::ConnectionFailed;
+    ctsBinaryResultType m_resultType = ctsBinaryResultType::Success;
+    uint32_t m_error = 0;
+    // seconds since ctsTraffic started (the TimeSlice column)
+    float m_timeSlice = 0.0f;
+    SOCKADDR_INET m_localAddress{};
+    SOCKADDR_INET m_remoteAddress{};
+    int64_t m_elapsedMs = 0;
+    // TCP : SendBytes, SendBps, RecvBytes, RecvBps
+    // UDP : Bits/Sec, Completed, Dropped, Repeated, Errors
+    int64_t m_counters[5]{};
+    // TCP : connect latency in microseconds (0 if this side did not connect)
+    // UDP : average network jitter and host jitter in microseconds
+    int64_t m_latencyUsec[2]{};
+    char m_connectionId[40]{};
+    // the name of the protocol error when m_resultType is ProtocolError
+    wchar_t m_protocolError[40]{};
+};
+static_assert(sizeof(ctsBinaryConnectionRecord) == 256);
+
+//
+// Appends records to the file through a fixed buffer
+// - records are written in batches as the buffer fills, and when the object is flushed or destroyed
+//
+class ctsBinaryConnectionLog
+{
+public:
+    // throws wil::ResultException on failure
+    explicit ctsBinaryConnectionLog(_In_ PCWSTR fileName)
+    {
+        m_fileHandle.reset(CreateFileW(
+            fileName,
+            GENERIC_WRITE,
+            FILE_SHARE_READ, // allow others to read the file while we write to it
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr));
+        THROW_LAST_ERROR_IF(!m_fileHandle.is_valid());
+
+        ctsBinaryConnectionLogHeader header;
+        header.m_recordSize = sizeof(ctsBinaryConnectionRecord);
+        LARGE_INTEGER qpc{};
+        QueryPerformanceFrequency(&qpc);
+        header.m_qpcFrequency = qpc.QuadPart;
+        QueryPerformanceCounter(&qpc);
+        header.m_qpcStart = qpc.QuadPart;
+
+        DWORD bytesWritten{};
+        THROW_LAST_ERROR_IF(!WriteFile(m_fileHandle.get(), &header, sizeof header, &bytesWritten, nullptr));
+
+        m_buffer = std::make_unique<ctsBinaryConnectionRecord[]>(c_bufferedRecords);
+    }
+
+    ~ctsBinaryConnectionLog() noexcept
+    {
+        Flush();
+    }
+
+    void Write(const ctsBinaryConnectionRecord& record) noexcept
+    {
+        const auto lock = m_lock.lock();
+        m_buffer[m_bufferedCount] = record;
+        ++m_bufferedCount;
+        if (m_bufferedCount == c_bufferedRecords)
+        {
+            WriteBuffer();
+        }
+    }
+
+    void Flush() noexcept
+    {
+        const auto lock = m_lock.lock();
+        WriteBuffer();
+    }
+
+    ctsBinaryConnectionLog(const ctsBinaryConnectionLog&) = delete;
+    ctsBinaryConnectionLog& operator=(const ctsBinaryConnectionLog&) = delete;
+    ctsBinaryConnectionLog(ctsBinaryConnectionLog&&) = delete;
+    ctsBinaryConnectionLog& operator=(ctsBinaryConnectionLog&&) = delete;
+
+private:
+    // 64KB of records per write
+    static constexpr uint32_t c_bufferedRecords = 256;
+
+    wil::critical_section m_lock{500};
+    wil::unique_hfile m_fileHandle;
+    std::unique_ptr<ctsBinaryConnectionRecord[]> m_buffer;
+    uint32_t m_bufferedCount = 0;
+
+    // must be called holding m_lock
+    void WriteBuffer() noexcept
+    {
+        if (0 == m_bufferedCount)
+        {
+            return;
+        }
+
+        DWORD bytesWritten{};
+        LOG_LAST_ERROR_IF(!WriteFile(
+            m_fileHandle.get(),
+            m_buffer.get(),
+            m_bufferedCount * static_cast<DWORD>(sizeof(ctsBinaryConnectionRecord)),
+            &bytesWritten,
+            nullptr));
+        m_bufferedCount = 0;
+    }
+};
+} // namespace
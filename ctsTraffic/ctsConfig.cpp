@@ -29,15 +29,20 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <wil/resource.h>
 // ctl headers
 #include <ctSockaddr.hpp>
+#include <ctFormat.hpp>
 #include <ctString.hpp>
 #include <ctNetAdapterAddresses.hpp>
 #include <ctSocketExtensions.hpp>
 #include <ctTimer.hpp>
 #include <ctRandom.hpp>
+#include <ctMemoryGuard.hpp>
 #include <ctWmiInitialize.hpp>
 // project headers
 #include "ctsConfig.h"
 #include "ctsLogger.hpp"
+#include "ctsMetricsExporter.h"
+#include "ctsTrace.h"
+#include "ctsBinaryConnectionLog.hpp"
 #include "ctsIOPattern.h"
 #include "ctsPrintStatus.hpp"
 // project functors
@@ -79,6 +84,7 @@ constexpr uint32_t c_defaultTcpConnectionLimit = 8;
 constexpr uint32_t c_defaultUdpConnectionLimit = 1;
 constexpr uint32_t c_defaultConnectionThrottleLimit = 1000;
 constexpr uint32_t c_defaultThreadpoolFactor = 2;
+constexpr uint32_t c_defaultIoBatchLimit = 32;
 
 static PTP_POOL g_threadPool = nullptr;
 static TP_CALLBACK_ENVIRON g_threadPoolEnvironment;
@@ -100,11 +106,15 @@ static uint64_t g_transferSizeHigh = 0;
 
 constexpr uint32_t c_defaultPushBytes = 0x100000;
 constexpr uint32_t c_defaultPullBytes = 0x100000;
+constexpr uint32_t c_defaultPingPongBytes = 64;
+constexpr uint64_t c_defaultPingPongRoundTrips = 10000;
 
 static uint32_t g_timePeriodRefCount{};
 
 static int64_t g_previousPrintTimeslice{};
 static int64_t g_printTimesliceCount{};
+// the system TCP attempt failures when first queried - status reports the count since then
+static long long g_tcpAttemptFailBaseline = -1;
 
 static NET_IF_COMPARTMENT_ID g_compartmentId = NET_IF_COMPARTMENT_ID_UNSPECIFIED;
 static ctNetAdapterAddresses* g_netAdapterAddresses = nullptr;
@@ -120,6 +130,8 @@ static shared_ptr<ctsLogger> g_statusLogger;
 static shared_ptr<ctsLogger> g_errorLogger;
 static shared_ptr<ctsLogger> g_jitterLogger;
 static shared_ptr<ctsLogger> g_tcpInfoLogger;
+// written instead of g_connectionLogger when -ConnectionFilename ends with .ctsbin
+static unique_ptr<ctsBinaryConnectionLog> g_binaryConnectionLog;
 
 static bool g_breakOnError = false;
 static bool g_shutdownCalled = false;
@@ -481,6 +493,26 @@ static void ParseForAccept(vector<const wchar_t*>& args)
             g_acceptFunctionName = L"MediaStream Server Listener";
         }
     }
+
+    const auto foundDepth = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-AcceptDepth");
+        return value != nullptr;
+    });
+    if (foundDepth != end(args))
+    {
+        if (g_configSettings->ListenAddresses.empty() || !ctString::iordinal_equals(L"AcceptEx", g_acceptFunctionName))
+        {
+            throw invalid_argument("-AcceptDepth (only applicable to servers using AcceptEx)");
+        }
+
+        g_configSettings->AcceptDepth = ConvertToIntegral<uint32_t>(ParseArgument(*foundDepth, L"-AcceptDepth"));
+        if (0 == g_configSettings->AcceptDepth)
+        {
+            throw invalid_argument("-AcceptDepth");
+        }
+        // always remove the arg from our vector
+        args.erase(foundDepth);
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -600,6 +632,35 @@ static void ParseForInlineCompletions(vector<const wchar_t*>& args)
     }
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Parses for the max # of IO tasks to process per socket before yielding the thread
+///
+/// -IoBatch:####
+///
+//////////////////////////////////////////////////////////////////////////////////////////
+static void ParseForIoBatch(vector<const wchar_t*>& args)
+{
+    const auto foundArgument = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-IoBatch");
+        return value != nullptr;
+    });
+    if (foundArgument != end(args))
+    {
+        g_configSettings->IoBatchLimit = ConvertToIntegral<uint32_t>(ParseArgument(*foundArgument, L"-IoBatch"));
+        if (0 == g_configSettings->IoBatchLimit)
+        {
+            throw invalid_argument("-IoBatch");
+        }
+        // always remove the arg from our vector
+        args.erase(foundArgument);
+    }
+    else
+    {
+        g_configSettings->IoBatchLimit = c_defaultIoBatchLimit;
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 ///
 /// Parses for the MsgWaitAll setting to use
@@ -681,7 +742,7 @@ static void ParseForProtocol(vector<const wchar_t*>& args)
 ///
 /// Parses for socket Options
 /// - allows for more than one option to be set
-/// -Options:<keepalive,tcpfastpath [-Options:<...>] [-Options:<...>]
+/// -Options:<keepalive,tcpfastpath,rxtimestamp> [-Options:<...>] [-Options:<...>]
 ///
 //////////////////////////////////////////////////////////////////////////////////////////
 static void ParseForOptions(vector<const wchar_t*>& args)
@@ -719,6 +780,51 @@ static void ParseForOptions(vector<const wchar_t*>& args)
                     throw invalid_argument("-Options (tcpfastpath only allowed with TCP sockets)");
                 }
             }
+            else if (ctString::iordinal_equals(L"reusesockets", value))
+            {
+                if (ProtocolType::TCP == g_configSettings->Protocol)
+                {
+                    g_configSettings->Options |= ReuseSockets;
+                }
+                else
+                {
+                    throw invalid_argument("-Options (reusesockets only allowed with TCP sockets)");
+                }
+            }
+            else if (ctString::iordinal_equals(L"precreatesockets", value))
+            {
+                if (g_configSettings->ListenAddresses.empty())
+                {
+                    g_configSettings->Options |= PreCreateSockets;
+                }
+                else
+                {
+                    throw invalid_argument("-Options (precreatesockets only allowed with clients)");
+                }
+            }
+            else if (ctString::iordinal_equals(L"workstealing", value))
+            {
+                // the per-processor threadpools of -CpuAffinity already decide where the state transitions run
+                if (CpuAffinityType::None == g_configSettings->CpuAffinity)
+                {
+                    g_configSettings->Options |= WorkStealing;
+                }
+                else
+                {
+                    throw invalid_argument("-Options (workstealing cannot be used with -CpuAffinity)");
+                }
+            }
+            else if (ctString::iordinal_equals(L"rxtimestamp", value))
+            {
+                if (ProtocolType::UDP == g_configSettings->Protocol && g_configSettings->ListenAddresses.empty())
+                {
+                    g_configSettings->Options |= RecvTimestamps;
+                }
+                else
+                {
+                    throw invalid_argument("-Options (rxtimestamp only allowed with UDP clients)");
+                }
+            }
             else
             {
                 throw invalid_argument("-Options");
@@ -733,6 +839,51 @@ static void ParseForOptions(vector<const wchar_t*>& args)
             break;
         }
     }
+
+    if (g_configSettings->Options & WorkStealing)
+    {
+        // not deleted: the same as the threadpool, callbacks can be running until the process exits
+        g_configSettings->WorkStealingPool = std::make_unique<ctWorkStealingPool>().release();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Parses for the connections-per-second mode
+///
+/// -cps:on
+/// -cps:off (*default)
+///
+//////////////////////////////////////////////////////////////////////////////////////////
+static void ParseForConnectionRate(vector<const wchar_t*>& args)
+{
+    const auto foundArgument = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-cps");
+        return value != nullptr;
+    });
+    if (foundArgument != end(args))
+    {
+        if (g_configSettings->Protocol != ProtocolType::TCP)
+        {
+            throw invalid_argument("-cps (only applicable to TCP)");
+        }
+
+        const auto* const value = ParseArgument(*foundArgument, L"-cps");
+        if (ctString::iordinal_equals(L"on", value))
+        {
+            g_configSettings->ConnectionRate = true;
+        }
+        else if (ctString::iordinal_equals(L"off", value))
+        {
+            g_configSettings->ConnectionRate = false;
+        }
+        else
+        {
+            throw invalid_argument("-cps");
+        }
+        // always remove the arg from our vector
+        args.erase(foundArgument);
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -774,6 +925,7 @@ static void ParseForKeepAlive(vector<const wchar_t*>& args)
 /// -pattern:pull
 /// -pattern:pushpull
 /// -pattern:duplex
+/// -pattern:pingpong
 ///
 //////////////////////////////////////////////////////////////////////////////////////////
 static void ParseForIoPattern(vector<const wchar_t*>& args)
@@ -807,6 +959,10 @@ static void ParseForIoPattern(vector<const wchar_t*>& args)
             // the old name for this was 'flood'
             g_configSettings->IoPattern = IoPatternType::Duplex;
         }
+        else if (ctString::iordinal_equals(L"pingpong", value))
+        {
+            g_configSettings->IoPattern = IoPatternType::PingPong;
+        }
         else
         {
             throw invalid_argument("-pattern");
@@ -867,6 +1023,29 @@ static void ParseForIoPattern(vector<const wchar_t*>& args)
         g_configSettings->PullBytes = c_defaultPullBytes;
     }
 
+    const auto foundPingPongBytes = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-pingpongbytes");
+        return value != nullptr;
+    });
+    if (foundPingPongBytes != end(args))
+    {
+        if (g_configSettings->IoPattern != IoPatternType::PingPong)
+        {
+            throw invalid_argument("-PingPongBytes can only be set with -Pattern:PingPong");
+        }
+        g_configSettings->PingPongBytes = ConvertToIntegral<uint32_t>(ParseArgument(*foundPingPongBytes, L"-pingpongbytes"));
+        if (0 == g_configSettings->PingPongBytes)
+        {
+            throw invalid_argument("-PingPongBytes");
+        }
+        // always remove the arg from our vector
+        args.erase(foundPingPongBytes);
+    }
+    else
+    {
+        g_configSettings->PingPongBytes = c_defaultPingPongBytes;
+    }
+
     const auto foundBurstCount = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
         const auto* const value = ParseArgument(parameter, L"-burstcount");
         return value != nullptr;
@@ -1458,6 +1637,17 @@ static void ParseForTransfer(vector<const wchar_t*>& args)
         // always remove the arg from our vector
         args.erase(foundArgument);
     }
+    else if (g_configSettings->ConnectionRate)
+    {
+        // without a payload to exchange, connections are closed as soon as they are established
+        g_configSettings->ConnectOnly = true;
+    }
+    else if (IoPatternType::PingPong == g_configSettings->IoPattern)
+    {
+        // the default transfer would be millions of round trips of small messages
+        // - default to a fixed number of round trips instead (each round trip sends and receives a message)
+        g_transferSizeLow = static_cast<uint64_t>(g_configSettings->PingPongBytes) * 2 * c_defaultPingPongRoundTrips;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -1524,6 +1714,93 @@ static void ParseForIfIndex(vector<const wchar_t*>& args)
     }
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Parses for how clients choose the target address for each new connection
+///
+/// -TargetPolicy:<roundrobin,leastactive,weighted,latency>
+/// -TargetWeights:####,####,...
+///
+//////////////////////////////////////////////////////////////////////////////////////////
+static void ParseForTargetPolicy(vector<const wchar_t*>& args)
+{
+    const auto foundPolicy = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-TargetPolicy");
+        return value != nullptr;
+    });
+    if (foundPolicy != end(args))
+    {
+        if (!g_configSettings->ListenAddresses.empty())
+        {
+            throw invalid_argument("-TargetPolicy (only applicable to clients)");
+        }
+
+        const auto* const value = ParseArgument(*foundPolicy, L"-TargetPolicy");
+        if (ctString::iordinal_equals(L"roundrobin", value))
+        {
+            g_configSettings->TargetPolicy = TargetPolicyType::RoundRobin;
+        }
+        else if (ctString::iordinal_equals(L"leastactive", value))
+        {
+            g_configSettings->TargetPolicy = TargetPolicyType::LeastActive;
+        }
+        else if (ctString::iordinal_equals(L"weighted", value))
+        {
+            g_configSettings->TargetPolicy = TargetPolicyType::Weighted;
+        }
+        else if (ctString::iordinal_equals(L"latency", value))
+        {
+            g_configSettings->TargetPolicy = TargetPolicyType::LowestLatency;
+        }
+        else
+        {
+            throw invalid_argument("-TargetPolicy");
+        }
+        // always remove the arg from our vector
+        args.erase(foundPolicy);
+    }
+
+    const auto foundWeights = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-TargetWeights");
+        return value != nullptr;
+    });
+    if (foundWeights != end(args))
+    {
+        if (g_configSettings->TargetPolicy != TargetPolicyType::Weighted)
+        {
+            throw invalid_argument("-TargetWeights requires -TargetPolicy:weighted");
+        }
+
+        const wstring value(ParseArgument(*foundWeights, L"-TargetWeights"));
+        size_t weightStart = 0;
+        for (;;)
+        {
+            const auto weightEnd = value.find(L',', weightStart);
+            const auto weight = ConvertToIntegral<uint32_t>(value.substr(weightStart, weightEnd - weightStart));
+            if (0 == weight)
+            {
+                throw invalid_argument("-TargetWeights (each weight must be greater than zero)");
+            }
+            g_configSettings->TargetWeights.push_back(weight);
+            if (wstring::npos == weightEnd)
+            {
+                break;
+            }
+            weightStart = weightEnd + 1;
+        }
+        // always remove the arg from our vector
+        args.erase(foundWeights);
+    }
+
+    if (g_configSettings->TargetPolicy == TargetPolicyType::Weighted &&
+        g_configSettings->TargetWeights.size() != g_configSettings->TargetAddresses.size())
+    {
+        throw invalid_argument(
+            "-TargetPolicy:weighted requires -TargetWeights to give one weight for each target address "
+            "(after resolving names, in the order printed in the settings)");
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 ///
 /// Parses for Tcp throttling parameters
@@ -1619,6 +1896,7 @@ static void ParseForIterations(vector<const wchar_t*>& args)
 ///
 /// -ConsoleVerbosity:## <0-6>
 /// -StatusUpdate:####
+/// -CpuCost:<on,off>
 ///
 //////////////////////////////////////////////////////////////////////////////////////////
 static void ParseForLogging(vector<const wchar_t*>& args)
@@ -1653,6 +1931,29 @@ static void ParseForLogging(vector<const wchar_t*>& args)
         args.erase(foundStatusUpdate);
     }
 
+    const auto foundCpuCost = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-CpuCost");
+        return value != nullptr;
+    });
+    if (foundCpuCost != end(args))
+    {
+        const auto* const value = ParseArgument(*foundCpuCost, L"-CpuCost");
+        if (ctString::iordinal_equals(L"on", value))
+        {
+            g_configSettings->CpuCostStatus = true;
+        }
+        else if (ctString::iordinal_equals(L"off", value))
+        {
+            g_configSettings->CpuCostStatus = false;
+        }
+        else
+        {
+            throw invalid_argument("-CpuCost");
+        }
+        // always remove the arg from our vector
+        args.erase(foundCpuCost);
+    }
+
     wstring connectionFilename;
     wstring errorFilename;
     wstring statusFilename;
@@ -1719,7 +2020,11 @@ static void ParseForLogging(vector<const wchar_t*>& args)
 
     if (!connectionFilename.empty())
     {
-        if (ctString::iends_with(connectionFilename, L".csv"))
+        if (ctString::iends_with(connectionFilename, L".ctsbin"))
+        {
+            g_binaryConnectionLog = make_unique<ctsBinaryConnectionLog>(connectionFilename.c_str());
+        }
+        else if (ctString::iends_with(connectionFilename, L".csv"))
         {
             g_connectionLogger = make_shared<ctsTextLogger>(connectionFilename.c_str(), StatusFormatting::Csv);
         }
@@ -1733,6 +2038,10 @@ static void ParseForLogging(vector<const wchar_t*>& args)
     {
         if (ctString::iordinal_equals(connectionFilename, errorFilename))
         {
+            if (g_binaryConnectionLog)
+            {
+                throw invalid_argument("The error logfile cannot be of ctsbin format");
+            }
             if (g_connectionLogger->IsCsvFormat())
             {
                 throw invalid_argument("The error logfile cannot be of csv format");
@@ -1753,6 +2062,10 @@ static void ParseForLogging(vector<const wchar_t*>& args)
     {
         if (ctString::iordinal_equals(connectionFilename, statusFilename))
         {
+            if (g_binaryConnectionLog)
+            {
+                throw invalid_argument("The status logfile cannot be of ctsbin format");
+            }
             if (g_connectionLogger->IsCsvFormat())
             {
                 throw invalid_argument("The same csv filename cannot be used for different loggers");
@@ -1816,6 +2129,36 @@ static void ParseForLogging(vector<const wchar_t*>& args)
             throw invalid_argument("TCP Info can only be logged using a csv format");
         }
     }
+
+    const auto foundMetricsPort = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-MetricsPort");
+        return value != nullptr;
+    });
+    if (foundMetricsPort != end(args))
+    {
+        g_configSettings->MetricsPort = ConvertToIntegral<uint16_t>(ParseArgument(*foundMetricsPort, L"-MetricsPort"));
+        if (0 == g_configSettings->MetricsPort)
+        {
+            throw invalid_argument("-MetricsPort");
+        }
+        // always remove the arg from our vector
+        args.erase(foundMetricsPort);
+    }
+
+    const auto foundTraceFilename = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-TraceFilename");
+        return value != nullptr;
+    });
+    if (foundTraceFilename != end(args))
+    {
+        g_configSettings->TraceFilename = ParseArgument(*foundTraceFilename, L"-TraceFilename");
+        if (g_configSettings->TraceFilename.empty())
+        {
+            throw invalid_argument("-TraceFilename");
+        }
+        // always remove the arg from our vector
+        args.erase(foundTraceFilename);
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -2042,6 +2385,47 @@ static void ParseForThreadpool(vector<const wchar_t*>& args)
     g_configSettings->pTpEnvironment = &g_threadPoolEnvironment;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Parses for whether to run each connection's callbacks on one processor
+///
+/// -CpuAffinity:<none,roundrobin,rss>
+///
+//////////////////////////////////////////////////////////////////////////////////////////
+static void ParseForCpuAffinity(vector<const wchar_t*>& args)
+{
+    const auto foundArgument = ranges::find_if(args, [](const wchar_t* parameter) -> bool {
+        const auto* const value = ParseArgument(parameter, L"-CpuAffinity");
+        return value != nullptr;
+    });
+    if (foundArgument != end(args))
+    {
+        const auto* const value = ParseArgument(*foundArgument, L"-CpuAffinity");
+        if (ctString::iordinal_equals(L"none", value))
+        {
+            g_configSettings->CpuAffinity = CpuAffinityType::None;
+        }
+        else if (ctString::iordinal_equals(L"roundrobin", value))
+        {
+            g_configSettings->CpuAffinity = CpuAffinityType::RoundRobin;
+        }
+        else if (ctString::iordinal_equals(L"rss", value))
+        {
+            if (ProtocolType::TCP != g_configSettings->Protocol)
+            {
+                throw invalid_argument("-CpuAffinity:rss requires TCP");
+            }
+            g_configSettings->CpuAffinity = CpuAffinityType::Rss;
+        }
+        else
+        {
+            throw invalid_argument("-CpuAffinity");
+        }
+        // always remove the arg from our vector
+        args.erase(foundArgument);
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 ///
 /// Parses for whether to verify buffer contents on receiver
@@ -2274,18 +2658,28 @@ void PrintUsage(PrintUsageOption option)
                 L"\t- supports range : [low,high]  (each connection will randomly choose a buffer size from within this range)\n"
                 L"\t  note : Buffer is note required when -Pattern:MediaStream is specified,\n"
                 L"\t       : FrameSize is the effective buffer size in that traffic pattern\n"
+                L"-Cps:<on,off>\n"
+                L"   - measures the rate connections are established (connections per second)\n"
+                L"\t- <default> == off\n"
+                L"\t- on : connections are closed as soon as they are established, without transferring any data\n"
+                L"\t       unless -Transfer is specified, in which case that small payload is exchanged first\n"
+                L"\t       connects/sec (or accepts/sec) and connect handshake percentiles are written in the summary\n"
+                L"\t  note : both the client and the server must specify -Cps:on\n"
+                L"\t  note : -Options:reusesockets avoids the cost of creating a new socket for each connection\n"
                 L"-IO:<iocp,rioiocp>\n"
                 L"   - the API set and usage for processing the protocol pattern\n"
                 L"\t- <default> == iocp\n"
                 L"\t- iocp : leverages WSARecv/WSASend using IOCP for async completions\n"
                 L"\t- rioiocp : registered i/o using an overlapped IOCP for completion notification\n"
-                L"-Pattern:<push,pull,pushpull,duplex,burst>\n"
+                L"-Pattern:<push,pull,pushpull,duplex,pingpong>\n"
                 L"   - the protocol pattern to send & recv over the TCP connection\n"
                 L"\t- <default> == push\n"
                 L"\t- push : client pushes data to the server\n"
                 L"\t- pull : client pulls data from the server\n"
                 L"\t- pushpull : client/server alternates sending/receiving data\n"
                 L"\t- duplex : client/server sends and receives concurrently throughout the entire connection\n"
+                L"\t- pingpong : client/server alternate sending a single small message, measuring each round trip\n"
+                L"\t             TCP_NODELAY is set on all sockets and round-trip percentiles are written per connection\n"
                 L"-PullBytes:#####\n"
                 L"   - applied only with -Pattern:PushPull - the number of bytes to 'pull'\n"
                 L"\t- <default> == 1048576 (1MB)\n"
@@ -2294,6 +2688,11 @@ void PrintUsage(PrintUsageOption option)
                 L"   - applied only with -Pattern:PushPull - the number of bytes to 'push'\n"
                 L"\t- <default> == 1048576 (1MB)\n"
                 L"\t  note : pushbytes are the bytes sent from the client and received on the server\n"
+                L"-PingPongBytes:#####\n"
+                L"   - applied only with -Pattern:PingPong - the number of bytes in each message\n"
+                L"\t- <default> == 64\n"
+                L"\t  note : unless -transfer is specified, each connection will complete 10000 round trips\n"
+                L"\t  note : -transfer is rounded up to a multiple of 2 * PingPongBytes (a whole number of round trips)\n"
                 L"-BurstCount:####\n"
                 L"   - optional parameter\n"
                 L"   - applies to any TCP IO Pattern\n"
@@ -2375,6 +2774,8 @@ void PrintUsage(PrintUsageOption option)
                 L"                             the details printed are aggregate values from all connections for that time slice\n"
                 L"  - Jitter information     : for UDP-patterns only, the jitter logging information will write out data per-datagram\n"
                 L"                             -JitterFilename specifies the file written with this data\n"
+                L"                             this per-frame log is optional: RFC 3550 jitter, delay variation percentiles,\n"
+                L"                             reordering, late frames and loss runs are always summarized per stream and overall\n"
                 L"                             this information is formatted specifically to calculate jitter between packets\n"
                 L"                             it follows the same format used with the published tool ntttcp.exe:\n"
                 L"                             [frame#],[sender.qpc],[sender.qpf],[receiver.qpc],[receiver.qpf]\n"
@@ -2409,6 +2810,9 @@ void PrintUsage(PrintUsageOption option)
                 // L"\t   - 6 : above + debug output\n" // Not exposing debug information to users
                 L"-ConnectionFilename:<filename with/without path>\n"
                 L"\t - <default> == not written to a log file\n"
+                L"\t   note : a filename ending in .csv is written in csv format\n"
+                L"\t   note : a filename ending in .ctsbin is written as fixed-size binary records\n"
+                L"\t          which ctsLogConverter.exe converts to the csv format\n"
                 L"-ErrorFilename:<filename with/without path>\n"
                 L"\t - <default> == not written to a log file\n"
                 L"-StatusFilename:<filename with/without path>\n"
@@ -2420,6 +2824,26 @@ void PrintUsage(PrintUsageOption option)
                 L"-StatusUpdate:####\n"
                 L"\t - the millisecond frequency which real-time status updates are written\n"
                 L"\t   <default> == 5000 (milliseconds)\n"
+                L"-CpuCost:<on,off>\n"
+                L"\t - adds the CPU cost of each time slice to the status updates:\n"
+                L"\t   CPU seconds per GB sent and received, processor cycles per send or receive completed,\n"
+                L"\t   and context switches per second of this process\n"
+                L"\t   <default> == off\n"
+                L"\t   note : the CPU cost over the entire run is always included in the summary\n"
+                L"-MetricsPort:####\n"
+                L"\t - serves live statistics over HTTP at http://127.0.0.1:####/metrics in the OpenMetrics format\n"
+                L"\t   including the connection, TCP and UDP counters, IO latency, and per-processor IO counters\n"
+                L"\t   <default> == not served\n"
+                L"\t   note : only reachable from the local machine (bound to the loopback address)\n"
+                L"-TraceFilename:<filename with/without path>\n"
+                L"\t - records every IO request and completion, timer, socket state change, broker refresh\n"
+                L"\t   and media stream frame sent or received,\n"
+                L"\t   as compact binary events, which ctsLogConverter.exe converts to a Chrome / Perfetto trace (json)\n"
+                L"\t   <default> == not traced\n"
+                L"\t   note : events are buffered per thread; if a thread records faster than they are written\n"
+                L"\t          to the file, its new events are dropped (the count is kept in the file)\n"
+                L"\t   note : the same events are always available from the \"ctsTraffic\" ETW provider (TraceLogging)\n"
+                L"\t          e.g. tracelog -start cts -guid *ctsTraffic -f cts.etl\n"
                 L"\n");
             break;
 
@@ -2437,12 +2861,18 @@ void PrintUsage(PrintUsageOption option)
                 L"\t- AcceptEx : uses OVERLAPPED AcceptEx with IO Completion ports\n"
                 L"\t- accept : uses blocking calls to accept\n"
                 L"\t         : be careful using this as it will not scale out well as each call blocks a thread\n"
+                L"-AcceptDepth:####\n"
+                L"   - the number of AcceptEx requests kept outstanding on each listening address for each processor\n"
+                L"     accepted connections are handed to new connections on the processor they completed on\n"
+                L"\t- <default> == 100 divided across the processors, with at least 4 per processor\n"
+                L"\t  note : only applies to servers using AcceptEx\n"
                 L"-Bind:<IP-address or *>\n"
                 L"   - a client-side option used to control what IP address is used for outgoing connections\n"
                 L"\t- <default> == *  (will implicitly bind to the correct IP to connect to the target IP)\n"
                 L"\t  note : this is typically only necessary when wanting to distribute traffic\n"
                 L"\t         over a specific interface for multi-homed configurations\n"
                 L"\t  note : can specify multiple addresses by providing -Bind for each address\n"
+                L"\t         TCP connections to each target use the bind address with the fewest connections to that target\n"
                 L"-Compartment:<ifAlias>\n"
                 L"   - specifies the interface alias of the compartment to use for all sockets\n"
                 L"    this is most commonly appropriate for servers configured with IP Compartments\n"
@@ -2457,6 +2887,15 @@ void PrintUsage(PrintUsageOption option)
                 L"\t- ConnectEx : uses OVERLAPPED ConnectEx with IO Completion ports\n"
                 L"\t- connect : uses blocking calls to connect\n"
                 L"\t          : be careful using this as it will not scale out well as each call blocks a thread\n"
+                L"-CpuAffinity:<none,roundrobin,rss>\n"
+                L"   - places each connection on one processor for its lifetime\n"
+                L"     its IO completions, timers and state changes run on threads affinitized to that processor\n"
+                L"\t- <default> == none  (callbacks run on any thread of the shared threadpool)\n"
+                L"\t- roundrobin : connections are assigned to each processor in turn\n"
+                L"\t- rss : as roundrobin, then each connection is moved to the processor its packets are received on\n"
+                L"\t        (SIO_QUERY_RSS_PROCESSOR_INFO) - only TCP servers can move connections before their IO starts\n"
+                L"\t        client connections already on another processor are counted as cross-core handoffs\n"
+                L"\t  note : the summary then includes the bytes and the threadpool CPU time of each processor\n"
                 L"-IfIndex:####\n"
                 L"   - the interface index which to use for outbound connectivity\n"
                 L"     assigns the interface with IP_UNICAST_IF / IPV6_UNICAST_IF\n"
@@ -2467,6 +2906,12 @@ void PrintUsage(PrintUsageOption option)
                 L"     ::SetFileCompletionNotificationModes(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)\n"
                 L"\t- <default> == on for TCP 'iocp' -IO option, and is on for UDP client receivers\n"
                 L"                 off for all other -IO options\n"
+                L"-IoBatch:####\n"
+                L"   - the max # of IO requests started or completed inline on a socket before yielding the thread\n"
+                L"     the next IO request is then started from the threadpool so one fast connection\n"
+                L"     cannot hold a thread (and the socket lock) indefinitely\n"
+                L"\t- <default> == 32\n"
+                L"\t  note : only applies to the TCP 'iocp' -IO option\n"
                 L"-IO:<readwritefile>\n"
                 L"   - an additional IO option beyond iocp and rioiocp\n"
                 L"\t- readwritefile : leverages ReadFile/WriteFile using IOCP for async completions\n"
@@ -2483,6 +2928,9 @@ void PrintUsage(PrintUsageOption option)
                 L"\t  note : Be very careful when using with TCP connections, as port values will not be immediately\n"
                 L"\t         reusable; TCP will hold an closed IP:port in a TIME_WAIT statue for a period of time\n"
                 L"\t         only after which will it be able to be reused (default is 4 minutes)\n"
+                L"\t  note : with TCP, ports are tracked per bind address and target address (the 4-tuple)\n"
+                L"\t         the same port is used concurrently to different targets (with SO_REUSEADDR)\n"
+                L"\t         and the port released the longest time ago is chosen next\n"
                 L"-MsgWaitAll:<on,off>\n"
                 L"   - sets the MSG_WAITALL flag when calling WSARecv for receiving data over TCP connections\n"
                 L"     this flag instructs TCP to not complete the receive request until the entire buffer is full\n"
@@ -2495,13 +2943,27 @@ void PrintUsage(PrintUsageOption option)
                 L"\t- log : log error information only\n"
                 L"\t- break : break into the debugger with error information\n"
                 L"\t          useful when live-troubleshooting difficult failures\n"
-                L"-Options:<keepalive,tcpfastpath>  [-Options:<...>] [-Options:<...>]\n"
+                L"-Options:<keepalive,tcpfastpath,rxtimestamp,reusesockets,precreatesockets,workstealing>  [-Options:<...>] [-Options:<...>]\n"
                 L"   - additional socket options and IOCTLS available to be set on connected sockets\n"
                 L"\t- <default> == None\n"
                 L"\t- keepalive : only for TCP sockets - enables default timeout Keep-Alive probes\n"
                 L"\t            : ctsTraffic servers have this enabled by default\n"
                 L"\t- tcpfastpath : a new option for Windows 8, only for TCP sockets over loopback\n"
                 L"\t              : the firewall must be disabled for the option to take effect\n"
+                L"\t- reusesockets : only for TCP sockets using ConnectEx and AcceptEx\n"
+                L"\t               : successfully completed connections are disconnected with DisconnectEx(TF_REUSE_SOCKET)\n"
+                L"\t               : and the socket is reused for a later connection instead of creating a new socket\n"
+                L"\t- precreatesockets : only for clients - sockets are created, have their options set, and are bound\n"
+                L"\t                   : before connections are started, and the pool is refilled in the background\n"
+                L"\t                   : the pool holds the lesser of -Connections and -ThrottleConnections sockets\n"
+                L"\t                   : this keeps socket creation off the connection path when ramping up many connections\n"
+                L"\t- workstealing : the socket state transitions and the connection refreshes run on a pool of\n"
+                L"\t                 one thread per processor with per-thread work-stealing queues, instead of the threadpool\n"
+                L"\t                 IO completions still run on the threadpool; cannot be used with -CpuAffinity\n"
+                L"\t- rxtimestamp : only for UDP clients - enables SIO_TIMESTAMPING receive timestamps\n"
+                L"\t              : jitter is then measured from when the network stack received each datagram\n"
+                L"\t              : and the jitter added by this host is reported separately\n"
+                L"\t              : requires Windows 10 20H1 or later\n"
                 L"-PauseAtEnd:####\n"
                 L"   - specifies the number of milliseconds to pause before finally exiting the process after all work is done\n"
                 L"     this is useful for automation when one needs the process to not exit immediately\n"
@@ -2544,6 +3006,19 @@ void PrintUsage(PrintUsageOption option)
                 L"\t     Note: this is only necessary to specify in carefully considered scenarios\n"
                 L"\t     the default send buffering is optimal for the majority of scenarios\n"
                 L"\t- <default> == <not set>\n"
+                L"-TargetPolicy:<roundrobin,leastactive,weighted,latency>\n"
+                L"   - how clients choose which -Target address each new connection is made to\n"
+                L"\t- <default> == roundrobin\n"
+                L"\t- roundrobin : each target address in turn\n"
+                L"\t- leastactive : the target address with the fewest connections currently open\n"
+                L"\t- weighted : in proportion to the weights given with -TargetWeights\n"
+                L"\t- latency : the lower connect latency of two target addresses chosen at random (TCP only)\n"
+                L"\t  note : the summary then prints the connections, errors, and bytes for each target address\n"
+                L"\t       : this is a client-only option\n"
+                L"-TargetWeights:####,####,...\n"
+                L"   - the relative weight of each target address with -TargetPolicy:weighted\n"
+                L"\t  note : one weight is required for each target address, after names are resolved\n"
+                L"\t         in the order they are printed in the settings\n"
                 L"-ThrottleConnections:####\n"
                 L"   - gates currently pended connection attempts\n"
                 L"\t- <default> == 1000  (there will be at most 1000 sockets trying to connect at any one time)\n"
@@ -2653,6 +3128,7 @@ bool Startup(int argc, _In_reads_(argc) const wchar_t** argv)
     ParseForPort(args);
     ParseForLocalport(args);
     ParseForIfIndex(args);
+    ParseForTargetPolicy(args);
 
     //
     // ensure a Port is assigned to all listening addresses and target addresses
@@ -2689,6 +3165,7 @@ bool Startup(int argc, _In_reads_(argc) const wchar_t** argv)
 
     ParseForIoPattern(args);
     ParseForThreadpool(args);
+    ParseForCpuAffinity(args);
     // validate protocol & pattern combinations
     if (ProtocolType::UDP == g_configSettings->Protocol && IoPatternType::MediaStream != g_configSettings->IoPattern)
     {
@@ -2725,6 +3202,7 @@ bool Startup(int argc, _In_reads_(argc) const wchar_t** argv)
     // Next: capture other various settings which do not have explicit dependencies
     //
     ParseForOptions(args);
+    ParseForConnectionRate(args);
     ParseForKeepAlive(args);
     ParseForCompartment(args);
     ParseForConnections(args);
@@ -2775,6 +3253,11 @@ bool Startup(int argc, _In_reads_(argc) const wchar_t** argv)
         }
     }
 
+    if (TargetPolicyType::LowestLatency == g_configSettings->TargetPolicy && ProtocolType::TCP != g_configSettings->Protocol)
+    {
+        throw invalid_argument("-TargetPolicy:latency requires TCP to measure the connect latency");
+    }
+
     // validate localport usage
     if (!g_configSettings->ListenAddresses.empty() && g_configSettings->LocalPortLow != 0)
     {
@@ -2782,7 +3265,13 @@ bool Startup(int argc, _In_reads_(argc) const wchar_t** argv)
     }
     if (g_configSettings->LocalPortLow != 0)
     {
-        const USHORT numberOfPorts = g_configSettings->LocalPortHigh == 0 ? 1 : static_cast<USHORT>(g_configSettings->LocalPortHigh - g_configSettings->LocalPortLow + 1);
+        uint64_t numberOfPorts = g_configSettings->LocalPortHigh == 0 ? 1 : static_cast<USHORT>(g_configSettings->LocalPortHigh - g_configSettings->LocalPortLow + 1);
+        if (ProtocolType::TCP == g_configSettings->Protocol)
+        {
+            // TCP local ports are allocated per 4-tuple: each port can be used from every bind address to every target
+            // - this is the upper bound, as addresses of different families are never paired
+            numberOfPorts *= g_configSettings->BindAddresses.size() * g_configSettings->TargetAddresses.size();
+        }
         if (numberOfPorts < g_configSettings->ConnectionLimit)
         {
             throw invalid_argument(
@@ -2813,6 +3302,7 @@ bool Startup(int argc, _In_reads_(argc) const wchar_t** argv)
     //
     ParseForIoFunction(args);
     ParseForInlineCompletions(args);
+    ParseForIoBatch(args);
     ParseForMsgWaitAll(args);
     ParseForCreate(args);
     ParseForConnect(args);
@@ -2833,6 +3323,33 @@ bool Startup(int argc, _In_reads_(argc) const wchar_t** argv)
         throw invalid_argument("-PrePostRecvs > 1 requires -Verify:connection when using TCP");
     }
     ParseForPrepostsends(args);
+    if (g_configSettings->Options & ReuseSockets)
+    {
+        // sockets disconnected with DisconnectEx(TF_REUSE_SOCKET) can only be passed back to ConnectEx or AcceptEx
+        if (IsListening() ? !ctString::iordinal_equals(L"AcceptEx", g_acceptFunctionName) : !ctString::iordinal_equals(L"ConnectEx", g_connectFunctionName))
+        {
+            throw invalid_argument("-Options:reusesockets requires ConnectEx and AcceptEx (-conn:ConnectEx -acc:AcceptEx)");
+        }
+        if (WI_IsFlagSet(g_configSettings->SocketFlags, WSA_FLAG_REGISTERED_IO))
+        {
+            throw invalid_argument("-Options:reusesockets cannot be used with -io:rioiocp");
+        }
+        // a reused socket stays associated with the threadpool of the processor it was first used on
+        if (CpuAffinityType::None != g_configSettings->CpuAffinity)
+        {
+            throw invalid_argument("-Options:reusesockets cannot be used with -CpuAffinity");
+        }
+        // the ideal send backlog notification stays pended on the socket until it's closed
+        if (0 == g_configSettings->PrePostSends)
+        {
+            throw invalid_argument("-Options:reusesockets requires -PrePostSends to be non-zero");
+        }
+        // a reused socket keeps the local address it was first bound to
+        if (g_configSettings->LocalPortLow != 0)
+        {
+            throw invalid_argument("-Options:reusesockets cannot be used with -LocalPort");
+        }
+    }
     ParseForRecvbufvalue(args);
     ParseForSendbufvalue(args);
 
@@ -2880,6 +3397,15 @@ void Shutdown() noexcept
     delete g_netAdapterAddresses;
     g_netAdapterAddresses = nullptr;
 
+    ctsMetricsExporter::Stop();
+    ctsTrace::Stop();
+
+    // results from connections still completing are written when the log is destroyed
+    if (g_binaryConnectionLog)
+    {
+        g_binaryConnectionLog->Flush();
+    }
+
     while (g_timePeriodRefCount > 0)
     {
         timeEndPeriod(1);
@@ -2945,7 +3471,7 @@ void PrintLegend() noexcept
 
     if (g_jitterLogger && g_jitterLogger->IsCsvFormat())
     {
-        g_jitterLogger->LogMessage(L"SequenceNumber,SenderQpc,SenderQpf,ReceiverQpc,ReceiverQpf,RelativeInFlightTimeMs,PrevToCurrentInFlightTimeJitter\r\n");
+        g_jitterLogger->LogMessage(L"SequenceNumber,SenderQpc,SenderQpf,ReceiverQpc,ReceiverQpf,RelativeInFlightTimeMs,PrevToCurrentInFlightTimeJitter,ReceiverAppQpc,HostDelayMs,PrevToCurrentHostDelayJitter\r\n");
     }
 
     if (g_tcpInfoLogger && g_tcpInfoLogger->IsCsvFormat())
@@ -3252,25 +3778,46 @@ void PrintJitterUpdate(const JitterFrameEntry& currentFrame, const JitterFrameEn
         if (g_jitterLogger)
         {
             const auto jitter = std::abs(previousFrame.m_estimatedTimeInFlightMs - currentFrame.m_estimatedTimeInFlightMs);
-            // int64_t ~= up to 20 characters long, 10 for each float, plus 10 for commas & CR
-            constexpr size_t formattedTextLength = 20 * 5 + 10 * 2 + 10;
-            wchar_t formattedText[formattedTextLength]{};
-            const auto converted = _snwprintf_s(
-                formattedText,
-                formattedTextLength,
-                L"%lld,%lld,%lld,%lld,%lld,%.3f,%.3f\r\n",
-                currentFrame.m_sequenceNumber, currentFrame.m_senderQpc, currentFrame.m_senderQpf, currentFrame.m_receiverQpc, currentFrame.m_receiverQpf, currentFrame.m_estimatedTimeInFlightMs, jitter);
-            FAIL_FAST_IF(-1 == converted);
-            g_jitterLogger->LogMessage(formattedText);
+            // the host delay is zero unless receive timestamps are enabled (-Options:rxtimestamp)
+            const auto hostDelay = currentFrame.HostDelayMs();
+            const auto hostJitter = std::abs(previousFrame.HostDelayMs() - hostDelay);
+            try
+            {
+                g_jitterLogger->LogMessage(ctFormatUtf8(
+                    "{},{},{},{},{},{:.3f},{:.3f},{},{:.3f},{:.3f}\r\n",
+                    currentFrame.m_sequenceNumber, currentFrame.m_senderQpc, currentFrame.m_senderQpf, currentFrame.m_receiverQpc, currentFrame.m_receiverQpf, currentFrame.m_estimatedTimeInFlightMs, jitter,
+                    currentFrame.m_receiverAppQpc, hostDelay, hostJitter));
+            }
+            catch (...)
+            {
+            }
         }
     }
 }
 
-void PrintNewConnection(const ctSockaddr& localAddr, const ctSockaddr& remoteAddr) noexcept try
+// writes the connection text formatted by ctFormatUtf8 on this thread
+// - to the console (as UTF16), and to the connection log if it's not writing csv
+static void WriteConnectionText(bool writeToConsole)
 {
-    ctsConfigInitOnce();
+    if (writeToConsole)
+    {
+        thread_local std::wstring t_consoleText;
+        t_consoleText.clear();
+        ctAppendUtf16(ctThreadFormatBuffer(), t_consoleText);
+        fwprintf(stdout, L"%ws\n", t_consoleText.c_str());
+    }
 
-    // write even after shutdown so can print the final summaries
+    if (g_connectionLogger && !g_connectionLogger->IsCsvFormat())
+    {
+        g_connectionLogger->LogMessage(ctFormatUtf8Append("\r\n"));
+    }
+}
+
+void PrintNewConnection(const ctSockaddr& localAddr, const ctSockaddr& remoteAddr) noexcept try
+{
+    ctsConfigInitOnce();
+
+    // write even after shutdown so can print the final summaries
     auto writeToConsole = false;
     // ReSharper disable once CppDefaultCaseNotHandledInSwitchStatement
     switch (g_consoleVerbosity) // NOLINT(hicpp-multiway-paths-covered)
@@ -3287,35 +3834,74 @@ void PrintNewConnection(const ctSockaddr& localAddr, const ctSockaddr& remoteAdd
         }
     }
 
-    WCHAR wsaLocalAddress[ctSockaddr::FixedStringLength]{};
-    localAddr.writeCompleteAddress(wsaLocalAddress);
-    WCHAR wsaRemoteAddress[ctSockaddr::FixedStringLength]{};
-    remoteAddr.writeCompleteAddress(wsaRemoteAddress);
-    if (writeToConsole)
+    if (!writeToConsole && !(g_connectionLogger && !g_connectionLogger->IsCsvFormat()))
     {
-        wprintf_s(
-            ProtocolType::TCP == g_configSettings->Protocol ?
-            L"[%.3f] TCP connection established [%ws - %ws]\n" :
-            L"[%.3f] UDP connection established [%ws - %ws]\n",
-            GetStatusTimeStamp(),
-            wsaLocalAddress,
-            wsaRemoteAddress);
+        return;
     }
 
-    if (g_connectionLogger && !g_connectionLogger->IsCsvFormat())
+    CHAR localAddress[ctSockaddr::FixedStringLength]{};
+    localAddr.writeCompleteAddress(localAddress);
+    CHAR remoteAddress[ctSockaddr::FixedStringLength]{};
+    remoteAddr.writeCompleteAddress(remoteAddress);
+    ctFormatUtf8(
+        "[{:.3f}] {} connection established [{} - {}]",
+        GetStatusTimeStamp(),
+        ProtocolType::TCP == g_configSettings->Protocol ? "TCP" : "UDP",
+        localAddress,
+        remoteAddress);
+    WriteConnectionText(writeToConsole);
+}
+catch (...)
+{
+}
+
+static void FillBinaryRecord(
+    ctsBinaryConnectionRecord& record,
+    ctsBinaryRecordType recordType,
+    const ctSockaddr& localAddr,
+    const ctSockaddr& remoteAddr,
+    uint32_t error,
+    float currentTime) noexcept
+{
+    record.m_recordType = recordType;
+    record.m_error = error;
+    record.m_timeSlice = currentTime;
+    record.m_localAddress = *localAddr.sockaddr_inet();
+    record.m_remoteAddress = *remoteAddr.sockaddr_inet();
+    if (0 == error)
     {
-        g_connectionLogger->LogMessage(
-            wil::str_printf<std::wstring>(
-                ProtocolType::TCP == g_configSettings->Protocol ?
-                L"[%.3f] TCP connection established [%ws - %ws]\r\n" :
-                L"[%.3f] UDP connection established [%ws - %ws]\r\n",
-                GetStatusTimeStamp(),
-                wsaLocalAddress,
-                wsaRemoteAddress).c_str());
+        record.m_resultType = ctsBinaryResultType::Success;
+    }
+    else if (ctsIoPattern::IsProtocolError(error))
+    {
+        record.m_resultType = ctsBinaryResultType::ProtocolError;
+        wcscpy_s(record.m_protocolError, ctsIoPattern::BuildProtocolErrorString(error));
+    }
+    else
+    {
+        record.m_resultType = ctsBinaryResultType::NetworkError;
     }
 }
-catch (...)
+
+// the Result column: only a network error needs a string built (and so allocates)
+static ctWideArg BuildResultString(uint32_t error, std::wstring& errorString)
 {
+    if (0 == error)
+    {
+        return ctWideArg{L"Succeeded"};
+    }
+    if (ctsIoPattern::IsProtocolError(error))
+    {
+        return ctWideArg{ctsIoPattern::BuildProtocolErrorString(error)};
+    }
+
+    errorString = wil::str_printf<std::wstring>(
+        L"%lu: %ws",
+        error,
+        ctString::format_message(error).c_str());
+    // remove any commas from the formatted string - since that will mess up csv files
+    ctString::replace_all(errorString, L",", L" ");
+    return ctWideArg{errorString};
 }
 
 void PrintConnectionResults(uint32_t error) noexcept try
@@ -3339,102 +3925,45 @@ void PrintConnectionResults(uint32_t error) noexcept try
         }
     }
 
-    enum class ErrorType
-    {
-        Success,
-        NetworkError,
-        ProtocolError
-    } errorType = ErrorType::Success;
+    const float currentTime = GetStatusTimeStamp();
 
-    if (0 == error)
+    if (g_binaryConnectionLog)
     {
-        errorType = ErrorType::Success;
+        ctsBinaryConnectionRecord record;
+        FillBinaryRecord(record, ctsBinaryRecordType::ConnectionFailed, ctSockaddr(), ctSockaddr(), error, currentTime);
+        g_binaryConnectionLog->Write(record);
     }
-    else if (ctsIoPattern::IsProtocolError(error))
-    {
-        errorType = ErrorType::ProtocolError;
-    }
-    else
+    if (!writeToConsole && !g_connectionLogger)
     {
-        errorType = ErrorType::NetworkError;
+        return;
     }
 
-
-    const float currentTime = GetStatusTimeStamp();
-
-    wstring csvString;
-    wstring textString;
     wstring errorString;
-    if (ErrorType::ProtocolError != errorType)
-    {
-        if (0 == error)
-        {
-            errorString = L"Succeeded";
-        }
-        else
-        {
-            errorString = wil::str_printf<std::wstring>(
-                L"%lu: %ws",
-                error,
-                ctString::format_message(error).c_str());
-            // remove any commas from the formatted string - since that will mess up csv files
-            ctString::replace_all(errorString, L",", L" ");
-        }
-    }
+    const auto resultString = BuildResultString(error, errorString);
+    CHAR emptyAddress[ctSockaddr::FixedStringLength]{};
+    ctSockaddr().writeCompleteAddress(emptyAddress);
 
     if (g_connectionLogger && g_connectionLogger->IsCsvFormat())
     {
-        // csv format : L"TimeSlice,LocalAddress,RemoteAddress,SendBytes,SendBps,RecvBytes,RecvBps,TimeMs,Result,ConnectionId"
-        static const auto* tcpResultCsvFormat = L"%.3f,%ws,%ws,%lld,%lld,%lld,%lld,%lld,%ws,%hs\r\n";
-        csvString = wil::str_printf<std::wstring>(
-            tcpResultCsvFormat,
+        // csv format : "TimeSlice,LocalAddress,RemoteAddress,SendBytes,SendBps,RecvBytes,RecvBps,TimeMs,Result,ConnectionId"
+        g_connectionLogger->LogMessage(ctFormatUtf8(
+            "{:.3f},{},{},0,0,0,0,0,{},\r\n",
             currentTime,
-            ctSockaddr().writeCompleteAddress().c_str(),
-            ctSockaddr().writeCompleteAddress().c_str(),
-            0LL,
-            0LL,
-            0LL,
-            0LL,
-            0LL,
-            errorString.c_str(),
-            L"");
+            emptyAddress,
+            emptyAddress,
+            resultString));
     }
     // we'll never write csv format to the console so we'll need a text string in that case
     // - and/or in the case the g_ConnectionLogger isn't writing to csv
     if (writeToConsole || g_connectionLogger && !g_connectionLogger->IsCsvFormat())
     {
-        static const auto* tcpNetworkFailureResultTextFormat = L"[%.3f] TCP connection failed with the error %ws : [%ws - %ws] [%hs] : SendBytes[%lld]  SendBps[%lld]  RecvBytes[%lld]  RecvBps[%lld]  Time[%lld ms]";
-        textString = wil::str_printf<std::wstring>(
-            tcpNetworkFailureResultTextFormat,
+        ctFormatUtf8(
+            "[{:.3f}] TCP connection failed with the error {} : [{} - {}] [] : SendBytes[0]  SendBps[0]  RecvBytes[0]  RecvBps[0]  Time[0 ms]",
             currentTime,
-            errorString.c_str(),
-            ctSockaddr().writeCompleteAddress().c_str(),
-            ctSockaddr().writeCompleteAddress().c_str(),
-            L"",
-            0LL,
-            0LL,
-            0LL,
-            0LL,
-            0LL);
-    }
-
-    if (writeToConsole)
-    {
-        // text strings always go to the console
-        fwprintf(stdout, L"%ws\n", textString.c_str());
-    }
-
-    if (g_connectionLogger)
-    {
-        if (g_connectionLogger->IsCsvFormat())
-        {
-            g_connectionLogger->LogMessage(csvString.c_str());
-        }
-        else
-        {
-            g_connectionLogger->LogMessage(
-                wil::str_printf<std::wstring>(L"%ws\r\n", textString.c_str()).c_str());
-        }
+            resultString,
+            emptyAddress,
+            emptyAddress);
+        WriteConnectionText(writeToConsole);
     }
 }
 catch (...)
@@ -3462,136 +3991,95 @@ void PrintConnectionResults(const ctSockaddr& localAddr, const ctSockaddr& remot
         }
     }
 
-    enum class ErrorType
-    {
-        Success,
-        NetworkError,
-        ProtocolError
-    } errorType = ErrorType::Success;
-
-    if (0 == error)
-    {
-        errorType = ErrorType::Success;
-    }
-    else if (ctsIoPattern::IsProtocolError(error))
-    {
-        errorType = ErrorType::ProtocolError;
-    }
-    else
-    {
-        errorType = ErrorType::NetworkError;
-    }
-
     const int64_t totalTime = stats.m_endTime.GetValue() - stats.m_startTime.GetValue();
     FAIL_FAST_IF_MSG(
         totalTime < 0LL,
         "end_time is less than start_time in this ctsTcpStatistics object (%p)", &stats);
     const float currentTime = GetStatusTimeStamp();
+    const int64_t sendBps = totalTime > 0LL ? stats.m_bytesSent.GetValue() * 1000LL / totalTime : 0LL;
+    const int64_t recvBps = totalTime > 0LL ? stats.m_bytesRecv.GetValue() * 1000LL / totalTime : 0LL;
 
-    wstring csvString;
-    wstring textString;
-    wstring errorString;
-    if (ErrorType::ProtocolError != errorType)
+    if (g_binaryConnectionLog)
     {
-        if (0 == error)
-        {
-            errorString = L"Succeeded";
-        }
-        else
-        {
-            errorString = wil::str_printf<std::wstring>(
-                L"%lu: %ws",
-                error,
-                ctString::format_message(error).c_str());
-            // remove any commas from the formatted string - since that will mess up csv files
-            ctString::replace_all(errorString, L",", L" ");
-        }
+        ctsBinaryConnectionRecord record;
+        FillBinaryRecord(record, ctsBinaryRecordType::TcpResult, localAddr, remoteAddr, error, currentTime);
+        record.m_elapsedMs = totalTime;
+        record.m_counters[0] = stats.m_bytesSent.GetValue();
+        record.m_counters[1] = sendBps;
+        record.m_counters[2] = stats.m_bytesRecv.GetValue();
+        record.m_counters[3] = recvBps;
+        record.m_latencyUsec[0] = stats.m_connectLatencyUsec.GetValue();
+        memcpy_s(record.m_connectionId, sizeof record.m_connectionId, stats.m_connectionIdentifier, ctsStatistics::ConnectionIdLength);
+        g_binaryConnectionLog->Write(record);
+    }
+    if (!writeToConsole && !g_connectionLogger)
+    {
+        return;
     }
 
+    wstring errorString;
+    const auto resultString = BuildResultString(error, errorString);
+    CHAR localAddress[ctSockaddr::FixedStringLength]{};
+    localAddr.writeCompleteAddress(localAddress);
+    CHAR remoteAddress[ctSockaddr::FixedStringLength]{};
+    remoteAddr.writeCompleteAddress(remoteAddress);
+
     if (g_connectionLogger && g_connectionLogger->IsCsvFormat())
     {
-        WCHAR wsaLocalAddress[ctSockaddr::FixedStringLength]{};
-        localAddr.writeCompleteAddress(wsaLocalAddress);
-        WCHAR wsaRemoteAddress[ctSockaddr::FixedStringLength]{};
-        remoteAddr.writeCompleteAddress(wsaRemoteAddress);
-
-        // csv format : L"TimeSlice,LocalAddress,RemoteAddress,SendBytes,SendBps,RecvBytes,RecvBps,TimeMs,Result,ConnectionId"
-        static const auto* tcpResultCsvFormat = L"%.3f,%ws,%ws,%lld,%lld,%lld,%lld,%lld,%ws,%hs\r\n";
-        csvString = wil::str_printf<std::wstring>(
-            tcpResultCsvFormat,
+        // csv format : "TimeSlice,LocalAddress,RemoteAddress,SendBytes,SendBps,RecvBytes,RecvBps,TimeMs,Result,ConnectionId"
+        g_connectionLogger->LogMessage(ctFormatUtf8(
+            "{:.3f},{},{},{},{},{},{},{},{},{}\r\n",
             currentTime,
-            wsaLocalAddress,
-            wsaRemoteAddress,
+            localAddress,
+            remoteAddress,
             stats.m_bytesSent.GetValue(),
-            totalTime > 0LL ? stats.m_bytesSent.GetValue() * 1000LL / totalTime : 0LL,
+            sendBps,
             stats.m_bytesRecv.GetValue(),
-            totalTime > 0LL ? stats.m_bytesRecv.GetValue() * 1000LL / totalTime : 0LL,
+            recvBps,
             totalTime,
-            ErrorType::ProtocolError == errorType ?
-            ctsIoPattern::BuildProtocolErrorString(error) :
-            errorString.c_str(),
-            stats.m_connectionIdentifier);
+            resultString,
+            stats.m_connectionIdentifier));
     }
     // we'll never write csv format to the console so we'll need a text string in that case
     // - and/or in the case the g_ConnectionLogger isn't writing to csv
     if (writeToConsole || g_connectionLogger && !g_connectionLogger->IsCsvFormat())
     {
-        WCHAR wsaLocalAddress[ctSockaddr::FixedStringLength]{};
-        localAddr.writeCompleteAddress(wsaLocalAddress);
-        WCHAR wsaRemoteAddress[ctSockaddr::FixedStringLength]{};
-        remoteAddr.writeCompleteAddress(wsaRemoteAddress);
-
         if (0 == error)
         {
-            static const auto* tcpSuccessfulResultTextFormat = L"[%.3f] TCP connection succeeded : [%ws - %ws] [%hs]: SendBytes[%lld]  SendBps[%lld]  RecvBytes[%lld]  RecvBps[%lld]  Time[%lld ms]";
-            textString = wil::str_printf<std::wstring>(
-                tcpSuccessfulResultTextFormat,
+            ctFormatUtf8(
+                "[{:.3f}] TCP connection succeeded : [{} - {}] [{}]: ",
                 currentTime,
-                wsaLocalAddress,
-                wsaRemoteAddress,
-                stats.m_connectionIdentifier,
-                stats.m_bytesSent.GetValue(),
-                totalTime > 0LL ? stats.m_bytesSent.GetValue() * 1000LL / totalTime : 0LL,
-                stats.m_bytesRecv.GetValue(),
-                totalTime > 0LL ? stats.m_bytesRecv.GetValue() * 1000LL / totalTime : 0LL,
-                totalTime);
+                localAddress,
+                remoteAddress,
+                stats.m_connectionIdentifier);
         }
         else
         {
-            static const auto* tcpProtocolFailureResultTextFormat = L"[%.3f] TCP connection failed with the protocol error %ws : [%ws - %ws] [%hs] : SendBytes[%lld]  SendBps[%lld]  RecvBytes[%lld]  RecvBps[%lld]  Time[%lld ms]";
-            static const auto* tcpNetworkFailureResultTextFormat = L"[%.3f] TCP connection failed with the error %ws : [%ws - %ws] [%hs] : SendBytes[%lld]  SendBps[%lld]  RecvBytes[%lld]  RecvBps[%lld]  Time[%lld ms]";
-            textString = wil::str_printf<std::wstring>(
-                ErrorType::ProtocolError == errorType ? tcpProtocolFailureResultTextFormat : tcpNetworkFailureResultTextFormat,
+            ctFormatUtf8(
+                "[{:.3f}] TCP connection failed with the {}error {} : [{} - {}] [{}] : ",
                 currentTime,
-                ErrorType::ProtocolError == errorType ? ctsIoPattern::BuildProtocolErrorString(error) : errorString.c_str(),
-                wsaLocalAddress,
-                wsaRemoteAddress,
-                stats.m_connectionIdentifier,
-                stats.m_bytesSent.GetValue(),
-                totalTime > 0LL ? stats.m_bytesSent.GetValue() * 1000LL / totalTime : 0LL,
-                stats.m_bytesRecv.GetValue(),
-                totalTime > 0LL ? stats.m_bytesRecv.GetValue() * 1000LL / totalTime : 0LL,
-                totalTime);
-        }
-    }
-
-    if (writeToConsole)
-    {
-        // text strings always go to the console
-        fwprintf(stdout, L"%ws\n", textString.c_str());
-    }
-
-    if (g_connectionLogger)
-    {
-        if (g_connectionLogger->IsCsvFormat())
-        {
-            g_connectionLogger->LogMessage(csvString.c_str());
-        }
-        else
+                ctsIoPattern::IsProtocolError(error) ? "protocol " : "",
+                resultString,
+                localAddress,
+                remoteAddress,
+                stats.m_connectionIdentifier);
+        }
+        ctFormatUtf8Append(
+            "SendBytes[{}]  SendBps[{}]  RecvBytes[{}]  RecvBps[{}]  Time[{} ms]",
+            stats.m_bytesSent.GetValue(),
+            sendBps,
+            stats.m_bytesRecv.GetValue(),
+            recvBps,
+            totalTime);
+        if (stats.m_stallCount.GetValue() > 0)
         {
-            g_connectionLogger->LogMessage(
-                wil::str_printf<std::wstring>(L"%ws\r\n", textString.c_str()).c_str());
+            ctFormatUtf8Append(
+                "  Stalls[{}]  StallTime[{} ms]  LongestStall[{} ms]",
+                stats.m_stallCount.GetValue(),
+                stats.m_stallTimeMs.GetValue(),
+                stats.m_longestStallMs.GetValue());
         }
+        WriteConnectionText(writeToConsole);
     }
 }
 catch (...)
@@ -3619,136 +4107,100 @@ void PrintConnectionResults(const ctSockaddr& localAddr, const ctSockaddr& remot
         }
     }
 
-    enum class ErrorType
-    {
-        Success,
-        NetworkError,
-        ProtocolError
-    } errorType{};
-
-    if (0 == error)
-    {
-        errorType = ErrorType::Success;
-    }
-    else if (ctsIoPattern::IsProtocolError(error))
-    {
-        errorType = ErrorType::ProtocolError;
-    }
-    else
-    {
-        errorType = ErrorType::NetworkError;
-    }
-
     const float currentTime = GetStatusTimeStamp();
     const int64_t elapsedTime(stats.m_endTime.GetValue() - stats.m_startTime.GetValue());
     const int64_t bitsPerSecond = elapsedTime > 0LL ? stats.m_bitsReceived.GetValue() * 1000LL / elapsedTime : 0LL;
 
-    wstring csvString;
-    wstring textString;
-    wstring errorString;
-    if (ErrorType::ProtocolError != errorType)
+    if (g_binaryConnectionLog)
     {
-        if (0 == error)
+        ctsBinaryConnectionRecord record;
+        FillBinaryRecord(record, ctsBinaryRecordType::UdpResult, localAddr, remoteAddr, error, currentTime);
+        record.m_elapsedMs = elapsedTime;
+        record.m_counters[0] = bitsPerSecond;
+        record.m_counters[1] = stats.m_successfulFrames.GetValue();
+        record.m_counters[2] = stats.m_droppedFrames.GetValue();
+        record.m_counters[3] = stats.m_duplicateFrames.GetValue();
+        record.m_counters[4] = stats.m_errorFrames.GetValue();
+        if (const auto jitterSamples = stats.m_jitterSamples.GetValue(); jitterSamples > 0)
         {
-            errorString = L"Succeeded";
-        }
-        else
-        {
-            errorString = wil::str_printf<std::wstring>(
-                L"%lu: %ws",
-                error,
-                ctString::format_message(error).c_str());
-            // remove any commas from the formatted string - since that will mess up csv files
-            ctString::replace_all(errorString, L",", L" ");
+            record.m_latencyUsec[0] = stats.m_networkJitterMicroseconds.GetValue() / jitterSamples;
+            record.m_latencyUsec[1] = stats.m_hostJitterMicroseconds.GetValue() / jitterSamples;
         }
+        memcpy_s(record.m_connectionId, sizeof record.m_connectionId, stats.m_connectionIdentifier, ctsStatistics::ConnectionIdLength);
+        g_binaryConnectionLog->Write(record);
+    }
+    if (!writeToConsole && !g_connectionLogger)
+    {
+        return;
     }
 
+    wstring errorString;
+    const auto resultString = BuildResultString(error, errorString);
+    CHAR localAddress[ctSockaddr::FixedStringLength]{};
+    localAddr.writeCompleteAddress(localAddress);
+    CHAR remoteAddress[ctSockaddr::FixedStringLength]{};
+    remoteAddr.writeCompleteAddress(remoteAddress);
+
     if (g_connectionLogger && g_connectionLogger->IsCsvFormat())
     {
-        WCHAR wsaLocalAddress[ctSockaddr::FixedStringLength]{};
-        localAddr.writeCompleteAddress(wsaLocalAddress);
-        WCHAR wsaRemoteAddress[ctSockaddr::FixedStringLength]{};
-        remoteAddr.writeCompleteAddress(wsaRemoteAddress);
-
         // csv format : "TimeSlice,LocalAddress,RemoteAddress,Bits/Sec,Completed,Dropped,Repeated,Errors,Result,ConnectionId"
-        static const auto* udpResultCsvFormat = L"%.3f,%ws,%ws,%llu,%llu,%llu,%llu,%llu,%ws,%hs\r\n";
-        csvString = wil::str_printf<std::wstring>(
-            udpResultCsvFormat,
+        g_connectionLogger->LogMessage(ctFormatUtf8(
+            "{:.3f},{},{},{},{},{},{},{},{},{}\r\n",
             currentTime,
-            wsaLocalAddress,
-            wsaRemoteAddress,
+            localAddress,
+            remoteAddress,
             bitsPerSecond,
             stats.m_successfulFrames.GetValue(),
             stats.m_droppedFrames.GetValue(),
             stats.m_duplicateFrames.GetValue(),
             stats.m_errorFrames.GetValue(),
-            ErrorType::ProtocolError == errorType ?
-            ctsIoPattern::BuildProtocolErrorString(error) :
-            errorString.c_str(),
-            stats.m_connectionIdentifier);
+            resultString,
+            stats.m_connectionIdentifier));
     }
     // we'll never write csv format to the console so we'll need a text string in that case
     // - and/or in the case the g_ConnectionLogger isn't writing to csv
     if (writeToConsole || g_connectionLogger && !g_connectionLogger->IsCsvFormat())
     {
-        WCHAR wsaLocalAddress[ctSockaddr::FixedStringLength]{};
-        localAddr.writeCompleteAddress(wsaLocalAddress);
-        WCHAR wsaRemoteAddress[ctSockaddr::FixedStringLength]{};
-        remoteAddr.writeCompleteAddress(wsaRemoteAddress);
-
         if (0 == error)
         {
-            static const auto* udpSuccessfulResultTextFormat = L"[%.3f] UDP connection succeeded : [%ws - %ws] [%hs] : BitsPerSecond [%llu]  Completed [%llu]  Dropped [%llu]  Repeated [%llu]  Errors [%llu]";
-            textString = wil::str_printf<std::wstring>(
-                udpSuccessfulResultTextFormat,
+            ctFormatUtf8(
+                "[{:.3f}] UDP connection succeeded : [{} - {}] [{}] : ",
                 currentTime,
-                wsaLocalAddress,
-                wsaRemoteAddress,
-                stats.m_connectionIdentifier,
-                bitsPerSecond,
-                stats.m_successfulFrames.GetValue(),
-                stats.m_droppedFrames.GetValue(),
-                stats.m_duplicateFrames.GetValue(),
-                stats.m_errorFrames.GetValue());
+                localAddress,
+                remoteAddress,
+                stats.m_connectionIdentifier);
         }
         else
         {
-            static const auto* udpProtocolFailureResultTextFormat = L"[%.3f] UDP connection failed with the protocol error %ws : [%ws - %ws] [%hs] : BitsPerSecond [%llu]  Completed [%llu]  Dropped [%llu]  Repeated [%llu]  Errors [%llu]";
-            static const auto* udpNetworkFailureResultTextFormat = L"[%.3f] UDP connection failed with the error %ws : [%ws - %ws] [%hs] : BitsPerSecond [%llu]  Completed [%llu]  Dropped [%llu]  Repeated [%llu]  Errors [%llu]";
-            textString = wil::str_printf<std::wstring>(
-                ErrorType::ProtocolError == errorType ? udpProtocolFailureResultTextFormat : udpNetworkFailureResultTextFormat,
+            ctFormatUtf8(
+                "[{:.3f}] UDP connection failed with the {}error {} : [{} - {}] [{}] : ",
                 currentTime,
-                ErrorType::ProtocolError == errorType ?
-                ctsIoPattern::BuildProtocolErrorString(error) :
-                errorString.c_str(),
-                wsaLocalAddress,
-                wsaRemoteAddress,
-                stats.m_connectionIdentifier,
-                bitsPerSecond,
-                stats.m_successfulFrames.GetValue(),
-                stats.m_droppedFrames.GetValue(),
-                stats.m_duplicateFrames.GetValue(),
-                stats.m_errorFrames.GetValue());
-        }
-    }
-
-    if (writeToConsole)
-    {
-        // text strings always go to the console
-        fwprintf(stdout, L"%ws\n", textString.c_str());
-    }
-
-    if (g_connectionLogger)
-    {
-        if (g_connectionLogger->IsCsvFormat())
-        {
-            g_connectionLogger->LogMessage(csvString.c_str());
-        }
-        else
+                ctsIoPattern::IsProtocolError(error) ? "protocol " : "",
+                resultString,
+                localAddress,
+                remoteAddress,
+                stats.m_connectionIdentifier);
+        }
+        ctFormatUtf8Append(
+            "BitsPerSecond [{}]  Completed [{}]  Dropped [{}]  Repeated [{}]  Errors [{}]",
+            bitsPerSecond,
+            stats.m_successfulFrames.GetValue(),
+            stats.m_droppedFrames.GetValue(),
+            stats.m_duplicateFrames.GetValue(),
+            stats.m_errorFrames.GetValue());
+        if (stats.m_successfulFrames.GetValue() > 0)
         {
-            g_connectionLogger->LogMessage(
-                wil::str_printf<std::wstring>(L"%ws\r\n", textString.c_str()).c_str());
+            ctFormatUtf8Append(
+                "  Jitter [{:.3f} ms]  DelayVariation P50 [{} us] P99 [{} us]  Late [{}]  Reordered [{}]  LossRuns [{}] (longest {})",
+                static_cast<double>(stats.m_rfc3550JitterUsec.GetValue()) / 1000.0,
+                stats.m_delayVariationP50Usec.GetValue(),
+                stats.m_delayVariationP99Usec.GetValue(),
+                stats.m_lateFrames.GetValue(),
+                stats.m_reorderedFrames.GetValue(),
+                stats.m_lossRunCount.GetValue(),
+                stats.m_longestLossRun.GetValue());
         }
+        WriteConnectionText(writeToConsole);
     }
 }
 catch (...)
@@ -3852,6 +4304,151 @@ catch (...)
 {
 }
 
+void PrintRoundTripResults(const ctSockaddr& localAddr, const ctSockaddr& remoteAddr, _In_ PCSTR connectionId, const ctsRoundTripHistogram& roundTrips, uint32_t tcpRttUs, uint32_t tcpMinRttUs) noexcept try
+{
+    ctsConfigInitOnce();
+
+    if (0 == roundTrips.GetCount())
+    {
+        return;
+    }
+
+    auto writeToConsole = false;
+    // ReSharper disable once CppDefaultCaseNotHandledInSwitchStatement
+    switch (g_consoleVerbosity) // NOLINT(hicpp-multiway-paths-covered)
+    {
+        // case 0: // nothing
+        // case 1: // status updates
+        // case 2: // error info
+        case 3: // connection info
+        case 4: // connection info + error info
+        case 5: // connection info + error info + status updates
+        case 6: // above + debug info
+        {
+            writeToConsole = true;
+        }
+    }
+
+    // the round-trip results are only written as text - the csv connection format is fixed
+    const auto writeToLogger = g_connectionLogger && !g_connectionLogger->IsCsvFormat();
+    if (!writeToConsole && !writeToLogger)
+    {
+        return;
+    }
+
+    WCHAR wsaLocalAddress[ctSockaddr::FixedStringLength]{};
+    localAddr.writeCompleteAddress(wsaLocalAddress);
+    WCHAR wsaRemoteAddress[ctSockaddr::FixedStringLength]{};
+    remoteAddr.writeCompleteAddress(wsaRemoteAddress);
+
+    // the application RTT includes both hosts' processing and TCP stack time,
+    // the TCP RTT values are measured by the TCP stack from its own segments and acks
+    static const auto* roundTripTextFormat =
+        L"[%.3f] TCP round trips : [%ws - %ws] [%hs]: Count[%llu]  Min[%llu us]  P50[%llu us]  P90[%llu us]  P99[%llu us]  P99.9[%llu us]  Max[%llu us]  Mean[%llu us]  TcpRtt[%lu us]  TcpMinRtt[%lu us]";
+    const auto textString = wil::str_printf<std::wstring>(
+        roundTripTextFormat,
+        GetStatusTimeStamp(),
+        wsaLocalAddress,
+        wsaRemoteAddress,
+        connectionId,
+        roundTrips.GetCount(),
+        roundTrips.GetMin(),
+        roundTrips.GetPercentile(50.0),
+        roundTrips.GetPercentile(90.0),
+        roundTrips.GetPercentile(99.0),
+        roundTrips.GetPercentile(99.9),
+        roundTrips.GetMax(),
+        roundTrips.GetMean(),
+        tcpRttUs,
+        tcpMinRttUs);
+
+    if (writeToConsole)
+    {
+        fwprintf(stdout, L"%ws\n", textString.c_str());
+    }
+
+    if (writeToLogger)
+    {
+        g_connectionLogger->LogMessage(
+            wil::str_printf<std::wstring>(L"%ws\r\n", textString.c_str()).c_str());
+    }
+}
+catch (...)
+{
+}
+
+void PrintThroughputTimeline(const ctSockaddr& localAddr, const ctSockaddr& remoteAddr, _In_ PCSTR connectionId, const ctsThroughputTimeline& timeline) noexcept try
+{
+    ctsConfigInitOnce();
+
+    if (0 == timeline.GetIntervalCount())
+    {
+        return;
+    }
+
+    auto writeToConsole = false;
+    // ReSharper disable once CppDefaultCaseNotHandledInSwitchStatement
+    switch (g_consoleVerbosity) // NOLINT(hicpp-multiway-paths-covered)
+    {
+        // case 0: // nothing
+        // case 1: // status updates
+        // case 2: // error info
+        case 3: // connection info
+        case 4: // connection info + error info
+        case 5: // connection info + error info + status updates
+        case 6: // above + debug info
+        {
+            writeToConsole = true;
+        }
+    }
+
+    // the timeline is only written as text - the csv connection format is fixed
+    if (!writeToConsole && !(g_connectionLogger && !g_connectionLogger->IsCsvFormat()))
+    {
+        return;
+    }
+
+    CHAR localAddress[ctSockaddr::FixedStringLength]{};
+    localAddr.writeCompleteAddress(localAddress);
+    CHAR remoteAddress[ctSockaddr::FixedStringLength]{};
+    remoteAddr.writeCompleteAddress(remoteAddress);
+
+    // the bytes completed in each interval, oldest first, up to the interval with the last progress
+    ctFormatUtf8(
+        "[{:.3f}] TCP throughput : [{} - {}] [{}]: Interval[{} ms]  Bytes[",
+        GetStatusTimeStamp(),
+        localAddress,
+        remoteAddress,
+        connectionId,
+        timeline.GetIntervalMs());
+    for (auto age = timeline.GetIntervalCount() - 1; age > 0; --age)
+    {
+        ctFormatUtf8Append("{},", timeline.GetIntervalBytes(age));
+    }
+    ctFormatUtf8Append("{}]", timeline.GetIntervalBytes(0));
+    WriteConnectionText(writeToConsole);
+}
+catch (...)
+{
+}
+
+void RecordConnectLatency(int64_t microseconds) noexcept
+{
+    if (microseconds < 0)
+    {
+        microseconds = 0;
+    }
+
+    const auto lock = g_configSettings->ConnectLatencyLock.lock();
+    g_configSettings->ConnectLatency.AddSample(static_cast<uint64_t>(microseconds));
+}
+
+void RecordMediaStreamQuality(const ctsMediaStreamQuality& streamQuality) noexcept
+{
+    const auto lock = g_configSettings->MediaStreamQualityLock.lock();
+    g_configSettings->MediaStreamQuality.Merge(streamQuality);
+}
+
 void __cdecl PrintSummary(_In_ _Printf_format_string_ PCWSTR text, ...) noexcept
 {
     ctsConfigInitOnce();
@@ -4004,6 +4601,45 @@ int GetListenBacklog() noexcept
     return backlog;
 }
 
+int64_t GetTcpAttemptFailCount() noexcept
+{
+    // dwAttemptFails counts connections reset from SYN-RCVD, which includes those dropped
+    // when the listen backlog overflowed - these are system-wide counts, not only ctsTraffic
+    long long attemptFails = 0;
+    for (const auto family : {AF_INET, AF_INET6})
+    {
+        MIB_TCPSTATS tcpStats{};
+        if (NO_ERROR == GetTcpStatisticsEx(&tcpStats, family))
+        {
+            attemptFails += tcpStats.dwAttemptFails;
+        }
+    }
+
+    ctMemoryGuardWriteConditionally(&g_tcpAttemptFailBaseline, attemptFails, -1);
+    const auto baseline = ctMemoryGuardRead(&g_tcpAttemptFailBaseline);
+    // the 32-bit system counters can wrap
+    return attemptFails >= baseline ? attemptFails - baseline : 0;
+}
+
+int64_t GetDroppedLogRecordCount() noexcept
+{
+    ctsConfigInitOnce();
+
+    // the same logger can be used for more than one type of output
+    int64_t droppedRecords = 0;
+    const ctsLogger* countedLoggers[5]{};
+    size_t countedLoggerCount = 0;
+    for (const auto* logger : {g_connectionLogger.get(), g_statusLogger.get(), g_errorLogger.get(), g_jitterLogger.get(), g_tcpInfoLogger.get()})
+    {
+        if (logger && std::find(countedLoggers, countedLoggers + countedLoggerCount, logger) == countedLoggers + countedLoggerCount)
+        {
+            countedLoggers[countedLoggerCount++] = logger;
+            droppedRecords += logger->GetDroppedRecordCount();
+        }
+    }
+    return droppedRecords;
+}
+
 const MediaStreamSettings& GetMediaStream() noexcept
 {
     ctsConfigInitOnce();
@@ -4248,6 +4884,47 @@ int SetPreBindOptions(SOCKET socket, const ctSockaddr& localAddress) noexcept
         }
     }
 
+    if (IoPatternType::PingPong == g_configSettings->IoPattern)
+    {
+        // round trips of small messages must not be held back by Nagle
+        // - set on listening sockets as well, as accepted sockets inherit the option
+        constexpr DWORD optval{1}; // BOOL
+        constexpr int optlen{sizeof optval};
+
+        if (setsockopt(
+                socket,
+                IPPROTO_TCP, // level
+                TCP_NODELAY, // optname
+                reinterpret_cast<const char*>(&optval),
+                optlen) != 0)
+        {
+            const auto gle = WSAGetLastError();
+            PrintErrorIfFailed("setsockopt(TCP_NODELAY)", gle);
+            return gle;
+        }
+    }
+
+    if (g_configSettings->Options & RecvTimestamps)
+    {
+        TIMESTAMPING_CONFIG timestampConfig{};
+        timestampConfig.Flags = TIMESTAMPING_FLAG_RX;
+        DWORD bytesReturned{};
+
+        if (WSAIoctl(
+                socket,
+                SIO_TIMESTAMPING,
+                &timestampConfig, sizeof timestampConfig,
+                nullptr, 0,
+                &bytesReturned,
+                nullptr,
+                nullptr) != 0)
+        {
+            const auto gle = WSAGetLastError();
+            PrintErrorIfFailed("WSAIoctl(SIO_TIMESTAMPING)", gle);
+            return gle;
+        }
+    }
+
     if (g_configSettings->Options & HandleInlineIocp)
     {
         if (!SetFileCompletionNotificationModes(reinterpret_cast<HANDLE>(socket), FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)) // NOLINT(performance-no-int-to-ptr)
@@ -4343,10 +5020,34 @@ void PrintSettings()
         {
             settingString.append(L" MsgWaitAll");
         }
+        if (g_configSettings->Options & ReuseSockets)
+        {
+            settingString.append(L" ReuseSockets");
+        }
+        if (g_configSettings->Options & PreCreateSockets)
+        {
+            settingString.append(L" PreCreateSockets");
+        }
+        if (g_configSettings->Options & WorkStealing)
+        {
+            settingString.append(L" WorkStealing");
+        }
+        if (g_configSettings->Options & RecvTimestamps)
+        {
+            settingString.append(L" RxTimestamp");
+        }
     }
     settingString.append(L"\n");
 
     settingString.append(wil::str_printf<std::wstring>(L"\tIO function: %ws\n", g_ioFunctionName));
+    if (CpuAffinityType::RoundRobin == g_configSettings->CpuAffinity)
+    {
+        settingString.append(L"\tCPU affinity: each connection runs on one processor, assigned round-robin\n");
+    }
+    else if (CpuAffinityType::Rss == g_configSettings->CpuAffinity)
+    {
+        settingString.append(L"\tCPU affinity: each connection runs on one processor, steered to its RSS processor\n");
+    }
 
     settingString.append(L"\tIoPattern: ");
     switch (g_configSettings->IoPattern)
@@ -4368,6 +5069,10 @@ void PrintSettings()
         case IoPatternType::MediaStream:
             settingString.append(L"MediaStream <UDP controlled stream from server to client>\n");
             break;
+        case IoPatternType::PingPong:
+            settingString.append(L"PingPong <TCP client/server alternate single message round trips>\n");
+            settingString.append(wil::str_printf<std::wstring>(L"\t\tPingPongBytes: %lu\n", g_configSettings->PingPongBytes));
+            break;
 
         case IoPatternType::NoIoSet:
             [[fallthrough]];
@@ -4386,6 +5091,21 @@ void PrintSettings()
         settingString.append(wil::str_printf<std::wstring>(L"\tPrePostSends: Following Ideal Send Backlog\n"));
     }
 
+    settingString.append(wil::str_printf<std::wstring>(L"\tIoBatchLimit: %u\n", g_configSettings->IoBatchLimit));
+
+    if (g_configSettings->ConnectionRate)
+    {
+        settingString.append(
+            wil::str_printf<std::wstring>(
+                L"\tConnections Per Second: %ws\n",
+                g_configSettings->ConnectOnly ? L"connect only (no data transferred)" : L"exchanging -Transfer bytes per connection"));
+    }
+
+    if (g_configSettings->CpuCostStatus)
+    {
+        settingString.append(L"\tStatus updates include the CPU cost of each time slice\n");
+    }
+
     settingString.append(
         wil::str_printf<std::wstring>(
             L"\tLevel of verification: %ws\n",
@@ -4491,6 +5211,14 @@ void PrintSettings()
                 settingString.append(L"\n");
             }
         }
+
+        if (g_configSettings->AcceptDepth != 0)
+        {
+            settingString.append(
+                wil::str_printf<std::wstring>(
+                    L"\tAcceptEx requests outstanding per address for each processor: %u\n",
+                    g_configSettings->AcceptDepth));
+        }
     }
     else
     {
@@ -4513,6 +5241,37 @@ void PrintSettings()
             }
         }
 
+        if (g_configSettings->TargetAddresses.size() > 1)
+        {
+            const wchar_t* targetPolicy = L"roundrobin";
+            switch (g_configSettings->TargetPolicy)
+            {
+                case TargetPolicyType::LeastActive:
+                    targetPolicy = L"leastactive";
+                    break;
+                case TargetPolicyType::Weighted:
+                    targetPolicy = L"weighted";
+                    break;
+                case TargetPolicyType::LowestLatency:
+                    targetPolicy = L"latency";
+                    break;
+                case TargetPolicyType::RoundRobin:
+                    break;
+            }
+            settingString.append(
+                wil::str_printf<std::wstring>(
+                    L"\tChoosing the target address for each connection by: %ws\n", targetPolicy));
+            if (!g_configSettings->TargetWeights.empty())
+            {
+                settingString.append(L"\tTarget weights:");
+                for (const auto weight : g_configSettings->TargetWeights)
+                {
+                    settingString.append(wil::str_printf<std::wstring>(L" %u", weight));
+                }
+                settingString.append(L"\n");
+            }
+        }
+
         settingString.append(L"\tBinding to local addresses for outgoing connections:\n");
         for (const auto& addr : g_configSettings->BindAddresses)
         {
@@ -4600,6 +5359,16 @@ void PrintSettings()
         }
     }
 
+    if (g_configSettings->MetricsPort != 0)
+    {
+        settingString.append(wil::str_printf<std::wstring>(L"\tMetrics served at http://127.0.0.1:%u/metrics\n", g_configSettings->MetricsPort));
+    }
+
+    if (!g_configSettings->TraceFilename.empty())
+    {
+        settingString.append(wil::str_printf<std::wstring>(L"\tTracing IO events to %ws\n", g_configSettings->TraceFilename.c_str()));
+    }
+
     settingString.append(L"\n");
 
     // immediately print the legend once we know the status info object
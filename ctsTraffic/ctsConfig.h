@@ -20,11 +20,13 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <vector>
 #include <functional>
 #include <memory>
+#include <string>
 // os headers
 #include <Windows.h>
 // ctl headers
 #include <ctTimer.hpp>
 #include <ctSockaddr.hpp>
+#include <ctWorkStealingPool.hpp>
 //
 // ** NOTE ** cannot include local project cts headers to avoid circular references
 // - with the below exceptions : these do not include any cts* headers
@@ -73,7 +75,8 @@ namespace ctsConfig
         Pull,
         PushPull,
         Duplex,
-        MediaStream
+        MediaStream,
+        PingPong
     };
 
     enum class StatusFormatting
@@ -84,6 +87,21 @@ namespace ctsConfig
         ConsoleOutput
     };
 
+    enum class TargetPolicyType
+    {
+        RoundRobin,
+        LeastActive,
+        Weighted,
+        LowestLatency
+    };
+
+    enum class CpuAffinityType
+    {
+        None,
+        RoundRobin,
+        Rss
+    };
+
     // cannot be an enum class and have the below operator overloads work correctly
     enum OptionType
     {
@@ -97,7 +115,11 @@ namespace ctsConfig
         SetSendBuf = 0x0040,
         EnableCircularQueueing = 0x0080,
         MsgWaitAll = 0x0100,
-        // next enum  = 0x0200
+        RecvTimestamps = 0x0200,
+        ReuseSockets = 0x0400,
+        PreCreateSockets = 0x0800,
+        WorkStealing = 0x1000,
+        // next enum  = 0x2000
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -178,10 +200,24 @@ namespace ctsConfig
         int64_t m_senderQpf = 0LL;
         int64_t m_receiverQpc = 0LL;
         int64_t m_receiverQpf = 0LL;
+        // the QPC when ctsTraffic processed the datagram
+        // - m_receiverQpc is the network stack receive timestamp when -Options:rxtimestamp is set
+        //   otherwise the two values are identical
+        int64_t m_receiverAppQpc = 0LL;
         double m_estimatedTimeInFlightMs = 0;
+
+        // the time the datagram sat in the host between the network stack and ctsTraffic processing it
+        [[nodiscard]] double HostDelayMs() const noexcept
+        {
+            return m_receiverQpf != 0 ?
+                   static_cast<double>(m_receiverAppQpc - m_receiverQpc) * 1000.0 / static_cast<double>(m_receiverQpf) :
+                   0.0;
+        }
     };
 
     void PrintJitterUpdate(const JitterFrameEntry& currentFrame, const JitterFrameEntry& previousFrame) noexcept;
+    // merges a media stream's quality statistics (once its stream ended) into the summary of all streams
+    void RecordMediaStreamQuality(const ctsMediaStreamQuality& streamQuality) noexcept;
 
     void __cdecl PrintSummary(_In_ _Printf_format_string_ PCWSTR text, ...) noexcept;
     void PrintStatusUpdate() noexcept;
@@ -191,6 +227,9 @@ namespace ctsConfig
     void PrintErrorInfoOverride(_In_ PCWSTR text) noexcept;
 
     // Putting PrintDebugInfo as a macro to avoid running any code for debug printing if not necessary
+    // - debug output (-ConsoleVerbosity:6) is only compiled into debug builds, or with CTSTRAFFIC_DEBUG_OUTPUT defined
+    //   release builds still compile the arguments (so they stay valid) but never evaluate them
+#if defined(_DEBUG) || defined(CTSTRAFFIC_DEBUG_OUTPUT)
 #define PRINT_DEBUG_INFO(fmt, ...)                                            \
         do                                                                    \
         {                                                                     \
@@ -201,6 +240,16 @@ namespace ctsConfig
             }                                                                 \
         }                                                                     \
         while ((void)0, 0)
+#else
+#define PRINT_DEBUG_INFO(fmt, ...)                                            \
+        do                                                                    \
+        {                                                                     \
+            if constexpr (false) {                                            \
+                ::wprintf_s(fmt, ##__VA_ARGS__);                              \
+            }                                                                 \
+        }                                                                     \
+        while ((void)0, 0)
+#endif
 
     constexpr DWORD Win32FromHresult(HRESULT hr) noexcept
     {
@@ -221,6 +270,11 @@ namespace ctsConfig
     void PrintConnectionResults(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr, uint32_t error, const ctsUdpStatistics& stats) noexcept;
     void PrintConnectionResults(uint32_t error) noexcept;
     void PrintTcpDetails(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr, SOCKET socket, const ctsTcpStatistics& stats) noexcept;
+    void PrintRoundTripResults(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr, _In_ PCSTR connectionId, const ctsRoundTripHistogram& roundTrips, uint32_t tcpRttUs, uint32_t tcpMinRttUs) noexcept;
+    void PrintThroughputTimeline(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr, _In_ PCSTR connectionId, const ctsThroughputTimeline& timeline) noexcept;
+
+    // tracks the time taken by a successful connect handshake, for the -cps summary
+    void RecordConnectLatency(int64_t microseconds) noexcept;
 
     constexpr void PrintTcpDetails(const ctl::ctSockaddr&, const ctl::ctSockaddr&, SOCKET, const ctsUdpStatistics&) noexcept
     {
@@ -238,6 +292,10 @@ namespace ctsConfig
 
     int32_t GetListenBacklog() noexcept;
     bool IsListening() noexcept;
+    // system-wide count of failed TCP connection attempts since first called
+    int64_t GetTcpAttemptFailCount() noexcept;
+    // messages dropped by the log files because they could not be written fast enough
+    int64_t GetDroppedLogRecordCount() noexcept;
 
     // Set* functions
     int32_t SetPreBindOptions(SOCKET socket, const ctl::ctSockaddr& localAddress) noexcept;
@@ -342,6 +400,8 @@ namespace ctsConfig
 
         HANDLE CtrlCHandle = nullptr;
         PTP_CALLBACK_ENVIRON pTpEnvironment = nullptr;
+        // set with -Options:workstealing : runs the broker refreshes and the socket state transitions
+        ctl::ctWorkStealingPool* WorkStealingPool = nullptr;
 
         ctsSocketFunction CreateFunction;
         ctsSocketFunction ConnectFunction;
@@ -353,23 +413,38 @@ namespace ctsConfig
         TcpShutdownType TcpShutdown = TcpShutdownType::NoShutdownOptionSet;
         IoPatternType IoPattern = IoPatternType::NoIoSet;
         OptionType Options = NoOptionSet;
+        TargetPolicyType TargetPolicy = TargetPolicyType::RoundRobin;
+        CpuAffinityType CpuAffinity = CpuAffinityType::None;
 
         uint32_t SocketFlags = 0;
 
         uint64_t Iterations = 0;
         uint64_t ServerExitLimit = 0;
         uint32_t AcceptLimit = 0;
+        // AcceptEx requests kept outstanding per listening address for each processor - 0 uses the default
+        uint32_t AcceptDepth = 0;
         uint32_t ConnectionLimit = 0;
         uint32_t ConnectionThrottleLimit = 0;
 
         std::vector<ctl::ctSockaddr> ListenAddresses{};
         std::vector<ctl::ctSockaddr> TargetAddresses{};
         std::vector<ctl::ctSockaddr> BindAddresses{};
+        // one weight per TargetAddresses entry with -TargetPolicy:weighted
+        std::vector<uint32_t> TargetWeights{};
+
+        // -TraceFilename : records IO, timer and socket state events per thread (empty when not specified)
+        std::wstring TraceFilename{};
 
         // stats for status updates and summaries
         ctsConnectionStatistics ConnectionStatusDetails;
         ctsTcpStatistics TcpStatusDetails;
         ctsUdpStatistics UdpStatusDetails;
+        // connect handshake times in microseconds - guarded by ConnectLatencyLock
+        wil::critical_section ConnectLatencyLock{c_CriticalSectionSpinlock};
+        ctsRoundTripHistogram ConnectLatency;
+        // the quality statistics of all media streams which have ended - guarded by MediaStreamQualityLock
+        wil::critical_section MediaStreamQualityLock{c_CriticalSectionSpinlock};
+        ctsMediaStreamQuality MediaStreamQuality;
 
         uint32_t StatusUpdateFrequencyMilliseconds = 0;
 
@@ -380,12 +455,14 @@ namespace ctsConfig
         uint32_t PauseAtEnd = 0;
         uint32_t PrePostRecvs = 0;
         uint32_t PrePostSends = 0;
+        uint32_t IoBatchLimit = 0;
         uint32_t RecvBufValue = 0;
         uint32_t SendBufValue = 0;
         uint32_t KeepAliveValue = 0;
 
         uint32_t PushBytes = 0;
         uint32_t PullBytes = 0;
+        uint32_t PingPongBytes = 0;
 
         std::optional<uint32_t> BurstCount;
         std::optional<uint32_t> BurstDelay;
@@ -395,9 +472,17 @@ namespace ctsConfig
         uint16_t LocalPortLow = 0;
         uint16_t LocalPortHigh = 0;
         uint16_t Port = 0;
+        // -MetricsPort : serves live statistics on the loopback address (0 when not specified)
+        uint16_t MetricsPort = 0;
 
         bool UseSharedBuffer = false;
         bool ShouldVerifyBuffers = false;
+        // -cps : measure the rate connections are established
+        bool ConnectionRate = false;
+        // -cps without -transfer : close each connection as soon as it's established without any IO
+        bool ConnectOnly = false;
+        // -CpuCost : adds the CPU cost of each time slice to the status updates
+        bool CpuCostStatus = false;
 
         static constexpr DWORD c_CriticalSectionSpinlock = 200ul;
     };
@@ -20,6 +20,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <ctSocketExtensions.hpp>
 #include <ctThreadIocp.hpp>
 #include <ctSockaddr.hpp>
+#include <ctTimer.hpp>
 // project headers
 #include "ctsSocket.h"
 
@@ -28,7 +29,8 @@ namespace ctsTraffic
 static void ctsConnectExIoCompletionCallback(
     OVERLAPPED* overlapped,
     const std::weak_ptr<ctsSocket>& weakSocket,
-    const ctl::ctSockaddr& targetAddress) noexcept
+    const ctl::ctSockaddr& targetAddress,
+    int64_t connectStartUsec) noexcept
 {
     const auto sharedSocket(weakSocket.lock());
     if (!sharedSocket)
@@ -72,6 +74,8 @@ static void ctsConnectExIoCompletionCallback(
     ctl::ctSockaddr localAddr;
     if (NO_ERROR == gle)
     {
+        sharedSocket->RecordConnectLatency(ctl::ctTimer::snap_qpc_as_usec() - connectStartUsec);
+
         // store the local addr of the connection
         int localAddrLen = localAddr.length();
         if (0 == getsockname(socket, localAddr.sockaddr(), &localAddrLen))
@@ -110,8 +114,10 @@ void ctsConnectEx(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
             // get a new IO request from the socket's TP
             const std::shared_ptr<ctl::ctThreadIocp>& connectIocp = sharedSocket->GetIocpThreadpool();
 
+            // the handshake latency is measured from just before ConnectEx is issued
+            const auto connectStartUsec = ctl::ctTimer::snap_qpc_as_usec();
             OVERLAPPED* pOverlapped = connectIocp->new_request(
-                [weakSocket, targetAddress](OVERLAPPED* pCallbackOverlapped) noexcept { ctsConnectExIoCompletionCallback(pCallbackOverlapped, weakSocket, targetAddress); });
+                [weakSocket, targetAddress, connectStartUsec](OVERLAPPED* pCallbackOverlapped) noexcept { ctsConnectExIoCompletionCallback(pCallbackOverlapped, weakSocket, targetAddress, connectStartUsec); });
 
             if (!ctl::ctConnectEx(socket, targetAddress.sockaddr(), targetAddress.length(), nullptr, 0, nullptr, pOverlapped))
             {
@@ -133,7 +139,7 @@ void ctsConnectEx(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
                 connectIocp->cancel_request(pOverlapped);
                 // directly invoke the callback to complete the IO
                 // - with a nullptr OVERLAPPED to indicate it's already completed
-                ctsConnectExIoCompletionCallback(nullptr, weakSocket, targetAddress);
+                ctsConnectExIoCompletionCallback(nullptr, weakSocket, targetAddress, connectStartUsec);
             }
 
             ctsConfig::PrintErrorIfFailed("ConnectEx", error);
@@ -0,0 +1,312 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsCpuAffinity.h"
+// cpp headers
+#include <cstdint>
+#include <memory>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+#include <mstcpip.h>
+// wil headers
+#include <wil/resource.h>
+// ctl headers
+#include <ctMemoryGuard.hpp>
+// project headers
+#include "ctsConfig.h"
+
+namespace ctsTraffic::ctsCpuAffinity
+{
+    // each processor's threadpool has a fixed number of threads
+    // - more than one so a callback which blocks does not stall every connection on that processor
+    constexpr uint32_t c_threadsPerProcessor = 2;
+    constexpr DWORD c_startTimeoutMilliseconds = 30000;
+
+    struct ctsProcessorWorkers
+    {
+        PROCESSOR_NUMBER m_processor{};
+        // the pool is not closed: connections can be completing until the process exits
+        // - the same as the threadpool created by ctsConfig
+        PTP_POOL m_threadPool = nullptr;
+        TP_CALLBACK_ENVIRON m_environment{};
+
+        wil::critical_section m_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
+        std::vector<wil::unique_handle> m_threads;
+        _Interlocked_ long m_startedThreads = 0;
+        wil::unique_event m_threadsStarted;
+
+        _Interlocked_ long long m_connectionCount = 0;
+        _Interlocked_ long long m_bytesTransferred = 0;
+    };
+
+    // shared with the AffinitizeThreadCallback callbacks: each callback holds a reference until it returns
+    static std::vector<std::shared_ptr<ctsProcessorWorkers>> g_processorWorkers; // NOLINT(clang-diagnostic-exit-time-destructors)
+    static _Interlocked_ long long g_assignCounter = 0;
+
+    // -CpuAffinity:rss results for each connection
+    static _Interlocked_ long long g_rssAlreadyPlaced = 0;
+    static _Interlocked_ long long g_rssSteered = 0;
+    static _Interlocked_ long long g_rssCrossCoreHandoffs = 0;
+    static _Interlocked_ long long g_rssUnavailable = 0;
+
+    //
+    // run once on each thread of a processor's threadpool
+    // - blocks until every thread of that threadpool has run it, so each thread is affinitized exactly once
+    // - context is a heap-allocated reference to the ctsProcessorWorkers, released when the callback returns
+    //   so the workers outlive every callback even if Start fails while callbacks are still waiting
+    //
+    static VOID CALLBACK AffinitizeThreadCallback(PTP_CALLBACK_INSTANCE, PVOID context) noexcept
+    {
+        const std::unique_ptr<std::shared_ptr<ctsProcessorWorkers>> workersReference{static_cast<std::shared_ptr<ctsProcessorWorkers>*>(context)};
+        const auto& workers = *workersReference;
+
+        GROUP_AFFINITY groupAffinity{};
+        groupAffinity.Group = workers->m_processor.Group;
+        groupAffinity.Mask = static_cast<KAFFINITY>(1) << workers->m_processor.Number;
+        if (!SetThreadGroupAffinity(GetCurrentThread(), &groupAffinity, nullptr))
+        {
+            ctsConfig::PrintErrorIfFailed("SetThreadGroupAffinity", GetLastError());
+        }
+        SetThreadIdealProcessorEx(GetCurrentThread(), &workers->m_processor, nullptr);
+
+        // a real handle to this thread to query its CPU time for the summary
+        HANDLE threadHandle{};
+        if (DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &threadHandle, THREAD_QUERY_LIMITED_INFORMATION, FALSE, 0))
+        {
+            try
+            {
+                wil::unique_handle uniqueHandle{threadHandle};
+                const auto lock = workers->m_lock.lock();
+                workers->m_threads.emplace_back(std::move(uniqueHandle));
+            }
+            catch (...)
+            {
+                // only the summary is affected
+            }
+        }
+
+        if (ctl::ctMemoryGuardIncrement(&workers->m_startedThreads) == static_cast<long>(c_threadsPerProcessor))
+        {
+            workers->m_threadsStarted.SetEvent();
+        }
+        else
+        {
+            workers->m_threadsStarted.wait(c_startTimeoutMilliseconds);
+        }
+    }
+
+    void Start()
+    {
+        if (ctsConfig::CpuAffinityType::None == ctsConfig::g_configSettings->CpuAffinity)
+        {
+            return;
+        }
+
+        std::vector<std::shared_ptr<ctsProcessorWorkers>> processorWorkers;
+        // on failure: release any callbacks waiting for their threadpool's threads, and close the threadpools created
+        // - each pool is released once its callbacks have returned
+        auto closeThreadpools = wil::scope_exit([&]() noexcept {
+            for (const auto& workers : processorWorkers)
+            {
+                workers->m_threadsStarted.SetEvent();
+                if (workers->m_threadPool)
+                {
+                    CloseThreadpool(workers->m_threadPool);
+                    workers->m_threadPool = nullptr;
+                }
+            }
+        });
+
+        const auto groupCount = GetActiveProcessorGroupCount();
+        for (WORD group = 0; group < groupCount; ++group)
+        {
+            const auto processorCount = GetActiveProcessorCount(group);
+            for (DWORD number = 0; number < processorCount; ++number)
+            {
+                auto workers = std::make_shared<ctsProcessorWorkers>();
+                workers->m_processor.Group = group;
+                workers->m_processor.Number = static_cast<BYTE>(number);
+                workers->m_threads.reserve(c_threadsPerProcessor);
+                workers->m_threadsStarted.create(wil::EventOptions::ManualReset);
+                processorWorkers.emplace_back(workers);
+
+                workers->m_threadPool = CreateThreadpool(nullptr);
+                THROW_LAST_ERROR_IF_NULL_MSG(workers->m_threadPool, "CreateThreadpool (ctsCpuAffinity)");
+                SetThreadpoolThreadMaximum(workers->m_threadPool, c_threadsPerProcessor);
+                THROW_LAST_ERROR_IF_MSG(!SetThreadpoolThreadMinimum(workers->m_threadPool, c_threadsPerProcessor), "SetThreadpoolThreadMinimum (ctsCpuAffinity)");
+
+                InitializeThreadpoolEnvironment(&workers->m_environment);
+                SetThreadpoolCallbackPool(&workers->m_environment, workers->m_threadPool);
+            }
+        }
+
+        for (const auto& workers : processorWorkers)
+        {
+            for (auto thread = 0u; thread < c_threadsPerProcessor; ++thread)
+            {
+                auto workersReference = std::make_unique<std::shared_ptr<ctsProcessorWorkers>>(workers);
+                THROW_LAST_ERROR_IF_MSG(
+                    !TrySubmitThreadpoolCallback(AffinitizeThreadCallback, workersReference.get(), &workers->m_environment),
+                    "TrySubmitThreadpoolCallback (ctsCpuAffinity)");
+                // now owned by the callback
+                workersReference.release();
+            }
+        }
+        for (const auto& workers : processorWorkers)
+        {
+            if (!workers->m_threadsStarted.wait(c_startTimeoutMilliseconds))
+            {
+                THROW_WIN32_MSG(ERROR_TIMEOUT, "ctsCpuAffinity timed out affinitizing the threads for processor %u:%u", workers->m_processor.Group, workers->m_processor.Number);
+            }
+        }
+
+        closeThreadpools.release();
+        g_processorWorkers = std::move(processorWorkers);
+    }
+
+    uint32_t AssignProcessor() noexcept
+    {
+        if (g_processorWorkers.empty())
+        {
+            return 0;
+        }
+        const auto counter = ctl::ctMemoryGuardIncrement(&g_assignCounter);
+        const auto processor = static_cast<uint32_t>(counter % static_cast<long long>(g_processorWorkers.size()));
+        ctl::ctMemoryGuardIncrement(&g_processorWorkers[processor]->m_connectionCount);
+        return processor;
+    }
+
+    PTP_CALLBACK_ENVIRON GetEnvironment(uint32_t processor) noexcept
+    {
+        if (processor < g_processorWorkers.size())
+        {
+            return &g_processorWorkers[processor]->m_environment;
+        }
+        return ctsConfig::g_configSettings->pTpEnvironment;
+    }
+
+    void SteerConnection(SOCKET socket, uint32_t& processor, bool canMove) noexcept
+    {
+        if (ctsConfig::CpuAffinityType::Rss != ctsConfig::g_configSettings->CpuAffinity || processor >= g_processorWorkers.size())
+        {
+            return;
+        }
+
+        SOCKET_PROCESSOR_AFFINITY rssAffinity{};
+        DWORD bytesReturned{};
+        if (0 != WSAIoctl(socket, SIO_QUERY_RSS_PROCESSOR_INFO, nullptr, 0, &rssAffinity, sizeof rssAffinity, &bytesReturned, nullptr, nullptr))
+        {
+            // e.g. the interface does not have RSS enabled
+            PRINT_DEBUG_INFO(L"\t\tctsCpuAffinity : SIO_QUERY_RSS_PROCESSOR_INFO failed (%d)\n", WSAGetLastError());
+            ctl::ctMemoryGuardIncrement(&g_rssUnavailable);
+            return;
+        }
+
+        uint32_t rssProcessor = 0;
+        while (rssProcessor < g_processorWorkers.size() &&
+               (g_processorWorkers[rssProcessor]->m_processor.Group != rssAffinity.Processor.Group ||
+                g_processorWorkers[rssProcessor]->m_processor.Number != rssAffinity.Processor.Number))
+        {
+            ++rssProcessor;
+        }
+
+        if (rssProcessor == g_processorWorkers.size())
+        {
+            ctl::ctMemoryGuardIncrement(&g_rssUnavailable);
+        }
+        else if (rssProcessor == processor)
+        {
+            ctl::ctMemoryGuardIncrement(&g_rssAlreadyPlaced);
+        }
+        else if (canMove)
+        {
+            ctl::ctMemoryGuardDecrement(&g_processorWorkers[processor]->m_connectionCount);
+            ctl::ctMemoryGuardIncrement(&g_processorWorkers[rssProcessor]->m_connectionCount);
+            processor = rssProcessor;
+            ctl::ctMemoryGuardIncrement(&g_rssSteered);
+        }
+        else
+        {
+            // every completion is handed from the RSS processor to the threadpool of another processor
+            ctl::ctMemoryGuardIncrement(&g_rssCrossCoreHandoffs);
+        }
+    }
+
+    void RecordResult(uint32_t processor, int64_t bytesTransferred) noexcept
+    {
+        if (processor < g_processorWorkers.size())
+        {
+            ctl::ctMemoryGuardAdd(&g_processorWorkers[processor]->m_bytesTransferred, bytesTransferred);
+        }
+    }
+
+    void PrintSummary(int64_t totalTimeMilliseconds) noexcept try
+    {
+        if (g_processorWorkers.empty())
+        {
+            return;
+        }
+
+        ctsConfig::PrintSummary(
+            L"\n"
+            L"  Per-Processor Statistics\n"
+            L"-------------------------------------------------------------------------------\n");
+        for (const auto& workers : g_processorWorkers)
+        {
+            // the CPU time of this processor's threadpool threads, in 100ns units
+            uint64_t cpuTime = 0;
+            {
+                const auto lock = workers->m_lock.lock();
+                for (const auto& thread : workers->m_threads)
+                {
+                    FILETIME creationTime{};
+                    FILETIME exitTime{};
+                    FILETIME kernelTime{};
+                    FILETIME userTime{};
+                    if (GetThreadTimes(thread.get(), &creationTime, &exitTime, &kernelTime, &userTime))
+                    {
+                        cpuTime += wil::filetime::to_int64(kernelTime) + wil::filetime::to_int64(userTime);
+                    }
+                }
+            }
+
+            const auto bytesTransferred = ctl::ctMemoryGuardRead(&workers->m_bytesTransferred);
+            ctsConfig::PrintSummary(
+                L"  Processor %u:%u : Connections [%lld] Bytes [%lld] Bytes/sec [%lld] Worker CPU [%.1f%%]\n",
+                workers->m_processor.Group,
+                workers->m_processor.Number,
+                ctl::ctMemoryGuardRead(&workers->m_connectionCount),
+                bytesTransferred,
+                totalTimeMilliseconds > 0 ? bytesTransferred * 1000LL / totalTimeMilliseconds : 0LL,
+                totalTimeMilliseconds > 0 ?
+                static_cast<double>(cpuTime) / static_cast<double>(totalTimeMilliseconds * wil::filetime_duration::one_millisecond) * 100.0 :
+                0.0);
+        }
+
+        if (ctsConfig::CpuAffinityType::Rss == ctsConfig::g_configSettings->CpuAffinity)
+        {
+            ctsConfig::PrintSummary(
+                L"  RSS Placement : AlreadyPlaced [%lld] Steered [%lld] CrossCoreHandoffs [%lld] Unavailable [%lld]\n",
+                ctl::ctMemoryGuardRead(&g_rssAlreadyPlaced),
+                ctl::ctMemoryGuardRead(&g_rssSteered),
+                ctl::ctMemoryGuardRead(&g_rssCrossCoreHandoffs),
+                ctl::ctMemoryGuardRead(&g_rssUnavailable));
+        }
+    }
+    catch (...)
+    {
+    }
+}
@@ -0,0 +1,56 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <cstdint>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+
+// With -CpuAffinity each connection is placed on one processor for its lifetime
+// - every processor has its own threadpool, whose threads are affinitized to that processor
+// - the IO completions, timers and state machine work of a connection all run on its processor's threadpool
+//   keeping the connection and its IO pattern state in that processor's caches
+//
+// Connections are assigned to processors round-robin as they are created
+// - with -CpuAffinity:rss, once connected each is moved to the processor RSS delivers its packets to
+//   (SIO_QUERY_RSS_PROCESSOR_INFO), so its completions are processed where its receives are indicated
+// - only the IO completions and timers move: the state machine's remaining (closing) callback
+//   stays on the threadpool of the processor the connection was first assigned
+// - connections which cannot be moved are counted as cross-core handoffs
+//
+// The bytes transferred and the CPU time of each processor's threads are tracked for the summary
+
+namespace ctsTraffic::ctsCpuAffinity
+{
+    // creates the per-processor threadpools when -CpuAffinity is specified
+    // - throws wil::ResultException or std::bad_alloc on failure
+    void Start();
+
+    // returns the processor for a new connection
+    uint32_t AssignProcessor() noexcept;
+
+    // returns the threadpool environment for callbacks of a connection on that processor
+    // - this is ctsConfigSettings::pTpEnvironment when -CpuAffinity is not specified
+    PTP_CALLBACK_ENVIRON GetEnvironment(uint32_t processor) noexcept;
+
+    // with -CpuAffinity:rss, updates processor to the RSS processor of the connected socket
+    // - canMove is false once the socket's IO is bound to the threadpool of the current processor
+    void SteerConnection(SOCKET socket, uint32_t& processor, bool canMove) noexcept;
+
+    void RecordResult(uint32_t processor, int64_t bytesTransferred) noexcept;
+
+    void PrintSummary(int64_t totalTimeMilliseconds) noexcept;
+}
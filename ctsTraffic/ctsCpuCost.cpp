@@ -0,0 +1,248 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsCpuCost.h"
+// cpp headers
+#include <cstdint>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <winternl.h>
+// wil headers
+#include <wil/resource.h>
+#include <wil/win32_helpers.h>
+// ctl headers
+#include <ctTimer.hpp>
+// project headers
+#include "ctsConfig.h"
+
+namespace ctsTraffic::ctsCpuCost
+{
+    // STATUS_INFO_LENGTH_MISMATCH (ntstatus.h cannot be included with Windows.h)
+    constexpr NTSTATUS c_statusInfoLengthMismatch = static_cast<NTSTATUS>(0xC0000004L);
+    constexpr double c_bytesPerGb = 1024.0 * 1024.0 * 1024.0;
+
+    struct ctsCpuCostSample
+    {
+        int64_t m_timeMs = 0;
+        // 100ns units
+        uint64_t m_userTime = 0;
+        uint64_t m_kernelTime = 0;
+        uint64_t m_cycles = 0;
+        uint64_t m_contextSwitches = 0;
+        int64_t m_bytes = 0;
+        int64_t m_completedIo = 0;
+    };
+
+    static wil::critical_section g_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock}; // NOLINT(clang-diagnostic-exit-time-destructors)
+    _Guarded_by_(g_lock) static ctsCpuCostSample g_startSample;
+    _Guarded_by_(g_lock) static ctsCpuCostSample g_stopSample;
+    _Guarded_by_(g_lock) static ctsCpuCostSample g_statusSample;
+    _Guarded_by_(g_lock) static bool g_started = false;
+    _Guarded_by_(g_lock) static bool g_stopped = false;
+    // reused across samples: the information of every process on the system
+    _Guarded_by_(g_lock) static std::vector<BYTE> g_processInformation; // NOLINT(clang-diagnostic-exit-time-destructors)
+
+    _Requires_lock_held_(g_lock) static uint64_t ReadContextSwitches() noexcept try
+    {
+        ULONG length = 0;
+        auto status = c_statusInfoLengthMismatch;
+        while (c_statusInfoLengthMismatch == status)
+        {
+            if (g_processInformation.size() < length)
+            {
+                // processes and threads can be created before the next call: leave room for them
+                g_processInformation.resize(length + 64 * 1024);
+            }
+            else if (g_processInformation.empty())
+            {
+                g_processInformation.resize(256 * 1024);
+            }
+
+            status = NtQuerySystemInformation(
+                SystemProcessInformation,
+                g_processInformation.data(),
+                static_cast<ULONG>(g_processInformation.size()),
+                &length);
+        }
+        if (!NT_SUCCESS(status))
+        {
+            return 0;
+        }
+
+        const auto currentProcessId = GetCurrentProcessId();
+        const auto* process = reinterpret_cast<const SYSTEM_PROCESS_INFORMATION*>(g_processInformation.data());
+        for (;;)
+        {
+            if (HandleToULong(process->UniqueProcessId) == currentProcessId)
+            {
+                // the thread entries immediately follow their process entry
+                // - winternl.h names the per-thread context switch count Reserved3
+                const auto* threads = reinterpret_cast<const SYSTEM_THREAD_INFORMATION*>(process + 1);
+                uint64_t contextSwitches = 0;
+                for (ULONG thread = 0; thread < process->NumberOfThreads; ++thread)
+                {
+                    contextSwitches += threads[thread].Reserved3;
+                }
+                return contextSwitches;
+            }
+
+            if (0 == process->NextEntryOffset)
+            {
+                return 0;
+            }
+            process = reinterpret_cast<const SYSTEM_PROCESS_INFORMATION*>(reinterpret_cast<const BYTE*>(process) + process->NextEntryOffset);
+        }
+    }
+    catch (...)
+    {
+        return 0;
+    }
+
+    _Requires_lock_held_(g_lock) static ctsCpuCostSample TakeSample() noexcept
+    {
+        ctsCpuCostSample sample;
+        sample.m_timeMs = ctl::ctTimer::snap_qpc_as_msec();
+
+        FILETIME creationTime{};
+        FILETIME exitTime{};
+        FILETIME kernelTime{};
+        FILETIME userTime{};
+        if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+        {
+            sample.m_userTime = wil::filetime::to_int64(userTime);
+            sample.m_kernelTime = wil::filetime::to_int64(kernelTime);
+        }
+
+        ULONG64 cycles{};
+        if (QueryProcessCycleTime(GetCurrentProcess(), &cycles))
+        {
+            sample.m_cycles = cycles;
+        }
+
+        sample.m_contextSwitches = ReadContextSwitches();
+        // every IO pattern's completed bytes are tracked in TcpStatusDetails, including UDP
+        sample.m_bytes =
+            ctsConfig::g_configSettings->TcpStatusDetails.m_bytesSent.GetValue() +
+            ctsConfig::g_configSettings->TcpStatusDetails.m_bytesRecv.GetValue();
+        sample.m_completedIo = ctsConfig::g_configSettings->ConnectionStatusDetails.m_completedIoCount.GetValue();
+        return sample;
+    }
+
+    static ctsCpuCostRates CalculateRates(const ctsCpuCostSample& from, const ctsCpuCostSample& to) noexcept
+    {
+        const auto cpuTime = to.m_userTime + to.m_kernelTime - from.m_userTime - from.m_kernelTime;
+        const auto bytes = to.m_bytes - from.m_bytes;
+        const auto completedIo = to.m_completedIo - from.m_completedIo;
+        const auto elapsedMs = to.m_timeMs - from.m_timeMs;
+        // threads which exited take their context switches with them
+        const auto contextSwitches = to.m_contextSwitches > from.m_contextSwitches ? to.m_contextSwitches - from.m_contextSwitches : 0ULL;
+
+        ctsCpuCostRates rates;
+        if (bytes > 0)
+        {
+            rates.m_cpuSecondsPerGb =
+                static_cast<double>(cpuTime) / static_cast<double>(wil::filetime_duration::one_second) /
+                (static_cast<double>(bytes) / c_bytesPerGb);
+        }
+        if (completedIo > 0)
+        {
+            rates.m_cyclesPerIo = static_cast<int64_t>((to.m_cycles - from.m_cycles) / static_cast<uint64_t>(completedIo));
+        }
+        if (elapsedMs > 0)
+        {
+            rates.m_contextSwitchesPerSecond = static_cast<int64_t>(contextSwitches * 1000ULL / static_cast<uint64_t>(elapsedMs));
+        }
+        return rates;
+    }
+
+    void Start() noexcept
+    {
+        const auto lock = g_lock.lock();
+        g_startSample = TakeSample();
+        g_statusSample = g_startSample;
+        g_started = true;
+    }
+
+    void Stop() noexcept
+    {
+        const auto lock = g_lock.lock();
+        if (g_started && !g_stopped)
+        {
+            g_stopSample = TakeSample();
+            g_stopped = true;
+        }
+    }
+
+    ctsCpuCostRates SnapStatusInterval(bool clearStatus) noexcept
+    {
+        const auto lock = g_lock.lock();
+        if (!g_started)
+        {
+            return {};
+        }
+
+        // the final status update is printed after Stop()
+        const auto currentSample = g_stopped ? g_stopSample : TakeSample();
+        const auto rates = CalculateRates(g_statusSample, currentSample);
+        if (clearStatus)
+        {
+            g_statusSample = currentSample;
+        }
+        return rates;
+    }
+
+    void PrintSummary() noexcept
+    {
+        ctsCpuCostSample startSample;
+        ctsCpuCostSample stopSample;
+        {
+            const auto lock = g_lock.lock();
+            if (!g_started || !g_stopped)
+            {
+                return;
+            }
+            startSample = g_startSample;
+            stopSample = g_stopSample;
+        }
+
+        const auto rates = CalculateRates(startSample, stopSample);
+        const auto userSeconds = static_cast<double>(stopSample.m_userTime - startSample.m_userTime) / static_cast<double>(wil::filetime_duration::one_second);
+        const auto kernelSeconds = static_cast<double>(stopSample.m_kernelTime - startSample.m_kernelTime) / static_cast<double>(wil::filetime_duration::one_second);
+        const auto elapsedSeconds = static_cast<double>(stopSample.m_timeMs - startSample.m_timeMs) / 1000.0;
+        const auto processorCount = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+        const auto bytes = stopSample.m_bytes - startSample.m_bytes;
+        const auto cycles = stopSample.m_cycles - startSample.m_cycles;
+        const auto contextSwitches = stopSample.m_contextSwitches > startSample.m_contextSwitches ? stopSample.m_contextSwitches - startSample.m_contextSwitches : 0ULL;
+
+        ctsConfig::PrintSummary(
+            L"\n"
+            L"  CPU Cost Statistics (this process, over the Total Time)\n"
+            L"-------------------------------------------------------------------------------\n"
+            L"  CPU Time : %.3f sec (user %.3f sec, kernel %.3f sec)   Average Utilization : %.1f%% of %u processors\n"
+            L"  CPU-sec/GB : %.3f   Cycles/Byte : %.2f   Cycles/IO : %lld (%lld sends and receives)\n"
+            L"  Context Switches : %llu (%lld/sec)\n",
+            userSeconds + kernelSeconds,
+            userSeconds,
+            kernelSeconds,
+            elapsedSeconds > 0.0 && processorCount > 0 ? (userSeconds + kernelSeconds) / elapsedSeconds / processorCount * 100.0 : 0.0,
+            processorCount,
+            rates.m_cpuSecondsPerGb,
+            bytes > 0 ? static_cast<double>(cycles) / static_cast<double>(bytes) : 0.0,
+            rates.m_cyclesPerIo,
+            stopSample.m_completedIo - startSample.m_completedIo,
+            contextSwitches,
+            rates.m_contextSwitchesPerSecond);
+    }
+}
@@ -0,0 +1,52 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <cstdint>
+
+// Tracks what the traffic costs this process in CPU, to compare IO models and options by efficiency
+// - CPU time (user + kernel) from GetProcessTimes
+// - processor cycles charged to the process's threads from QueryProcessCycleTime
+// - context switches of the process's threads from NtQuerySystemInformation(SystemProcessInformation)
+//   (threads which have exited are no longer counted)
+//
+// The cost is reported relative to the bytes sent and received and the sends and receives completed
+// - always in the summary, for the time from Start() to Stop()
+// - in each status update with -CpuCost:on, for that time slice
+
+namespace ctsTraffic::ctsCpuCost
+{
+    struct ctsCpuCostRates
+    {
+        // CPU seconds (user + kernel) per GB sent and received
+        double m_cpuSecondsPerGb = 0.0;
+        // processor cycles per send or receive completed
+        int64_t m_cyclesPerIo = 0;
+        int64_t m_contextSwitchesPerSecond = 0;
+    };
+
+    // captures the baseline immediately before the first connection is started
+    void Start() noexcept;
+
+    // captures the end of the run, before the connections are torn down
+    void Stop() noexcept;
+
+    // the cost since the prior status update
+    // - the time slice is only restarted when clearStatus is true, as with the status statistics
+    ctsCpuCostRates SnapStatusInterval(bool clearStatus) noexcept;
+
+    // prints the cost from Start() to Stop()
+    void PrintSummary() noexcept;
+}
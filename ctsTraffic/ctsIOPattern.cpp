@@ -16,6 +16,8 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include "ctsIOPattern.h"
 // cpp headers
 #include <vector>
+// os headers
+#include <mstcpip.h>
 // wil headers
 #include <wil/stl.h>
 #include <wil/resource.h>
@@ -24,7 +26,9 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <ctTimer.hpp>
 // project headers
 #include "ctsMediaStreamProtocol.hpp"
+#include "ctsMetricsExporter.h"
 #include "ctsTCPFunctions.h"
+#include "ctsTrace.h"
 
 namespace ctsTraffic
 {
@@ -46,6 +50,8 @@ static char* g_senderSharedBuffer = nullptr;
 static uint32_t g_maximumBufferSize = 0;
 
 constexpr auto c_maxSupportedBytesInFlight = 0x1000000ul;
+// the width of each interval of bytes tracked for TCP connections - stalls must span at least one whole interval
+constexpr int64_t c_throughputIntervalMs = 100;
 static uint32_t g_maxNumberOfRioSendBuffers = 0;
 
 BOOL CALLBACK InitOnceIoPatternCallback(PINIT_ONCE, PVOID, PVOID*) noexcept // NOLINT(bugprone-exception-escape)
@@ -107,6 +113,9 @@ shared_ptr<ctsIoPattern> ctsIoPattern::MakeIoPattern()
         case ctsConfig::IoPatternType::Duplex:
             return make_shared<ctsIoPatternDuplex>();
 
+        case ctsConfig::IoPatternType::PingPong:
+            return make_shared<ctsIoPatternPingPong>();
+
         case ctsConfig::IoPatternType::MediaStream:
             if (ctsConfig::IsListening())
             {
@@ -343,6 +352,30 @@ ctsTask ctsIoPattern::InitiateIo() noexcept
     }
 
     m_patternState.NotifyNextTask(returnTask);
+    if (ctsTaskAction::None != returnTask.m_ioAction)
+    {
+        ctsTrace::TraceIoInitiated(m_traceId, static_cast<uint16_t>(returnTask.m_ioAction), returnTask.m_bufferLength);
+    }
+    if (ctsTaskAction::Send == returnTask.m_ioAction || ctsTaskAction::Recv == returnTask.m_ioAction)
+    {
+        if (ctsConfig::g_configSettings->Protocol == ctsConfig::ProtocolType::TCP)
+        {
+            const auto nowMs = ctTimer::snap_qpc_as_msec();
+            if (!m_throughputTimeline.IsStarted())
+            {
+                m_throughputTimeline.Start(nowMs, c_throughputIntervalMs);
+            }
+            if (0 == m_outstandingIo++)
+            {
+                // IO deliberately delayed (e.g. -RateLimit) is not outstanding until it's actually requested
+                m_outstandingSinceMs = nowMs + returnTask.m_timeOffsetMilliseconds;
+            }
+        }
+        if (ctsMetricsExporter::IsEnabled())
+        {
+            returnTask.m_issuedUsec = ctTimer::snap_qpc_as_usec();
+        }
+    }
     return returnTask;
 }
 
@@ -367,6 +400,11 @@ ctsIoStatus ctsIoPattern::CompleteIo(const ctsTask& originalTask, uint32_t curre
     // preserve the initial state for the prior task
     const bool wasIoRequestedFromPattern = m_patternState.IsCurrentStateMoreIo();
 
+    if (ctsTaskAction::None != originalTask.m_ioAction)
+    {
+        ctsTrace::TraceIoCompleted(m_traceId, static_cast<uint16_t>(originalTask.m_ioAction), currentTransfer, statusCode);
+    }
+
     // add the recv buffer back if it was one of our dynamically allocated recv buffers
     // add back the RIO BufferId if it was a RIO request
     if (ctsTask::BufferType::Dynamic == originalTask.m_bufferType)
@@ -510,12 +548,32 @@ ctsIoStatus ctsIoPattern::CompleteIo(const ctsTask& originalTask, uint32_t curre
         {
             ctsConfig::g_configSettings->TcpStatusDetails.m_bytesRecv.Add(currentTransfer);
         }
+        if (ctsTaskAction::Send == originalTask.m_ioAction || ctsTaskAction::Recv == originalTask.m_ioAction)
+        {
+            ctsConfig::g_configSettings->ConnectionStatusDetails.m_completedIoCount.Increment();
+        }
+        if (m_throughputTimeline.IsStarted() &&
+            (ctsTaskAction::Send == originalTask.m_ioAction || ctsTaskAction::Recv == originalTask.m_ioAction))
+        {
+            m_throughputTimeline.RecordProgress(ctTimer::snap_qpc_as_msec(), currentTransfer, m_outstandingSinceMs);
+        }
+        if (originalTask.m_issuedUsec != 0)
+        {
+            // not counting the time the IO was deliberately delayed (e.g. -RateLimit)
+            const auto latencyUsec = ctTimer::snap_qpc_as_usec() - originalTask.m_issuedUsec - originalTask.m_timeOffsetMilliseconds * 1000LL;
+            ctsMetricsExporter::RecordIo(ctsTaskAction::Send == originalTask.m_ioAction, currentTransfer, latencyUsec > 0 ? latencyUsec : 0LL);
+        }
         // only complete tasks that were requested
         if (wasIoRequestedFromPattern)
         {
             UpdateLastPatternError(CompleteTaskBackToPattern(originalTask, currentTransfer));
         }
     }
+    if (m_outstandingIo > 0 &&
+        (ctsTaskAction::Send == originalTask.m_ioAction || ctsTaskAction::Recv == originalTask.m_ioAction))
+    {
+        --m_outstandingIo;
+    }
     //
     // If the state machine has verified the connection has completed, 
     // - set the last error to zero in case it was not already set to an error
@@ -771,6 +829,16 @@ bool ctsIoPattern::VerifyBuffer(const ctsTask& originalTask, uint32_t transferre
     return lengthMatched == transferredBytes;
 }
 
+[[nodiscard]] const ctsThroughputTimeline& ctsIoPattern::CloseThroughputTimeline() noexcept
+{
+    const auto lock = AcquireIoPatternLock();
+    if (m_outstandingIo > 0)
+    {
+        m_throughputTimeline.RecordClose(ctTimer::snap_qpc_as_msec(), m_outstandingSinceMs);
+    }
+    return m_throughputTimeline;
+}
+
 [[nodiscard]] wil::cs_leave_scope_exit ctsIoPattern::AcquireIoPatternLock() const noexcept
 {
     const auto sharedSocket = m_parentSocket.lock();
@@ -1015,6 +1083,146 @@ ctsIoPatternError ctsIoPatternPushPull::CompleteTaskBackToPattern(const ctsTask&
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///
+///     - PingPong Pattern
+///    -- TCP-only
+///    -- The client sends a message of PingPongBytes, the server receives it then sends one back
+///    -- Both sides measure from the start of each send until the full reply is received
+///       (the server has no measurement for the first message it receives)
+///    -- The transfer is rounded up to a whole number of round trips, so the last reply is never cut short
+///
+///    -- Not supporting concurrent IO via ctsConfig::GetConcurrentIoCount()
+///       as a single message in flight is the point of the pattern
+///
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ctsIoPatternPingPong::ctsIoPatternPingPong() :
+    ctsIoPatternStatistics(1), // only ever 1 IO request in flight
+    m_messageSize(ctsConfig::g_configSettings->PingPongBytes),
+    m_sending(!ctsConfig::IsListening()) // start with clients sending, servers receiving
+{
+    // each round trip sends and receives one full message
+    const auto roundTripBytes = static_cast<uint64_t>(m_messageSize) * 2;
+    const auto partialRoundTrip = GetTotalTransfer() % roundTripBytes;
+    if (partialRoundTrip != 0)
+    {
+        SetTotalTransfer(GetTotalTransfer() + roundTripBytes - partialRoundTrip);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// virtual methods from the base class:
+/// - assumes will be called under a CS from the base class
+///
+/// Return an empty task when no more IO is needed
+///
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ctsTask ctsIoPatternPingPong::GetNextTaskFromPattern() noexcept
+{
+    FAIL_FAST_IF_MSG(
+        m_intraMessageTransfer >= m_messageSize,
+        "Invalid ctsIoPatternPingPong state: intra_message_transfer (%lu), message_size (%lu)",
+        m_intraMessageTransfer, m_messageSize);
+
+    if (m_ioNeeded)
+    {
+        m_ioNeeded = false;
+
+        if (m_sending)
+        {
+            if (0 == m_intraMessageTransfer)
+            {
+                // the round trip starts when the first byte of the message is handed to the stack
+                m_sendStartUsec = ctTimer::snap_qpc_as_usec();
+            }
+            return CreateTrackedTask(
+                ctsTaskAction::Send,
+                m_messageSize - m_intraMessageTransfer);
+        }
+        return CreateTrackedTask(
+            ctsTaskAction::Recv,
+            m_messageSize - m_intraMessageTransfer);
+    }
+    return ctsTask();
+}
+
+ctsIoPatternError ctsIoPatternPingPong::CompleteTaskBackToPattern(const ctsTask& task, uint32_t currentTransfer) noexcept
+{
+    if (ctsTaskAction::Send == task.m_ioAction)
+    {
+        m_statistics.m_bytesSent.Add(currentTransfer);
+    }
+    else
+    {
+        m_statistics.m_bytesRecv.Add(currentTransfer);
+    }
+
+    m_ioNeeded = true;
+    m_intraMessageTransfer += currentTransfer;
+
+    FAIL_FAST_IF_MSG(
+        m_intraMessageTransfer > m_messageSize,
+        "Invalid ctsIoPatternPingPong state: intra_message_transfer (%lu), message_size (%lu)",
+        m_intraMessageTransfer, m_messageSize);
+
+    if (m_messageSize == m_intraMessageTransfer)
+    {
+        // the full reply was received: the round trip is complete
+        if (!m_sending && m_sendStartUsec != 0)
+        {
+            const auto roundTripUsec = ctTimer::snap_qpc_as_usec() - m_sendStartUsec;
+            m_roundTrips.AddSample(roundTripUsec > 0 ? static_cast<uint64_t>(roundTripUsec) : 0ULL);
+        }
+
+        m_sending = !m_sending;
+        m_intraMessageTransfer = 0;
+    }
+
+    return ctsIoPatternError::NoError;
+}
+
+void ctsIoPatternPingPong::PrintStatistics(const ctSockaddr& localAddr, const ctSockaddr& remoteAddr) noexcept
+{
+    ctsIoPatternStatistics::PrintStatistics(localAddr, remoteAddr);
+
+    // the pattern lock guarantees the final IO completion has finished updating the histogram
+    const auto lock = AcquireIoPatternLock();
+    ctsConfig::PrintRoundTripResults(
+        localAddr,
+        remoteAddr,
+        m_statistics.m_connectionIdentifier,
+        m_roundTrips,
+        m_tcpRttUs,
+        m_tcpMinRttUs);
+}
+
+void ctsIoPatternPingPong::PrintTcpInfo(const ctSockaddr& localAddr, const ctSockaddr& remoteAddr, SOCKET socket) noexcept
+{
+    // TCP_INFO_v0 carries the RTT the TCP stack measured from its own segments
+    // - compared against the application round trips, this splits out time spent in both hosts above the stack
+    TCP_INFO_v0 tcpInfo{};
+    DWORD tcpInfoVersion = 0;
+    DWORD bytesReturned{};
+    if (WSAIoctl(
+            socket,
+            SIO_TCP_INFO,
+            &tcpInfoVersion, sizeof tcpInfoVersion,
+            &tcpInfo, sizeof tcpInfo,
+            &bytesReturned,
+            nullptr,
+            nullptr) == 0)
+    {
+        m_tcpRttUs = tcpInfo.RttUs;
+        m_tcpMinRttUs = tcpInfo.MinRttUs;
+    }
+
+    ctsIoPatternStatistics::PrintTcpInfo(localAddr, remoteAddr, socket);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///
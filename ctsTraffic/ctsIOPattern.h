@@ -17,6 +17,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <array>
 #include <memory>
 #include <algorithm>
+#include <type_traits>
 // os headers
 #include <Windows.h>
 // project headers
@@ -96,6 +97,15 @@ public:
     ///
     virtual void PrintStatistics(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr) noexcept = 0;
     virtual void PrintTcpInfo(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr, SOCKET socket) noexcept = 0;
+    // the total bytes this connection has transferred, used to attribute its traffic to its target address
+    [[nodiscard]] virtual int64_t GetBytesTransferred() const noexcept
+    {
+        return 0;
+    }
+    // recorded with the connection results where the statistics type tracks it
+    virtual void SetConnectLatency(int64_t) noexcept
+    {
+    }
 
     //
     // These are public functions exposed to ctsSocket and the derived types
@@ -116,6 +126,16 @@ public:
         m_parentSocket = parentSocket;
     }
 
+    void SetTraceId(uint64_t traceId) noexcept
+    {
+        m_traceId = traceId;
+    }
+
+    uint64_t GetTraceId() const noexcept
+    {
+        return m_traceId;
+    }
+
     void SetIdealSendBacklog(uint32_t newIsb) noexcept
     {
         m_patternState.SetIdealSendBacklog(newIsb);
@@ -203,6 +223,8 @@ private:
     // holding a weak reference to the parent socket object
     // since these will share the same locking requirements
     std::weak_ptr<ctsSocket> m_parentSocket;
+    // identifies this connection's trace events
+    uint64_t m_traceId = 0;
 
     // track the state of the L4 protocol (TCP or UDP)
     ctsIoPatternState m_patternState;
@@ -286,6 +308,13 @@ private:
     int64_t m_bytesSendingThisQuantum{0};
     int64_t m_quantumStartTimeMs{0};
 
+    // TCP bytes completed per interval, and the stalls between them
+    // - a stall requires IO to be outstanding: the Send and Recv tasks handed out and not yet completed,
+    //   and the time the oldest of them was requested
+    ctsThroughputTimeline m_throughputTimeline;
+    uint32_t m_outstandingIo = 0;
+    int64_t m_outstandingSinceMs = 0;
+
     uint32_t m_lastError = c_statusIoRunning;
 
 protected:
@@ -313,6 +342,10 @@ protected:
     void CreateRecvBuffers();
     void CreateSendBuffers();
 
+    // counts IO still outstanding as a stall where it already spans a whole interval, then returns the timeline
+    // - called as the connection results are printed: no further progress will be recorded
+    [[nodiscard]] const ctsThroughputTimeline& CloseThroughputTimeline() noexcept;
+
     ///////////////////////////////////////////////////////////////////////////////////////////////////
     ///
     /// CreateTrackedTask(IOTaskAction, uint32_t _max_transfer)
@@ -483,11 +516,36 @@ public:
             UpdateLastPatternError(ctsIoPatternError::TooFewBytes);
         }
 
+        if constexpr (std::is_same_v<S, ctsTcpStatistics>)
+        {
+            const auto& timeline = CloseThroughputTimeline();
+            if (timeline.GetStallCount() > 0)
+            {
+                m_statistics.m_stallCount.SetValue(static_cast<int64_t>(timeline.GetStallCount()));
+                m_statistics.m_stallTimeMs.SetValue(timeline.GetStallTimeMs());
+                m_statistics.m_longestStallMs.SetValue(timeline.GetLongestStallMs());
+
+                auto& connectionDetails = ctsConfig::g_configSettings->ConnectionStatusDetails;
+                connectionDetails.m_stalledConnectionCount.Increment();
+                connectionDetails.m_stallCount.Add(static_cast<int64_t>(timeline.GetStallCount()));
+                connectionDetails.m_stallTimeMs.Add(timeline.GetStallTimeMs());
+            }
+        }
+
         ctsConfig::PrintConnectionResults(
             localAddr,
             remoteAddr,
             GetLastPatternError(),
             m_statistics);
+
+        if constexpr (std::is_same_v<S, ctsTcpStatistics>)
+        {
+            ctsConfig::PrintThroughputTimeline(
+                localAddr,
+                remoteAddr,
+                m_statistics.m_connectionIdentifier,
+                CloseThroughputTimeline());
+        }
     }
 
     void PrintTcpInfo(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr, SOCKET socket) noexcept override
@@ -497,6 +555,20 @@ public:
         ctsConfig::PrintTcpDetails(localAddr, remoteAddr, socket, m_statistics);
     }
 
+    // TCP statistics count bytes sent and received - UDP statistics count bytes received
+    [[nodiscard]] int64_t GetBytesTransferred() const noexcept override
+    {
+        return m_statistics.GetBytesReceived();
+    }
+
+    void SetConnectLatency(int64_t microseconds) noexcept override
+    {
+        if constexpr (std::is_same_v<S, ctsTcpStatistics>)
+        {
+            m_statistics.m_connectLatencyUsec.SetValue(microseconds);
+        }
+    }
+
     // the caller must guarantee calls to Start and End are serialized
     void StartStatistics() noexcept override
     {
@@ -617,6 +689,47 @@ private:
     bool m_sending{false};
 };
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///
+///     - PingPong Pattern
+///    -- TCP-only
+///    -- The client sends a single small message, the server echoes a message back
+///    -- Exactly one IO is in flight at any time
+///    -- Both sides track the time from starting a send until the full reply is received
+///
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class ctsIoPatternPingPong final : public ctsIoPatternStatistics<ctsTcpStatistics>
+{
+public:
+    ctsIoPatternPingPong();
+    ~ctsIoPatternPingPong() noexcept override = default;
+
+    ctsIoPatternPingPong(const ctsIoPatternPingPong&) = delete;
+    ctsIoPatternPingPong& operator=(const ctsIoPatternPingPong&) = delete;
+    ctsIoPatternPingPong(ctsIoPatternPingPong&&) = delete;
+    ctsIoPatternPingPong& operator=(ctsIoPatternPingPong&&) = delete;
+
+    ctsTask GetNextTaskFromPattern() noexcept override;
+    ctsIoPatternError CompleteTaskBackToPattern(const ctsTask& task, uint32_t currentTransfer) noexcept override;
+
+    // adds the round-trip distribution to the connection results
+    void PrintStatistics(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr) noexcept override;
+    // captures the RTT measured by the TCP stack before the socket is closed
+    void PrintTcpInfo(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr, SOCKET socket) noexcept override;
+
+private:
+    ctsRoundTripHistogram m_roundTrips;
+    const uint32_t m_messageSize;
+
+    uint32_t m_intraMessageTransfer{0};
+    int64_t m_sendStartUsec{0};
+    uint32_t m_tcpRttUs{0};
+    uint32_t m_tcpMinRttUs{0};
+
+    bool m_ioNeeded{true};
+    bool m_sending{false};
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///
 ///  - Duplex Pattern
@@ -715,6 +828,8 @@ public:
     // required virtual functions
     ctsTask GetNextTaskFromPattern() noexcept override;
     ctsIoPatternError CompleteTaskBackToPattern(const ctsTask& task, uint32_t completedBytes) noexcept override;
+    // adds the stream quality statistics to the connection results
+    void PrintStatistics(const ctl::ctSockaddr& localAddr, const ctl::ctSockaddr& remoteAddr) noexcept override;
 
 private:
     // private member variables
@@ -740,6 +855,7 @@ private:
     // tracking for jitter information
     ctsConfig::JitterFrameEntry m_firstFrame;
     ctsConfig::JitterFrameEntry m_previousFrame;
+    ctsMediaStreamQuality m_streamQuality;
 
     bool m_finishedStream = false;
 
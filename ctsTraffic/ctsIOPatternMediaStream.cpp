@@ -13,6 +13,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 
 
 // cpp headers
+#include <cmath>
 #include <vector>
 // os headers
 #include <Windows.h>
@@ -24,6 +25,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include "ctsConfig.h"
 #include "ctsIOTask.hpp"
 #include "ctsMediaStreamProtocol.hpp"
+#include "ctsTrace.h"
 // wil headers
 #include <wil/stl.h>
 #include <wil/resource.h>
@@ -206,6 +208,17 @@ ctsIoPatternError ctsIoPatternMediaStreamClient::CompleteTaskBackToPattern(const
         m_statistics.m_bitsReceived.Add(static_cast<int64_t>(completedBytes) * 8LL);
 
         const auto receivedsequenceNumber = ctsMediaStreamMessage::GetSequenceNumberFromTask(task);
+        ctsTrace::TraceMediaFrameReceived(GetTraceId(), receivedsequenceNumber, completedBytes);
+        const auto bufferedQpc = *reinterpret_cast<int64_t*>(task.m_buffer + 8);
+        const auto bufferedQpf = *reinterpret_cast<int64_t*>(task.m_buffer + 16);
+        // prefer the network stack receive timestamp so the jitter calculations exclude our own dispatch latency
+        // - only accept it if it's in the same QPC timeline (not a raw NIC hardware clock value)
+        const auto receiverQpc =
+            task.m_receiveTimestampQpc > 0 && task.m_receiveTimestampQpc <= qpc.QuadPart ?
+            task.m_receiveTimestampQpc :
+            qpc.QuadPart;
+        const auto receiverQpf = ctTimer::snap_qpf();
+
         if (receivedsequenceNumber > m_finalFrame)
         {
             ctsConfig::g_configSettings->UdpStatusDetails.m_errorFrames.Increment();
@@ -222,17 +235,23 @@ ctsIoPatternError ctsIoPatternMediaStreamClient::CompleteTaskBackToPattern(const
             // search our circular queue (starting at the head_entry)
             // for the seq number we just received, and if found, tag as received
             //
+            if (bufferedQpf > 0)
+            {
+                m_streamQuality.RecordArrival(
+                    receivedsequenceNumber,
+                    static_cast<double>(bufferedQpc) * 1'000'000.0 / static_cast<double>(bufferedQpf),
+                    static_cast<double>(receiverQpc) * 1'000'000.0 / static_cast<double>(receiverQpf));
+            }
+
             const auto foundSlot = FindSequenceNumber(receivedsequenceNumber);
             if (foundSlot != m_frameEntries.end())
             {
-                const auto bufferedQpc = *reinterpret_cast<int64_t*>(task.m_buffer + 8);
-                const auto bufferedQpf = *reinterpret_cast<int64_t*>(task.m_buffer + 16);
-
                 // always overwrite qpc & qpf values with the latest datagram details
                 foundSlot->m_senderQpc = bufferedQpc;
                 foundSlot->m_senderQpf = bufferedQpf;
-                foundSlot->m_receiverQpc = qpc.QuadPart;
-                foundSlot->m_receiverQpf = ctTimer::snap_qpf();
+                foundSlot->m_receiverAppQpc = qpc.QuadPart;
+                foundSlot->m_receiverQpc = receiverQpc;
+                foundSlot->m_receiverQpf = receiverQpf;
                 foundSlot->m_bytesReceived += completedBytes;
 
                 PRINT_DEBUG_INFO(
@@ -257,6 +276,8 @@ ctsIoPatternError ctsIoPatternMediaStreamClient::CompleteTaskBackToPattern(const
 
                 if (receivedsequenceNumber < m_headEntry->m_sequenceNumber)
                 {
+                    // its frame was already rendered
+                    m_streamQuality.RecordLateFrame();
                     PRINT_DEBUG_INFO(
                         L"\t\tctsIOPatternMediaStreamClient received **a stale** seq number (%lld) - current seq number (%lld)\n",
                         receivedsequenceNumber,
@@ -281,6 +302,27 @@ ctsIoPatternError ctsIoPatternMediaStreamClient::CompleteTaskBackToPattern(const
     return ctsIoPatternError::NoError;
 }
 
+void ctsIoPatternMediaStreamClient::PrintStatistics(const ctSockaddr& localAddr, const ctSockaddr& remoteAddr) noexcept
+{
+    {
+        // the pattern lock guarantees the renderer timer and IO completions have finished updating the stream quality
+        const auto lock = AcquireIoPatternLock();
+        m_streamQuality.EndStream();
+
+        const auto& delayVariation = m_streamQuality.GetDelayVariation();
+        m_statistics.m_rfc3550JitterUsec.SetValue(static_cast<int64_t>(m_streamQuality.GetJitterUsec()));
+        m_statistics.m_delayVariationP50Usec.SetValue(static_cast<int64_t>(delayVariation.GetPercentile(50.0)));
+        m_statistics.m_delayVariationP99Usec.SetValue(static_cast<int64_t>(delayVariation.GetPercentile(99.0)));
+        m_statistics.m_lateFrames.SetValue(static_cast<int64_t>(m_streamQuality.GetLateFrames()));
+        m_statistics.m_reorderedFrames.SetValue(static_cast<int64_t>(m_streamQuality.GetReorderedFrames()));
+        m_statistics.m_lossRunCount.SetValue(static_cast<int64_t>(m_streamQuality.GetLossRunCount()));
+        m_statistics.m_longestLossRun.SetValue(static_cast<int64_t>(m_streamQuality.GetLongestLossRun()));
+        ctsConfig::RecordMediaStreamQuality(m_streamQuality);
+    }
+
+    ctsIoPatternStatistics::PrintStatistics(localAddr, remoteAddr);
+}
+
 // Returns an iterator within frame_entries pointing to the FrameEntry
 //   matching the specified sequence number.
 // If the sequence number was not found, will return end(frame_entries)
@@ -399,9 +441,27 @@ void ctsIoPatternMediaStreamClient::RenderFrame() noexcept
             L"\t\tctsIOPatternMediaStreamClient rendered frame %lld\n",
             m_headEntry->m_sequenceNumber);
 
+        m_streamQuality.RecordRenderedFrame(false);
+
         // Directly write this status update if jitter is enabled
         PrintJitterUpdate(*m_headEntry, m_previousFrame);
 
+        // split the jitter from the prior frame into what the network introduced vs. what this host introduced
+        if (m_previousFrame.m_receiverQpf != 0)
+        {
+            const auto networkJitterMs = std::abs(m_headEntry->m_estimatedTimeInFlightMs - m_previousFrame.m_estimatedTimeInFlightMs);
+            const auto hostJitterMs = std::abs(m_headEntry->HostDelayMs() - m_previousFrame.HostDelayMs());
+            const auto networkJitterUs = static_cast<int64_t>(networkJitterMs * 1000.0);
+            const auto hostJitterUs = static_cast<int64_t>(hostJitterMs * 1000.0);
+
+            ctsConfig::g_configSettings->UdpStatusDetails.m_networkJitterMicroseconds.Add(networkJitterUs);
+            ctsConfig::g_configSettings->UdpStatusDetails.m_hostJitterMicroseconds.Add(hostJitterUs);
+            ctsConfig::g_configSettings->UdpStatusDetails.m_jitterSamples.Increment();
+            m_statistics.m_networkJitterMicroseconds.Add(networkJitterUs);
+            m_statistics.m_hostJitterMicroseconds.Add(hostJitterUs);
+            m_statistics.m_jitterSamples.Increment();
+        }
+
         // if this is the first frame, capture it
         if (m_firstFrame.m_receiverQpc == 0)
         {
@@ -419,6 +479,8 @@ void ctsIoPatternMediaStreamClient::RenderFrame() noexcept
             L"\t\tctsIOPatternMediaStreamClient **dropped** frame for seq number (%lld)\n",
             m_headEntry->m_sequenceNumber);
 
+        m_streamQuality.RecordRenderedFrame(true);
+
         // track the dropped frame
         // indicate zero's for the other values so we won't calculate jitter for a dropped datagram
         ctsConfig::JitterFrameEntry droppedFrame;
@@ -429,6 +491,7 @@ void ctsIoPatternMediaStreamClient::RenderFrame() noexcept
     {
         ctsConfig::g_configSettings->UdpStatusDetails.m_duplicateFrames.Increment();
         m_statistics.m_duplicateFrames.Increment();
+        m_streamQuality.RecordRenderedFrame(false);
 
         PRINT_DEBUG_INFO(
             L"\t\tctsIOPatternMediaStreamClient **a duplicate** frame for seq number (%lld)\n",
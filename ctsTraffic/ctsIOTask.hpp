@@ -47,6 +47,14 @@ struct ctsTask
     uint32_t m_expectedPatternOffset = 0UL;
     ctsTaskAction m_ioAction = ctsTaskAction::None;
 
+    // the QPC value the network stack stamped when the datagram was received (SO_TIMESTAMP)
+    // - set on completed Recv tasks only when receive timestamps are enabled; otherwise zero
+    int64_t m_receiveTimestampQpc = 0LL;
+
+    // the QPC time in microseconds when the pattern returned this task from InitiateIo
+    // - set only when the metrics endpoint is measuring IO latency (-MetricsPort); otherwise zero
+    int64_t m_issuedUsec = 0LL;
+
     // (internal) flag identifying the type of buffer
     enum class BufferType
     {
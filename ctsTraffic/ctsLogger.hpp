@@ -14,11 +14,19 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #pragma once
 
 // cpp headers
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
 // os headers
 #include <Windows.h>
 // wil headers
 #include <wil/stl.h>
 #include <wil/resource.h>
+// ctl headers
+#include <ctFormat.hpp>
 // project headers
 #include "ctsConfig.h"
 #include "ctsPrintStatus.hpp"
@@ -31,8 +39,9 @@ namespace ctsTraffic
 ///
 ///
 /// - all concrete types must implement:
-///     message_impl(_In_ PCWSTR)
-///     error_impl(_In_ PCWSTR)
+///     LogMessageImpl(_In_ PCWSTR)
+///     LogMessageImpl(std::string_view) - UTF8 text, e.g. formatted by ctFormatUtf8
+///     LogErrorImpl(_In_ PCWSTR)
 ///
 ///   Note: all logging functions are no-throw
 ///         only the c'tor can throw
@@ -78,6 +87,11 @@ public:
         LogMessageImpl(message);
     }
 
+    void LogMessage(std::string_view utf8Message) noexcept
+    {
+        LogMessageImpl(utf8Message);
+    }
+
     void LogError(_In_ PCWSTR message) noexcept
     {
         LogErrorImpl(message);
@@ -88,6 +102,12 @@ public:
         return ctsConfig::StatusFormatting::Csv == m_format;
     }
 
+    // the number of messages discarded because they could not be written fast enough
+    [[nodiscard]] virtual int64_t GetDroppedRecordCount() const noexcept
+    {
+        return 0;
+    }
+
     // not copyable
     ctsLogger(const ctsLogger&) = delete;
     ctsLogger& operator=(const ctsLogger&) = delete;
@@ -99,9 +119,23 @@ private:
 
     /// pure virtual methods concrete classes must implement
     virtual void LogMessageImpl(_In_ PCWSTR message) noexcept = 0;
+    virtual void LogMessageImpl(std::string_view utf8Message) noexcept = 0;
     virtual void LogErrorImpl(_In_ PCWSTR message) noexcept = 0;
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// ctsTextLogger writes to its file asynchronously, as UTF8
+///
+/// - wide messages are converted to UTF8 as they are copied into the ring
+/// - callers copy each message into a slot of a bounded multi-producer ring (no lock is taken)
+/// - a writer thread drains the ring, batching the messages into one large WriteFile
+///   it wakes every c_flushIntervalMs, or sooner once the ring is half full or an error is logged
+///
+/// - when the ring is full, callers wait up to c_fullWaitMs for the writer to free a slot
+///   then the message is dropped and counted in GetDroppedRecordCount()
+///
+////////////////////////////////////////////////////////////////////////////////////////////////////
 class ctsTextLogger final : public ctsLogger
 {
 public:
@@ -118,27 +152,56 @@ public:
             nullptr));
         THROW_LAST_ERROR_IF_NULL(m_fileHandle.get());
 
-        // write the UTF16 Byte order mark
-        constexpr WCHAR bomUtf16 = 0xFEFF;
+        // write the UTF8 Byte order mark
+        constexpr BYTE bomUtf8[]{0xEF, 0xBB, 0xBF};
         DWORD bytesWritten{};
         THROW_LAST_ERROR_IF(!WriteFile(
             m_fileHandle.get(),
-            &bomUtf16,
-            sizeof WCHAR,
+            bomUtf8,
+            sizeof bomUtf8,
             &bytesWritten,
             nullptr));
+
+        m_ring = std::make_unique<RingSlot[]>(c_ringCapacity);
+        for (uint64_t index = 0; index < c_ringCapacity; ++index)
+        {
+            m_ring[index].m_sequence.store(index, std::memory_order_relaxed);
+        }
+        m_writeBuffer.reserve(c_writeBufferReserve);
+
+        m_writerThread = std::thread([this] { WriterLoop(); });
     }
 
-    ~ctsTextLogger() noexcept override = default;
+    ~ctsTextLogger() noexcept override
+    {
+        // the writer drains everything queued before it exits
+        m_stopping.store(true);
+        m_wakeWriter.SetEvent();
+        if (m_writerThread.joinable())
+        {
+            m_writerThread.join();
+        }
+    }
 
     void LogMessageImpl(_In_ PCWSTR message) noexcept override
     {
-        WriteImpl(message);
+        Enqueue([message](std::string& slotMessage) { ctl::ctAppendUtf8(message, slotMessage); }, false);
+    }
+
+    void LogMessageImpl(std::string_view utf8Message) noexcept override
+    {
+        Enqueue([utf8Message](std::string& slotMessage) { slotMessage.assign(utf8Message); }, false);
     }
 
     void LogErrorImpl(_In_ PCWSTR message) noexcept override
     {
-        WriteImpl(message);
+        // errors are written promptly: they are often the last thing logged before exiting
+        Enqueue([message](std::string& slotMessage) { ctl::ctAppendUtf8(message, slotMessage); }, true);
+    }
+
+    [[nodiscard]] int64_t GetDroppedRecordCount() const noexcept override
+    {
+        return m_droppedRecords.load();
     }
 
     ctsTextLogger(const ctsTextLogger&) = delete;
@@ -147,19 +210,159 @@ public:
     ctsTextLogger& operator=(ctsTextLogger&&) = delete;
 
 private:
-    wil::critical_section m_fileLock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
+    static constexpr uint64_t c_ringCapacity = 8192; // must be a power of 2
+    static constexpr DWORD c_flushIntervalMs = 100;
+    static constexpr DWORD c_fullWaitMs = 50;
+    static constexpr size_t c_writeBufferReserve = 256 * 1024;
+
+    // bounded MPMC ring (Vyukov) used with a single consumer
+    // - a slot is free for the producer at position N when its sequence == N
+    //   and holds a message for the consumer at position N when its sequence == N + 1
+    // - the slot strings keep their capacity once cleared, so steady-state logging does not allocate
+    struct RingSlot
+    {
+        std::atomic<uint64_t> m_sequence{0};
+        std::string m_message;
+    };
+
     wil::unique_hfile m_fileHandle;
+    std::unique_ptr<RingSlot[]> m_ring;
+    alignas(64) std::atomic<uint64_t> m_enqueuePosition{0};
+    // the writer's position, read by producers to decide when to wake it early
+    alignas(64) std::atomic<uint64_t> m_dequeuePositionHint{0};
+    uint64_t m_dequeuePosition = 0; // only accessed by the writer thread
+    std::atomic<int64_t> m_droppedRecords{0};
+    std::atomic<bool> m_stopping{false};
+    wil::slim_event_auto_reset m_wakeWriter;
+    // only accessed by the writer thread
+    std::string m_writeBuffer;
+    std::thread m_writerThread;
 
-    void WriteImpl(_In_ PCWSTR message) noexcept
+    // copyMessage writes the message into the (cleared) slot string
+    template <typename CopyT>
+    void Enqueue(CopyT&& copyMessage, bool wakeWriter) noexcept
     {
-        const auto lock = m_fileLock.lock();
+        const auto waitStart = GetTickCount64();
+        for (;;)
+        {
+            auto position = m_enqueuePosition.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                auto& slot = m_ring[position & (c_ringCapacity - 1)];
+                const auto sequence = slot.m_sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<int64_t>(sequence - position);
+                if (difference == 0)
+                {
+                    if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        try
+                        {
+                            slot.m_message.clear();
+                            copyMessage(slot.m_message);
+                        }
+                        catch (...)
+                        {
+                            // the slot must still be published: the writer skips the empty message
+                            slot.m_message.clear();
+                            m_droppedRecords.fetch_add(1);
+                        }
+                        slot.m_sequence.store(position + 1, std::memory_order_release);
+
+                        if (wakeWriter || position - m_dequeuePositionHint.load(std::memory_order_relaxed) == c_ringCapacity / 2)
+                        {
+                            m_wakeWriter.SetEvent();
+                        }
+                        return;
+                    }
+                    // position was updated by the failed compare_exchange
+                }
+                else if (difference < 0)
+                {
+                    // full
+                    break;
+                }
+                else
+                {
+                    position = m_enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+
+            // apply backpressure for a short time before dropping the message
+            if (GetTickCount64() - waitStart >= c_fullWaitMs || m_stopping.load())
+            {
+                m_droppedRecords.fetch_add(1);
+                return;
+            }
+            m_wakeWriter.SetEvent();
+            Sleep(1);
+        }
+    }
+
+    // returns true if any messages were taken from the ring
+    bool DrainRing() noexcept
+    {
+        auto drained = false;
+        for (;;)
+        {
+            auto& slot = m_ring[m_dequeuePosition & (c_ringCapacity - 1)];
+            if (slot.m_sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+            {
+                break;
+            }
+
+            try
+            {
+                m_writeBuffer.append(slot.m_message);
+            }
+            catch (...)
+            {
+                m_droppedRecords.fetch_add(1);
+            }
+            slot.m_message.clear();
+            slot.m_sequence.store(m_dequeuePosition + c_ringCapacity, std::memory_order_release);
+            ++m_dequeuePosition;
+            m_dequeuePositionHint.store(m_dequeuePosition, std::memory_order_relaxed);
+            drained = true;
+
+            if (m_writeBuffer.size() >= c_writeBufferReserve)
+            {
+                FlushWriteBuffer();
+            }
+        }
+        return drained;
+    }
+
+    void FlushWriteBuffer() noexcept
+    {
+        if (m_writeBuffer.empty())
+        {
+            return;
+        }
+
         DWORD bytesWritten{};
         LOG_LAST_ERROR_IF(!WriteFile(
             m_fileHandle.get(),
-            message,
-            static_cast<DWORD>(wcslen(message) * sizeof(WCHAR)),
+            m_writeBuffer.c_str(),
+            static_cast<DWORD>(m_writeBuffer.size()),
             &bytesWritten,
             nullptr));
+        m_writeBuffer.clear();
+    }
+
+    void WriterLoop() noexcept
+    {
+        for (;;)
+        {
+            const auto stopping = m_stopping.load();
+            DrainRing();
+            FlushWriteBuffer();
+            if (stopping)
+            {
+                // everything queued before the destructor was called has been written
+                break;
+            }
+            m_wakeWriter.wait(c_flushIntervalMs);
+        }
     }
 };
 } // namespace
@@ -52,7 +52,8 @@ IoImplStatus ctsMediaStreamClientIoImpl(
 void ctsMediaStreamClientIoCompletionCallback(
     _In_ OVERLAPPED* pOverlapped,
     const std::weak_ptr<ctsSocket>& weakSocket,
-    const ctsTask& task
+    const ctsTask& task,
+    const std::shared_ptr<wsRecvMsgContext>& recvContext
 ) noexcept;
 
 void ctsMediaStreamClientConnectionCompletionCallback(
@@ -229,10 +230,24 @@ IoImplStatus ctsMediaStreamClientIoImpl(const std::shared_ptr<ctsSocket>& shared
             [[fallthrough]];
         case ctsTaskAction::Recv:
         {
+            // receive timestamps need a WSAMSG + control buffer which must live until the IO completes
+            // - if that allocation fails, fall back to WSARecvFrom without a receive timestamp
+            std::shared_ptr<wsRecvMsgContext> recvContext;
+            if (ctsTaskAction::Recv == task.m_ioAction && ctsConfig::g_configSettings->Options & ctsConfig::OptionType::RecvTimestamps)
+            {
+                try
+                {
+                    recvContext = std::make_shared<wsRecvMsgContext>();
+                }
+                catch (...)
+                {
+                }
+            }
+
             // add-ref the IO about to start
             sharedSocket->IncrementIo();
-            auto callback = [weak_reference = std::weak_ptr(sharedSocket), task](OVERLAPPED* ov) noexcept {
-                ctsMediaStreamClientIoCompletionCallback(ov, weak_reference, task);
+            auto callback = [weak_reference = std::weak_ptr(sharedSocket), task, recvContext](OVERLAPPED* ov) noexcept {
+                ctsMediaStreamClientIoCompletionCallback(ov, weak_reference, task, recvContext);
             };
 
             PCSTR functionName{};
@@ -242,6 +257,11 @@ IoImplStatus ctsMediaStreamClientIoImpl(const std::shared_ptr<ctsSocket>& shared
                 functionName = "WSASendTo";
                 result = ctsWSASendTo(sharedSocket, socket, task, std::move(callback));
             }
+            else if (ctsTaskAction::Recv == task.m_ioAction && recvContext)
+            {
+                functionName = "WSARecvMsg";
+                result = ctsWSARecvMsg(sharedSocket, socket, task, *recvContext, std::move(callback));
+            }
             else if (ctsTaskAction::Recv == task.m_ioAction)
             {
                 functionName = "WSARecvFrom";
@@ -268,7 +288,13 @@ IoImplStatus ctsMediaStreamClientIoImpl(const std::shared_ptr<ctsSocket>& shared
                     PRINT_DEBUG_INFO(L"\t\tIO Failed: %hs (%u) [ctsMediaStreamClient]\n", functionName, result.m_errorCode);
                 }
 
-                switch (const auto protocolStatus = lockedPattern->CompleteIo(task, result.m_bytesTransferred, result.m_errorCode))
+                ctsTask completedTask(task);
+                if (recvContext && NO_ERROR == result.m_errorCode)
+                {
+                    completedTask.m_receiveTimestampQpc = recvContext->GetReceiveTimestamp();
+                }
+
+                switch (const auto protocolStatus = lockedPattern->CompleteIo(completedTask, result.m_bytesTransferred, result.m_errorCode))
                 {
                     case ctsIoStatus::ContinueIo:
                         // the protocol wants to ignore the error and send more data
@@ -356,7 +382,8 @@ IoImplStatus ctsMediaStreamClientIoImpl(const std::shared_ptr<ctsSocket>& shared
 void ctsMediaStreamClientIoCompletionCallback(
     _In_ OVERLAPPED* pOverlapped,
     const std::weak_ptr<ctsSocket>& weakSocket,
-    const ctsTask& task) noexcept
+    const ctsTask& task,
+    const std::shared_ptr<wsRecvMsgContext>& recvContext) noexcept
 {
     const auto sharedSocket(weakSocket.lock());
     if (!sharedSocket)
@@ -405,8 +432,15 @@ void ctsMediaStreamClientIoCompletionCallback(
         gle = NO_ERROR;
     }
 
+    // pass the network stack receive timestamp through to the pattern with the completed task
+    ctsTask completedTask(task);
+    if (recvContext && NO_ERROR == gle && socket != INVALID_SOCKET)
+    {
+        completedTask.m_receiveTimestampQpc = recvContext->GetReceiveTimestamp();
+    }
+
     // see if complete_io requests more IO
-    switch (const ctsIoStatus protocolStatus = lockedPattern->CompleteIo(task, transferred, gle))
+    switch (const ctsIoStatus protocolStatus = lockedPattern->CompleteIo(completedTask, transferred, gle))
     {
         case ctsIoStatus::ContinueIo:
         {
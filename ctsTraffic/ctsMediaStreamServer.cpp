@@ -32,6 +32,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include "ctsMediaStreamServerConnectedSocket.h"
 #include "ctsMediaStreamServerListeningSocket.h"
 #include "ctsMediaStreamProtocol.hpp"
+#include "ctsTrace.h"
 
 
 namespace ctsTraffic
@@ -440,6 +441,7 @@ namespace ctsMediaStreamServerImpl
                 L"\t\tctsMediaStreamServer sending seq number %lld (%lu bytes)\n",
                 sequenceNumber,
                 nextTask.m_bufferLength);
+            ctsTrace::TraceMediaFrameSent(ctsTrace::TraceId(connectedSocket), sequenceNumber, nextTask.m_bufferLength);
 
             ctsMediaStreamSendRequests sendingRequests(
                 nextTask.m_bufferLength, // total bytes to send
@@ -0,0 +1,366 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsMetricsExporter.h"
+// cpp headers
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+// wil headers
+#include <wil/resource.h>
+// ctl headers
+#include <ctFormat.hpp>
+#include <ctMemoryGuard.hpp>
+// project headers
+#include "ctsConfig.h"
+#include "ctsStatistics.hpp"
+
+namespace ctsTraffic::ctsMetricsExporter
+{
+    // a scrape request larger than this is rejected
+    constexpr size_t c_maxRequestBytes = 4096;
+    // bounds how long a stalled scraper can hold the exporter thread
+    constexpr DWORD c_socketTimeoutMilliseconds = 2000;
+
+    struct alignas(64) ctsProcessorShard
+    {
+        _Interlocked_ long long m_sendCount = 0;
+        _Interlocked_ long long m_recvCount = 0;
+        _Interlocked_ long long m_bytesSent = 0;
+        _Interlocked_ long long m_bytesRecv = 0;
+        _Interlocked_ long long m_latencySum = 0;
+        // the buckets of ctsRoundTripHistogram, in microseconds
+        _Interlocked_ long long m_latencyBuckets[ctsRoundTripHistogram::c_bucketCount]{};
+    };
+
+    static std::vector<std::unique_ptr<ctsProcessorShard>> g_shards; // NOLINT(clang-diagnostic-exit-time-destructors)
+    // the index of the first processor of each group in g_shards
+    static std::vector<uint32_t> g_groupOffsets; // NOLINT(clang-diagnostic-exit-time-destructors)
+
+    static wil::unique_socket g_listeningSocket; // NOLINT(clang-diagnostic-exit-time-destructors)
+    static wil::unique_handle g_exporterThread; // NOLINT(clang-diagnostic-exit-time-destructors)
+    static bool g_enabled = false;
+    static _Interlocked_ long g_stopping = 0;
+
+    static ctsProcessorShard* CurrentShard() noexcept
+    {
+        PROCESSOR_NUMBER processor{};
+        GetCurrentProcessorNumberEx(&processor);
+        auto index = processor.Number;
+        if (processor.Group < g_groupOffsets.size())
+        {
+            index += g_groupOffsets[processor.Group];
+        }
+        return g_shards[index % g_shards.size()].get();
+    }
+
+    // OpenMetrics counters are named with a _total suffix on the sample, not in the # TYPE line
+    static void AppendCounter(std::string_view name, std::string_view help, int64_t value)
+    {
+        ctl::ctFormatUtf8Append("# TYPE {0} counter\n# HELP {0} {1}\n{0}_total {2}\n", name, help, value);
+    }
+
+    static void AppendGauge(std::string_view name, std::string_view help, int64_t value)
+    {
+        ctl::ctFormatUtf8Append("# TYPE {0} gauge\n# HELP {0} {1}\n{0} {2}\n", name, help, value);
+    }
+
+    //
+    // writes the histogram with a bucket at the end of each power of 2
+    // - the log-linear buckets within each power of 2 are summed, keeping the output to a few dozen lines
+    // - no buckets are written past the largest sample
+    // - the count is the total of the buckets given, so +Inf and _count always agree
+    //
+    static void AppendHistogram(std::string_view name, std::string_view help, const uint64_t (&buckets)[ctsRoundTripHistogram::c_bucketCount], uint64_t sum)
+    {
+        ctl::ctFormatUtf8Append("# TYPE {0} histogram\n# HELP {0} {1}\n", name, help);
+
+        uint64_t count = 0;
+        uint32_t lastUsedBucket = 0;
+        for (uint32_t index = 0; index < ctsRoundTripHistogram::c_bucketCount; ++index)
+        {
+            count += buckets[index];
+            if (buckets[index] > 0)
+            {
+                lastUsedBucket = index;
+            }
+        }
+
+        uint64_t cumulative = 0;
+        for (uint32_t index = 0; index <= lastUsedBucket && count > 0; ++index)
+        {
+            cumulative += buckets[index];
+            if ((index + 1) % ctsRoundTripHistogram::c_subBucketCount == 0 || index == lastUsedBucket)
+            {
+                ctl::ctFormatUtf8Append("{}_bucket{{le=\"{}\"}} {}\n", name, ctsRoundTripHistogram::BucketUpperBound(index), cumulative);
+            }
+        }
+        ctl::ctFormatUtf8Append("{0}_bucket{{le=\"+Inf\"}} {1}\n{0}_sum {2}\n{0}_count {1}\n", name, count, sum);
+    }
+
+    // formats all metrics into the thread's ctFormat buffer
+    static std::string_view FormatMetrics()
+    {
+        const auto* const settings = ctsConfig::g_configSettings;
+        ctl::ctFormatUtf8("");
+
+        const auto& connections = settings->ConnectionStatusDetails;
+        AppendGauge("ctstraffic_connections_active", "Connections currently open", connections.m_activeConnectionCount.GetValue());
+        AppendCounter("ctstraffic_connections_established", "Connections established", connections.m_establishedCount.GetValue());
+        AppendCounter("ctstraffic_connections_succeeded", "Connections which completed successfully", connections.m_successfulCompletionCount.GetValue());
+        AppendCounter("ctstraffic_connections_network_errors", "Connections which failed with a network error", connections.m_connectionErrorCount.GetValue());
+        AppendCounter("ctstraffic_connections_protocol_errors", "Connections which failed with a protocol error", connections.m_protocolErrorCount.GetValue());
+        AppendCounter("ctstraffic_accept_queue_empty", "AcceptEx completions which found no accept requests still queued", connections.m_acceptQueueEmptyCount.GetValue());
+        AppendCounter("ctstraffic_socket_state_transitions", "Socket state transitions reported to the broker", connections.m_brokerTransitionCount.GetValue());
+        AppendCounter("ctstraffic_socket_pool_refreshes", "Times the broker refreshed its socket pool", connections.m_brokerRefreshCount.GetValue());
+
+        if (ctsConfig::ProtocolType::TCP == settings->Protocol)
+        {
+            AppendCounter("ctstraffic_tcp_bytes_sent", "TCP bytes sent", settings->TcpStatusDetails.m_bytesSent.GetValue());
+            AppendCounter("ctstraffic_tcp_bytes_received", "TCP bytes received", settings->TcpStatusDetails.m_bytesRecv.GetValue());
+            AppendCounter("ctstraffic_tcp_stalled_connections", "Closed TCP connections which stalled at least once", connections.m_stalledConnectionCount.GetValue());
+            AppendCounter("ctstraffic_tcp_stalls", "Periods closed TCP connections had IO outstanding but transferred no bytes", connections.m_stallCount.GetValue());
+            AppendCounter("ctstraffic_tcp_stall_milliseconds", "Time closed TCP connections spent stalled", connections.m_stallTimeMs.GetValue());
+
+            // copied under the lock connect completions take - not a lock on the IO path
+            auto connectLatency = std::make_unique<ctsRoundTripHistogram>();
+            {
+                const auto lock = settings->ConnectLatencyLock.lock();
+                *connectLatency = settings->ConnectLatency;
+            }
+            uint64_t connectBuckets[ctsRoundTripHistogram::c_bucketCount]{};
+            connectLatency->CopyBuckets(connectBuckets);
+            AppendHistogram(
+                "ctstraffic_connect_latency_microseconds",
+                "Time to establish each outgoing connection",
+                connectBuckets,
+                connectLatency->GetSum());
+        }
+        else
+        {
+            const auto& udp = settings->UdpStatusDetails;
+            AppendCounter("ctstraffic_udp_bits_received", "UDP bits received", udp.m_bitsReceived.GetValue());
+            AppendCounter("ctstraffic_udp_frames_completed", "UDP frames received complete", udp.m_successfulFrames.GetValue());
+            AppendCounter("ctstraffic_udp_frames_dropped", "UDP frames never received", udp.m_droppedFrames.GetValue());
+            AppendCounter("ctstraffic_udp_frames_repeated", "UDP frames received more than once", udp.m_duplicateFrames.GetValue());
+            AppendCounter("ctstraffic_udp_frames_errors", "UDP frames received with errors", udp.m_errorFrames.GetValue());
+            AppendCounter("ctstraffic_udp_network_jitter_microseconds", "Sum of the network jitter of each frame", udp.m_networkJitterMicroseconds.GetValue());
+            AppendCounter("ctstraffic_udp_host_jitter_microseconds", "Sum of the receive host jitter of each frame", udp.m_hostJitterMicroseconds.GetValue());
+            AppendCounter("ctstraffic_udp_jitter_samples", "Frames included in the jitter sums", udp.m_jitterSamples.GetValue());
+        }
+
+        // per-processor IO counters, and the IO latency histogram summed across processors
+        uint64_t ioBuckets[ctsRoundTripHistogram::c_bucketCount]{};
+        uint64_t ioLatencySum = 0;
+        for (auto metric = 0; metric < 4; ++metric)
+        {
+            static constexpr std::string_view names[]{"ctstraffic_processor_sends", "ctstraffic_processor_receives", "ctstraffic_processor_bytes_sent", "ctstraffic_processor_bytes_received"};
+            static constexpr std::string_view help[]{"Sends completed on each processor", "Receives completed on each processor", "Bytes sent by IO completed on each processor", "Bytes received by IO completed on each processor"};
+            ctl::ctFormatUtf8Append("# TYPE {0} counter\n# HELP {0} {1}\n", names[metric], help[metric]);
+            for (size_t processor = 0; processor < g_shards.size(); ++processor)
+            {
+                auto* shard = g_shards[processor].get();
+                long long* const values[]{&shard->m_sendCount, &shard->m_recvCount, &shard->m_bytesSent, &shard->m_bytesRecv};
+                ctl::ctFormatUtf8Append("{}_total{{cpu=\"{}\"}} {}\n", names[metric], processor, ctl::ctMemoryGuardRead(values[metric]));
+            }
+        }
+        for (const auto& shard : g_shards)
+        {
+            for (uint32_t index = 0; index < ctsRoundTripHistogram::c_bucketCount; ++index)
+            {
+                ioBuckets[index] += static_cast<uint64_t>(ctl::ctMemoryGuardRead(&shard->m_latencyBuckets[index]));
+            }
+            ioLatencySum += static_cast<uint64_t>(ctl::ctMemoryGuardRead(&shard->m_latencySum));
+        }
+        // the shards are read while IO continues: the count is taken from this one copy of the buckets
+        // - the sum may include a few completions not yet in the buckets copied
+        AppendHistogram(
+            "ctstraffic_io_latency_microseconds",
+            "Time from requesting each send or receive to its completion",
+            ioBuckets,
+            ioLatencySum);
+
+        return ctl::ctFormatUtf8Append("# EOF\n");
+    }
+
+    static void SendAll(SOCKET socket, std::string_view data) noexcept
+    {
+        while (!data.empty())
+        {
+            const auto sent = send(socket, data.data(), static_cast<int>(data.size()), 0);
+            if (sent == SOCKET_ERROR)
+            {
+                return;
+            }
+            data.remove_prefix(static_cast<size_t>(sent));
+        }
+    }
+
+    static void ServeScrape(SOCKET socket) noexcept try
+    {
+        // only the request line is used: read until the end of the headers
+        char request[c_maxRequestBytes]{};
+        size_t received = 0;
+        while (received < sizeof request)
+        {
+            const auto result = recv(socket, request + received, static_cast<int>(sizeof request - received), 0);
+            if (result <= 0)
+            {
+                return;
+            }
+            received += static_cast<size_t>(result);
+            if (std::string_view{request, received}.find("\r\n\r\n") != std::string_view::npos)
+            {
+                break;
+            }
+        }
+
+        const std::string_view requestLine{request, received};
+        if (!requestLine.starts_with("GET /metrics ") && !requestLine.starts_with("GET / "))
+        {
+            SendAll(socket, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return;
+        }
+
+        const auto body = FormatMetrics();
+        char header[256]{};
+        const auto headerLength = sprintf_s(
+            header,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: close\r\n\r\n",
+            body.size());
+        SendAll(socket, {header, static_cast<size_t>(headerLength)});
+        SendAll(socket, body);
+    }
+    catch (...)
+    {
+        SendAll(socket, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    }
+
+    static DWORD WINAPI ExporterThread(LPVOID) noexcept
+    {
+        for (;;)
+        {
+            wil::unique_socket acceptedSocket{accept(g_listeningSocket.get(), nullptr, nullptr)};
+            if (!acceptedSocket)
+            {
+                if (ctl::ctMemoryGuardRead(&g_stopping))
+                {
+                    break;
+                }
+                ctsConfig::PrintErrorIfFailed("accept (-MetricsPort)", WSAGetLastError());
+                Sleep(100);
+                continue;
+            }
+
+            setsockopt(acceptedSocket.get(), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&c_socketTimeoutMilliseconds), sizeof c_socketTimeoutMilliseconds);
+            setsockopt(acceptedSocket.get(), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&c_socketTimeoutMilliseconds), sizeof c_socketTimeoutMilliseconds);
+            ServeScrape(acceptedSocket.get());
+            shutdown(acceptedSocket.get(), SD_SEND);
+        }
+        return 0;
+    }
+
+    void Start()
+    {
+        if (0 == ctsConfig::g_configSettings->MetricsPort)
+        {
+            return;
+        }
+
+        const auto groupCount = GetActiveProcessorGroupCount();
+        uint32_t processorCount = 0;
+        for (WORD group = 0; group < groupCount; ++group)
+        {
+            g_groupOffsets.push_back(processorCount);
+            processorCount += GetActiveProcessorCount(group);
+        }
+        g_shards.reserve(processorCount);
+        for (uint32_t processor = 0; processor < processorCount; ++processor)
+        {
+            g_shards.emplace_back(std::make_unique<ctsProcessorShard>());
+        }
+
+        g_listeningSocket.reset(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+        THROW_LAST_ERROR_IF_MSG(!g_listeningSocket, "socket (-MetricsPort)");
+
+        // only reachable from this machine
+        SOCKADDR_IN address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(ctsConfig::g_configSettings->MetricsPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        THROW_IF_WIN32_ERROR_MSG(
+            bind(g_listeningSocket.get(), reinterpret_cast<const SOCKADDR*>(&address), sizeof address) == SOCKET_ERROR ? WSAGetLastError() : NO_ERROR,
+            "bind (-MetricsPort:%u)", ctsConfig::g_configSettings->MetricsPort);
+        THROW_IF_WIN32_ERROR_MSG(
+            listen(g_listeningSocket.get(), SOMAXCONN) == SOCKET_ERROR ? WSAGetLastError() : NO_ERROR,
+            "listen (-MetricsPort)");
+
+        g_exporterThread.reset(CreateThread(nullptr, 0, ExporterThread, nullptr, 0, nullptr));
+        THROW_LAST_ERROR_IF_MSG(!g_exporterThread, "CreateThread (-MetricsPort)");
+        g_enabled = true;
+    }
+
+    void Stop() noexcept
+    {
+        if (!g_exporterThread)
+        {
+            return;
+        }
+
+        // closing the listening socket fails the blocking accept
+        ctl::ctMemoryGuardWrite(&g_stopping, 1);
+        g_listeningSocket.reset();
+        WaitForSingleObject(g_exporterThread.get(), INFINITE);
+        g_exporterThread.reset();
+    }
+
+    bool IsEnabled() noexcept
+    {
+        return g_enabled;
+    }
+
+    void RecordIo(bool isSend, uint32_t bytesTransferred, int64_t latencyMicroseconds) noexcept
+    {
+        if (!g_enabled)
+        {
+            return;
+        }
+
+        auto* shard = CurrentShard();
+        if (isSend)
+        {
+            ctl::ctMemoryGuardIncrement(&shard->m_sendCount);
+            ctl::ctMemoryGuardAdd(&shard->m_bytesSent, bytesTransferred);
+        }
+        else
+        {
+            ctl::ctMemoryGuardIncrement(&shard->m_recvCount);
+            ctl::ctMemoryGuardAdd(&shard->m_bytesRecv, bytesTransferred);
+        }
+
+        if (latencyMicroseconds >= 0)
+        {
+            ctl::ctMemoryGuardIncrement(&shard->m_latencyBuckets[ctsRoundTripHistogram::BucketIndex(static_cast<uint64_t>(latencyMicroseconds))]);
+            ctl::ctMemoryGuardAdd(&shard->m_latencySum, latencyMicroseconds);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <cstdint>
+// os headers
+#include <Windows.h>
+
+// With -MetricsPort the live statistics are served over HTTP on the loopback address
+// - GET /metrics returns the OpenMetrics text format (which Prometheus scrapes)
+// - connection, TCP and UDP counters are read from ctsConfigSettings the same as status updates,
+//   but without taking a snapshot: a scrape never resets the values the status updates report
+//
+// IO counters and IO latency are kept in one shard per processor
+// - an IO completion only updates the shard of the processor it's running on (interlocked, as threads can migrate)
+// - a scrape sums the shards without taking any lock the IO path uses
+//
+// Scrapes are served one at a time by a dedicated thread, so a slow scraper cannot affect the IO threadpool
+
+namespace ctsTraffic::ctsMetricsExporter
+{
+    // starts listening when -MetricsPort is specified
+    // - throws wil::ResultException or std::bad_alloc on failure
+    void Start();
+
+    // stops listening and waits for a scrape in progress to finish
+    void Stop() noexcept;
+
+    // true once Start() is listening - callers skip timing IO when false
+    bool IsEnabled() noexcept;
+
+    // latencyMicroseconds is the time from when the IO was requested to its completion, or -1 if not measured
+    void RecordIo(bool isSend, uint32_t bytesTransferred, int64_t latencyMicroseconds) noexcept;
+}
@@ -19,6 +19,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <Windows.h>
 // project headers
 #include "ctsConfig.h"
+#include "ctsCpuCost.h"
 
 namespace ctsTraffic
 {
@@ -34,10 +35,17 @@ protected:
 
 private:
     // expanded beyond 80 to handle very long IPv6 address strings
+    // - and the -CpuCost columns following the widest protocol columns
     // - buffer is expected to be protected by only a single caller at a time
-    static constexpr uint32_t c_outputBufferSize = 128;
+    static constexpr uint32_t c_outputBufferSize = 160;
     // one more for the null terminator
     wchar_t m_outputBuffer[c_outputBufferSize + 1]{};
+    // the header with the -CpuCost columns appended
+    wchar_t m_headerBuffer[c_outputBufferSize + 1]{};
+
+    // the -CpuCost columns are right-justified in c_cpuCostColumnLength characters
+    static constexpr uint32_t c_cpuCostColumnLength = 12;
+    static constexpr uint32_t c_cpuCostValueLength = 10;
 
     void ResetBuffer() noexcept
     {
@@ -69,7 +77,7 @@ public:
 
     PCWSTR PrintHeader(const ctsConfig::StatusFormatting& format) noexcept
     {
-        return FormatHeader(format);
+        return AppendCpuCostHeader(format, FormatHeader(format));
     }
 
     //
@@ -232,6 +240,88 @@ protected:
         m_outputBuffer[offset + 2] = L'\0';
     }
 
+    ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    ///
+    /// Functions to write the -CpuCost columns after the last column of the derived class
+    /// - each must be called exactly once per FormatData() so the time slice is only restarted once
+    ///
+    ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    PCWSTR AppendCpuCostHeader(const ctsConfig::StatusFormatting& format, _In_ PCWSTR header) noexcept
+    {
+        if (!ctsConfig::g_configSettings->CpuCostStatus)
+        {
+            return header;
+        }
+
+        // the columns follow the header's last column, before its trailing space and line ending
+        auto headerLength = wcslen(header);
+        while (headerLength > 0 && (L' ' == header[headerLength - 1] || L'\r' == header[headerLength - 1] || L'\n' == header[headerLength - 1]))
+        {
+            --headerLength;
+        }
+
+        PCWSTR cpuCostColumns{};
+        switch (format)
+        {
+            case ctsConfig::StatusFormatting::Csv:
+                cpuCostColumns = L",CpuSec/GB,Cycles/IO,CSwitch/s\r\n";
+                break;
+            case ctsConfig::StatusFormatting::ConsoleOutput:
+                cpuCostColumns = L"   CpuSec/GB   Cycles/IO   CSwitch/s \n";
+                break;
+            default:
+                cpuCostColumns = L"   CpuSec/GB   Cycles/IO   CSwitch/s \r\n";
+                break;
+        }
+
+        const auto converted = _snwprintf_s(
+            m_headerBuffer,
+            c_outputBufferSize + 1,
+            _TRUNCATE,
+            L"%.*ws%ws",
+            static_cast<int>(headerLength),
+            header,
+            cpuCostColumns);
+        FAIL_FAST_IF(-1 == converted);
+        return m_headerBuffer;
+    }
+
+    // returns the offset following the columns
+    uint32_t RightJustifyCpuCost(uint32_t endOffset, bool clearStatus) noexcept
+    {
+        if (!ctsConfig::g_configSettings->CpuCostStatus)
+        {
+            return endOffset;
+        }
+
+        const auto rates = ctsCpuCost::SnapStatusInterval(clearStatus);
+        RightJustifyOutput(endOffset + c_cpuCostColumnLength, c_cpuCostValueLength, static_cast<float>(rates.m_cpuSecondsPerGb));
+        RightJustifyOutput(endOffset + c_cpuCostColumnLength * 2, c_cpuCostValueLength, rates.m_cyclesPerIo);
+        RightJustifyOutput(endOffset + c_cpuCostColumnLength * 3, c_cpuCostValueLength, rates.m_contextSwitchesPerSecond);
+        return endOffset + c_cpuCostColumnLength * 3;
+    }
+
+    // returns the number of characters written, starting with the comma separating them from the prior column
+    uint32_t AppendCpuCostCsv(uint32_t offset, bool clearStatus) noexcept
+    {
+        if (!ctsConfig::g_configSettings->CpuCostStatus)
+        {
+            return 0;
+        }
+
+        const auto rates = ctsCpuCost::SnapStatusInterval(clearStatus);
+        const auto converted = _snwprintf_s(
+            m_outputBuffer + offset,
+            c_outputBufferSize - offset,
+            _TRUNCATE,
+            L",%.3f,%lld,%lld",
+            rates.m_cpuSecondsPerGb,
+            rates.m_cyclesPerIo,
+            rates.m_contextSwitchesPerSecond);
+        FAIL_FAST_IF(-1 == converted);
+        return static_cast<uint32_t>(converted);
+    }
+
     ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     ///
     /// Functions to write to the output buffer in CSV formatting
@@ -428,6 +518,7 @@ public:
             charactersWritten += AppendCsvOutput(charactersWritten, c_droppedFramesLength, udpData.m_droppedFrames.GetValue());
             charactersWritten += AppendCsvOutput(charactersWritten, c_duplicatedFramesLength, udpData.m_duplicateFrames.GetValue());
             charactersWritten += AppendCsvOutput(charactersWritten, c_errorFramesLength, udpData.m_errorFrames.GetValue(), false); // no comma at the end
+            charactersWritten += AppendCpuCostCsv(charactersWritten, clearStatus);
             TerminateFileString(charactersWritten);
         }
         else
@@ -446,13 +537,14 @@ public:
             RightJustifyOutput(c_droppedFramesOffset, c_droppedFramesLength, udpData.m_droppedFrames.GetValue());
             RightJustifyOutput(c_duplicatedFramesOffset, c_duplicatedFramesLength, udpData.m_duplicateFrames.GetValue());
             RightJustifyOutput(c_errorFramesOffset, c_errorFramesLength, udpData.m_errorFrames.GetValue());
+            const auto endOffset = RightJustifyCpuCost(c_errorFramesOffset, clearStatus);
             if (format == ctsConfig::StatusFormatting::ConsoleOutput)
             {
-                TerminateString(c_errorFramesOffset);
+                TerminateString(endOffset);
             }
             else
             {
-                TerminateFileString(c_errorFramesOffset);
+                TerminateFileString(endOffset);
             }
         }
         return PrintingStatus::PrintComplete;
@@ -528,7 +620,17 @@ public:
             charactersWritten += AppendCsvOutput(charactersWritten, c_currentTransactionsLength, connectionData.m_activeConnectionCount.GetValue());
             charactersWritten += AppendCsvOutput(charactersWritten, c_completedTransactionsLength, connectionData.m_successfulCompletionCount.GetValue());
             charactersWritten += AppendCsvOutput(charactersWritten, c_connectionErrorsLength, connectionData.m_connectionErrorCount.GetValue());
-            charactersWritten += AppendCsvOutput(charactersWritten, c_protocolErrorsLength, connectionData.m_protocolErrorCount.GetValue(), false); // no comma at the end
+            if (ctsConfig::IsListening())
+            {
+                charactersWritten += AppendCsvOutput(charactersWritten, c_protocolErrorsLength, connectionData.m_protocolErrorCount.GetValue());
+                charactersWritten += AppendCsvOutput(charactersWritten, c_acceptQueueEmptyLength, connectionData.m_acceptQueueEmptyCount.GetValue());
+                charactersWritten += AppendCsvOutput(charactersWritten, c_attemptFailLength, ctsConfig::GetTcpAttemptFailCount(), false); // no comma at the end
+            }
+            else
+            {
+                charactersWritten += AppendCsvOutput(charactersWritten, c_protocolErrorsLength, connectionData.m_protocolErrorCount.GetValue(), false); // no comma at the end
+            }
+            charactersWritten += AppendCpuCostCsv(charactersWritten, clearStatus);
             TerminateFileString(charactersWritten);
         }
         else
@@ -551,13 +653,21 @@ public:
             RightJustifyOutput(c_completedTransactionsOffset, c_completedTransactionsLength, connectionData.m_successfulCompletionCount.GetValue());
             RightJustifyOutput(c_connectionErrorsOffset, c_connectionErrorsLength, connectionData.m_connectionErrorCount.GetValue());
             RightJustifyOutput(c_protocolErrorsOffset, c_protocolErrorsLength, connectionData.m_protocolErrorCount.GetValue());
+            uint32_t endOffset = c_protocolErrorsOffset;
+            if (ctsConfig::IsListening())
+            {
+                RightJustifyOutput(c_acceptQueueEmptyOffset, c_acceptQueueEmptyLength, connectionData.m_acceptQueueEmptyCount.GetValue());
+                RightJustifyOutput(c_attemptFailOffset, c_attemptFailLength, ctsConfig::GetTcpAttemptFailCount());
+                endOffset = c_attemptFailOffset;
+            }
+            endOffset = RightJustifyCpuCost(endOffset, clearStatus);
             if (format == ctsConfig::StatusFormatting::ConsoleOutput)
             {
-                TerminateString(c_protocolErrorsOffset);
+                TerminateString(endOffset);
             }
             else
             {
-                TerminateFileString(c_protocolErrorsOffset);
+                TerminateFileString(endOffset);
             }
         }
 
@@ -566,6 +676,36 @@ public:
 
     PCWSTR FormatLegend(const ctsConfig::StatusFormatting& format) noexcept override
     {
+        if (ctsConfig::IsListening())
+        {
+            if (ctsConfig::StatusFormatting::ConsoleOutput == format)
+            {
+                return
+                    L"Legend:\n"
+                    L"* TimeSlice - (seconds) cumulative runtime\n"
+                    L"* Send & Recv Rates - bytes/sec that were transferred within the TimeSlice period\n"
+                    L"* In-Flight - count of established connections transmitting IO pattern data\n"
+                    L"* Completed - cumulative count of successfully completed IO patterns\n"
+                    L"* Network Errors - cumulative count of failed IO patterns due to Winsock errors\n"
+                    L"* Data Errors - cumulative count of failed IO patterns due to data errors\n"
+                    L"* QueueEmpty - cumulative count of times no accept was pended: connections waited in the listen backlog\n"
+                    L"* AttemptFail - system-wide count of failed TCP connection attempts, including listen backlog overflows\n"
+                    L"\n";
+            }
+
+            return
+                L"Legend:\r\n"
+                L"* TimeSlice - (seconds) cumulative runtime\r\n"
+                L"* Send & Recv Rates - bytes/sec that were transferred within the TimeSlice period\r\n"
+                L"* In-Flight - count of established connections transmitting IO pattern data\r\n"
+                L"* Completed - cumulative count of successfully completed IO patterns\r\n"
+                L"* Network Errors - cumulative count of failed IO patterns due to Winsock errors\r\n"
+                L"* Data Errors - cumulative count of failed IO patterns due to data errors\r\n"
+                L"* QueueEmpty - cumulative count of times no accept was pended: connections waited in the listen backlog\r\n"
+                L"* AttemptFail - system-wide count of failed TCP connection attempts, including listen backlog overflows\r\n"
+                L"\r\n";
+        }
+
         if (ctsConfig::StatusFormatting::ConsoleOutput == format)
         {
             return
@@ -592,6 +732,26 @@ public:
 
     PCWSTR FormatHeader(const ctsConfig::StatusFormatting& format) noexcept override
     {
+        if (ctsConfig::IsListening())
+        {
+            if (format == ctsConfig::StatusFormatting::Csv)
+            {
+                return
+                    L"TimeSlice,SendBps,RecvBps,In-Flight,Completed,NetError,DataError,QueueEmpty,AttemptFail\r\n";
+            }
+
+            if (format == ctsConfig::StatusFormatting::ConsoleOutput)
+            {
+                return
+                    L" TimeSlice      SendBps      RecvBps  In-Flight  Completed  NetError  DataError  QueueEmpty  AttemptFail \n";
+                //    00000000.0..00000000000..00000000000....0000000....0000000...0000000....0000000..0000000000..00000000000.
+                //    1   5    0    5    0    5    0    5    0    5    0    5    0    5    0    5    0    5    0    5    0    5
+                //            10        20        30        40        50        60        70        80        90       100
+            }
+
+            return L" TimeSlice      SendBps      RecvBps  In-Flight  Completed  NetError  DataError  QueueEmpty  AttemptFail \r\n";
+        }
+
         if (format == ctsConfig::StatusFormatting::Csv)
         {
             return
@@ -633,6 +793,13 @@ private:
     static constexpr uint32_t c_protocolErrorsOffset = 79;
     static constexpr uint32_t c_protocolErrorsLength = 7;
 
+    // only printed by servers
+    static constexpr uint32_t c_acceptQueueEmptyOffset = 91;
+    static constexpr uint32_t c_acceptQueueEmptyLength = 10;
+
+    static constexpr uint32_t c_attemptFailOffset = 104;
+    static constexpr uint32_t c_attemptFailLength = 11;
+
     static constexpr uint32_t c_detailedSentOffset = 23;
     static constexpr uint32_t c_detailedSentLength = 10;
 
@@ -26,25 +26,27 @@ See the Apache Version 2.0 License for specific language governing permissions a
 
 namespace ctsTraffic
 {
-void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept;
+static void ctsReadWriteIocpInitiateIo(ctsSocket* pSocket) noexcept;
 
 // IO Threadpool completion callback 
+// - the ctsSocket is resolved from its handle without taking a reference:
+//   ctsSocket::Shutdown drains all IO callbacks before the socket is destroyed
 static void ctsReadWriteIocpIoCompletionCallback(
     _In_ OVERLAPPED* pOverlapped,
-    const std::weak_ptr<ctsSocket>& weakSocket,
+    ctsSocketHandle socketHandle,
     const ctsTask& task) noexcept
 {
-    const auto sharedSocket(weakSocket.lock());
-    if (!sharedSocket)
+    ctsSocket* const pSocket = ctsSocket::FromHandle(socketHandle);
+    if (!pSocket)
     {
         return;
     }
 
     uint32_t gle = NO_ERROR;
 
-    // hold a reference on the socket
-    const auto lockedSocket = sharedSocket->AcquireSocketLock();
-    const auto lockedPattern = lockedSocket.GetPattern();
+    // hold the socket lock
+    const auto lockedSocket = pSocket->AcquireSocketLock();
+    const auto& lockedPattern = lockedSocket.GetPattern();
     if (!lockedPattern)
     {
         gle = WSAECONNABORTED;
@@ -77,7 +79,7 @@ static void ctsReadWriteIocpIoCompletionCallback(
             case ctsIoStatus::ContinueIo:
                 // more IO is requested from the protocol
                 // - invoke the new IO call while holding a refcount to the prior IO
-                ctsReadWriteIocp(weakSocket);
+                ctsReadWriteIocpInitiateIo(pSocket);
                 break;
 
             case ctsIoStatus::CompletedIo:
@@ -100,26 +102,20 @@ static void ctsReadWriteIocpIoCompletionCallback(
     }
 
     // always decrement *after* attempting new IO - the prior IO is now formally "done"
-    if (sharedSocket->DecrementIo() == 0)
+    if (pSocket->DecrementIo() == 0)
     {
         // if we have no more IO pended, complete the state
-        sharedSocket->CompleteState(gle);
+        pSocket->CompleteState(gle);
     }
 }
 
-// The registered function with ctsConfig
-void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
+// Loops requesting IO from the pattern until it fails or no more IO is needed right now
+// - the caller must guarantee the lifetime of the ctsSocket
+static void ctsReadWriteIocpInitiateIo(ctsSocket* pSocket) noexcept
 {
-    // must get a reference to the socket and the IO pattern
-    const auto sharedSocket(weakSocket.lock());
-    if (!sharedSocket)
-    {
-        return;
-    }
-
-    // hold a reference on the socket
-    const auto lockedSocket = sharedSocket->AcquireSocketLock();
-    const auto lockedPattern = lockedSocket.GetPattern();
+    // hold the socket lock
+    const auto lockedSocket = pSocket->AcquireSocketLock();
+    const auto& lockedPattern = lockedSocket.GetPattern();
     if (!lockedPattern)
     {
         return;
@@ -158,7 +154,7 @@ void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
             if (ctsTaskAction::HardShutdown == nextIo.m_ioAction)
             {
                 // pass through -1 to force an RST with the closesocket
-                ioError = sharedSocket->CloseSocket(static_cast<uint32_t>(SOCKET_ERROR));
+                ioError = pSocket->CloseSocket(static_cast<uint32_t>(SOCKET_ERROR));
                 socket = INVALID_SOCKET;
 
                 ioDone = lockedPattern->CompleteIo(nextIo, 0, ioError) != ctsIoStatus::ContinueIo;
@@ -167,16 +163,17 @@ void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
 
             // else we need to initiate another IO
             // add-ref the IO about to start
-            ioCount = sharedSocket->IncrementIo();
+            ioCount = pSocket->IncrementIo();
 
-            std::shared_ptr<ctl::ctThreadIocp> ioThreadPool;
+            // not taking a reference on the threadpool : ctsSocket::Shutdown must release the last reference to drain callbacks
+            ctl::ctThreadIocp* pIoThreadPool = nullptr;
             OVERLAPPED* pOverlapped = nullptr;
             try
             {
                 // these are the only calls which can throw in this function
-                ioThreadPool = sharedSocket->GetIocpThreadpool();
-                pOverlapped = ioThreadPool->new_request(
-                    [weakSocket, nextIo](OVERLAPPED* pCallbackOverlapped) noexcept { ctsReadWriteIocpIoCompletionCallback(pCallbackOverlapped, weakSocket, nextIo); });
+                pIoThreadPool = pSocket->GetIocpThreadpool().get();
+                pOverlapped = pIoThreadPool->new_request(
+                    [socketHandle = pSocket->GetHandle(), nextIo](OVERLAPPED* pCallbackOverlapped) noexcept { ctsReadWriteIocpIoCompletionCallback(pCallbackOverlapped, socketHandle, nextIo); });
             }
             catch (...)
             {
@@ -186,7 +183,7 @@ void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
             // if an exception prevented this IO from initiating,
             if (ioError != NO_ERROR)
             {
-                ioCount = sharedSocket->DecrementIo();
+                ioCount = pSocket->DecrementIo();
                 ioDone = lockedPattern->CompleteIo(nextIo, 0, ioError) != ctsIoStatus::ContinueIo;
                 continue;
             }
@@ -217,9 +214,9 @@ void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
             if (ioError != NO_ERROR)
             {
                 // must cancel the IOCP TP if the IO call fails
-                ioThreadPool->cancel_request(pOverlapped);
+                pIoThreadPool->cancel_request(pOverlapped);
                 // decrement the IO count since it was not pended
-                ioCount = sharedSocket->DecrementIo();
+                ioCount = pSocket->DecrementIo();
 
                 const char* functionName = ctsTaskAction::Send == nextIo.m_ioAction ? "WriteFile" : "ReadFile";
                 PRINT_DEBUG_INFO(L"\t\tIO Failed: %hs (%u) [ctsReadWriteIocp]\n", functionName, ioError);
@@ -261,7 +258,20 @@ void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
     if (0 == ioCount)
     {
         // complete the ctsSocket if we have no IO pended
-        sharedSocket->CompleteState(ioError);
+        pSocket->CompleteState(ioError);
     }
 }
+
+// The registered function with ctsConfig
+void ctsReadWriteIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
+{
+    // must get a reference to the socket
+    const auto sharedSocket(weakSocket.lock());
+    if (!sharedSocket)
+    {
+        return;
+    }
+
+    ctsReadWriteIocpInitiateIo(sharedSocket.get());
+}
 } // namespace
@@ -26,9 +26,6 @@ See the Apache Version 2.0 License for specific language governing permissions a
 
 namespace ctsTraffic
 {
-/// forward delcaration
-void ctsSendRecvIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept;
-
 struct ctsSendRecvStatus
 {
     // Winsock error code
@@ -39,23 +36,28 @@ struct ctsSendRecvStatus
     bool m_ioStarted = false;
 };
 
+/// forward delcaration
+static ctsSendRecvStatus ctsSendRecvPump(SOCKET socket, ctsSocket* pSocket, const std::shared_ptr<ctsIoPattern>& sharedPattern) noexcept;
+
 // IO Threadpool completion callback 
+// - the ctsSocket is resolved from its handle without taking a reference:
+//   ctsSocket::Shutdown drains all IO callbacks before the socket is destroyed
 static void ctsSendRecvCompletionCallback(
     _In_ OVERLAPPED* pOverlapped,
-    const std::weak_ptr<ctsSocket>& weakSocket,
+    ctsSocketHandle socketHandle,
     const ctsTask& task) noexcept
 {
-    const auto sharedSocket(weakSocket.lock());
-    if (!sharedSocket)
+    ctsSocket* const pSocket = ctsSocket::FromHandle(socketHandle);
+    if (!pSocket)
     {
         return;
     }
 
     int gle = NO_ERROR;
 
-    // hold a reference on the socket
-    const auto lockedSocket = sharedSocket->AcquireSocketLock();
-    const auto lockedPattern = lockedSocket.GetPattern();
+    // hold the socket lock
+    const auto lockedSocket = pSocket->AcquireSocketLock();
+    const auto& lockedPattern = lockedSocket.GetPattern();
     if (!lockedPattern)
     {
         gle = WSAECONNABORTED;
@@ -91,9 +93,16 @@ static void ctsSendRecvCompletionCallback(
         switch (const ctsIoStatus protocolStatus = lockedPattern->CompleteIo(task, transferred, gle))
         {
             case ctsIoStatus::ContinueIo:
-                // more IO is requested from the protocol : invoke the new IO call while holding a refcount to the prior IO
-                ctsSendRecvIocp(weakSocket);
+            {
+                // more IO is requested from the protocol : invoke the new IO calls while holding a refcount to the prior IO
+                // - reusing the socket lock and references already held by this callback
+                const auto pumpStatus = ctsSendRecvPump(socket, pSocket, lockedPattern);
+                if (pumpStatus.m_ioErrorcode != NO_ERROR)
+                {
+                    gle = static_cast<int>(pumpStatus.m_ioErrorcode);
+                }
                 break;
+            }
 
             case ctsIoStatus::CompletedIo:
                 // no more IO is requested from the protocol : indicate success
@@ -113,10 +122,10 @@ static void ctsSendRecvCompletionCallback(
     }
 
     // always decrement *after* attempting new IO : the prior IO is now formally "done"
-    if (sharedSocket->DecrementIo() == 0)
+    if (pSocket->DecrementIo() == 0)
     {
         // if we have no more IO pended, complete the state
-        sharedSocket->CompleteState(gle);
+        pSocket->CompleteState(gle);
     }
 }
 
@@ -127,7 +136,7 @@ static void ctsSendRecvCompletionCallback(
 /// ** ctsSocket::increment_io must have been called before this function was invoked
 ///
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static ctsSendRecvStatus ctsSendRecvProcessTask(SOCKET socket, const std::shared_ptr<ctsSocket>& sharedSocket, const std::shared_ptr<ctsIoPattern>& sharedPattern, const ctsTask& nextIo) noexcept
+static ctsSendRecvStatus ctsSendRecvProcessTask(SOCKET socket, ctsSocket* pSocket, const std::shared_ptr<ctsIoPattern>& sharedPattern, const ctsTask& nextIo) noexcept
 {
     ctsSendRecvStatus returnStatus;
 
@@ -154,7 +163,7 @@ static ctsSendRecvStatus ctsSendRecvProcessTask(SOCKET socket, const std::shared
     else if (ctsTaskAction::HardShutdown == nextIo.m_ioAction)
     {
         // pass through -1 to force an RST with the closesocket
-        returnStatus.m_ioErrorcode = sharedSocket->CloseSocket(static_cast<uint32_t>(SOCKET_ERROR));
+        returnStatus.m_ioErrorcode = pSocket->CloseSocket(static_cast<uint32_t>(SOCKET_ERROR));
         returnStatus.m_ioDone = sharedPattern->CompleteIo(nextIo, 0, returnStatus.m_ioErrorcode) != ctsIoStatus::ContinueIo;
         returnStatus.m_ioStarted = false;
     }
@@ -163,10 +172,10 @@ static ctsSendRecvStatus ctsSendRecvProcessTask(SOCKET socket, const std::shared
         try
         {
             // attempt to allocate an IO thread-pool object
-            const std::shared_ptr<ctl::ctThreadIocp>& ioThreadPool(sharedSocket->GetIocpThreadpool());
+            const std::shared_ptr<ctl::ctThreadIocp>& ioThreadPool(pSocket->GetIocpThreadpool());
             OVERLAPPED* const pOverlapped = ioThreadPool->new_request(
-                [weak_reference = std::weak_ptr(sharedSocket), nextIo](OVERLAPPED* pCallbackOverlapped) noexcept {
-                    ctsSendRecvCompletionCallback(pCallbackOverlapped, weak_reference, nextIo);
+                [socketHandle = pSocket->GetHandle(), nextIo](OVERLAPPED* pCallbackOverlapped) noexcept {
+                    ctsSendRecvCompletionCallback(pCallbackOverlapped, socketHandle, nextIo);
                 });
 
             WSABUF wsabuffer{};
@@ -267,18 +276,18 @@ static ctsSendRecvStatus ctsSendRecvProcessTask(SOCKET socket, const std::shared
 /// Processes the given task and then calls ctsSendRecvIocp function to deal with any additional tasks
 ///
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static void ctsSendRecvTimerCallback(const std::weak_ptr<ctsSocket>& weakSocket, const ctsTask& nextIo) noexcept
+static void ctsSendRecvTimerCallback(ctsSocketHandle socketHandle, const ctsTask& nextIo) noexcept
 {
-    // attempt to get a reference to the socket
-    const auto sharedSocket(weakSocket.lock());
-    if (!sharedSocket)
+    // the timer is drained by ctsSocket::Shutdown, so the handle resolves for as long as the timer can fire
+    ctsSocket* const pSocket = ctsSocket::FromHandle(socketHandle);
+    if (!pSocket)
     {
         return;
     }
 
-    // hold a reference on the socket
-    const auto lockedSocket = sharedSocket->AcquireSocketLock();
-    const auto lockedPattern = lockedSocket.GetPattern();
+    // hold the socket lock
+    const auto lockedSocket = pSocket->AcquireSocketLock();
+    const auto& lockedPattern = lockedSocket.GetPattern();
     if (!lockedPattern)
     {
         return;
@@ -287,39 +296,51 @@ static void ctsSendRecvTimerCallback(const std::weak_ptr<ctsSocket>& weakSocket,
     // where it's handled appropriately
 
     // increment IO for this IO request
-    sharedSocket->IncrementIo();
+    pSocket->IncrementIo();
 
     // run the ctsIOTask (next_io) that was scheduled through the TP timer
     // ReSharper disable once CppUseStructuredBinding
-    const ctsSendRecvStatus status = ctsSendRecvProcessTask(lockedSocket.GetSocket(), sharedSocket, lockedPattern, nextIo);
+    ctsSendRecvStatus status = ctsSendRecvProcessTask(lockedSocket.GetSocket(), pSocket, lockedPattern, nextIo);
     // if no IO was started, decrement the IO counter
     if (!status.m_ioStarted)
     {
-        if (0 == sharedSocket->DecrementIo())
+        if (0 == pSocket->DecrementIo())
         {
             // this should never be zero since we should be holding a refcount for this callback
             FAIL_FAST_MSG(
-                "The refcount of the ctsSocket object (%p) fell to zero during a scheduled callback", sharedSocket.get());
+                "The refcount of the ctsSocket object (%p) fell to zero during a scheduled callback", pSocket);
         }
     }
     // continue requesting IO if this connection still isn't done with all IO after scheduling the prior IO
     if (!status.m_ioDone)
     {
-        ctsSendRecvIocp(weakSocket);
+        const auto pumpStatus = ctsSendRecvPump(lockedSocket.GetSocket(), pSocket, lockedPattern);
+        if (pumpStatus.m_ioErrorcode != NO_ERROR)
+        {
+            status.m_ioErrorcode = pumpStatus.m_ioErrorcode;
+        }
     }
     // finally decrement the IO that was counted for this IO that was completed async
-    if (sharedSocket->DecrementIo() == 0)
+    if (pSocket->DecrementIo() == 0)
     {
         // if we have no more IO pended, complete the state
-        sharedSocket->CompleteState(status.m_ioErrorcode);
+        pSocket->CompleteState(status.m_ioErrorcode);
     }
 }
 
-// The function registered with ctsConfig
-void ctsSendRecvIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// This is the threadpool callback scheduled when ctsSendRecvPump yields after a full batch of IO.
+/// Continues requesting IO on a new threadpool thread, releasing the IO refcount taken when it was scheduled
+///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void NTAPI ctsSendRecvYieldCallback(PTP_CALLBACK_INSTANCE, PVOID pContext) noexcept
 {
+    const std::unique_ptr<std::weak_ptr<ctsSocket>> weakSocket(static_cast<std::weak_ptr<ctsSocket>*>(pContext));
+
     // attempt to get a reference to the socket
-    const auto sharedSocket(weakSocket.lock());
+    // - threadpool work callbacks are not drained by ctsSocket::Shutdown, so this must hold a reference
+    const auto sharedSocket(weakSocket->lock());
     if (!sharedSocket)
     {
         return;
@@ -327,44 +348,89 @@ void ctsSendRecvIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
 
     // hold a reference on the socket
     const auto lockedSocket = sharedSocket->AcquireSocketLock();
-    const auto lockedPattern = lockedSocket.GetPattern();
-    if (!lockedPattern)
+    const auto& lockedPattern = lockedSocket.GetPattern();
+
+    ctsSendRecvStatus status{};
+    if (lockedPattern)
     {
-        return;
+        status = ctsSendRecvPump(lockedSocket.GetSocket(), sharedSocket.get(), lockedPattern);
+    }
+    else
+    {
+        status.m_ioErrorcode = WSAECONNABORTED;
     }
-    // if lockedSocket has an INVALID_SOCKET, continue below to ctsSendRecvProcessTask
-    // where it's handled appropriately
 
-    //
-    // loop until failure or initiate_io returns None
-    //
-    // IO is always done in the ctsProcessIOTask function,
-    // - either synchronously or scheduled through a timer object
-    //
-    // The IO refcount must be incremented here to hold an IO count on the socket
-    // - so that we won't inadvertently call complete_state() while IO is still being scheduled
-    //
-    sharedSocket->IncrementIo();
+    // decrement the IO that was counted when this callback was scheduled
+    if (sharedSocket->DecrementIo() == 0)
+    {
+        // if we have no more IO pended, complete the state
+        sharedSocket->CompleteState(status.m_ioErrorcode);
+    }
+}
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Loops requesting IO from the pattern until it fails or no more IO is needed right now
+///
+/// IO is always done in the ctsSendRecvProcessTask function,
+/// - either synchronously or scheduled through a timer object
+///
+/// Processing stops after ctsConfig::g_configSettings->IoBatchLimit tasks, and continues from a threadpool callback
+/// - with inline completions, each task can complete immediately and hand back another task,
+///   so without a limit one connection could hold this thread and the socket lock for its entire transfer
+///
+/// ** the caller must hold the socket lock and an IO refcount on the ctsSocket
+///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static ctsSendRecvStatus ctsSendRecvPump(SOCKET socket, ctsSocket* pSocket, const std::shared_ptr<ctsIoPattern>& sharedPattern) noexcept
+{
+    uint32_t tasksProcessed = 0;
     ctsSendRecvStatus status{};
     while (!status.m_ioDone)
     {
-        const ctsTask nextIo = lockedPattern->InitiateIo();
+        if (tasksProcessed >= ctsConfig::g_configSettings->IoBatchLimit)
+        {
+            // yield this thread, continuing from the threadpool
+            // - the scheduled callback holds its own IO refcount so the socket cannot complete underneath it
+            try
+            {
+                auto weakContext = std::make_unique<std::weak_ptr<ctsSocket>>(pSocket->weak_from_this());
+                pSocket->IncrementIo();
+                if (!TrySubmitThreadpoolCallback(ctsSendRecvYieldCallback, weakContext.get(), pSocket->GetThreadpoolEnvironment()))
+                {
+                    const auto gle = GetLastError();
+                    pSocket->DecrementIo();
+                    THROW_WIN32_MSG(gle, "TrySubmitThreadpoolCallback (ctsSendRecvIocp)");
+                }
+                // ownership was passed to the callback
+                weakContext.release();
+                break;
+            }
+            catch (...)
+            {
+                // failing to yield is not fatal : continue processing IO on this thread
+                ctsConfig::PrintThrownException();
+                tasksProcessed = 0;
+            }
+        }
+
+        const ctsTask nextIo = sharedPattern->InitiateIo();
         if (ctsTaskAction::None == nextIo.m_ioAction)
         {
             // nothing failed, just no more IO right now
             break;
         }
+        ++tasksProcessed;
 
         // increment IO for each individual request
-        sharedSocket->IncrementIo();
+        pSocket->IncrementIo();
 
         if (nextIo.m_timeOffsetMilliseconds > 0)
         {
             // set_timer can throw
             try
             {
-                sharedSocket->SetTimer(nextIo, ctsSendRecvTimerCallback);
+                pSocket->SetTimer(nextIo, ctsSendRecvTimerCallback);
                 status.m_ioStarted = true; // IO started in the context of keeping the count incremented
                 status.m_ioDone = true;
             }
@@ -376,21 +442,52 @@ void ctsSendRecvIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
         }
         else
         {
-            status = ctsSendRecvProcessTask(lockedSocket.GetSocket(), sharedSocket, lockedPattern, nextIo);
+            status = ctsSendRecvProcessTask(socket, pSocket, sharedPattern, nextIo);
         }
 
         // if no IO was started, decrement the IO counter
         if (!status.m_ioStarted)
         {
             // since IO is not pended, remove the refcount
-            if (0 == sharedSocket->DecrementIo())
+            if (0 == pSocket->DecrementIo())
             {
-                // this should never be zero as we are holding a reference outside the loop
+                // this should never be zero as the caller is holding a reference
                 FAIL_FAST_MSG(
-                    "The ctsSocket (%p) refcount fell to zero while this function was holding a reference", sharedSocket.get());
+                    "The ctsSocket (%p) refcount fell to zero while this function was holding a reference", pSocket);
             }
         }
     }
+    return status;
+}
+
+// The function registered with ctsConfig
+void ctsSendRecvIocp(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
+{
+    // attempt to get a reference to the socket
+    const auto sharedSocket(weakSocket.lock());
+    if (!sharedSocket)
+    {
+        return;
+    }
+
+    // hold a reference on the socket
+    const auto lockedSocket = sharedSocket->AcquireSocketLock();
+    const auto lockedPattern = lockedSocket.GetPattern();
+    if (!lockedPattern)
+    {
+        return;
+    }
+    // if lockedSocket has an INVALID_SOCKET, continue below to ctsSendRecvProcessTask
+    // where it's handled appropriately
+
+    //
+    // The IO refcount must be incremented here to hold an IO count on the socket
+    // - so that we won't inadvertently call complete_state() while IO is still being scheduled
+    //
+    sharedSocket->IncrementIo();
+
+    const ctsSendRecvStatus status = ctsSendRecvPump(lockedSocket.GetSocket(), sharedSocket.get(), lockedPattern);
+
     // decrement IO at the end to release the refcount held before the loop
     if (0 == sharedSocket->DecrementIo())
     {
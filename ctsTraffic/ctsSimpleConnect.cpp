@@ -18,6 +18,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <WinSock2.h>
 // ctl headers
 #include <ctSockaddr.hpp>
+#include <ctTimer.hpp>
 // project headers
 #include "ctsSocket.h"
 #include "ctsConfig.h"
@@ -54,6 +55,7 @@ void ctsSimpleConnect(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
         }
         else
         {
+            const auto connectStartUsec = ctl::ctTimer::snap_qpc_as_usec();
             if (0 != connect(socket, targetAddress.sockaddr(), targetAddress.length()))
             {
                 error = WSAGetLastError();
@@ -61,6 +63,12 @@ void ctsSimpleConnect(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
             }
             else
             {
+                // a UDP connect only sets the default destination - there's no handshake to measure
+                if (ctsConfig::ProtocolType::TCP == ctsConfig::g_configSettings->Protocol)
+                {
+                    sharedSocket->RecordConnectLatency(ctl::ctTimer::snap_qpc_as_usec() - connectStartUsec);
+                }
+
                 // set the local address
                 ctl::ctSockaddr localAddr;
                 auto localAddrLen = localAddr.length();
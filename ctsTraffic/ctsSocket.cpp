@@ -13,6 +13,9 @@ See the Apache Version 2.0 License for specific language governing permissions a
 
 // parent header
 #include "ctsSocket.h"
+// cpp headers
+#include <atomic>
+#include <vector>
 // OS headers
 #include <Windows.h>
 // ctl headers
@@ -21,7 +24,10 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <ctMemoryGuard.hpp>
 // project headers
 #include "ctsConfig.h"
+#include "ctsCpuAffinity.h"
+#include "ctsSocketPool.h"
 #include "ctsSocketState.h"
+#include "ctsTrace.h"
 #include "ctsWinsockLayer.h"
 
 namespace ctsTraffic
@@ -29,9 +35,130 @@ namespace ctsTraffic
 using namespace ctl;
 using namespace std;
 
+//
+// The table of ctsSocket objects which have started IO, indexed by ctsSocketHandle::m_index
+// - slots are allocated in fixed-size chunks which are never moved or freed while the process runs,
+//   so resolving a handle reads the slot without taking a lock
+// - the generation of a slot is bumped each time it's released so stale handles fail to resolve
+//
+class ctsSocketTable
+{
+public:
+    ctsSocketTable() noexcept = default;
+
+    ~ctsSocketTable() noexcept
+    {
+        for (auto& chunk : m_chunks)
+        {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    ctsSocketTable(const ctsSocketTable&) = delete;
+    ctsSocketTable& operator=(const ctsSocketTable&) = delete;
+    ctsSocketTable(ctsSocketTable&&) = delete;
+    ctsSocketTable& operator=(ctsSocketTable&&) = delete;
+
+    // can throw std::bad_alloc or wil::ResultException
+    ctsSocketHandle Insert(ctsSocket* socket)
+    {
+        const auto lock = m_lock.lock();
+
+        uint32_t index{};
+        if (!m_freeSlots.empty())
+        {
+            index = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            index = m_slotCount;
+            const auto chunk = index / c_chunkSize;
+            if (chunk >= c_maxChunks)
+            {
+                THROW_WIN32_MSG(WSAENOBUFS, "ctsSocketTable: all %u slots are in use", c_chunkSize * c_maxChunks);
+            }
+            // guarantee Remove never needs to allocate to track the free slot
+            m_freeSlots.reserve(static_cast<size_t>(m_slotCount) + 1);
+            if (0 == index % c_chunkSize)
+            {
+                m_chunks[chunk].store(new Slot[c_chunkSize], std::memory_order_release);
+            }
+            ++m_slotCount;
+        }
+
+        auto& slot = m_chunks[index / c_chunkSize].load(std::memory_order_relaxed)[index % c_chunkSize];
+        slot.m_socket.store(socket, std::memory_order_release);
+        return {index, slot.m_generation.load(std::memory_order_relaxed)};
+    }
+
+    void Remove(const ctsSocketHandle& handle) noexcept
+    {
+        const auto lock = m_lock.lock();
+
+        auto& slot = m_chunks[handle.m_index / c_chunkSize].load(std::memory_order_relaxed)[handle.m_index % c_chunkSize];
+        FAIL_FAST_IF_MSG(
+            slot.m_generation.load(std::memory_order_relaxed) != handle.m_generation,
+            "ctsSocketTable::Remove: the handle (index %u, generation %u) was already removed", handle.m_index, handle.m_generation);
+
+        slot.m_socket.store(nullptr, std::memory_order_release);
+        auto nextGeneration = handle.m_generation + 1;
+        if (0 == nextGeneration)
+        {
+            nextGeneration = 1;
+        }
+        slot.m_generation.store(nextGeneration, std::memory_order_release);
+        m_freeSlots.push_back(handle.m_index);
+    }
+
+    [[nodiscard]] ctsSocket* Lookup(const ctsSocketHandle& handle) const noexcept
+    {
+        const auto chunk = handle.m_index / c_chunkSize;
+        if (0 == handle.m_generation || chunk >= c_maxChunks)
+        {
+            return nullptr;
+        }
+
+        const auto* const slots = m_chunks[chunk].load(std::memory_order_acquire);
+        if (!slots)
+        {
+            return nullptr;
+        }
+
+        // read the generation after the pointer: if it still matches, the pointer belongs to that generation
+        const auto& slot = slots[handle.m_index % c_chunkSize];
+        auto* const socket = slot.m_socket.load(std::memory_order_acquire);
+        if (slot.m_generation.load(std::memory_order_acquire) != handle.m_generation)
+        {
+            return nullptr;
+        }
+        return socket;
+    }
+
+private:
+    static constexpr uint32_t c_chunkSize = 1024;
+    static constexpr uint32_t c_maxChunks = 4096;
+
+    struct Slot
+    {
+        std::atomic<ctsSocket*> m_socket{nullptr};
+        std::atomic<uint32_t> m_generation{1};
+    };
+
+    wil::critical_section m_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
+    std::atomic<Slot*> m_chunks[c_maxChunks]{};
+    _Guarded_by_(m_lock) std::vector<uint32_t> m_freeSlots;
+    _Guarded_by_(m_lock) uint32_t m_slotCount = 0;
+};
+
+static ctsSocketTable g_socketTable;
+
 // default values are assigned in the class declaration
-ctsSocket::ctsSocket(weak_ptr<ctsSocketState> parent) noexcept :
-    m_parent(move(parent))
+ctsSocket::ctsSocket(weak_ptr<ctsSocketState> parent, uint32_t processor) noexcept :
+    m_parent(move(parent)),
+    // events are recorded against the ctsSocketState, which lives for the entire connection
+    m_traceId(ctsTrace::TraceId(m_parent.lock().get())),
+    m_processor(processor)
 {
 }
 
@@ -67,7 +194,7 @@ _No_competing_thread_ ctsSocket::~ctsSocket() noexcept
     return {std::move(lock), lockedSocketValue, m_pattern};
 }
 
-void ctsSocket::SetSocket(SOCKET socket) noexcept
+void ctsSocket::SetSocket(SOCKET socket, shared_ptr<ctThreadIocp> tpIocp) noexcept
 {
     const auto lock = m_lock.lock();
 
@@ -77,6 +204,10 @@ void ctsSocket::SetSocket(SOCKET socket) noexcept
         socket, m_socket.get());
 
     m_socket.reset(socket);
+    if (tpIocp)
+    {
+        m_tpIocp = std::move(tpIocp);
+    }
 }
 
 int ctsSocket::CloseSocket(uint32_t errorCode) noexcept
@@ -102,9 +233,65 @@ int ctsSocket::CloseSocket(uint32_t errorCode) noexcept
 
         m_socket.reset();
     }
+    // the local address can be given to a new connection once the SOCKET is closed
+    m_sourceLease.reset();
     return error;
 }
 
+void ctsSocket::RecycleSocket() noexcept
+{
+    // every IO callback holds the socket lock until it returns:
+    // - with no IO outstanding, once this lock is taken no IO callback can still be using this ctsSocket
+    const auto lock = m_lock.lock();
+    if (!m_socket)
+    {
+        return;
+    }
+    FAIL_FAST_IF_MSG(
+        ctMemoryGuardRead(&m_ioCount) != 0,
+        "ctsSocket::RecycleSocket requires no IO outstanding (%d)", ctMemoryGuardRead(&m_ioCount));
+
+    if (m_pattern)
+    {
+        m_pattern->PrintTcpInfo(m_localSockaddr, m_targetSockaddr, m_socket.get());
+    }
+
+    // the socket must travel with its IOCP ThreadPool: create it now if no IO was ever issued
+    if (!m_tpIocp)
+    {
+        try
+        {
+            m_tpIocp = make_shared<ctThreadIocp>(m_socket.get(), GetThreadpoolEnvironment());
+        }
+        catch (...)
+        {
+            ctsConfig::PrintThrownException();
+            m_socket.reset();
+            return;
+        }
+    }
+
+    // the socket stays bound to its local address while pooled, so it keeps the lease for that address
+    ctsSocketPool::ctsPooledSocket pooledSocket;
+    pooledSocket.m_socket = std::move(m_socket);
+    pooledSocket.m_tpIocp = m_tpIocp;
+    pooledSocket.m_sourceLease = std::move(m_sourceLease);
+    pooledSocket.m_targetAddr = m_targetSockaddr;
+    pooledSocket.m_family = m_targetSockaddr.family() != AF_UNSPEC ? m_targetSockaddr.family() : m_localSockaddr.family();
+    if (ctsSocketPool::Recycle(pooledSocket))
+    {
+        m_recycled = true;
+    }
+    else
+    {
+        // the pool did not take ownership - close it as we would without -Options:reusesockets
+        pooledSocket.m_socket.reset();
+        pooledSocket.m_sourceLease.reset();
+    }
+    // there's no IO outstanding at this point, so it's safe for Shutdown to release m_tpIocp
+    // - the pool holds its own reference while the disconnect is outstanding
+}
+
 const shared_ptr<ctThreadIocp>& ctsSocket::GetIocpThreadpool()
 {
     // use the SOCKET cs to also guard creation of this TP object
@@ -112,7 +299,7 @@ const shared_ptr<ctThreadIocp>& ctsSocket::GetIocpThreadpool()
     // must verify a valid socket first to avoid racing destrying the iocp shared_ptr as we try to create it here
     if (m_socket && !m_tpIocp)
     {
-        m_tpIocp = make_shared<ctThreadIocp>(m_socket.get(), ctsConfig::g_configSettings->pTpEnvironment); // can throw
+        m_tpIocp = make_shared<ctThreadIocp>(m_socket.get(), GetThreadpoolEnvironment()); // can throw
     }
     return m_tpIocp;
 }
@@ -126,6 +313,19 @@ void ctsSocket::PrintPatternResults(uint32_t lastError) const noexcept
             GetLocalSockaddr(),
             GetRemoteSockaddr());
     }
+    else if (NO_ERROR == lastError && ctsConfig::g_configSettings->ConnectOnly)
+    {
+        // -cps without -transfer closes as soon as connected: there is no pattern to print the results
+        // - report the connection as having succeeded with its addresses and connect time
+        ctsTcpStatistics stats;
+        const auto lock = m_lock.lock();
+        stats.m_connectLatencyUsec.SetValue(m_connectLatencyUsec);
+        ctsConfig::PrintConnectionResults(
+            GetLocalSockaddr(),
+            GetRemoteSockaddr(),
+            lastError,
+            stats);
+    }
     else
     {
         // failed during socket creation, bind, or connect
@@ -167,6 +367,57 @@ void ctsSocket::SetLocalSockaddr(const ctSockaddr& localAddress) noexcept
     m_localSockaddr = localAddress;
 }
 
+void ctsSocket::SetSourceLease(shared_ptr<ctsSourceLease> lease) noexcept
+{
+    const auto lock = m_lock.lock();
+    m_sourceLease = std::move(lease);
+}
+
+void ctsSocket::SetTargetLease(shared_ptr<ctsTargetLease> lease) noexcept
+{
+    const auto lock = m_lock.lock();
+    m_targetLease = std::move(lease);
+}
+
+void ctsSocket::RecordConnectLatency(int64_t microseconds) noexcept
+{
+    ctsConfig::RecordConnectLatency(microseconds);
+
+    const auto lock = m_lock.lock();
+    m_connectLatencyUsec = microseconds;
+    if (m_targetLease)
+    {
+        ctsTargetSelector::RecordConnectLatency(*m_targetLease, microseconds);
+    }
+}
+
+void ctsSocket::ReleaseTarget(uint32_t lastError) noexcept
+{
+    const auto lock = m_lock.lock();
+    const auto bytesTransferred = m_pattern ? m_pattern->GetBytesTransferred() : 0LL;
+    ctsCpuAffinity::RecordResult(m_processor, bytesTransferred);
+    if (m_targetLease)
+    {
+        ctsTargetSelector::RecordResult(*m_targetLease, lastError, bytesTransferred);
+        m_targetLease.reset();
+    }
+}
+
+PTP_CALLBACK_ENVIRON ctsSocket::GetThreadpoolEnvironment() const noexcept
+{
+    return ctsCpuAffinity::GetEnvironment(m_processor);
+}
+
+void ctsSocket::SteerToRssProcessor() noexcept
+{
+    const auto lock = m_lock.lock();
+    if (m_socket)
+    {
+        // ConnectEx binds the SOCKET to the IOCP threadpool before the connection is established
+        ctsCpuAffinity::SteerConnection(m_socket.get(), m_processor, !m_tpIocp && !m_tpTimer);
+    }
+}
+
 const ctSockaddr& ctsSocket::GetRemoteSockaddr() const noexcept
 {
     return m_targetSockaddr;
@@ -177,8 +428,24 @@ void ctsSocket::SetRemoteSockaddr(const ctSockaddr& targetAddress) noexcept
     m_targetSockaddr = targetAddress;
 }
 
+ctsSocketHandle ctsSocket::GetHandle() const noexcept
+{
+    return m_handle;
+}
+
+ctsSocket* ctsSocket::FromHandle(const ctsSocketHandle& handle) noexcept
+{
+    return g_socketTable.Lookup(handle);
+}
+
 void ctsSocket::SetIoPattern()
 {
+    // register before any IO is started so IO completions can resolve this ctsSocket from its handle
+    if (0 == m_handle.m_generation)
+    {
+        m_handle = g_socketTable.Insert(this);
+    }
+
     m_pattern = ctsIoPattern::MakeIoPattern();
     if (!m_pattern)
     {
@@ -187,6 +454,11 @@ void ctsSocket::SetIoPattern()
     }
 
     m_pattern->SetParent(shared_from_this());
+    m_pattern->SetTraceId(m_traceId);
+    {
+        const auto lock = m_lock.lock();
+        m_pattern->SetConnectLatency(m_connectLatencyUsec);
+    }
 
     if (ctsConfig::g_configSettings->PrePostSends == 0)
     {
@@ -313,8 +585,22 @@ void ctsSocket::Shutdown() noexcept
     // - instead of calling this from the d'tor of ctsSocket, as the final reference
     //   to this ctsSocket might be from a TP thread - in which case this d'tor will deadlock
     //   (it will wait for all TP threads to exit, but it is using/blocking on of those TP threads)
+    // FromHandle relies on this being the last reference to the ctThreadIocp, so destroying it waits for the IO callbacks
+    {
+        const auto lock = m_lock.lock();
+        FAIL_FAST_IF_MSG(
+            m_tpIocp && !m_recycled && m_tpIocp.use_count() > 1,
+            "ctsSocket::Shutdown must release the last reference to its ctThreadIocp (%ld references)", m_tpIocp.use_count());
+    }
     m_tpIocp.reset();
     m_tpTimer.reset();
+
+    // all IO and timer callbacks have now completed - none can still be resolving this handle
+    if (m_handle.m_generation != 0)
+    {
+        g_socketTable.Remove(m_handle);
+        m_handle = {};
+    }
 }
 
 ///
@@ -322,7 +608,7 @@ void ctsSocket::Shutdown() noexcept
 /// - note that the timer 
 /// - can throw under low resource conditions
 ///
-void ctsSocket::SetTimer(const ctsTask& task, function<void(weak_ptr<ctsSocket>, const ctsTask&)>&& func)
+void ctsSocket::SetTimer(const ctsTask& task, function<void(ctsSocketHandle, const ctsTask&)>&& func)
 {
     const auto lock = m_lock.lock();
     m_timerTask = task;
@@ -330,12 +616,13 @@ void ctsSocket::SetTimer(const ctsTask& task, function<void(weak_ptr<ctsSocket>,
 
     if (!m_tpTimer)
     {
-        m_tpTimer.reset(CreateThreadpoolTimer(ThreadPoolTimerCallback, this, ctsConfig::g_configSettings->pTpEnvironment));
+        m_tpTimer.reset(CreateThreadpoolTimer(ThreadPoolTimerCallback, this, GetThreadpoolEnvironment()));
         THROW_LAST_ERROR_IF(!m_tpTimer);
     }
 
     FILETIME relativeTimeout = wil::filetime::from_int64(-1 * wil::filetime_duration::one_millisecond * task.m_timeOffsetMilliseconds);
     SetThreadpoolTimer(m_tpTimer.get(), &relativeTimeout, 0, 0);
+    ctsTrace::TraceTimerArmed(m_traceId, static_cast<uint16_t>(task.m_ioAction), static_cast<uint32_t>(task.m_timeOffsetMilliseconds));
 }
 
 void NTAPI ctsSocket::ThreadPoolTimerCallback(PTP_CALLBACK_INSTANCE, PVOID pContext, PTP_TIMER)
@@ -343,14 +630,15 @@ void NTAPI ctsSocket::ThreadPoolTimerCallback(PTP_CALLBACK_INSTANCE, PVOID pCont
     auto* pThis = static_cast<ctsSocket*>(pContext);
 
     ctsTask task{};
-    function<void(weak_ptr<ctsSocket>, const ctsTask&)> callback;
+    function<void(ctsSocketHandle, const ctsTask&)> callback;
     {
         const auto lock = pThis->m_lock.lock();
         task = pThis->m_timerTask;
         callback = std::move(pThis->m_timerCallback);
     }
+    ctsTrace::TraceTimerFired(pThis->m_traceId, static_cast<uint16_t>(task.m_ioAction));
 
     // invoke the callback outside the lock
-    callback(pThis->weak_from_this(), task);
+    callback(pThis->m_handle, task);
 }
 } // namespace
@@ -29,6 +29,8 @@ See the Apache Version 2.0 License for specific language governing permissions a
 // project headers
 #include "ctsIOPattern.h"
 #include "ctsIOTask.hpp"
+#include "ctsSourceAllocator.h"
+#include "ctsTargetSelector.h"
 
 namespace ctsTraffic
 {
@@ -38,6 +40,19 @@ namespace ctsTraffic
 //
 class ctsSocketState;
 
+//
+// A generation-checked reference to a ctsSocket
+// - IO completion contexts carry this instead of a std::weak_ptr<ctsSocket>
+//   resolving it through ctsSocket::FromHandle is a pair of plain loads, where weak_ptr::lock()
+//   is an interlocked compare-exchange on the shared control block plus an interlocked decrement to release it
+//
+struct ctsSocketHandle
+{
+    uint32_t m_index = 0;
+    // zero is never a valid generation
+    uint32_t m_generation = 0;
+};
+
 //
 // A safe socket container
 // - ensures has a lock on the socket while in scope
@@ -59,30 +74,33 @@ public:
             return m_socket;
         }
 
-        [[nodiscard]] std::shared_ptr<ctsIoPattern> GetPattern() const noexcept
+        // the pattern is only released when the ctsSocket is destroyed
+        // - so a reference is valid for as long as the caller holds the ctsSocket
+        [[nodiscard]] const std::shared_ptr<ctsIoPattern>& GetPattern() const noexcept
         {
-            return m_patternWeakRef.lock();
+            return m_pattern;
         }
 
     private:
         friend class ctsSocket;
 
-        SocketReference(wil::cs_leave_scope_exit&& socketLock, SOCKET socket, std::weak_ptr<ctsIoPattern> patternWeakRef) noexcept :
-            m_socketLock(std::move(socketLock)), m_socket(socket), m_patternWeakRef(std::move(patternWeakRef))
+        SocketReference(wil::cs_leave_scope_exit&& socketLock, SOCKET socket, const std::shared_ptr<ctsIoPattern>& pattern) noexcept :
+            m_socketLock(std::move(socketLock)), m_socket(socket), m_pattern(pattern)
         {
         }
 
         const wil::cs_leave_scope_exit m_socketLock;
         const SOCKET m_socket = INVALID_SOCKET;
-        const std::weak_ptr<ctsIoPattern> m_patternWeakRef;
+        const std::shared_ptr<ctsIoPattern>& m_pattern;
     };
 
     [[nodiscard]] SocketReference AcquireSocketLock() const noexcept;
 
     //
     // c'tor requiring a parent ctsSocketState weak reference
+    // - processor is from ctsCpuAffinity::AssignProcessor, choosing the threadpool for all callbacks
     //
-    explicit ctsSocket(std::weak_ptr<ctsSocketState> parent) noexcept;
+    explicit ctsSocket(std::weak_ptr<ctsSocketState> parent, uint32_t processor = 0) noexcept;
 
     _No_competing_thread_ ~ctsSocket() noexcept;
 
@@ -96,7 +114,10 @@ public:
     //
     // A no-fail operation
     //
-    void SetSocket(SOCKET socket) noexcept;
+    // tpIocp is given when the SOCKET was taken from ctsSocketPool
+    // - it remains associated with the IOCP ThreadPool it was first used with
+    //
+    void SetSocket(SOCKET socket, std::shared_ptr<ctl::ctThreadIocp> tpIocp = {}) noexcept;
 
     //
     // Safely closes the encapsulated socket 
@@ -109,6 +130,13 @@ public:
     // 
     int CloseSocket(uint32_t errorCode = NO_ERROR) noexcept;
 
+    //
+    // Hands the encapsulated socket to ctsSocketPool to be disconnected and reused (-Options:reusesockets)
+    // - only valid once the connection has completed successfully with no IO outstanding
+    // - closes the socket if it cannot be handed to the pool
+    //
+    void RecycleSocket() noexcept;
+
     //
     // Provides access to the IOCP ThreadPool associated with the SOCKET
     // - if not already association with the TP, will associate on the first call
@@ -131,6 +159,39 @@ public:
     const ctl::ctSockaddr& GetLocalSockaddr() const noexcept;
     void SetLocalSockaddr(const ctl::ctSockaddr& localAddress) noexcept;
 
+    //
+    // Holds the local address chosen by ctsSourceAllocator until the SOCKET is closed
+    //
+    void SetSourceLease(std::shared_ptr<ctsSourceLease> lease) noexcept;
+    //
+    // Holds the target address chosen by ctsTargetSelector until ReleaseTarget
+    //
+    void SetTargetLease(std::shared_ptr<ctsTargetLease> lease) noexcept;
+    //
+    // Records the time taken to establish the connection, both overall and for its target address
+    //
+    void RecordConnectLatency(int64_t microseconds) noexcept;
+    //
+    // Records the result and bytes transferred of the connection against its target address and processor
+    // - the connection then no longer counts as active to that target
+    //
+    void ReleaseTarget(uint32_t lastError) noexcept;
+
+    //
+    // Returns the threadpool environment for all callbacks on this SOCKET
+    // - the threadpool of the processor the connection was assigned with -CpuAffinity
+    //
+    [[nodiscard]] PTP_CALLBACK_ENVIRON GetThreadpoolEnvironment() const noexcept;
+
+    //
+    // With -CpuAffinity:rss, moves the connection to the processor its packets are received on
+    // - must be called once connected, before IO is started
+    // - the connection stays on its processor if its SOCKET is already bound to that processor's threadpool
+    // - only this socket's IO completions and timers are steered: ctsSocketState's closing callback
+    //   still runs on the threadpool of the processor the connection was assigned when created
+    //
+    void SteerToRssProcessor() noexcept;
+
     //
     // Gets/Sets the target address of the SOCKET, if there is one
     //
@@ -159,10 +220,29 @@ public:
     // Function to register a task for completion at the future point in time referenced
     // - by ctsIOTask::time_offset_milliseconds
     //
-    // set_timer stores a weak_ptr to 'this' ctsSocket object
+    // set_timer passes the handle of 'this' ctsSocket object to the callback
     // - so that the object lifetime is not maintained just from a scheduled work item
+    //   (Shutdown waits for the timer callback before the handle is invalidated)
+    //
+    void SetTimer(const ctsTask& task, std::function<void(ctsSocketHandle, const ctsTask&)>&& func);
+
+    //
+    // Returns the handle registered for this ctsSocket by SetIoPattern
+    // - the handle is valid until Shutdown
+    //
+    [[nodiscard]] ctsSocketHandle GetHandle() const noexcept;
+
+    //
+    // Resolves a handle back to its ctsSocket - returns nullptr if that ctsSocket has been shutdown
+    //
+    // The returned pointer may only be used from IO completion and timer callbacks on that ctsSocket
+    // - Shutdown waits for all of those callbacks to complete before invalidating the handle,
+    //   which is what keeps the ctsSocket alive while its IO is outstanding without taking a reference per IO
+    // - Shutdown waits by destroying the ctThreadIocp, so this ctsSocket must hold its only reference
+    //   the one exception is a socket recycled into ctsSocketPool: RecycleSocket requires no IO outstanding,
+    //   and takes the socket lock which every IO callback holds until it returns
     //
-    void SetTimer(const ctsTask& task, std::function<void(std::weak_ptr<ctsSocket>, const ctsTask&)>&& func);
+    static ctsSocket* FromHandle(const ctsSocketHandle& handle) noexcept;
 
     // not copyable or movable
     ctsSocket(const ctsSocket&) = delete;
@@ -199,12 +279,23 @@ private:
 
     /// only guarded when returning to the caller
     std::shared_ptr<ctl::ctThreadIocp> m_tpIocp;
+    // set once m_tpIocp is shared with ctsSocketPool
+    _Guarded_by_(m_lock) bool m_recycled = false;
     wil::unique_threadpool_timer m_tpTimer;
     ctsTask m_timerTask{};
-    std::function<void(std::weak_ptr<ctsSocket>, const ctsTask&)> m_timerCallback;
+    std::function<void(ctsSocketHandle, const ctsTask&)> m_timerCallback;
+    ctsSocketHandle m_handle{};
+    // identifies this connection's trace events
+    uint64_t m_traceId = 0;
+    // only changed by SteerToRssProcessor, before any IO is started
+    uint32_t m_processor = 0;
 
     ctl::ctSockaddr m_localSockaddr;
     ctl::ctSockaddr m_targetSockaddr;
+    _Guarded_by_(m_lock) std::shared_ptr<ctsSourceLease> m_sourceLease;
+    _Guarded_by_(m_lock) std::shared_ptr<ctsTargetLease> m_targetLease;
+    // given to the IO pattern once connected, for the connection results
+    _Guarded_by_(m_lock) int64_t m_connectLatencyUsec = 0;
 
     static void NTAPI ThreadPoolTimerCallback(PTP_CALLBACK_INSTANCE, PVOID pContext, PTP_TIMER);
 };
@@ -25,6 +25,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 // project headers
 #include "ctsConfig.h"
 #include "ctsSocketState.h"
+#include "ctsTrace.h"
 
 namespace ctsTraffic
 {
@@ -122,7 +123,7 @@ void ctsSocketBroker::InitiatingIo() noexcept
     --m_pendingSockets;
     ++m_activeSockets;
 
-    m_tpFlatQueue.submit([&] { RefreshSockets(); });
+    ScheduleRefresh();
 }
 
 //
@@ -150,7 +151,7 @@ void ctsSocketBroker::Closing(bool wasActive) noexcept
         --m_pendingSockets;
     }
 
-    m_tpFlatQueue.submit([&] { RefreshSockets(); });
+    ScheduleRefresh();
 }
 
 bool ctsSocketBroker::Wait(DWORD milliseconds) const noexcept
@@ -179,6 +180,21 @@ bool ctsSocketBroker::Wait(DWORD milliseconds) const noexcept
     return fReturn;
 }
 
+//
+// Queues a refresh unless one is already queued
+// - must be called holding m_lock
+//
+void ctsSocketBroker::ScheduleRefresh() noexcept
+{
+    ctsConfig::g_configSettings->ConnectionStatusDetails.m_brokerTransitionCount.Increment();
+
+    if (!m_refreshPending)
+    {
+        // if it couldn't be queued, the next state change tries again
+        m_refreshPending = m_tpFlatQueue.submit([&] { RefreshSockets(); });
+    }
+}
+
 //
 // Timer callback to scavenge any closed sockets
 // Then refresh sockets that should be created anew
@@ -189,10 +205,15 @@ void ctsSocketBroker::RefreshSockets() noexcept try
     vector<shared_ptr<ctsSocketState>> removedObjects;
 
     auto exiting = false;
+    size_t socketCount = 0;
     try
     {
         const auto lock = m_lock.lock();
 
+        // state changes from here on need another refresh
+        m_refreshPending = false;
+        ctsConfig::g_configSettings->ConnectionStatusDetails.m_brokerRefreshCount.Increment();
+
         exiting = 0 == m_totalConnectionsRemaining &&
                   0 == m_pendingSockets &&
                   0 == m_activeSockets;
@@ -241,11 +262,13 @@ void ctsSocketBroker::RefreshSockets() noexcept try
                 }
             }
         }
+        socketCount = m_socketPool.size();
     }
     catch (...)
     {
         ctsConfig::PrintThrownException();
     }
+    ctsTrace::TraceBrokerRefresh(ctsTrace::TraceId(this), static_cast<uint32_t>(socketCount));
 
     removedObjects.clear();
 
@@ -59,6 +59,7 @@ public:
     ctsSocketBroker& operator=(ctsSocketBroker&&) = delete;
 
 private:
+    void ScheduleRefresh() noexcept;
     void RefreshSockets() noexcept;
 
     // CS to guard access to the vector socket_pool
@@ -75,7 +76,11 @@ private:
     uint32_t m_pendingLimit = 0UL;
     uint32_t m_pendingSockets = 0UL;
     uint32_t m_activeSockets = 0UL;
+    // set while a refresh is queued and not yet started
+    // - state changes before it starts are all handled by that one pass, so no other refresh is queued for them
+    bool m_refreshPending = false;
 
-    ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Flat> m_tpFlatQueue;
+    // runs on the -Options:workstealing pool when set, else on its own single-threaded threadpool
+    ctl::ctThreadpoolQueue<ctl::ctThreadpoolGrowthPolicy::Flat> m_tpFlatQueue{ctsConfig::g_configSettings->WorkStealingPool};
 };
 } // namespace
@@ -0,0 +1,316 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsSocketPool.h"
+// cpp headers
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+#include <MSWSock.h>
+// wil headers
+#include <wil/resource.h>
+// ctl headers
+#include <ctMemoryGuard.hpp>
+#include <ctSockaddr.hpp>
+#include <ctSocketExtensions.hpp>
+#include <ctThreadIocp.hpp>
+// project headers
+#include "ctsConfig.h"
+
+namespace ctsTraffic { namespace ctsSocketPool
+    {
+        struct ctsPreCreatedSocket
+        {
+            ctsPooledSocket m_pooledSocket;
+            // the address the socket was created for, with a port of 0
+            ctl::ctSockaddr m_localAddr;
+        };
+
+        struct ctsSocketPoolImpl
+        {
+            wil::critical_section m_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
+            std::vector<ctsPooledSocket> m_sockets;
+            // sockets currently being disconnected: m_sockets always has capacity reserved for each
+            size_t m_pendingCount = 0;
+
+            std::vector<ctsPreCreatedSocket> m_preCreatedSockets;
+            // set to zero to stop refilling if creating a socket fails
+            size_t m_preCreatedTarget = 0;
+            bool m_refillQueued = false;
+            int64_t m_bindCounter = 0LL;
+            // declared last so it's destroyed first, waiting for a refill to complete
+            wil::unique_threadpool_work m_refillWork;
+        };
+
+        static ctsSocketPoolImpl g_socketPool; // NOLINT(clang-diagnostic-exit-time-destructors)
+
+        // capacity was reserved in Recycle, so this cannot fail
+        // - this is important as it can be called from the IO callback of the ctThreadIocp being added:
+        //   that ctThreadIocp must never be destroyed from within its own callback
+        static void AddToPool(ctsPooledSocket&& pooledSocket) noexcept
+        {
+            const auto lock = g_socketPool.m_lock.lock();
+            FAIL_FAST_IF(g_socketPool.m_pendingCount == 0);
+            --g_socketPool.m_pendingCount;
+            g_socketPool.m_sockets.emplace_back(std::move(pooledSocket));
+        }
+
+        bool Recycle(ctsPooledSocket& pooledSocket) noexcept try
+        {
+            FAIL_FAST_IF_MSG(
+                !pooledSocket.m_tpIocp,
+                "ctsSocketPool::Recycle requires the threadpool IO object associated with the socket (%Iu)",
+                pooledSocket.m_socket.get());
+
+            // all allocations are made before taking ownership of the socket
+            // - so the caller still owns both the socket and the ctThreadIocp if anything throws
+            {
+                const auto lock = g_socketPool.m_lock.lock();
+                g_socketPool.m_sockets.reserve(g_socketPool.m_sockets.size() + g_socketPool.m_pendingCount + 1);
+                ++g_socketPool.m_pendingCount;
+            }
+            auto decrementPending = wil::scope_exit([&]() noexcept {
+                const auto lock = g_socketPool.m_lock.lock();
+                --g_socketPool.m_pendingCount;
+            });
+
+            // the callback hands the pooled socket to the pool once the disconnect completes
+            auto sharedPooledSocket = std::make_shared<ctsPooledSocket>();
+            ctl::ctThreadIocp* const pTpIocp = pooledSocket.m_tpIocp.get();
+            OVERLAPPED* pOverlapped = pTpIocp->new_request(
+                [sharedPooledSocket](OVERLAPPED* pCallbackOverlapped) noexcept {
+                    DWORD transferred{};
+                    DWORD flags{};
+                    if (!WSAGetOverlappedResult(sharedPooledSocket->m_socket.get(), pCallbackOverlapped, &transferred, FALSE, &flags))
+                    {
+                        PRINT_DEBUG_INFO(L"\t\tctsSocketPool : DisconnectEx failed (%d) - closing the socket\n", WSAGetLastError());
+                        // the closed socket is still added to the pool - Acquire discards it
+                        sharedPooledSocket->m_socket.reset();
+                        sharedPooledSocket->m_sourceLease.reset();
+                    }
+                    AddToPool(std::move(*sharedPooledSocket));
+                });
+
+            // nothing below can throw
+            decrementPending.release();
+            *sharedPooledSocket = std::move(pooledSocket);
+
+            const auto socket = sharedPooledSocket->m_socket.get();
+            if (!ctl::ctDisconnectEx(socket, pOverlapped, TF_REUSE_SOCKET, 0))
+            {
+                const auto gle = WSAGetLastError();
+                if (gle != ERROR_IO_PENDING)
+                {
+                    PRINT_DEBUG_INFO(L"\t\tctsSocketPool : DisconnectEx failed (%d) - closing the socket\n", gle);
+                    // must cancel the IOCP TP request since the IO failed
+                    // - moving the pooled socket out of the request first: canceling destroys the callback
+                    auto failedSocket = std::move(*sharedPooledSocket);
+                    failedSocket.m_socket.reset();
+                    failedSocket.m_sourceLease.reset();
+                    pTpIocp->cancel_request(pOverlapped);
+                    AddToPool(std::move(failedSocket));
+                }
+            }
+            else if (ctsConfig::g_configSettings->Options & ctsConfig::OptionType::HandleInlineIocp)
+            {
+                // completed inline - the callback will not be queued to the IOCP
+                auto completedSocket = std::move(*sharedPooledSocket);
+                pTpIocp->cancel_request(pOverlapped);
+                AddToPool(std::move(completedSocket));
+            }
+            return true;
+        }
+        catch (...)
+        {
+            ctsConfig::PrintThrownException();
+            return false;
+        }
+
+        // throws wil::ResultException or bad_alloc on failure
+        static ctsPreCreatedSocket CreatePreCreatedSocket()
+        {
+            const auto& bindAddresses = ctsConfig::g_configSettings->BindAddresses;
+            const auto bindCounter = ctl::ctMemoryGuardIncrement(&g_socketPool.m_bindCounter);
+
+            ctsPreCreatedSocket preCreated;
+            preCreated.m_localAddr = bindAddresses[bindCounter % bindAddresses.size()];
+            preCreated.m_localAddr.setPort(0);
+            preCreated.m_pooledSocket.m_family = preCreated.m_localAddr.family();
+
+            const auto isTcp = ctsConfig::ProtocolType::TCP == ctsConfig::g_configSettings->Protocol;
+            preCreated.m_pooledSocket.m_socket.reset(
+                ctsConfig::CreateSocket(
+                    preCreated.m_localAddr.family(),
+                    isTcp ? SOCK_STREAM : SOCK_DGRAM,
+                    isTcp ? IPPROTO_TCP : IPPROTO_UDP,
+                    ctsConfig::g_configSettings->SocketFlags));
+
+            const auto error = ctsConfig::SetPreBindOptions(preCreated.m_pooledSocket.m_socket.get(), preCreated.m_localAddr);
+            if (error != 0)
+            {
+                THROW_WIN32_MSG(error, "SetPreBindOptions (ctsSocketPool)");
+            }
+
+            // ctsWSASocket must bind each socket itself when it chooses the port from -LocalPort
+            if (0 == ctsConfig::g_configSettings->LocalPortLow)
+            {
+                if (SOCKET_ERROR == bind(preCreated.m_pooledSocket.m_socket.get(), preCreated.m_localAddr.sockaddr(), preCreated.m_localAddr.length()))
+                {
+                    THROW_WIN32_MSG(WSAGetLastError(), "bind (ctsSocketPool)");
+                }
+                preCreated.m_pooledSocket.m_isBound = true;
+            }
+
+            return preCreated;
+        }
+
+        static VOID CALLBACK RefillPreCreated(PTP_CALLBACK_INSTANCE, PVOID, PTP_WORK) noexcept
+        {
+            while (!ctsConfig::ShutdownCalled())
+            {
+                {
+                    const auto lock = g_socketPool.m_lock.lock();
+                    if (g_socketPool.m_preCreatedSockets.size() >= g_socketPool.m_preCreatedTarget)
+                    {
+                        break;
+                    }
+                }
+
+                try
+                {
+                    auto preCreated = CreatePreCreatedSocket();
+                    const auto lock = g_socketPool.m_lock.lock();
+                    g_socketPool.m_preCreatedSockets.emplace_back(std::move(preCreated));
+                }
+                catch (...)
+                {
+                    // stop refilling - ctsWSASocket will create sockets as it needs them
+                    ctsConfig::PrintThrownException();
+                    const auto lock = g_socketPool.m_lock.lock();
+                    g_socketPool.m_preCreatedTarget = 0;
+                    break;
+                }
+            }
+
+            const auto lock = g_socketPool.m_lock.lock();
+            g_socketPool.m_refillQueued = false;
+        }
+
+        void FillPreCreated()
+        {
+            const auto preCreatedTarget = std::min(
+                ctsConfig::g_configSettings->ConnectionLimit,
+                ctsConfig::g_configSettings->ConnectionThrottleLimit);
+
+            g_socketPool.m_refillWork.reset(CreateThreadpoolWork(RefillPreCreated, nullptr, ctsConfig::g_configSettings->pTpEnvironment));
+            THROW_LAST_ERROR_IF(!g_socketPool.m_refillWork);
+
+            std::vector<ctsPreCreatedSocket> preCreatedSockets;
+            preCreatedSockets.reserve(preCreatedTarget);
+            while (preCreatedSockets.size() < preCreatedTarget)
+            {
+                preCreatedSockets.emplace_back(CreatePreCreatedSocket());
+            }
+
+            const auto lock = g_socketPool.m_lock.lock();
+            g_socketPool.m_preCreatedSockets = std::move(preCreatedSockets);
+            g_socketPool.m_preCreatedTarget = preCreatedTarget;
+        }
+
+        ctsPooledSocket AcquirePreCreated(const ctl::ctSockaddr& localAddr) noexcept
+        {
+            auto bindAddress(localAddr);
+            bindAddress.setPort(0);
+
+            ctsPooledSocket returnSocket;
+            const auto lock = g_socketPool.m_lock.lock();
+            auto& preCreatedSockets = g_socketPool.m_preCreatedSockets;
+            for (auto index = preCreatedSockets.size(); index > 0; --index)
+            {
+                if (preCreatedSockets[index - 1].m_localAddr == bindAddress)
+                {
+                    returnSocket = std::move(preCreatedSockets[index - 1].m_pooledSocket);
+                    preCreatedSockets.erase(preCreatedSockets.begin() + static_cast<ptrdiff_t>(index - 1));
+                    break;
+                }
+            }
+
+            if (!g_socketPool.m_refillQueued && preCreatedSockets.size() < g_socketPool.m_preCreatedTarget / 2)
+            {
+                g_socketPool.m_refillQueued = true;
+                SubmitThreadpoolWork(g_socketPool.m_refillWork.get());
+            }
+
+            return returnSocket;
+        }
+
+        template <typename Predicate>
+        static ctsPooledSocket AcquireMatching(Predicate predicate) noexcept
+        {
+            // sockets which failed to be disconnected are destroyed after releasing the lock
+            // - destroying their ctThreadIocp waits for its callbacks to complete
+            ctsPooledSocket discarded[4];
+            size_t discardedCount = 0;
+
+            ctsPooledSocket returnSocket;
+            {
+                const auto lock = g_socketPool.m_lock.lock();
+                auto& sockets = g_socketPool.m_sockets;
+                // take the most recently recycled socket
+                for (auto index = sockets.size(); index > 0; --index)
+                {
+                    auto& pooledSocket = sockets[index - 1];
+                    if (!pooledSocket.m_socket)
+                    {
+                        if (discardedCount < std::size(discarded))
+                        {
+                            discarded[discardedCount] = std::move(pooledSocket);
+                            ++discardedCount;
+                            sockets.erase(sockets.begin() + static_cast<ptrdiff_t>(index - 1));
+                        }
+                        continue;
+                    }
+
+                    if (predicate(pooledSocket))
+                    {
+                        returnSocket = std::move(pooledSocket);
+                        sockets.erase(sockets.begin() + static_cast<ptrdiff_t>(index - 1));
+                        break;
+                    }
+                }
+            }
+
+            return returnSocket;
+        }
+
+        ctsPooledSocket Acquire(ADDRESS_FAMILY family) noexcept
+        {
+            return AcquireMatching([family](const ctsPooledSocket& pooledSocket) noexcept {
+                return pooledSocket.m_family == family;
+            });
+        }
+
+        ctsPooledSocket AcquireForTarget(const ctl::ctSockaddr& targetAddr) noexcept
+        {
+            return AcquireMatching([&targetAddr](const ctsPooledSocket& pooledSocket) noexcept {
+                return pooledSocket.m_targetAddr == targetAddr;
+            });
+        }
+    }
+}
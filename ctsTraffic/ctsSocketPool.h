@@ -0,0 +1,80 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <memory>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+// wil headers
+#include <wil/resource.h>
+// ctl headers
+#include <ctSockaddr.hpp>
+#include <ctThreadIocp.hpp>
+// project headers
+#include "ctsSourceAllocator.h"
+
+// The socket pool holds TCP sockets which can be used for a new connection without creating a new socket
+// - sockets are added by Recycle once a connection has completed successfully (-Options:reusesockets)
+//   they are disconnected with DisconnectEx(TF_REUSE_SOCKET) and can then only be given to ConnectEx or AcceptEx
+//
+// A recycled socket remains associated with the threadpool IO object it was first used with
+// - a SOCKET can only be associated with one completion port, so the ctThreadIocp must travel with the SOCKET
+//
+// The pool separately holds pre-created sockets for the connect path (-Options:precreatesockets)
+// - these are created with their pre-bind options set, and bound to port 0 unless -LocalPort is specified
+// - it's filled before connections are started, then refilled on a threadpool thread as sockets are taken
+//   so that socket creation is not on the connection path while ramping up connections
+
+namespace ctsTraffic { namespace ctsSocketPool
+    {
+        struct ctsPooledSocket
+        {
+            wil::unique_socket m_socket;
+            std::shared_ptr<ctl::ctThreadIocp> m_tpIocp;
+            ADDRESS_FAMILY m_family = AF_UNSPEC;
+            // only set for pre-created sockets: recycled sockets are always still bound
+            bool m_isBound = false;
+            // a recycled socket keeps the lease for the address it's still bound to (see ctsSourceAllocator)
+            // - a lease is for a (bind address, target address) pair, so the target it was connected to is kept with it
+            std::shared_ptr<ctsSourceLease> m_sourceLease;
+            ctl::ctSockaddr m_targetAddr;
+        };
+
+        // Disconnects the socket with DisconnectEx(TF_REUSE_SOCKET) and adds it to the pool once that completes
+        // - the socket is closed if it cannot be disconnected for reuse
+        // - must not be called with any IO outstanding on the socket
+        // - returns false if the pool could not take ownership: pooledSocket is then left unchanged
+        bool Recycle(ctsPooledSocket& pooledSocket) noexcept;
+
+        // Returns a disconnected socket of the requested address family
+        // - m_socket is INVALID_SOCKET if none are available
+        ctsPooledSocket Acquire(ADDRESS_FAMILY family) noexcept;
+
+        // Returns a disconnected socket which was last connected to the target address
+        // - used with the source allocator, as the socket's source lease is only valid for that target
+        // - m_socket is INVALID_SOCKET if none are available
+        ctsPooledSocket AcquireForTarget(const ctl::ctSockaddr& targetAddr) noexcept;
+
+        // Creates the lesser of ConnectionLimit and ConnectionThrottleLimit sockets, rotating through the bind addresses
+        // - can throw wil::ResultException or std::bad_alloc
+        void FillPreCreated();
+
+        // Returns a pre-created socket for the bind address (ignoring the port)
+        // - m_socket is INVALID_SOCKET if none are available
+        // - queues a background refill once the pool drops below half
+        ctsPooledSocket AcquirePreCreated(const ctl::ctSockaddr& localAddr) noexcept;
+    }
+}
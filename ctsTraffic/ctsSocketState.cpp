@@ -21,15 +21,18 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include "ctsSocket.h"
 #include "ctsSocketBroker.h"
 #include "ctsConfig.h"
+#include "ctsCpuAffinity.h"
 #include "ctsIOPattern.h"
+#include "ctsTrace.h"
 
 
 namespace ctsTraffic
 {
 ctsSocketState::ctsSocketState(std::weak_ptr<ctsSocketBroker> pBroker) :
-    m_broker(move(pBroker))
+    m_broker(move(pBroker)),
+    m_processor(ctsCpuAffinity::AssignProcessor())
 {
-    m_threadPoolWorker.reset(CreateThreadpoolWork(ThreadPoolWorker, this, ctsConfig::g_configSettings->pTpEnvironment));
+    m_threadPoolWorker.reset(CreateThreadpoolWork(ThreadPoolWorker, this, ctsCpuAffinity::GetEnvironment(m_processor)));
     THROW_LAST_ERROR_IF_NULL(m_threadPoolWorker.get());
 }
 
@@ -55,7 +58,7 @@ void ctsSocketState::Start() noexcept
     FAIL_FAST_IF_MSG(
         m_state != InternalState::Creating,
         "ctsSocketState::start must only be called once at the initial state of the object (this == %p)", this);
-    SubmitThreadpoolWork(m_threadPoolWorker.get());
+    ScheduleWorker();
 }
 
 void ctsSocketState::CompleteState(DWORD error) noexcept
@@ -79,6 +82,7 @@ void ctsSocketState::CompleteState(DWORD error) noexcept
                 {
                     m_state = InternalState::InitiatingIo;
                     ctsConfig::g_configSettings->ConnectionStatusDetails.m_activeConnectionCount.Increment();
+                    ctsConfig::g_configSettings->ConnectionStatusDetails.m_establishedCount.Increment();
                 }
                 break;
             }
@@ -87,6 +91,7 @@ void ctsSocketState::CompleteState(DWORD error) noexcept
             {
                 m_state = InternalState::InitiatingIo;
                 ctsConfig::g_configSettings->ConnectionStatusDetails.m_activeConnectionCount.Increment();
+                ctsConfig::g_configSettings->ConnectionStatusDetails.m_establishedCount.Increment();
                 break;
             }
 
@@ -125,6 +130,28 @@ void ctsSocketState::CompleteState(DWORD error) noexcept
         m_state = InternalState::Closing;
     }
 
+    ScheduleWorker();
+}
+
+void ctsSocketState::ScheduleWorker() noexcept
+{
+    if (auto* const pool = ctsConfig::g_configSettings->WorkStealingPool)
+    {
+        try
+        {
+            // the reference keeps this object alive until the work returns
+            // - the destructor only waits for work submitted to m_threadPoolWorker
+            pool->submit([sharedThis = shared_from_this()] {
+                ThreadPoolWorker(nullptr, sharedThis.get(), nullptr);
+            });
+            return;
+        }
+        catch (...)
+        {
+            // fall back to the threadpool
+            ctsConfig::PrintThrownException();
+        }
+    }
     SubmitThreadpoolWork(m_threadPoolWorker.get());
 }
 
@@ -145,13 +172,14 @@ VOID NTAPI ctsSocketState::ThreadPoolWorker(PTP_CALLBACK_INSTANCE, PVOID context
     //   needs to know that we already tried to run the functor for this state
     //
     auto* thisPtr = static_cast<ctsSocketState*>(context);
+    ctsTrace::TraceSocketState(ctsTrace::TraceId(thisPtr), static_cast<uint16_t>(thisPtr->m_state));
     switch (thisPtr->m_state)
     {
         case InternalState::Creating:
         {
             try
             {
-                thisPtr->m_socket = std::make_shared<ctsSocket>(thisPtr->shared_from_this());
+                thisPtr->m_socket = std::make_shared<ctsSocket>(thisPtr->shared_from_this(), thisPtr->m_processor);
 
                 auto lock = thisPtr->m_stateGuard.lock();
                 thisPtr->m_state = InternalState::Created;
@@ -186,6 +214,20 @@ VOID NTAPI ctsSocketState::ThreadPoolWorker(PTP_CALLBACK_INSTANCE, PVOID context
                 parent->InitiatingIo();
             }
 
+            if (ctsConfig::g_configSettings->ConnectOnly)
+            {
+                // -cps with no -transfer : the connection is complete once established
+                auto lock = thisPtr->m_stateGuard.lock();
+                thisPtr->m_state = InternalState::InitiatedIo;
+                lock.reset();
+
+                thisPtr->CompleteState(NO_ERROR);
+                break;
+            }
+
+            // with -CpuAffinity:rss, IO will run on the processor receiving the connection's packets
+            thisPtr->m_socket->SteerToRssProcessor();
+
             try
             {
                 thisPtr->m_socket->SetIoPattern();
@@ -239,8 +281,17 @@ VOID NTAPI ctsSocketState::ThreadPoolWorker(PTP_CALLBACK_INSTANCE, PVOID context
 
             if (thisPtr->m_socket)
             {
-                thisPtr->m_socket->CloseSocket(thisPtr->m_lastError);
+                if (0 == thisPtr->m_lastError &&
+                    ctsConfig::g_configSettings->Options & ctsConfig::OptionType::ReuseSockets)
+                {
+                    thisPtr->m_socket->RecycleSocket();
+                }
+                else
+                {
+                    thisPtr->m_socket->CloseSocket(thisPtr->m_lastError);
+                }
                 thisPtr->m_socket->PrintPatternResults(thisPtr->m_lastError);
+                thisPtr->m_socket->ReleaseTarget(thisPtr->m_lastError);
 
                 if (ctsConfig::g_configSettings->ClosingFunction)
                 {
@@ -253,6 +304,7 @@ VOID NTAPI ctsSocketState::ThreadPoolWorker(PTP_CALLBACK_INSTANCE, PVOID context
             auto lock = thisPtr->m_stateGuard.lock();
             thisPtr->m_state = InternalState::Closed;
             lock.reset();
+            ctsTrace::TraceSocketState(ctsTrace::TraceId(thisPtr), static_cast<uint16_t>(InternalState::Closed));
 
             if (const auto parent = thisPtr->m_broker.lock())
             {
@@ -97,11 +97,20 @@ private:
     wil::unique_threadpool_work m_threadPoolWorker;
     mutable wil::critical_section m_stateGuard{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
     std::weak_ptr<ctsSocketBroker> m_broker{};
+    // the processor this connection was assigned (with -CpuAffinity): m_threadPoolWorker runs on its threadpool
+    // - -CpuAffinity:rss can move the socket's IO to another processor; the state machine callbacks stay here
+    const uint32_t m_processor = 0;
     std::shared_ptr<ctsSocket> m_socket{};
     InternalState m_state = InternalState::Creating;
     uint32_t m_lastError = 0UL;
     bool m_initiatedIo = false;
 
+    //
+    // runs ThreadPoolWorker for the current state
+    // - on the -Options:workstealing pool when set, holding a reference to this object until it returns
+    //
+    void ScheduleWorker() noexcept;
+
     //
     // static threadpool callback function
     //
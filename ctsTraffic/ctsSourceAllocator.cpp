@@ -0,0 +1,247 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsSourceAllocator.h"
+// cpp headers
+#include <cstdint>
+#include <memory>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+// wil headers
+#include <wil/resource.h>
+// ctl headers
+#include <ctSockaddr.hpp>
+// project headers
+#include "ctsConfig.h"
+
+namespace ctsTraffic
+{
+    namespace details
+    {
+        // the local address state for connections from one bind address to one target address
+        struct ctsSourcePair
+        {
+            ctl::ctSockaddr m_bindAddr;
+            uint32_t m_activeCount = 0;
+
+            // a fixed-size ring of free local ports - released ports are appended
+            // so the port released the longest time ago is the next to be used
+            std::vector<uint16_t> m_freePorts;
+            size_t m_freeHead = 0;
+            size_t m_freeCount = 0;
+
+            uint16_t PopPort() noexcept
+            {
+                const auto port = m_freePorts[m_freeHead];
+                m_freeHead = (m_freeHead + 1) % m_freePorts.size();
+                --m_freeCount;
+                return port;
+            }
+
+            void PushPort(uint16_t port) noexcept
+            {
+                m_freePorts[(m_freeHead + m_freeCount) % m_freePorts.size()] = port;
+                ++m_freeCount;
+            }
+        };
+
+        struct ctsSourceAllocatorImpl
+        {
+            wil::critical_section m_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
+            // indexed by the index into TargetAddresses
+            // - each holds a pair for every bind address with the same address family
+            std::vector<std::vector<std::unique_ptr<ctsSourcePair>>> m_pairsByTarget;
+            bool m_usesPortRange = false;
+        };
+
+        static ctsSourceAllocatorImpl g_sourceAllocator; // NOLINT(clang-diagnostic-exit-time-destructors)
+        // ReSharper disable once CppZeroConstantCanBeReplacedWithNullptr
+        static INIT_ONCE g_sourceAllocatorInitOnce = INIT_ONCE_STATIC_INIT;
+
+        static BOOL CALLBACK ctsSourceAllocatorInitFn(PINIT_ONCE, PVOID perror, PVOID*) noexcept try
+        {
+            const auto& bindAddresses = ctsConfig::g_configSettings->BindAddresses;
+            const auto& targetAddresses = ctsConfig::g_configSettings->TargetAddresses;
+            const auto portLow = ctsConfig::g_configSettings->LocalPortLow;
+            const auto portHigh = ctsConfig::g_configSettings->LocalPortHigh == 0 ? portLow : ctsConfig::g_configSettings->LocalPortHigh;
+
+            g_sourceAllocator.m_usesPortRange = portLow != 0;
+            g_sourceAllocator.m_pairsByTarget.resize(targetAddresses.size());
+            for (size_t targetIndex = 0; targetIndex < targetAddresses.size(); ++targetIndex)
+            {
+                for (const auto& bindAddr : bindAddresses)
+                {
+                    if (bindAddr.family() != targetAddresses[targetIndex].family())
+                    {
+                        continue;
+                    }
+
+                    auto pair = std::make_unique<ctsSourcePair>();
+                    pair->m_bindAddr = bindAddr;
+                    pair->m_bindAddr.setPort(0);
+                    if (g_sourceAllocator.m_usesPortRange)
+                    {
+                        pair->m_freePorts.reserve(static_cast<size_t>(portHigh - portLow) + 1);
+                        for (uint32_t port = portLow; port <= portHigh; ++port)
+                        {
+                            pair->m_freePorts.push_back(static_cast<uint16_t>(port));
+                        }
+                        pair->m_freeCount = pair->m_freePorts.size();
+                    }
+                    g_sourceAllocator.m_pairsByTarget[targetIndex].emplace_back(std::move(pair));
+                }
+            }
+            return TRUE;
+        }
+        catch (...)
+        {
+            *static_cast<DWORD*>(perror) = ctsConfig::PrintThrownException();
+            return FALSE;
+        }
+    }
+
+    struct ctsSourceLease
+    {
+        details::ctsSourcePair* m_pair = nullptr;
+        uint16_t m_port = 0;
+
+        ctsSourceLease() noexcept = default;
+
+        ~ctsSourceLease() noexcept
+        {
+            if (m_pair)
+            {
+                const auto lock = details::g_sourceAllocator.m_lock.lock();
+                --m_pair->m_activeCount;
+                if (m_port != 0)
+                {
+                    m_pair->PushPort(m_port);
+                }
+            }
+        }
+
+        ctsSourceLease(const ctsSourceLease&) = delete;
+        ctsSourceLease& operator=(const ctsSourceLease&) = delete;
+        ctsSourceLease(ctsSourceLease&&) = delete;
+        ctsSourceLease& operator=(ctsSourceLease&&) = delete;
+    };
+
+    namespace ctsSourceAllocator
+    {
+        bool IsEnabled() noexcept
+        {
+            if (ctsConfig::ProtocolType::TCP != ctsConfig::g_configSettings->Protocol ||
+                ctsConfig::g_configSettings->TargetAddresses.empty())
+            {
+                return false;
+            }
+            if (ctsConfig::g_configSettings->LocalPortLow != 0)
+            {
+                return true;
+            }
+
+            // there is only a choice to make if an address family has more than one bind address
+            // - the default bind addresses are one IPv4 and one IPv6 wildcard address
+            size_t bindV4 = 0;
+            size_t bindV6 = 0;
+            for (const auto& bindAddr : ctsConfig::g_configSettings->BindAddresses)
+            {
+                if (bindAddr.family() == AF_INET)
+                {
+                    ++bindV4;
+                }
+                else
+                {
+                    ++bindV6;
+                }
+            }
+            return bindV4 > 1 || bindV6 > 1;
+        }
+
+        bool SharesLocalPorts() noexcept
+        {
+            return IsEnabled() &&
+                   ctsConfig::g_configSettings->LocalPortLow != 0 &&
+                   ctsConfig::g_configSettings->TargetAddresses.size() > 1;
+        }
+
+        uint32_t SetPreBindOptions(SOCKET socket) noexcept
+        {
+            if (!SharesLocalPorts())
+            {
+                return NO_ERROR;
+            }
+
+            constexpr DWORD optval{1}; // BOOL
+            if (SOCKET_ERROR == setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&optval), static_cast<int>(sizeof optval)))
+            {
+                return WSAGetLastError();
+            }
+            return NO_ERROR;
+        }
+
+        uint32_t Select(size_t targetIndex, ctl::ctSockaddr& localAddr, std::shared_ptr<ctsSourceLease>& lease) noexcept
+        {
+            DWORD error = 0;
+            if (!InitOnceExecuteOnce(&details::g_sourceAllocatorInitOnce, details::ctsSourceAllocatorInitFn, &error, nullptr))
+            {
+                return error;
+            }
+
+            std::shared_ptr<ctsSourceLease> newLease;
+            try
+            {
+                newLease = std::make_shared<ctsSourceLease>();
+            }
+            catch (...)
+            {
+                return WSAENOBUFS;
+            }
+
+            const auto lock = details::g_sourceAllocator.m_lock.lock();
+            details::ctsSourcePair* selectedPair = nullptr;
+            for (const auto& pair : details::g_sourceAllocator.m_pairsByTarget[targetIndex])
+            {
+                if (details::g_sourceAllocator.m_usesPortRange && 0 == pair->m_freeCount)
+                {
+                    continue;
+                }
+                if (!selectedPair || pair->m_activeCount < selectedPair->m_activeCount)
+                {
+                    selectedPair = pair.get();
+                }
+            }
+
+            if (!selectedPair)
+            {
+                PRINT_DEBUG_INFO(L"\t\tctsSourceAllocator : no local ports available to target index %Iu\n", targetIndex);
+                return WSAEADDRINUSE;
+            }
+
+            ++selectedPair->m_activeCount;
+            newLease->m_pair = selectedPair;
+            if (details::g_sourceAllocator.m_usesPortRange)
+            {
+                newLease->m_port = selectedPair->PopPort();
+            }
+
+            localAddr = selectedPair->m_bindAddr;
+            localAddr.setPort(newLease->m_port);
+            lease = std::move(newLease);
+            return NO_ERROR;
+        }
+    }
+}
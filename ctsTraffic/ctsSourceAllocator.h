@@ -0,0 +1,56 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <cstdint>
+#include <memory>
+// os headers
+#include <WinSock2.h>
+// ctl headers
+#include <ctSockaddr.hpp>
+
+// The source allocator chooses the local address for outgoing TCP connections
+// - it's used when multiple bind addresses of the same family or -LocalPort are specified
+//
+// A connection is identified by its 4-tuple, so the local ports are tracked per (bind address, target address) pair
+// - the same local port can be used concurrently to different targets (bound with SO_REUSEADDR)
+// - within a pair, ports are reused in the order they were released, giving TIME_WAIT the longest time to expire
+// - the bind address with the fewest connections to the chosen target is used, spreading connections across all bind addresses
+//
+// With ephemeral ports (no -LocalPort), only the connection counts per pair are tracked
+// - SO_PORT_SCALABILITY (or SO_REUSE_UNICASTPORT) then gives each bind address its own ephemeral port range
+
+namespace ctsTraffic
+{
+    // releases the local address back to the allocator when destroyed
+    struct ctsSourceLease;
+
+    namespace ctsSourceAllocator
+    {
+        // true when ctsWSASocket should use the allocator for the current settings
+        bool IsEnabled() noexcept;
+
+        // true when the same local port is given to connections to different targets
+        bool SharesLocalPorts() noexcept;
+
+        // sets the options a socket needs before it's bound to an address from Select
+        // - SO_REUSEADDR when SharesLocalPorts: the 4-tuple of each connection remains unique
+        uint32_t SetPreBindOptions(SOCKET socket) noexcept;
+
+        // chooses the local address to connect to TargetAddresses[targetIndex]
+        // - returns WSAEADDRINUSE if every local port to that target is in use
+        uint32_t Select(size_t targetIndex, ctl::ctSockaddr& localAddr, std::shared_ptr<ctsSourceLease>& lease) noexcept;
+    }
+}
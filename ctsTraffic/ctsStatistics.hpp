@@ -14,6 +14,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 // ReSharper disable CppInconsistentNaming
 #pragma once
 // cpp headers
+#include <cmath>
 #include <cstring>
 // os headers
 #include <Windows.h>
@@ -202,9 +203,22 @@ namespace ctsTraffic { namespace ctsStatistics
         ctsStatsTracking m_startTime;
         ctsStatsTracking m_endTime;
         ctsStatsTracking m_activeConnectionCount;
+        // connections which were successfully connected (clients) or accepted (servers)
+        ctsStatsTracking m_establishedCount;
         ctsStatsTracking m_successfulCompletionCount;
         ctsStatsTracking m_connectionErrorCount;
         ctsStatsTracking m_protocolErrorCount;
+        // times every AcceptEx posted by a listener had completed (servers)
+        ctsStatsTracking m_acceptQueueEmptyCount;
+        // sockets changing state (initiating IO or closing) and the broker passes refreshing the socket pool for them
+        ctsStatsTracking m_brokerTransitionCount;
+        ctsStatsTracking m_brokerRefreshCount;
+        // TCP connections with at least one stall, and the stalls and stalled time across all connections
+        ctsStatsTracking m_stalledConnectionCount;
+        ctsStatsTracking m_stallCount;
+        ctsStatsTracking m_stallTimeMs;
+        // sends and receives completed successfully, for the CPU cost per IO
+        ctsStatsTracking m_completedIoCount;
 
         explicit ctsConnectionStatistics(int64_t start_time = 0LL) noexcept :
             m_startTime(start_time)
@@ -237,9 +251,17 @@ namespace ctsTraffic { namespace ctsStatistics
             returnStats.m_endTime.SetValue(currentTime);
 
             returnStats.m_activeConnectionCount.SetValue(m_activeConnectionCount.GetValue());
+            returnStats.m_establishedCount.SetValue(m_establishedCount.GetValue());
             returnStats.m_successfulCompletionCount.SetValue(m_successfulCompletionCount.GetValue());
             returnStats.m_connectionErrorCount.SetValue(m_connectionErrorCount.GetValue());
             returnStats.m_protocolErrorCount.SetValue(m_protocolErrorCount.GetValue());
+            returnStats.m_acceptQueueEmptyCount.SetValue(m_acceptQueueEmptyCount.GetValue());
+            returnStats.m_brokerTransitionCount.SetValue(m_brokerTransitionCount.GetValue());
+            returnStats.m_brokerRefreshCount.SetValue(m_brokerRefreshCount.GetValue());
+            returnStats.m_stalledConnectionCount.SetValue(m_stalledConnectionCount.GetValue());
+            returnStats.m_stallCount.SetValue(m_stallCount.GetValue());
+            returnStats.m_stallTimeMs.SetValue(m_stallTimeMs.GetValue());
+            returnStats.m_completedIoCount.SetValue(m_completedIoCount.GetValue());
 
             return returnStats;
         }
@@ -254,6 +276,20 @@ namespace ctsTraffic { namespace ctsStatistics
         ctsStatsTracking m_droppedFrames;
         ctsStatsTracking m_duplicateFrames;
         ctsStatsTracking m_errorFrames;
+        // jitter between consecutive rendered frames, split by where it was introduced
+        // - network jitter is measured from the network stack receive timestamps
+        // - host jitter is the change in delay between the network stack and ctsTraffic processing the frame
+        ctsStatsTracking m_networkJitterMicroseconds;
+        ctsStatsTracking m_hostJitterMicroseconds;
+        ctsStatsTracking m_jitterSamples;
+        // set once the stream ends, from the stream's ctsMediaStreamQuality
+        ctsStatsTracking m_rfc3550JitterUsec;
+        ctsStatsTracking m_delayVariationP50Usec;
+        ctsStatsTracking m_delayVariationP99Usec;
+        ctsStatsTracking m_lateFrames;
+        ctsStatsTracking m_reorderedFrames;
+        ctsStatsTracking m_lossRunCount;
+        ctsStatsTracking m_longestLossRun;
         // unique connection identifier
         char m_connectionIdentifier[ctsStatistics::ConnectionIdLength]{};
 
@@ -296,6 +332,9 @@ namespace ctsTraffic { namespace ctsStatistics
                 returnStats.m_droppedFrames.SetValue(m_droppedFrames.SnapValueDifference());
                 returnStats.m_duplicateFrames.SetValue(m_duplicateFrames.SnapValueDifference());
                 returnStats.m_errorFrames.SetValue(m_errorFrames.SnapValueDifference());
+                returnStats.m_networkJitterMicroseconds.SetValue(m_networkJitterMicroseconds.SnapValueDifference());
+                returnStats.m_hostJitterMicroseconds.SetValue(m_hostJitterMicroseconds.SnapValueDifference());
+                returnStats.m_jitterSamples.SetValue(m_jitterSamples.SnapValueDifference());
             }
             else
             {
@@ -304,6 +343,9 @@ namespace ctsTraffic { namespace ctsStatistics
                 returnStats.m_droppedFrames.SetValue(m_droppedFrames.ReadValueDifference());
                 returnStats.m_duplicateFrames.SetValue(m_duplicateFrames.ReadValueDifference());
                 returnStats.m_errorFrames.SetValue(m_errorFrames.ReadValueDifference());
+                returnStats.m_networkJitterMicroseconds.SetValue(m_networkJitterMicroseconds.ReadValueDifference());
+                returnStats.m_hostJitterMicroseconds.SetValue(m_hostJitterMicroseconds.ReadValueDifference());
+                returnStats.m_jitterSamples.SetValue(m_jitterSamples.ReadValueDifference());
             }
 
             return returnStats;
@@ -316,6 +358,12 @@ namespace ctsTraffic { namespace ctsStatistics
         ctsStatsTracking m_endTime;
         ctsStatsTracking m_bytesSent;
         ctsStatsTracking m_bytesRecv;
+        // the connect handshake time when this side made the connection
+        ctsStatsTracking m_connectLatencyUsec;
+        // periods with IO outstanding but no bytes transferred (see ctsThroughputTimeline)
+        ctsStatsTracking m_stallCount;
+        ctsStatsTracking m_stallTimeMs;
+        ctsStatsTracking m_longestStallMs;
         // unique connection identifier
         char m_connectionIdentifier[ctsStatistics::ConnectionIdLength]{};
 
@@ -369,4 +417,601 @@ namespace ctsTraffic { namespace ctsStatistics
             return returnStats;
         }
     };
+
+    //
+    // log-linear histogram of round-trip times, in microseconds
+    // - values below c_subBucketCount are tracked exactly
+    // - every power of 2 above that is split into c_subBucketCount linear buckets
+    //   bounding the error of a reported percentile to 1/c_subBucketCount (12.5%) of the value
+    //
+    // not thread-safe: the owning IO pattern updates it under its own lock
+    //
+    class ctsRoundTripHistogram
+    {
+    public:
+        static constexpr uint32_t c_subBucketBits = 3;
+        static constexpr uint32_t c_subBucketCount = 1UL << c_subBucketBits;
+        static constexpr uint32_t c_bucketCount = c_subBucketCount + (64 - c_subBucketBits) * c_subBucketCount;
+
+        void AddSample(uint64_t microseconds) noexcept
+        {
+            ++m_buckets[BucketIndex(microseconds)];
+            if (0 == m_count || microseconds < m_min)
+            {
+                m_min = microseconds;
+            }
+            if (microseconds > m_max)
+            {
+                m_max = microseconds;
+            }
+            m_sum += microseconds;
+            ++m_count;
+        }
+
+        void AddSamples(uint64_t microseconds, uint64_t count) noexcept
+        {
+            if (0 == count)
+            {
+                return;
+            }
+            m_buckets[BucketIndex(microseconds)] += count;
+            if (0 == m_count || microseconds < m_min)
+            {
+                m_min = microseconds;
+            }
+            if (microseconds > m_max)
+            {
+                m_max = microseconds;
+            }
+            m_sum += microseconds * count;
+            m_count += count;
+        }
+
+        // calls function(value, count) for each bucket with samples
+        // - the value is the bucket's upper bound, kept within [min, max] as GetPercentile reports it
+        template <typename T>
+        void ForEachBucket(T&& function) const noexcept
+        {
+            for (uint32_t index = 0; index < c_bucketCount && m_count > 0; ++index)
+            {
+                if (m_buckets[index] > 0)
+                {
+                    auto value = BucketUpperBound(index);
+                    if (value < m_min)
+                    {
+                        value = m_min;
+                    }
+                    else if (value > m_max)
+                    {
+                        value = m_max;
+                    }
+                    function(value, m_buckets[index]);
+                }
+            }
+        }
+
+        [[nodiscard]] uint64_t GetCount() const noexcept
+        {
+            return m_count;
+        }
+
+        [[nodiscard]] uint64_t GetMin() const noexcept
+        {
+            return m_min;
+        }
+
+        [[nodiscard]] uint64_t GetMax() const noexcept
+        {
+            return m_max;
+        }
+
+        [[nodiscard]] uint64_t GetMean() const noexcept
+        {
+            return m_count > 0 ? m_sum / m_count : 0;
+        }
+
+        [[nodiscard]] uint64_t GetSum() const noexcept
+        {
+            return m_sum;
+        }
+
+        void CopyBuckets(uint64_t (&buckets)[c_bucketCount]) const noexcept
+        {
+            memcpy_s(buckets, sizeof buckets, m_buckets, sizeof m_buckets);
+        }
+
+        void Merge(const ctsRoundTripHistogram& other) noexcept
+        {
+            if (0 == other.m_count)
+            {
+                return;
+            }
+            for (uint32_t index = 0; index < c_bucketCount; ++index)
+            {
+                m_buckets[index] += other.m_buckets[index];
+            }
+            if (0 == m_count || other.m_min < m_min)
+            {
+                m_min = other.m_min;
+            }
+            if (other.m_max > m_max)
+            {
+                m_max = other.m_max;
+            }
+            m_sum += other.m_sum;
+            m_count += other.m_count;
+        }
+
+        // returns the upper bound of the bucket holding the requested percentile (0.0 - 100.0)
+        // - clamped to the exact min and max values seen
+        [[nodiscard]] uint64_t GetPercentile(double percentile) const noexcept
+        {
+            if (0 == m_count)
+            {
+                return 0;
+            }
+
+            auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(m_count)));
+            if (rank < 1)
+            {
+                rank = 1;
+            }
+            else if (rank > m_count)
+            {
+                rank = m_count;
+            }
+
+            uint64_t seen = 0;
+            for (uint32_t index = 0; index < c_bucketCount; ++index)
+            {
+                seen += m_buckets[index];
+                if (seen >= rank)
+                {
+                    const auto upperBound = BucketUpperBound(index);
+                    if (upperBound < m_min)
+                    {
+                        return m_min;
+                    }
+                    return upperBound > m_max ? m_max : upperBound;
+                }
+            }
+            return m_max;
+        }
+
+        static uint32_t BucketIndex(uint64_t value) noexcept
+        {
+            if (value < c_subBucketCount)
+            {
+                return static_cast<uint32_t>(value);
+            }
+
+            unsigned long mostSignificantBit{};
+            _BitScanReverse64(&mostSignificantBit, value);
+            const auto shift = mostSignificantBit - c_subBucketBits;
+            const auto subBucket = static_cast<uint32_t>(value >> shift) & (c_subBucketCount - 1);
+            return c_subBucketCount + shift * c_subBucketCount + subBucket;
+        }
+
+        static uint64_t BucketUpperBound(uint32_t index) noexcept
+        {
+            if (index < c_subBucketCount)
+            {
+                return index;
+            }
+
+            const auto shift = (index - c_subBucketCount) / c_subBucketCount;
+            const auto subBucket = (index - c_subBucketCount) % c_subBucketCount;
+            const auto lowerBound = static_cast<uint64_t>(c_subBucketCount + subBucket) << shift;
+            return lowerBound + ((1ULL << shift) - 1);
+        }
+
+    private:
+        uint64_t m_buckets[c_bucketCount]{};
+        uint64_t m_count = 0;
+        uint64_t m_min = 0;
+        uint64_t m_max = 0;
+        uint64_t m_sum = 0;
+    };
+
+    //
+    // the bytes a connection transferred in each fixed interval, for the most recent c_intervalCount intervals
+    // - intervals are numbered from the time passed to Start
+    //
+    // a stall is a period with IO outstanding but no bytes transferred which spans at least one whole interval
+    // - the caller passes when its IO became outstanding, so time spent with no IO requested
+    //   (e.g. waiting on a rate limit) is not counted as stalled
+    //
+    // not thread-safe: the owning IO pattern updates it under its own lock
+    //
+    class ctsThroughputTimeline
+    {
+    public:
+        static constexpr uint32_t c_intervalCount = 64;
+
+        void Start(int64_t startTimeMs, int64_t intervalMs) noexcept
+        {
+            m_startTimeMs = startTimeMs;
+            m_intervalMs = intervalMs > 0 ? intervalMs : 1;
+            m_lastProgressMs = startTimeMs;
+            m_currentInterval = 0;
+            m_started = true;
+        }
+
+        [[nodiscard]] bool IsStarted() const noexcept
+        {
+            return m_started;
+        }
+
+        // ioOutstandingSinceMs is when the IO outstanding at nowMs was requested
+        void RecordProgress(int64_t nowMs, uint64_t bytes, int64_t ioOutstandingSinceMs) noexcept
+        {
+            if (!m_started || nowMs < m_startTimeMs)
+            {
+                return;
+            }
+
+            RecordStall(nowMs, ioOutstandingSinceMs);
+
+            AdvanceTo(IntervalOf(nowMs));
+            m_intervalBytes[m_currentInterval % c_intervalCount] += bytes;
+            m_lastProgressMs = nowMs;
+        }
+
+        // called when the connection closes with IO still outstanding (requested at ioOutstandingSinceMs)
+        // - no progress will follow to end that wait, so it's counted now if it already spans a whole interval
+        void RecordClose(int64_t nowMs, int64_t ioOutstandingSinceMs) noexcept
+        {
+            if (!m_started || nowMs < m_startTimeMs)
+            {
+                return;
+            }
+
+            RecordStall(nowMs, ioOutstandingSinceMs);
+            // the wait has been counted: a second call will not count it again
+            m_lastProgressMs = nowMs;
+        }
+
+        [[nodiscard]] uint64_t GetStallCount() const noexcept
+        {
+            return m_stallCount;
+        }
+
+        [[nodiscard]] int64_t GetStallTimeMs() const noexcept
+        {
+            return m_stallTimeMs;
+        }
+
+        [[nodiscard]] int64_t GetLongestStallMs() const noexcept
+        {
+            return m_longestStallMs;
+        }
+
+        [[nodiscard]] int64_t GetIntervalMs() const noexcept
+        {
+            return m_intervalMs;
+        }
+
+        // the number of intervals GetIntervalBytes can return (up to c_intervalCount)
+        [[nodiscard]] uint32_t GetIntervalCount() const noexcept
+        {
+            if (!m_started)
+            {
+                return 0;
+            }
+            return m_currentInterval + 1 < c_intervalCount ? static_cast<uint32_t>(m_currentInterval + 1) : c_intervalCount;
+        }
+
+        // age 0 is the most recent interval with progress
+        [[nodiscard]] uint64_t GetIntervalBytes(uint32_t age) const noexcept
+        {
+            if (age >= GetIntervalCount())
+            {
+                return 0;
+            }
+            return m_intervalBytes[(m_currentInterval - age) % c_intervalCount];
+        }
+
+    private:
+        uint64_t m_intervalBytes[c_intervalCount]{};
+        int64_t m_startTimeMs = 0;
+        int64_t m_intervalMs = 1;
+        int64_t m_lastProgressMs = 0;
+        uint64_t m_currentInterval = 0;
+        uint64_t m_stallCount = 0;
+        int64_t m_stallTimeMs = 0;
+        int64_t m_longestStallMs = 0;
+        bool m_started = false;
+
+        void RecordStall(int64_t nowMs, int64_t ioOutstandingSinceMs) noexcept
+        {
+            const auto stallStartMs = ioOutstandingSinceMs > m_lastProgressMs ? ioOutstandingSinceMs : m_lastProgressMs;
+            if (stallStartMs >= m_startTimeMs && nowMs > stallStartMs)
+            {
+                // whole intervals strictly between the start of the wait and now
+                const auto emptyIntervals = static_cast<int64_t>(IntervalOf(nowMs) - IntervalOf(stallStartMs)) - 1;
+                if (emptyIntervals > 0)
+                {
+                    const auto stallMs = nowMs - stallStartMs;
+                    ++m_stallCount;
+                    m_stallTimeMs += stallMs;
+                    if (stallMs > m_longestStallMs)
+                    {
+                        m_longestStallMs = stallMs;
+                    }
+                }
+            }
+        }
+
+        [[nodiscard]] uint64_t IntervalOf(int64_t timeMs) const noexcept
+        {
+            return static_cast<uint64_t>((timeMs - m_startTimeMs) / m_intervalMs);
+        }
+
+        // clears the slots of intervals skipped without progress
+        void AdvanceTo(uint64_t interval) noexcept
+        {
+            if (interval <= m_currentInterval)
+            {
+                return;
+            }
+            const auto skipped = interval - m_currentInterval;
+            for (uint64_t clear = 1; clear <= skipped && clear <= c_intervalCount; ++clear)
+            {
+                m_intervalBytes[(m_currentInterval + clear) % c_intervalCount] = 0;
+            }
+            m_currentInterval = interval;
+        }
+    };
+
+    //
+    // streaming quality statistics for a media stream, updated as each datagram arrives and each frame is rendered
+    // - interarrival jitter as defined in RFC 3550 (6.4.1), in arrival order
+    // - delay variation: each datagram's transit time above the lowest transit time of its stream (RFC 5481 PDV)
+    //   sender and receiver clocks need not be synchronized as their offset cancels out
+    //   transit times are kept relative to the first datagram, so all are measured from the stream's final minimum
+    // - reordering: datagrams arriving after one with a higher sequence number, and how far behind they were
+    // - late frames: datagrams arriving after their frame was already rendered
+    // - loss runs: consecutive frames rendered as dropped, bucketed by run length 1, 2-3, 4-7, ... 128+
+    //
+    // once EndStream is called, the statistics of many streams can be Merged for a summary of all streams
+    //
+    // not thread-safe: the owning IO pattern updates it under its own lock
+    //
+    class ctsMediaStreamQuality
+    {
+    public:
+        static constexpr uint32_t c_lossRunBucketCount = 8;
+
+        // sequence numbers of datagrams from the same frame are equal, and are not counted as reordered
+        void RecordArrival(int64_t sequenceNumber, double senderUsec, double receiverUsec) noexcept
+        {
+            const auto transitUsec = receiverUsec - senderUsec;
+            if (m_arrivals > 0)
+            {
+                // J(i) = J(i-1) + (|D(i-1,i)| - J(i-1)) / 16
+                const auto difference = std::abs(transitUsec - m_previousTransitUsec);
+                m_jitterUsec += (difference - m_jitterUsec) / 16.0;
+
+                if (sequenceNumber < m_highestSequenceNumber)
+                {
+                    ++m_reorderedFrames;
+                    const auto depth = static_cast<uint64_t>(m_highestSequenceNumber - sequenceNumber);
+                    if (depth > m_maxReorderDepth)
+                    {
+                        m_maxReorderDepth = depth;
+                    }
+                }
+            }
+            else
+            {
+                m_firstTransitUsec = transitUsec;
+            }
+            if (0 == m_arrivals || sequenceNumber > m_highestSequenceNumber)
+            {
+                m_highestSequenceNumber = sequenceNumber;
+            }
+
+            if (transitUsec >= m_firstTransitUsec)
+            {
+                m_transitAboveFirst.AddSample(static_cast<uint64_t>(transitUsec - m_firstTransitUsec));
+            }
+            else
+            {
+                m_transitBelowFirst.AddSample(static_cast<uint64_t>(m_firstTransitUsec - transitUsec));
+            }
+            m_previousTransitUsec = transitUsec;
+            ++m_arrivals;
+        }
+
+        void RecordLateFrame() noexcept
+        {
+            ++m_lateFrames;
+        }
+
+        void RecordRenderedFrame(bool dropped) noexcept
+        {
+            if (dropped)
+            {
+                ++m_currentLossRun;
+            }
+            else
+            {
+                CloseLossRun();
+            }
+        }
+
+        // closes a loss run still open at the end of the stream, and captures its final jitter
+        void EndStream() noexcept
+        {
+            if (m_streamEnded)
+            {
+                return;
+            }
+            CloseLossRun();
+            AddDelayVariation(m_delayVariation);
+            m_transitAboveFirst = {};
+            m_transitBelowFirst = {};
+            if (m_arrivals > 1)
+            {
+                m_streamJitterSumUsec = m_jitterUsec;
+                m_maxStreamJitterUsec = m_jitterUsec;
+                m_jitterStreamCount = 1;
+            }
+            m_streamEnded = true;
+        }
+
+        // combines streams which have been ended
+        void Merge(const ctsMediaStreamQuality& other) noexcept
+        {
+            m_arrivals += other.m_arrivals;
+            m_delayVariation.Merge(other.GetDelayVariation());
+            m_lateFrames += other.m_lateFrames;
+            m_reorderedFrames += other.m_reorderedFrames;
+            if (other.m_maxReorderDepth > m_maxReorderDepth)
+            {
+                m_maxReorderDepth = other.m_maxReorderDepth;
+            }
+            for (uint32_t index = 0; index < c_lossRunBucketCount; ++index)
+            {
+                m_lossRuns[index] += other.m_lossRuns[index];
+            }
+            m_lossRunCount += other.m_lossRunCount;
+            if (other.m_longestLossRun > m_longestLossRun)
+            {
+                m_longestLossRun = other.m_longestLossRun;
+            }
+            m_streamJitterSumUsec += other.m_streamJitterSumUsec;
+            if (other.m_maxStreamJitterUsec > m_maxStreamJitterUsec)
+            {
+                m_maxStreamJitterUsec = other.m_maxStreamJitterUsec;
+            }
+            m_jitterStreamCount += other.m_jitterStreamCount;
+        }
+
+        [[nodiscard]] uint64_t GetArrivals() const noexcept
+        {
+            return m_arrivals;
+        }
+
+        // the current RFC 3550 jitter estimate of this stream
+        [[nodiscard]] double GetJitterUsec() const noexcept
+        {
+            return m_jitterUsec;
+        }
+
+        // the final RFC 3550 jitter of the ended streams
+        [[nodiscard]] uint64_t GetJitterStreamCount() const noexcept
+        {
+            return m_jitterStreamCount;
+        }
+
+        [[nodiscard]] double GetMeanStreamJitterUsec() const noexcept
+        {
+            return m_jitterStreamCount > 0 ? m_streamJitterSumUsec / static_cast<double>(m_jitterStreamCount) : 0.0;
+        }
+
+        [[nodiscard]] double GetMaxStreamJitterUsec() const noexcept
+        {
+            return m_maxStreamJitterUsec;
+        }
+
+        // a stream not yet ended is measured from its lowest transit time so far
+        [[nodiscard]] ctsRoundTripHistogram GetDelayVariation() const noexcept
+        {
+            ctsRoundTripHistogram delayVariation{m_delayVariation};
+            AddDelayVariation(delayVariation);
+            return delayVariation;
+        }
+
+        [[nodiscard]] uint64_t GetLateFrames() const noexcept
+        {
+            return m_lateFrames;
+        }
+
+        [[nodiscard]] uint64_t GetReorderedFrames() const noexcept
+        {
+            return m_reorderedFrames;
+        }
+
+        [[nodiscard]] uint64_t GetMaxReorderDepth() const noexcept
+        {
+            return m_maxReorderDepth;
+        }
+
+        [[nodiscard]] uint64_t GetLossRunCount() const noexcept
+        {
+            return m_lossRunCount;
+        }
+
+        [[nodiscard]] uint64_t GetLongestLossRun() const noexcept
+        {
+            return m_longestLossRun;
+        }
+
+        [[nodiscard]] uint64_t GetLossRuns(uint32_t bucket) const noexcept
+        {
+            return bucket < c_lossRunBucketCount ? m_lossRuns[bucket] : 0;
+        }
+
+        // bucket n holds runs of 2^n to 2^(n+1)-1 frames; the last bucket holds all longer runs
+        static uint32_t LossRunBucketIndex(uint64_t runLength) noexcept
+        {
+            uint32_t bucket = 0;
+            while (runLength > 1 && bucket < c_lossRunBucketCount - 1)
+            {
+                runLength >>= 1;
+                ++bucket;
+            }
+            return bucket;
+        }
+
+    private:
+        // of the ended streams
+        ctsRoundTripHistogram m_delayVariation;
+        // of the stream not yet ended, relative to the transit time of its first datagram
+        ctsRoundTripHistogram m_transitAboveFirst;
+        ctsRoundTripHistogram m_transitBelowFirst;
+        uint64_t m_lossRuns[c_lossRunBucketCount]{};
+        double m_jitterUsec = 0.0;
+        double m_previousTransitUsec = 0.0;
+        double m_firstTransitUsec = 0.0;
+        double m_streamJitterSumUsec = 0.0;
+        double m_maxStreamJitterUsec = 0.0;
+        int64_t m_highestSequenceNumber = 0;
+        uint64_t m_arrivals = 0;
+        uint64_t m_lateFrames = 0;
+        uint64_t m_reorderedFrames = 0;
+        uint64_t m_maxReorderDepth = 0;
+        uint64_t m_currentLossRun = 0;
+        uint64_t m_lossRunCount = 0;
+        uint64_t m_longestLossRun = 0;
+        uint64_t m_jitterStreamCount = 0;
+        bool m_streamEnded = false;
+
+        // adds the transit times of the stream not yet ended, less the lowest of them
+        void AddDelayVariation(ctsRoundTripHistogram& delayVariation) const noexcept
+        {
+            const auto firstAboveLowest = m_transitBelowFirst.GetCount() > 0 ? m_transitBelowFirst.GetMax() : 0;
+            m_transitAboveFirst.ForEachBucket([&](uint64_t aboveFirst, uint64_t count) noexcept {
+                delayVariation.AddSamples(firstAboveLowest + aboveFirst, count);
+            });
+            m_transitBelowFirst.ForEachBucket([&](uint64_t belowFirst, uint64_t count) noexcept {
+                delayVariation.AddSamples(firstAboveLowest - belowFirst, count);
+            });
+        }
+
+        void CloseLossRun() noexcept
+        {
+            if (m_currentLossRun > 0)
+            {
+                ++m_lossRuns[LossRunBucketIndex(m_currentLossRun)];
+                ++m_lossRunCount;
+                if (m_currentLossRun > m_longestLossRun)
+                {
+                    m_longestLossRun = m_currentLossRun;
+                }
+                m_currentLossRun = 0;
+            }
+        }
+    };
 }
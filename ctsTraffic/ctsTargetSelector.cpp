@@ -0,0 +1,349 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsTargetSelector.h"
+// cpp headers
+#include <cstdint>
+#include <memory>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <WinSock2.h>
+// wil headers
+#include <wil/resource.h>
+// ctl headers
+#include <ctRandom.hpp>
+#include <ctSockaddr.hpp>
+#include <ctTimer.hpp>
+// project headers
+#include "ctsConfig.h"
+
+namespace ctsTraffic
+{
+    namespace details
+    {
+        struct ctsTargetState
+        {
+            int64_t m_weight = 1;
+            // the running weight for the smooth weighted round-robin
+            int64_t m_currentWeight = 0;
+
+            uint32_t m_activeCount = 0;
+            // the time this target has had at least one connection open, for its Bytes/sec
+            int64_t m_activeSinceMs = 0;
+            int64_t m_activeTimeMs = 0;
+            uint64_t m_successfulCount = 0;
+            uint64_t m_errorCount = 0;
+            int64_t m_bytesTransferred = 0;
+
+            // a moving average of the connect latency, weighting each new sample 1/8
+            int64_t m_connectLatencyUsec = 0;
+            uint64_t m_connectLatencySamples = 0;
+        };
+
+        struct ctsTargetSelectorImpl
+        {
+            wil::critical_section m_lock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock};
+            // indexed the same as TargetAddresses
+            std::vector<ctsTargetState> m_targets;
+            // scratch space for the targets of the requested family - reserved to avoid allocating on each Select
+            std::vector<size_t> m_eligible;
+            uint64_t m_counter = 0;
+            ctl::ctRandomTwister m_random;
+        };
+
+        static ctsTargetSelectorImpl g_targetSelector; // NOLINT(clang-diagnostic-exit-time-destructors)
+        // ReSharper disable once CppZeroConstantCanBeReplacedWithNullptr
+        static INIT_ONCE g_targetSelectorInitOnce = INIT_ONCE_STATIC_INIT;
+
+        static BOOL CALLBACK ctsTargetSelectorInitFn(PINIT_ONCE, PVOID, PVOID*) noexcept try
+        {
+            const auto targetCount = ctsConfig::g_configSettings->TargetAddresses.size();
+            g_targetSelector.m_targets.resize(targetCount);
+            g_targetSelector.m_eligible.reserve(targetCount);
+            // ctsConfig guarantees there is a weight for each target when they're specified
+            const auto& weights = ctsConfig::g_configSettings->TargetWeights;
+            for (size_t index = 0; index < weights.size() && index < targetCount; ++index)
+            {
+                g_targetSelector.m_targets[index].m_weight = weights[index];
+            }
+            return TRUE;
+        }
+        catch (...)
+        {
+            ctsConfig::PrintThrownException();
+            return FALSE;
+        }
+
+        static void AddActiveConnection(ctsTargetState& target) noexcept
+        {
+            if (0 == target.m_activeCount++)
+            {
+                target.m_activeSinceMs = ctl::ctTimer::snap_qpc_as_msec();
+            }
+        }
+
+        static void RemoveActiveConnection(ctsTargetState& target) noexcept
+        {
+            if (0 == --target.m_activeCount)
+            {
+                target.m_activeTimeMs += ctl::ctTimer::snap_qpc_as_msec() - target.m_activeSinceMs;
+            }
+        }
+
+        static size_t SelectRoundRobin() noexcept
+        {
+            const auto& eligible = g_targetSelector.m_eligible;
+            return eligible[g_targetSelector.m_counter++ % eligible.size()];
+        }
+
+        static size_t SelectLeastActive() noexcept
+        {
+            // start from a rotating position so ties are spread across the targets
+            const auto& eligible = g_targetSelector.m_eligible;
+            const auto start = g_targetSelector.m_counter++;
+            auto selected = eligible[start % eligible.size()];
+            for (size_t offset = 1; offset < eligible.size(); ++offset)
+            {
+                const auto index = eligible[(start + offset) % eligible.size()];
+                if (g_targetSelector.m_targets[index].m_activeCount < g_targetSelector.m_targets[selected].m_activeCount)
+                {
+                    selected = index;
+                }
+            }
+            return selected;
+        }
+
+        static size_t SelectWeighted() noexcept
+        {
+            // smooth weighted round-robin: spreads the selections of heavier targets between the lighter ones
+            int64_t totalWeight = 0;
+            auto selected = g_targetSelector.m_eligible[0];
+            for (const auto index : g_targetSelector.m_eligible)
+            {
+                auto& target = g_targetSelector.m_targets[index];
+                target.m_currentWeight += target.m_weight;
+                totalWeight += target.m_weight;
+                if (target.m_currentWeight > g_targetSelector.m_targets[selected].m_currentWeight)
+                {
+                    selected = index;
+                }
+            }
+            g_targetSelector.m_targets[selected].m_currentWeight -= totalWeight;
+            return selected;
+        }
+
+        static size_t SelectLowestLatency()
+        {
+            const auto& eligible = g_targetSelector.m_eligible;
+            if (eligible.size() == 1)
+            {
+                return eligible[0];
+            }
+
+            // power of two choices: compare two distinct targets chosen at random
+            const auto lastEligible = eligible.size() - 1;
+            const auto first = g_targetSelector.m_random.uniform_int<size_t>(0, lastEligible);
+            auto second = g_targetSelector.m_random.uniform_int<size_t>(0, lastEligible - 1);
+            if (second >= first)
+            {
+                ++second;
+            }
+
+            const auto& firstTarget = g_targetSelector.m_targets[eligible[first]];
+            const auto& secondTarget = g_targetSelector.m_targets[eligible[second]];
+            // a target without a latency sample is chosen so it gets one
+            if (0 == firstTarget.m_connectLatencySamples)
+            {
+                return eligible[first];
+            }
+            if (0 == secondTarget.m_connectLatencySamples)
+            {
+                return eligible[second];
+            }
+            if (firstTarget.m_connectLatencyUsec == secondTarget.m_connectLatencyUsec)
+            {
+                return firstTarget.m_activeCount <= secondTarget.m_activeCount ? eligible[first] : eligible[second];
+            }
+            return firstTarget.m_connectLatencyUsec < secondTarget.m_connectLatencyUsec ? eligible[first] : eligible[second];
+        }
+    }
+
+    struct ctsTargetLease
+    {
+        size_t m_targetIndex = 0;
+
+        explicit ctsTargetLease(size_t targetIndex) noexcept :
+            m_targetIndex(targetIndex)
+        {
+        }
+
+        ~ctsTargetLease() noexcept
+        {
+            const auto lock = details::g_targetSelector.m_lock.lock();
+            details::RemoveActiveConnection(details::g_targetSelector.m_targets[m_targetIndex]);
+        }
+
+        ctsTargetLease(const ctsTargetLease&) = delete;
+        ctsTargetLease& operator=(const ctsTargetLease&) = delete;
+        ctsTargetLease(ctsTargetLease&&) = delete;
+        ctsTargetLease& operator=(ctsTargetLease&&) = delete;
+    };
+
+    namespace ctsTargetSelector
+    {
+        size_t Select(ADDRESS_FAMILY family, std::shared_ptr<ctsTargetLease>& lease) noexcept
+        {
+            const auto& targetAddresses = ctsConfig::g_configSettings->TargetAddresses;
+            if (!InitOnceExecuteOnce(&details::g_targetSelectorInitOnce, details::ctsTargetSelectorInitFn, nullptr, nullptr))
+            {
+                // fall back to the first target of the family without tracking the connection
+                // - ctsConfig guarantees each bind address family has at least one target of the same family
+                size_t index = 0;
+                while (family != AF_UNSPEC && targetAddresses[index].family() != family)
+                {
+                    ++index;
+                }
+                return index;
+            }
+
+            const auto lock = details::g_targetSelector.m_lock.lock();
+            auto& eligible = details::g_targetSelector.m_eligible;
+            eligible.clear();
+            for (size_t index = 0; index < targetAddresses.size(); ++index)
+            {
+                if (AF_UNSPEC == family || targetAddresses[index].family() == family)
+                {
+                    // capacity was reserved for every target
+                    eligible.push_back(index);
+                }
+            }
+            if (eligible.empty())
+            {
+                return 0;
+            }
+
+            size_t selected = 0;
+            try
+            {
+                switch (ctsConfig::g_configSettings->TargetPolicy)
+                {
+                    case ctsConfig::TargetPolicyType::LeastActive:
+                        selected = details::SelectLeastActive();
+                        break;
+
+                    case ctsConfig::TargetPolicyType::Weighted:
+                        selected = details::SelectWeighted();
+                        break;
+
+                    case ctsConfig::TargetPolicyType::LowestLatency:
+                        selected = details::SelectLowestLatency();
+                        break;
+
+                    case ctsConfig::TargetPolicyType::RoundRobin:
+                        [[fallthrough]];
+                    default: // NOLINT(clang-diagnostic-covered-switch-default)
+                        selected = details::SelectRoundRobin();
+                }
+
+                lease = std::make_shared<ctsTargetLease>(selected);
+                details::AddActiveConnection(details::g_targetSelector.m_targets[selected]);
+            }
+            catch (...)
+            {
+                // the connection is still made, just not tracked
+                ctsConfig::PrintThrownException();
+            }
+            return selected;
+        }
+
+        void RecordConnectLatency(ctsTargetLease& lease, int64_t microseconds) noexcept
+        {
+            if (microseconds < 0)
+            {
+                microseconds = 0;
+            }
+
+            const auto lock = details::g_targetSelector.m_lock.lock();
+            auto& target = details::g_targetSelector.m_targets[lease.m_targetIndex];
+            if (0 == target.m_connectLatencySamples)
+            {
+                target.m_connectLatencyUsec = microseconds;
+            }
+            else
+            {
+                target.m_connectLatencyUsec += (microseconds - target.m_connectLatencyUsec) / 8;
+            }
+            ++target.m_connectLatencySamples;
+        }
+
+        void RecordResult(ctsTargetLease& lease, uint32_t error, int64_t bytesTransferred) noexcept
+        {
+            const auto lock = details::g_targetSelector.m_lock.lock();
+            auto& target = details::g_targetSelector.m_targets[lease.m_targetIndex];
+            if (0 == error)
+            {
+                ++target.m_successfulCount;
+            }
+            else
+            {
+                ++target.m_errorCount;
+            }
+            target.m_bytesTransferred += bytesTransferred;
+        }
+
+        void PrintSummary() noexcept try
+        {
+            const auto& targetAddresses = ctsConfig::g_configSettings->TargetAddresses;
+            if (targetAddresses.size() < 2)
+            {
+                return;
+            }
+
+            const auto lock = details::g_targetSelector.m_lock.lock();
+            if (details::g_targetSelector.m_targets.empty())
+            {
+                return;
+            }
+
+            ctsConfig::PrintSummary(
+                L"\n"
+                L"  Per-Target Statistics\n"
+                L"-------------------------------------------------------------------------------\n");
+            const auto nowMs = ctl::ctTimer::snap_qpc_as_msec();
+            for (size_t index = 0; index < targetAddresses.size(); ++index)
+            {
+                const auto& target = details::g_targetSelector.m_targets[index];
+                // the rate while this target had connections open, not over the whole run
+                auto activeTimeMs = target.m_activeTimeMs;
+                if (target.m_activeCount > 0)
+                {
+                    activeTimeMs += nowMs - target.m_activeSinceMs;
+                }
+                ctsConfig::PrintSummary(
+                    L"  %ws : SuccessfulConnections [%llu] Errors [%llu] Bytes [%lld] Active [%lld ms] Bytes/sec [%lld] ConnectLatency [%lld us]\n",
+                    targetAddresses[index].writeCompleteAddress().c_str(),
+                    target.m_successfulCount,
+                    target.m_errorCount,
+                    target.m_bytesTransferred,
+                    activeTimeMs,
+                    activeTimeMs > 0 ? target.m_bytesTransferred * 1000LL / activeTimeMs : 0LL,
+                    target.m_connectLatencyUsec);
+            }
+        }
+        catch (...)
+        {
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <cstdint>
+#include <memory>
+// os headers
+#include <WinSock2.h>
+
+// The target selector chooses which of the -Target addresses each new client connection is made to (-TargetPolicy)
+// - roundrobin : each target in turn
+// - leastactive : the target with the fewest connections currently open
+// - weighted : in proportion to the -TargetWeights given for each target
+// - latency : the lower connect latency of two targets chosen at random (power of two choices)
+//
+// Statistics are tracked per target from each completed connection
+// - these drive the leastactive and latency policies, and are printed per target in the summary
+
+namespace ctsTraffic
+{
+    // tracks one connection to a target - the connection is no longer active once destroyed
+    struct ctsTargetLease;
+
+    namespace ctsTargetSelector
+    {
+        // returns the index into TargetAddresses for a new connection
+        // - family limits the choice to targets of that address family, or AF_UNSPEC for any target
+        // - lease is only set if it could be allocated : the connection is then not tracked
+        size_t Select(ADDRESS_FAMILY family, std::shared_ptr<ctsTargetLease>& lease) noexcept;
+
+        void RecordConnectLatency(ctsTargetLease& lease, int64_t microseconds) noexcept;
+        void RecordResult(ctsTargetLease& lease, uint32_t error, int64_t bytesTransferred) noexcept;
+
+        // Bytes/sec for each target is over the time it had at least one connection open
+        void PrintSummary() noexcept;
+    }
+}
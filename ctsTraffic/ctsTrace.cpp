@@ -0,0 +1,308 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+// parent header
+#include "ctsTrace.h"
+// cpp headers
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+// os headers
+#include <Windows.h>
+#include <intrin.h>
+// wil headers
+#include <wil/resource.h>
+// project headers
+#include "ctsConfig.h"
+
+namespace ctsTraffic::ctsTrace
+{
+    // {c21cae82-e297-59c9-6224-fc821b28bc71} is derived from the provider name, as ETW tools expect
+    TRACELOGGING_DEFINE_PROVIDER(
+        g_traceLoggingProvider,
+        "ctsTraffic",
+        (0xc21cae82, 0xe297, 0x59c9, 0x62, 0x24, 0xfc, 0x82, 0x1b, 0x28, 0xbc, 0x71));
+
+    // must be a power of 2: 768KB per thread
+    constexpr uint32_t c_ringEvents = 32768;
+    // each ring can sustain c_ringEvents / c_flushIntervalMs events per millisecond without dropping
+    constexpr DWORD c_flushIntervalMs = 20;
+
+    // a single-producer (the owning thread) single-consumer (the flush thread) ring
+    struct ctsTraceRing
+    {
+        // only written by the owning thread
+        alignas(64) std::atomic<uint64_t> m_written{0};
+        std::atomic<uint64_t> m_dropped{0};
+        // set by the owning thread as it exits: it will not write another event
+        std::atomic<bool> m_released{false};
+        // only written by the flush thread
+        alignas(64) std::atomic<uint64_t> m_read{0};
+        uint32_t m_threadId = 0;
+        ctsTraceEvent m_events[c_ringEvents]{};
+    };
+
+    // releases the ring when its thread exits, so it can be recycled once drained
+    struct ctsTraceRingOwner
+    {
+        ctsTraceRing* m_ring = nullptr;
+
+        ctsTraceRingOwner() noexcept = default;
+        ~ctsTraceRingOwner() noexcept
+        {
+            if (m_ring)
+            {
+                m_ring->m_released.store(true, std::memory_order_release);
+            }
+        }
+
+        ctsTraceRingOwner(const ctsTraceRingOwner&) = delete;
+        ctsTraceRingOwner& operator=(const ctsTraceRingOwner&) = delete;
+        ctsTraceRingOwner(ctsTraceRingOwner&&) = delete;
+        ctsTraceRingOwner& operator=(ctsTraceRingOwner&&) = delete;
+    };
+
+    // g_rings are owned by running threads (or released and not yet drained)
+    // g_freeRings were released and drained: they are handed to the next new thread instead of allocating another
+    static wil::critical_section g_ringLock{ctsConfig::ctsConfigSettings::c_CriticalSectionSpinlock}; // NOLINT(clang-diagnostic-exit-time-destructors)
+    static std::vector<std::unique_ptr<ctsTraceRing>> g_rings; // NOLINT(clang-diagnostic-exit-time-destructors)
+    static std::vector<std::unique_ptr<ctsTraceRing>> g_freeRings; // NOLINT(clang-diagnostic-exit-time-destructors)
+
+    static wil::unique_hfile g_traceFile; // NOLINT(clang-diagnostic-exit-time-destructors)
+    static wil::unique_event g_stopEvent; // NOLINT(clang-diagnostic-exit-time-destructors)
+    static wil::unique_handle g_flushThread; // NOLINT(clang-diagnostic-exit-time-destructors)
+    // only used by the flush thread, then by Stop() after the flush thread has exited
+    static std::vector<BYTE> g_writeBuffer; // NOLINT(clang-diagnostic-exit-time-destructors)
+
+    static int64_t ReadTimestamp() noexcept
+    {
+#if defined(_M_IX86) || defined(_M_X64)
+        return static_cast<int64_t>(__rdtsc());
+#else
+        LARGE_INTEGER qpc{};
+        QueryPerformanceCounter(&qpc);
+        return qpc.QuadPart;
+#endif
+    }
+
+    static ctsTraceRing* RegisterThread() noexcept
+    {
+        try
+        {
+            std::unique_ptr<ctsTraceRing> ring;
+            {
+                const auto lock = g_ringLock.lock();
+                if (!g_freeRings.empty())
+                {
+                    ring = std::move(g_freeRings.back());
+                    g_freeRings.pop_back();
+                }
+            }
+
+            if (ring)
+            {
+                // the flush thread no longer references a ring in the free list
+                ring->m_written.store(0, std::memory_order_relaxed);
+                ring->m_dropped.store(0, std::memory_order_relaxed);
+                ring->m_released.store(false, std::memory_order_relaxed);
+                ring->m_read.store(0, std::memory_order_relaxed);
+            }
+            else
+            {
+                ring = std::make_unique<ctsTraceRing>();
+            }
+            ring->m_threadId = GetCurrentThreadId();
+
+            const auto lock = g_ringLock.lock();
+            g_rings.emplace_back(std::move(ring));
+            return g_rings.rbegin()->get();
+        }
+        catch (...)
+        {
+            // this thread will try again on its next event
+            return nullptr;
+        }
+    }
+
+    static void AppendBytes(const void* bytes, size_t length)
+    {
+        const auto* const begin = static_cast<const BYTE*>(bytes);
+        g_writeBuffer.insert(g_writeBuffer.end(), begin, begin + length);
+    }
+
+    // moves everything recorded so far into the file
+    // - must only be called from one thread at a time
+    static void DrainRings() noexcept try
+    {
+        g_writeBuffer.clear();
+        {
+            const auto lock = g_ringLock.lock();
+            for (auto ringIterator = g_rings.begin(); ringIterator != g_rings.end();)
+            {
+                const auto& ring = *ringIterator;
+                // loaded before m_written: once released, the last event the thread wrote is visible
+                const auto released = ring->m_released.load(std::memory_order_acquire);
+                const auto written = ring->m_written.load(std::memory_order_acquire);
+                const auto read = ring->m_read.load(std::memory_order_relaxed);
+                if (written == read)
+                {
+                    if (released)
+                    {
+                        // its thread has exited and everything it wrote is in the file: stop scanning it
+                        g_freeRings.emplace_back(std::move(*ringIterator));
+                        ringIterator = g_rings.erase(ringIterator);
+                    }
+                    else
+                    {
+                        ++ringIterator;
+                    }
+                    continue;
+                }
+
+                LARGE_INTEGER qpc{};
+                QueryPerformanceCounter(&qpc);
+                ctsTraceChunkHeader chunk;
+                chunk.m_threadId = ring->m_threadId;
+                chunk.m_eventCount = static_cast<uint32_t>(written - read);
+                chunk.m_droppedEvents = ring->m_dropped.load(std::memory_order_relaxed);
+                chunk.m_qpc = qpc.QuadPart;
+                chunk.m_timestamp = ReadTimestamp();
+                AppendBytes(&chunk, sizeof chunk);
+
+                // the events can wrap around the end of the ring
+                const auto first = static_cast<uint32_t>(read & (c_ringEvents - 1));
+                const auto firstCount = (std::min)(chunk.m_eventCount, c_ringEvents - first);
+                AppendBytes(&ring->m_events[first], firstCount * sizeof(ctsTraceEvent));
+                AppendBytes(&ring->m_events[0], (chunk.m_eventCount - firstCount) * sizeof(ctsTraceEvent));
+
+                // the owning thread can now reuse these slots
+                ring->m_read.store(written, std::memory_order_release);
+                // a released ring is recycled on the next pass, after its events are written to the file
+                ++ringIterator;
+            }
+        }
+
+        if (!g_writeBuffer.empty())
+        {
+            DWORD bytesWritten{};
+            LOG_LAST_ERROR_IF(!WriteFile(
+                g_traceFile.get(),
+                g_writeBuffer.data(),
+                static_cast<DWORD>(g_writeBuffer.size()),
+                &bytesWritten,
+                nullptr));
+        }
+    }
+    catch (...)
+    {
+        // the events stay in their rings for the next attempt
+    }
+
+    static DWORD WINAPI FlushThread(LPVOID) noexcept
+    {
+        while (WaitForSingleObject(g_stopEvent.get(), c_flushIntervalMs) == WAIT_TIMEOUT)
+        {
+            DrainRings();
+        }
+        return 0;
+    }
+
+    void Start()
+    {
+        THROW_IF_FAILED(TraceLoggingRegister(g_traceLoggingProvider));
+
+        if (ctsConfig::g_configSettings->TraceFilename.empty())
+        {
+            return;
+        }
+
+        g_traceFile.reset(CreateFileW(
+            ctsConfig::g_configSettings->TraceFilename.c_str(),
+            GENERIC_WRITE,
+            FILE_SHARE_READ, // allow others to read the file while we write to it
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr));
+        THROW_LAST_ERROR_IF_MSG(!g_traceFile.is_valid(), "CreateFile (-TraceFilename)");
+
+        ctsTraceFileHeader header;
+        header.m_chunkHeaderSize = sizeof(ctsTraceChunkHeader);
+        header.m_eventSize = sizeof(ctsTraceEvent);
+        LARGE_INTEGER qpc{};
+        QueryPerformanceFrequency(&qpc);
+        header.m_qpcFrequency = qpc.QuadPart;
+        QueryPerformanceCounter(&qpc);
+        header.m_qpcStart = qpc.QuadPart;
+        header.m_timestampStart = ReadTimestamp();
+
+        DWORD bytesWritten{};
+        THROW_LAST_ERROR_IF(!WriteFile(g_traceFile.get(), &header, sizeof header, &bytesWritten, nullptr));
+
+        g_stopEvent.create(wil::EventOptions::ManualReset);
+        g_flushThread.reset(CreateThread(nullptr, 0, FlushThread, nullptr, 0, nullptr));
+        THROW_LAST_ERROR_IF_MSG(!g_flushThread, "CreateThread (-TraceFilename)");
+        g_traceEnabled = true;
+    }
+
+    void Stop() noexcept
+    {
+        // the TraceLogging provider is deliberately left registered until the process exits
+        // - IO can still be completing on other threads, and it can't be unregistered while they write events
+
+        if (!g_flushThread)
+        {
+            return;
+        }
+
+        g_stopEvent.SetEvent();
+        WaitForSingleObject(g_flushThread.get(), INFINITE);
+        g_flushThread.reset();
+
+        // anything recorded after this point stays in the rings
+        DrainRings();
+        g_traceFile.reset();
+    }
+
+    void RecordEvent(ctsTraceEventType type, uint64_t connection, uint32_t value, uint16_t detail) noexcept
+    {
+        thread_local ctsTraceRingOwner t_ringOwner;
+        if (!t_ringOwner.m_ring)
+        {
+            t_ringOwner.m_ring = RegisterThread();
+            if (!t_ringOwner.m_ring)
+            {
+                return;
+            }
+        }
+        ctsTraceRing* const ring = t_ringOwner.m_ring;
+
+        const auto written = ring->m_written.load(std::memory_order_relaxed);
+        if (written - ring->m_read.load(std::memory_order_acquire) >= c_ringEvents)
+        {
+            ring->m_dropped.store(ring->m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto& event = ring->m_events[written & (c_ringEvents - 1)];
+        event.m_timestamp = ReadTimestamp();
+        event.m_connection = connection;
+        event.m_value = value;
+        event.m_type = type;
+        event.m_detail = detail;
+        // publishes the event to the flush thread
+        ring->m_written.store(written + 1, std::memory_order_release);
+    }
+}
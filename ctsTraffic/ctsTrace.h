@@ -0,0 +1,251 @@
+/*
+
+Copyright (c) Microsoft Corporation
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the ""License""); you may not use this file except in compliance with the License. You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+
+THIS CODE IS PROVIDED ON AN  *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+
+See the Apache Version 2.0 License for specific language governing permissions and limitations under the License.
+
+*/
+
+#pragma once
+
+// cpp headers
+#include <cstdint>
+// os headers
+#include <Windows.h>
+#include <TraceLoggingProvider.h>
+
+// With -TraceFilename every connection's IO, timers and state changes are recorded as compact events
+// - each thread records into its own ring buffer: no lock or interlocked operation is taken per event
+// - a dedicated thread drains the rings into the file every c_flushIntervalMs
+// - if a ring fills before it's drained, new events on that thread are dropped (and counted)
+// - when a thread exits, its ring is recycled for the next new thread once drained
+// - timestamps are the processor's TSC where available (QPC otherwise); each chunk of events
+//   carries a QPC / timestamp pair so the converter can place them on a common timeline
+//
+// ctsLogConverter writes a Chrome / Perfetto trace (json) from the file
+//
+// Every tracepoint is also a TraceLogging event from the "ctsTraffic" ETW provider
+// ({c21cae82-e297-59c9-6224-fc821b28bc71}, the name-derived guid), so ETW tools (xperf, wpr, tracelog, PerfView)
+// can attach to a running ctsTraffic without -TraceFilename and without restarting it
+// - e.g. tracelog -start cts -guid *ctsTraffic -f cts.etl ... tracelog -stop cts
+//
+// When neither is enabled, a tracepoint is a test of g_traceEnabled and of the provider's enabled level
+
+namespace ctsTraffic::ctsTrace
+{
+    enum class ctsTraceEventType : uint16_t
+    {
+        // detail : ctsTaskAction, value : bytes requested
+        IoInitiated = 1,
+        // detail : ctsTaskAction, value : bytes transferred
+        IoCompleted = 2,
+        // detail : ctsTaskAction, value : the error
+        IoFailed = 3,
+        // detail : ctsTaskAction, value : milliseconds until it fires
+        TimerArmed = 4,
+        // detail : ctsTaskAction
+        TimerFired = 5,
+        // detail : ctsSocketState::InternalState being entered
+        SocketState = 6,
+        // value : sockets tracked by the broker after the refresh
+        BrokerRefresh = 7,
+        // value : the frame's sequence number (the low 32 bits)
+        MediaFrameSent = 8,
+        // value : the frame's sequence number (the low 32 bits)
+        MediaFrameReceived = 9
+    };
+
+    // keywords on the TraceLogging events, to enable a subset of them
+    constexpr ULONGLONG c_keywordIo = 0x1;
+    constexpr ULONGLONG c_keywordTimer = 0x2;
+    constexpr ULONGLONG c_keywordSocketState = 0x4;
+    constexpr ULONGLONG c_keywordBroker = 0x8;
+    constexpr ULONGLONG c_keywordMediaStream = 0x10;
+
+    TRACELOGGING_DECLARE_PROVIDER(g_traceLoggingProvider);
+
+    // the file is a ctsTraceFileHeader followed by any number of chunks:
+    // a ctsTraceChunkHeader followed by m_eventCount ctsTraceEvents from that thread
+    struct ctsTraceFileHeader
+    {
+        static constexpr uint32_t c_signature = 0x54535443; // "CTST"
+        static constexpr uint16_t c_currentVersion = 1;
+
+        uint32_t m_signature = c_signature;
+        uint16_t m_version = c_currentVersion;
+        uint16_t m_headerSize = sizeof(ctsTraceFileHeader);
+        uint32_t m_chunkHeaderSize = 0;
+        uint32_t m_eventSize = 0;
+        int64_t m_qpcFrequency = 0;
+        // QPC and the event timestamp read together when tracing started
+        int64_t m_qpcStart = 0;
+        int64_t m_timestampStart = 0;
+        uint8_t m_padding[24]{};
+    };
+    static_assert(sizeof(ctsTraceFileHeader) == 64);
+
+    struct ctsTraceChunkHeader
+    {
+        uint32_t m_threadId = 0;
+        uint32_t m_eventCount = 0;
+        // events dropped on this thread since tracing started
+        uint64_t m_droppedEvents = 0;
+        // QPC and the event timestamp read together when the chunk was written
+        int64_t m_qpc = 0;
+        int64_t m_timestamp = 0;
+    };
+    static_assert(sizeof(ctsTraceChunkHeader) == 32);
+
+    struct ctsTraceEvent
+    {
+        int64_t m_timestamp = 0;
+        // the address of the connection's ctsSocketState
+        // - the broker for BrokerRefresh, the ctsMediaStreamServerConnectedSocket for MediaFrameSent
+        uint64_t m_connection = 0;
+        uint32_t m_value = 0;
+        ctsTraceEventType m_type{};
+        uint16_t m_detail = 0;
+    };
+    static_assert(sizeof(ctsTraceEvent) == 24);
+
+    // set once by Start() before any connection is created
+    inline bool g_traceEnabled = false;
+
+    // registers the TraceLogging provider
+    // and creates the file and the flush thread when -TraceFilename is specified
+    // - throws wil::ResultException or std::bad_alloc on failure
+    void Start();
+
+    // stops recording, writes out everything recorded, and closes the file
+    void Stop() noexcept;
+
+    void RecordEvent(ctsTraceEventType type, uint64_t connection, uint32_t value, uint16_t detail) noexcept;
+
+    inline void Trace(ctsTraceEventType type, uint64_t connection, uint32_t value = 0, uint16_t detail = 0) noexcept
+    {
+        if (g_traceEnabled)
+        {
+            RecordEvent(type, connection, value, detail);
+        }
+    }
+
+    inline uint64_t TraceId(const void* connection) noexcept
+    {
+        return reinterpret_cast<uint64_t>(connection);
+    }
+
+    // the tracepoints: each records into the -TraceFilename rings and writes its TraceLogging event
+    // - action is a ctsTaskAction, state is a ctsSocketState::InternalState
+    inline void TraceIoInitiated(uint64_t connection, uint16_t action, uint32_t bytes) noexcept
+    {
+        Trace(ctsTraceEventType::IoInitiated, connection, bytes, action);
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "IoInitiated",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(c_keywordIo),
+            TraceLoggingUInt64(connection, "Connection"),
+            TraceLoggingUInt16(action, "Action"),
+            TraceLoggingUInt32(bytes, "Bytes"));
+    }
+
+    inline void TraceIoCompleted(uint64_t connection, uint16_t action, uint32_t bytes, uint32_t error) noexcept
+    {
+        if (0 == error)
+        {
+            Trace(ctsTraceEventType::IoCompleted, connection, bytes, action);
+        }
+        else
+        {
+            Trace(ctsTraceEventType::IoFailed, connection, error, action);
+        }
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "IoCompleted",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(c_keywordIo),
+            TraceLoggingUInt64(connection, "Connection"),
+            TraceLoggingUInt16(action, "Action"),
+            TraceLoggingUInt32(bytes, "Bytes"),
+            TraceLoggingWinError(error, "Error"));
+    }
+
+    inline void TraceTimerArmed(uint64_t connection, uint16_t action, uint32_t milliseconds) noexcept
+    {
+        Trace(ctsTraceEventType::TimerArmed, connection, milliseconds, action);
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "TimerArmed",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(c_keywordTimer),
+            TraceLoggingUInt64(connection, "Connection"),
+            TraceLoggingUInt16(action, "Action"),
+            TraceLoggingUInt32(milliseconds, "Milliseconds"));
+    }
+
+    inline void TraceTimerFired(uint64_t connection, uint16_t action) noexcept
+    {
+        Trace(ctsTraceEventType::TimerFired, connection, 0, action);
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "TimerFired",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(c_keywordTimer),
+            TraceLoggingUInt64(connection, "Connection"),
+            TraceLoggingUInt16(action, "Action"));
+    }
+
+    inline void TraceSocketState(uint64_t connection, uint16_t state) noexcept
+    {
+        Trace(ctsTraceEventType::SocketState, connection, 0, state);
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "SocketState",
+            TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+            TraceLoggingKeyword(c_keywordSocketState),
+            TraceLoggingUInt64(connection, "Connection"),
+            TraceLoggingUInt16(state, "State"));
+    }
+
+    inline void TraceBrokerRefresh(uint64_t broker, uint32_t socketCount) noexcept
+    {
+        Trace(ctsTraceEventType::BrokerRefresh, broker, socketCount);
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "BrokerRefresh",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(c_keywordBroker),
+            TraceLoggingUInt32(socketCount, "SocketCount"));
+    }
+
+    inline void TraceMediaFrameSent(uint64_t connection, int64_t sequenceNumber, uint32_t bytes) noexcept
+    {
+        Trace(ctsTraceEventType::MediaFrameSent, connection, static_cast<uint32_t>(sequenceNumber));
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "MediaFrameSent",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(c_keywordMediaStream),
+            TraceLoggingUInt64(connection, "Connection"),
+            TraceLoggingInt64(sequenceNumber, "SequenceNumber"),
+            TraceLoggingUInt32(bytes, "Bytes"));
+    }
+
+    inline void TraceMediaFrameReceived(uint64_t connection, int64_t sequenceNumber, uint32_t bytes) noexcept
+    {
+        Trace(ctsTraceEventType::MediaFrameReceived, connection, static_cast<uint32_t>(sequenceNumber));
+        TraceLoggingWrite(
+            g_traceLoggingProvider,
+            "MediaFrameReceived",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+            TraceLoggingKeyword(c_keywordMediaStream),
+            TraceLoggingUInt64(connection, "Connection"),
+            TraceLoggingInt64(sequenceNumber, "SequenceNumber"),
+            TraceLoggingUInt32(bytes, "Bytes"));
+    }
+}
@@ -24,7 +24,13 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <wil/resource.h>
 // local headers
 #include "ctsConfig.h"
+#include "ctsCpuAffinity.h"
+#include "ctsCpuCost.h"
+#include "ctsMetricsExporter.h"
 #include "ctsSocketBroker.h"
+#include "ctsSocketPool.h"
+#include "ctsTargetSelector.h"
+#include "ctsTrace.h"
 
 using namespace ctsTraffic;
 using namespace ctl;
@@ -97,7 +103,21 @@ int __cdecl wmain(int argc, _In_reads_z_(argc) const wchar_t** argv)
         ctsConfig::PrintSettings();
         ctsConfig::PrintLegend();
 
+        // create the per-processor threadpools before any connection is assigned to one
+        ctsCpuAffinity::Start();
+        // listen for scrapes before any IO, so IO latency is measured from the first connection
+        ctsMetricsExporter::Start();
+        // tracing must be enabled before the first socket is created
+        ctsTrace::Start();
+
+        // create sockets before starting the clock so their creation is not measured with the connections
+        if (ctsConfig::g_configSettings->Options & ctsConfig::OptionType::PreCreateSockets)
+        {
+            ctsSocketPool::FillPreCreated();
+        }
+
         // set the start timer as close as possible to the start of the engine
+        ctsCpuCost::Start();
         ctsConfig::g_configSettings->StartTimeMilliseconds = ctTimer::snap_qpc_as_msec();
         const auto broker(std::make_shared<ctsSocketBroker>());
         g_socketBroker = broker.get();
@@ -145,6 +165,7 @@ int __cdecl wmain(int argc, _In_reads_z_(argc) const wchar_t** argv)
     }
 
     const auto totalTimeRun = ctTimer::snap_qpc_as_msec() - ctsConfig::g_configSettings->StartTimeMilliseconds;
+    ctsCpuCost::Stop();
 
     // write out the final status update
     ctsConfig::PrintStatusUpdate();
@@ -168,6 +189,50 @@ int __cdecl wmain(int argc, _In_reads_z_(argc) const wchar_t** argv)
             L"  Total Bytes Sent : %lld\n",
             ctsConfig::g_configSettings->TcpStatusDetails.m_bytesRecv.GetValue(),
             ctsConfig::g_configSettings->TcpStatusDetails.m_bytesSent.GetValue());
+
+        if (ctsConfig::IsListening())
+        {
+            ctsConfig::PrintSummary(
+                L"  Accept Queue Empty : %lld\n"
+                L"  TCP Attempt Failures (system) : %lld\n",
+                ctsConfig::g_configSettings->ConnectionStatusDetails.m_acceptQueueEmptyCount.GetValue(),
+                ctsConfig::GetTcpAttemptFailCount());
+        }
+
+        if (const auto stalledConnections = ctsConfig::g_configSettings->ConnectionStatusDetails.m_stalledConnectionCount.GetValue(); stalledConnections > 0)
+        {
+            // stalls: intervals with IO outstanding but no bytes transferred
+            ctsConfig::PrintSummary(
+                L"  Stalled Connections : %lld   Stalls : %lld   Total Stall Time : %lld ms\n",
+                stalledConnections,
+                ctsConfig::g_configSettings->ConnectionStatusDetails.m_stallCount.GetValue(),
+                ctsConfig::g_configSettings->ConnectionStatusDetails.m_stallTimeMs.GetValue());
+        }
+
+        if (ctsConfig::g_configSettings->ConnectionRate)
+        {
+            const auto establishedCount = ctsConfig::g_configSettings->ConnectionStatusDetails.m_establishedCount.GetValue();
+            ctsConfig::PrintSummary(
+                L"  Total Connections Established : %lld\n"
+                L"  %ws : %.1f\n",
+                establishedCount,
+                ctsConfig::IsListening() ? L"Accepts/sec" : L"Connects/sec",
+                totalTimeRun > 0 ? static_cast<double>(establishedCount) * 1000.0 / static_cast<double>(totalTimeRun) : 0.0);
+
+            // the handshake is only timed on the side issuing the connect
+            const auto lock = ctsConfig::g_configSettings->ConnectLatencyLock.lock();
+            const auto& connectLatency = ctsConfig::g_configSettings->ConnectLatency;
+            if (connectLatency.GetCount() > 0)
+            {
+                ctsConfig::PrintSummary(
+                    L"  Connect Latency (us) : P50 %llu  P90 %llu  P99 %llu  P99.9 %llu  Max %llu\n",
+                    connectLatency.GetPercentile(50.0),
+                    connectLatency.GetPercentile(90.0),
+                    connectLatency.GetPercentile(99.0),
+                    connectLatency.GetPercentile(99.9),
+                    connectLatency.GetMax());
+            }
+        }
     }
     else
     {
@@ -200,11 +265,82 @@ int __cdecl wmain(int argc, _In_reads_z_(argc) const wchar_t** argv)
                 totalFrames > 0 ? static_cast<double>(duplicateFrames) / static_cast<double>(totalFrames) * 100.0 : 0.0,
                 errorFrames,
                 totalFrames > 0 ? static_cast<double>(errorFrames) / static_cast<double>(totalFrames) * 100.0 : 0.0);
+
+            // with receive timestamps, the jitter between frames can be split between the network and this host
+            const auto jitterSamples = ctsConfig::g_configSettings->UdpStatusDetails.m_jitterSamples.GetValue();
+            if (ctsConfig::g_configSettings->Options & ctsConfig::OptionType::RecvTimestamps && jitterSamples > 0)
+            {
+                const auto networkJitterMs = static_cast<double>(ctsConfig::g_configSettings->UdpStatusDetails.m_networkJitterMicroseconds.GetValue()) / 1000.0 / static_cast<double>(jitterSamples);
+                const auto hostJitterMs = static_cast<double>(ctsConfig::g_configSettings->UdpStatusDetails.m_hostJitterMicroseconds.GetValue()) / 1000.0 / static_cast<double>(jitterSamples);
+                const auto totalJitterMs = networkJitterMs + hostJitterMs;
+                ctsConfig::PrintSummary(
+                    L"  Average Network Jitter : %.3f ms (%f)\n"
+                    L"  Average Host Jitter : %.3f ms (%f)\n",
+                    networkJitterMs,
+                    totalJitterMs > 0.0 ? networkJitterMs / totalJitterMs * 100.0 : 0.0,
+                    hostJitterMs,
+                    totalJitterMs > 0.0 ? hostJitterMs / totalJitterMs * 100.0 : 0.0);
+            }
+
+            const auto lock = ctsConfig::g_configSettings->MediaStreamQualityLock.lock();
+            const auto& streamQuality = ctsConfig::g_configSettings->MediaStreamQuality;
+            if (streamQuality.GetArrivals() > 0)
+            {
+                const auto& delayVariation = streamQuality.GetDelayVariation();
+                ctsConfig::PrintSummary(
+                    L"  RFC 3550 Jitter : mean %.3f ms  max %.3f ms (across %llu streams)\n"
+                    L"  Delay Variation (us) : P50 %llu  P90 %llu  P99 %llu  P99.9 %llu  Max %llu\n"
+                    L"  Late Frames : %llu   Reordered Frames : %llu (max depth %llu)\n"
+                    L"  Loss Runs : %llu (longest %llu frames)  [1] %llu  [2-3] %llu  [4-7] %llu  [8-15] %llu  [16-31] %llu  [32-63] %llu  [64-127] %llu  [128+] %llu\n",
+                    streamQuality.GetMeanStreamJitterUsec() / 1000.0,
+                    streamQuality.GetMaxStreamJitterUsec() / 1000.0,
+                    streamQuality.GetJitterStreamCount(),
+                    delayVariation.GetPercentile(50.0),
+                    delayVariation.GetPercentile(90.0),
+                    delayVariation.GetPercentile(99.0),
+                    delayVariation.GetPercentile(99.9),
+                    delayVariation.GetMax(),
+                    streamQuality.GetLateFrames(),
+                    streamQuality.GetReorderedFrames(),
+                    streamQuality.GetMaxReorderDepth(),
+                    streamQuality.GetLossRunCount(),
+                    streamQuality.GetLongestLossRun(),
+                    streamQuality.GetLossRuns(0),
+                    streamQuality.GetLossRuns(1),
+                    streamQuality.GetLossRuns(2),
+                    streamQuality.GetLossRuns(3),
+                    streamQuality.GetLossRuns(4),
+                    streamQuality.GetLossRuns(5),
+                    streamQuality.GetLossRuns(6),
+                    streamQuality.GetLossRuns(7));
+            }
         }
     }
+    const auto brokerTransitions = ctsConfig::g_configSettings->ConnectionStatusDetails.m_brokerTransitionCount.GetValue();
+    const auto brokerRefreshes = ctsConfig::g_configSettings->ConnectionStatusDetails.m_brokerRefreshCount.GetValue();
+    ctsConfig::PrintSummary(
+        L"  Socket State Transitions : %lld (%.1f/sec)\n"
+        L"  Socket Pool Refreshes : %lld (%.1f/sec)\n",
+        brokerTransitions,
+        totalTimeRun > 0 ? static_cast<double>(brokerTransitions) * 1000.0 / static_cast<double>(totalTimeRun) : 0.0,
+        brokerRefreshes,
+        totalTimeRun > 0 ? static_cast<double>(brokerRefreshes) * 1000.0 / static_cast<double>(totalTimeRun) : 0.0);
+
     ctsConfig::PrintSummary(
         L"  Total Time : %lld ms.\n", totalTimeRun);
 
+    if (const auto droppedLogRecords = ctsConfig::GetDroppedLogRecordCount(); droppedLogRecords > 0)
+    {
+        ctsConfig::PrintSummary(
+            L"  Dropped Log Records : %lld (log files could not be written fast enough)\n", droppedLogRecords);
+    }
+
+    // only printed by clients with more than one target address
+    ctsTargetSelector::PrintSummary();
+    // only printed with -CpuAffinity
+    ctsCpuAffinity::PrintSummary(totalTimeRun);
+    ctsCpuCost::PrintSummary();
+
     int64_t errorCount =
         ctsConfig::g_configSettings->ConnectionStatusDetails.m_connectionErrorCount.GetValue() +
         ctsConfig::g_configSettings->ConnectionStatusDetails.m_protocolErrorCount.GetValue();
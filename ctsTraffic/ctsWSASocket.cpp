@@ -23,12 +23,14 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <ctString.hpp>
 // project headers
 #include "ctsSocket.h"
+#include "ctsSocketPool.h"
+#include "ctsSourceAllocator.h"
+#include "ctsTargetSelector.h"
 #include "ctsConfig.h"
 
 namespace ctsTraffic
 {
 static int64_t g_bindCounter = 0LL;
-static int64_t g_targetCounter = 0LL;
 static int64_t g_portCounter = 0LL;
 
 // ReSharper disable once CppInconsistentNaming
@@ -40,86 +42,159 @@ void ctsWSASocket(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
         return;
     }
 
-    USHORT nextPort = 0;
-    if (ctsConfig::g_configSettings->LocalPortHigh != 0 && ctsConfig::g_configSettings->LocalPortLow != 0)
+    uint32_t gle = 0;
+    const auto* functionName = "CreateSocket";
+
+    ctl::ctSockaddr localAddr;
+    ctl::ctSockaddr targetAddr;
+    std::shared_ptr<ctsSourceLease> sourceLease;
+    std::shared_ptr<ctsTargetLease> targetLease;
+    // a socket recycled with DisconnectEx(TF_REUSE_SOCKET) is still bound and associated with its IOCP
+    ctsSocketPool::ctsPooledSocket pooledSocket;
+    const auto reuseSockets = ctsConfig::g_configSettings->Options & ctsConfig::OptionType::ReuseSockets;
+    if (ctsSourceAllocator::IsEnabled())
     {
-        const auto portCounter = ctl::ctMemoryGuardIncrement(&g_portCounter);
-        nextPort = static_cast<uint16_t>(portCounter % (ctsConfig::g_configSettings->LocalPortHigh - ctsConfig::g_configSettings->LocalPortLow + 1)) + ctsConfig::g_configSettings->LocalPortLow;
+        //
+        // Choose the target first (-TargetPolicy), then the allocator chooses a bind address and port with a free 4-tuple to that target
+        // - ctsConfig guarantees every target address has at least one bind address of the same family
+        //
+        const auto targetIndex = ctsTargetSelector::Select(AF_UNSPEC, targetLease);
+        targetAddr = ctsConfig::g_configSettings->TargetAddresses[targetIndex];
+
+        // a recycled socket still holds the lease for the address it is bound to
+        // - so it's taken before selecting a new address: the allocator can run out while sockets are pooled
+        if (reuseSockets)
+        {
+            pooledSocket = ctsSocketPool::AcquireForTarget(targetAddr);
+        }
+        if (!pooledSocket.m_socket)
+        {
+            functionName = "ctsSourceAllocator::Select";
+            gle = ctsSourceAllocator::Select(targetIndex, localAddr, sourceLease);
+        }
     }
     else
     {
-        nextPort = ctsConfig::g_configSettings->LocalPortLow;
-    }
-
-    //
-    // Find a bind and target address by moving to the next address in the respective vectors
-    //
-    const auto bindSize = ctsConfig::g_configSettings->BindAddresses.size();
-    auto socketCounter = ctl::ctMemoryGuardIncrement(&g_bindCounter);
-    ctl::ctSockaddr localAddr(ctsConfig::g_configSettings->BindAddresses[socketCounter % bindSize]);
-    localAddr.setPort(nextPort);
+        USHORT nextPort = 0;
+        if (ctsConfig::g_configSettings->LocalPortHigh != 0 && ctsConfig::g_configSettings->LocalPortLow != 0)
+        {
+            const auto portCounter = ctl::ctMemoryGuardIncrement(&g_portCounter);
+            nextPort = static_cast<uint16_t>(portCounter % (ctsConfig::g_configSettings->LocalPortHigh - ctsConfig::g_configSettings->LocalPortLow + 1)) + ctsConfig::g_configSettings->LocalPortLow;
+        }
+        else
+        {
+            nextPort = ctsConfig::g_configSettings->LocalPortLow;
+        }
 
-    ctl::ctSockaddr targetAddr;
-    if (!ctsConfig::g_configSettings->TargetAddresses.empty())
-    {
         //
-        // the target address family must match the bind address family
-        // - ctsConfig guarantees that at least address families will match with at least one address in bind and target vectors
+        // Find a bind address by moving to the next address in the vector
+        // - the target address is then chosen by ctsTargetSelector (-TargetPolicy)
         //
-        const auto targetSize = ctsConfig::g_configSettings->TargetAddresses.size();
-        socketCounter = ctl::ctMemoryGuardIncrement(&g_targetCounter);
-        targetAddr = ctsConfig::g_configSettings->TargetAddresses[socketCounter % targetSize];
-        while (targetAddr.family() != localAddr.family())
+        const auto bindSize = ctsConfig::g_configSettings->BindAddresses.size();
+        const auto socketCounter = ctl::ctMemoryGuardIncrement(&g_bindCounter);
+        localAddr = ctsConfig::g_configSettings->BindAddresses[socketCounter % bindSize];
+        localAddr.setPort(nextPort);
+
+        if (!ctsConfig::g_configSettings->TargetAddresses.empty())
+        {
+            //
+            // the target address family must match the bind address family
+            // - ctsConfig guarantees that at least address families will match with at least one address in bind and target vectors
+            //
+            targetAddr = ctsConfig::g_configSettings->TargetAddresses[ctsTargetSelector::Select(localAddr.family(), targetLease)];
+        }
+
+        if (reuseSockets)
         {
-            socketCounter = ctl::ctMemoryGuardIncrement(&g_targetCounter);
-            targetAddr = ctsConfig::g_configSettings->TargetAddresses[socketCounter % targetSize];
+            pooledSocket = ctsSocketPool::Acquire(localAddr.family());
         }
     }
 
-    auto socket = INVALID_SOCKET;
-    uint32_t gle = 0;
-    const auto* functionName = "CreateSocket";
-    try
+    if (pooledSocket.m_socket)
     {
-        switch (ctsConfig::g_configSettings->Protocol)
+        // it remains bound to the address it was first bound to, not the address chosen above
+        // - it keeps the source lease for that address until the socket is finally closed
+        ctl::ctSockaddr boundAddr;
+        if (!boundAddr.setAddress(pooledSocket.m_socket.get()))
         {
-            case ctsConfig::ProtocolType::TCP:
-                socket = ctsConfig::CreateSocket(localAddr.family(), SOCK_STREAM, IPPROTO_TCP, ctsConfig::g_configSettings->SocketFlags);
-                break;
-
-            case ctsConfig::ProtocolType::UDP:
-                socket = ctsConfig::CreateSocket(localAddr.family(), SOCK_DGRAM, IPPROTO_UDP, ctsConfig::g_configSettings->SocketFlags);
-                break;
-
-            case ctsConfig::ProtocolType::NoProtocolSet:
-                [[fallthrough]];
-            default: // NOLINT(clang-diagnostic-covered-switch-default)
-                ctsConfig::PrintErrorInfo(
-                    L"Unknown socket protocol (%u)",
-                    static_cast<unsigned>(ctsConfig::g_configSettings->Protocol));
-                gle = WSAEINVAL;
+            boundAddr = localAddr;
         }
+        sharedSocket->SetSocket(pooledSocket.m_socket.release(), std::move(pooledSocket.m_tpIocp));
+        sharedSocket->SetSourceLease(std::move(pooledSocket.m_sourceLease));
+        sharedSocket->SetTargetLease(std::move(targetLease));
+        sharedSocket->SetLocalSockaddr(boundAddr);
+        sharedSocket->SetRemoteSockaddr(targetAddr);
+        sharedSocket->CompleteState(NO_ERROR);
+        return;
     }
-    catch (const wil::ResultException& e)
+
+    auto socket = INVALID_SOCKET;
+    auto isPreCreated = false;
+    auto isBound = false;
+    // a pre-created socket already has its pre-bind options set, and is bound unless -LocalPort was specified
+    if (NO_ERROR == gle && ctsConfig::g_configSettings->Options & ctsConfig::OptionType::PreCreateSockets)
     {
-        gle = ctsConfig::Win32FromHresult(e.GetErrorCode());
+        auto preCreatedSocket = ctsSocketPool::AcquirePreCreated(localAddr);
+        if (preCreatedSocket.m_socket)
+        {
+            socket = preCreatedSocket.m_socket.release();
+            isPreCreated = true;
+            isBound = preCreatedSocket.m_isBound;
+        }
     }
-    catch (...)
+
+    if (NO_ERROR == gle && !isPreCreated)
     {
-        gle = WSAENOBUFS;
+        try
+        {
+            switch (ctsConfig::g_configSettings->Protocol)
+            {
+                case ctsConfig::ProtocolType::TCP:
+                    socket = ctsConfig::CreateSocket(localAddr.family(), SOCK_STREAM, IPPROTO_TCP, ctsConfig::g_configSettings->SocketFlags);
+                    break;
+
+                case ctsConfig::ProtocolType::UDP:
+                    socket = ctsConfig::CreateSocket(localAddr.family(), SOCK_DGRAM, IPPROTO_UDP, ctsConfig::g_configSettings->SocketFlags);
+                    break;
+
+                case ctsConfig::ProtocolType::NoProtocolSet:
+                    [[fallthrough]];
+                default: // NOLINT(clang-diagnostic-covered-switch-default)
+                    ctsConfig::PrintErrorInfo(
+                        L"Unknown socket protocol (%u)",
+                        static_cast<unsigned>(ctsConfig::g_configSettings->Protocol));
+                    gle = WSAEINVAL;
+            }
+        }
+        catch (const wil::ResultException& e)
+        {
+            gle = ctsConfig::Win32FromHresult(e.GetErrorCode());
+        }
+        catch (...)
+        {
+            gle = WSAENOBUFS;
+        }
     }
 
-    if (NO_ERROR == gle)
+    if (NO_ERROR == gle && !isPreCreated)
     {
         functionName = "SetPreBindOptions";
         gle = ctsConfig::SetPreBindOptions(socket, localAddr);
     }
 
-    if (NO_ERROR == gle)
+    if (NO_ERROR == gle && !isBound && ctsSourceAllocator::IsEnabled())
+    {
+        // the local port can also be in use by connections to other targets
+        functionName = "ctsSourceAllocator::SetPreBindOptions";
+        gle = ctsSourceAllocator::SetPreBindOptions(socket);
+    }
+
+    if (NO_ERROR == gle && !isBound)
     {
         functionName = "bind";
 
-        if (0 == nextPort)
+        // port 0 lets the stack choose the port: only an explicitly chosen port can be in use
+        if (0 == localAddr.port())
         {
             if (SOCKET_ERROR == bind(socket, localAddr.sockaddr(), localAddr.length()))
             {
@@ -155,6 +230,8 @@ void ctsWSASocket(const std::weak_ptr<ctsSocket>& weakSocket) noexcept
 
     // store whatever values we have: for accurate logging
     sharedSocket->SetSocket(socket);
+    sharedSocket->SetSourceLease(std::move(sourceLease));
+    sharedSocket->SetTargetLease(std::move(targetLease));
     sharedSocket->SetLocalSockaddr(localAddr);
     sharedSocket->SetRemoteSockaddr(targetAddr);
 
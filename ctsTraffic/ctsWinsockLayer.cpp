@@ -19,6 +19,7 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #include <WinSock2.h>
 // ctl headers
 #include <ctSockaddr.hpp>
+#include <ctSocketExtensions.hpp>
 #include <ctThreadIocp.hpp>
 // project headers
 #include "ctsWinsockLayer.h"
@@ -95,6 +96,90 @@ wsIOResult ctsWSARecvFrom(
     return returnResult;
 }
 
+int64_t wsRecvMsgContext::GetReceiveTimestamp() const noexcept
+{
+    // the WSAMSG was updated with the length of control data actually returned
+    auto* const msg = const_cast<WSAMSG*>(&m_msg);
+    for (auto* cmsg = WSA_CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = WSA_CMSG_NXTHDR(msg, cmsg))
+    {
+        if (SOL_SOCKET == cmsg->cmsg_level && SO_TIMESTAMP == cmsg->cmsg_type)
+        {
+            UINT64 timestamp{};
+            memcpy_s(&timestamp, sizeof timestamp, WSA_CMSG_DATA(cmsg), sizeof timestamp);
+            return static_cast<int64_t>(timestamp);
+        }
+    }
+    return 0LL;
+}
+
+// ReSharper disable once CppInconsistentNaming
+wsIOResult ctsWSARecvMsg(
+    const std::shared_ptr<ctsSocket>& sharedSocket,
+    SOCKET socket,
+    const ctsTask& task,
+    wsRecvMsgContext& recvContext,
+    std::function<void(OVERLAPPED*)>&& callback) noexcept
+{
+    if (INVALID_SOCKET == socket)
+    {
+        return wsIOResult(WSAECONNABORTED);
+    }
+
+    wsIOResult returnResult;
+    try
+    {
+        const auto& ioThreadPool = sharedSocket->GetIocpThreadpool();
+        OVERLAPPED* pOverlapped = ioThreadPool->new_request(std::move(callback));
+
+        recvContext.m_dataBuffer.buf = task.m_buffer + task.m_bufferOffset;
+        recvContext.m_dataBuffer.len = task.m_bufferLength;
+        recvContext.m_msg.name = nullptr;
+        recvContext.m_msg.namelen = 0;
+        recvContext.m_msg.lpBuffers = &recvContext.m_dataBuffer;
+        recvContext.m_msg.dwBufferCount = 1;
+        recvContext.m_msg.Control.buf = recvContext.m_controlBuffer;
+        recvContext.m_msg.Control.len = sizeof recvContext.m_controlBuffer;
+        recvContext.m_msg.dwFlags = 0;
+
+        if (ctl::ctWSARecvMsg(socket, &recvContext.m_msg, nullptr, pOverlapped, nullptr) != 0)
+        {
+            returnResult.m_errorCode = WSAGetLastError();
+            // IO pended == successfully initiating the IO
+            if (returnResult.m_errorCode != WSA_IO_PENDING)
+            {
+                // must cancel the IOCP TP if the IO call fails
+                ioThreadPool->cancel_request(pOverlapped);
+            }
+            // will return WSA_IO_PENDING transparently to the caller
+        }
+        else
+        {
+            if (ctsConfig::g_configSettings->Options & ctsConfig::OptionType::HandleInlineIocp)
+            {
+                returnResult.m_errorCode = ERROR_SUCCESS;
+                // OVERLAPPED.InternalHigh == the number of bytes transferred for the I/O request.
+                // - this member is set when the request is completed inline
+                returnResult.m_bytesTransferred = static_cast<uint32_t>(pOverlapped->InternalHigh);
+                // completed inline, so the TP won't be notified
+                ioThreadPool->cancel_request(pOverlapped);
+            }
+            else
+            {
+                // WSARecvMsg returned success, but inline completions is not enabled
+                // so the IOCP callback will be invoked - thus will return WSA_IO_PENDING
+                returnResult.m_errorCode = WSA_IO_PENDING;
+            }
+        }
+    }
+    catch (...)
+    {
+        const auto error = ctsConfig::PrintThrownException();
+        return wsIOResult(error);
+    }
+
+    return returnResult;
+}
+
 // ReSharper disable once CppInconsistentNaming
 wsIOResult ctsWSASendTo(
     const std::shared_ptr<ctsSocket>& sharedSocket,
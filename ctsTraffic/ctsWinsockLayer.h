@@ -36,6 +36,21 @@ See the Apache Version 2.0 License for specific language governing permissions a
 #define SIO_TCP_INFO _WSAIORW(IOC_VENDOR,39)
 #endif
 
+// these are only defined in Windows 10 20H1 and later
+#ifndef SIO_TIMESTAMPING
+#define SIO_TIMESTAMPING _WSAIOW(IOC_VENDOR, 235)
+#define TIMESTAMPING_FLAG_RX 0x1
+#define TIMESTAMPING_FLAG_TX 0x2
+#define SO_TIMESTAMP 0x300A
+#define SO_TIMESTAMP_ID 0x300B
+
+typedef struct _TIMESTAMPING_CONFIG
+{
+    ULONG Flags;
+    USHORT TxTimestampsBuffered;
+} TIMESTAMPING_CONFIG, *PTIMESTAMPING_CONFIG;
+#endif
+
 namespace ctsTraffic
 {
 // this is only defined in the public header for Windows 10 RS2 and later
@@ -147,6 +162,27 @@ wsIOResult ctsWSARecvFrom(
     const ctsTask& task,
     std::function<void(OVERLAPPED*)>&& callback) noexcept;
 
+// the WSAMSG and control buffer must stay valid until the WSARecvMsg request completes
+// - the caller keeps this alive through the completion callback
+struct wsRecvMsgContext
+{
+    WSAMSG m_msg{};
+    WSABUF m_dataBuffer{};
+    char m_controlBuffer[WSA_CMSG_SPACE(sizeof(UINT64))]{};
+
+    // returns the SO_TIMESTAMP value from the control buffer of a completed request, or zero if none was returned
+    [[nodiscard]] int64_t GetReceiveTimestamp() const noexcept;
+};
+
+// WSARecvMsg requesting the network stack receive timestamp (requires SIO_TIMESTAMPING on the socket)
+// - the timestamp is read from recvContext after the request completes, inline or through the callback
+wsIOResult ctsWSARecvMsg(
+    const std::shared_ptr<ctsSocket>& sharedSocket,
+    SOCKET socket,
+    const ctsTask& task,
+    wsRecvMsgContext& recvContext,
+    std::function<void(OVERLAPPED*)>&& callback) noexcept;
+
 wsIOResult ctsWSASendTo(
     const std::shared_ptr<ctsSocket>& sharedSocket,
     SOCKET socket,